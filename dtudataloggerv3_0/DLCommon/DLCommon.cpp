@@ -221,12 +221,22 @@ int get_bandgap(void)
                 // Wait for it to complete
                 while( ( (ADCSRA & (1<<ADSC)) != 0 ) );
                 // Scale the value
-		_bandgap = (((InternalReferenceVoltage * 1023L) / ADC) + 5L) / 10L;
+		_bandgap = bandgap_scale(ADC, 1);
         }
 
       return _bandgap;
 }
 
+// Scale the sum of n bandgap conversions, the mean is kept in tenths
+// so averaged readings do not lose resolution
+int bandgap_scale(uint32_t sum, uint16_t n) {
+	uint32_t mean10;
+	if (n == 0 || sum == 0)
+		return 0;
+	mean10 = (sum * 10L + n / 2) / n;
+	return (((InternalReferenceVoltage * 10230L) / mean10) + 5L) / 10L;
+}
+
 void reboot_now() {
         wdt_enable(WDTO_15MS); 
 	while (1);
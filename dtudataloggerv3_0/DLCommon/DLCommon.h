@@ -46,12 +46,14 @@ uint8_t get_checksum(char *string);
 int memory_test();
 void fmtDouble(double val, byte precision, char *buf, unsigned bufLen = 0xffff);
 unsigned fmtUnsigned(unsigned long val, char *buf, unsigned bufLen = 0xffff, byte width = 0);
+unsigned long crc_update(unsigned long crc, byte data);
 unsigned long crc_string(char *s);
 unsigned long crc_struct(char *s, int len);
 void set_supply_voltage(long v);
 long get_supply_voltage();
 void set_bandgap(long iref, int offset);
 int get_bandgap();
+int bandgap_scale(uint32_t sum, uint16_t n);
 void reboot_now();
 void digital_clock_display();
 void print_digits(int d);
@@ -1,6 +1,10 @@
 #include <Arduino.h>
 #include "DLConfig.h"
 
+#if NUM_IO != CFG_IMAGE_PORTS
+#error CONFIG.BIN has a port count of its own
+#endif
+
 #define DEVICE_ID_ADDR 0
 #define FILES_COUNT_0 2
 #define FILES_COUNT_1 4
@@ -19,22 +23,12 @@
 
 Config _int_config;
 
-char* fforward(char *ptr) {
-        int i;
-        char *cptr = ptr;
-        for(i = 0; i < strlen(ptr); i++) {
-                if (ptr[i] == ' ')
-                        cptr++;
-                else
-                        return cptr;
-        }
-        return NULL;
-}
-
 DLConfig::DLConfig()
 {
 	_config = NULL;
 	_sd = NULL;
+	_delta_state = DELTA_NONE;
+	_version = 0;
 }
 
 void DLConfig::init(DLSD *sd, DLMeasure *measure, char *buff, int len) {
@@ -49,108 +43,138 @@ void DLConfig::init(DLSD *sd, DLMeasure *measure, char *buff, int len) {
 	_config->eeprom_events = &_epc.eeprom_events;
 }
 
+// Applies one KEY = value line
 int DLConfig::config_process_callback(char *line, int len) {
-        char *param, *ptr;
-	uint16_t tmpvar;
-        //. Here we extract the name and value combination by finding the equal sign
-        ptr = strstr(line, "=");
-        param = ptr + 1;
-        *ptr = 0;
-
-        //Serial.println(line);
-        if (strncmp_P(line, PSTR("PORT"), 4) == 0) {
-                ptr = line+10;
-                if (strncmp_P(line, PSTR("PORT_MOD"), 8) == 0) {
-			tmpvar = atoi(ptr);
-			Serial.print("Port ");
-			Serial.print(tmpvar);
-			Serial.print(": ");
-			Serial.println(param);
-			if (param[1] == 'A') { // Analog
-				_epc.AOD[tmpvar] = IO_ANALOG;
-				_measure->set_pin(tmpvar, IO_ANALOG); 
-			} else if (param[1] == 'C') { // Counter
-				_epc.AOD[tmpvar] = IO_COUNTER;
-				_measure->set_pin(tmpvar, IO_COUNTER);
-			} else if (param[1] == 'D') { // Digital
-				_epc.AOD[tmpvar] = IO_DIGITAL;
-				_measure->set_pin(tmpvar, IO_DIGITAL);
-			} else if (param[1] == 'E') { // Event
-				_epc.AOD[tmpvar] = IO_EVENT;
-				_measure->set_pin(tmpvar, IO_EVENT);
-			}
-                }
-        } else if (strncmp_P(line, PSTR("ID"), 2) == 0) {
-		tmpvar = atoi(param);
-		_config->id = tmpvar;
-		get_from_flash_P(PSTR("Device ID: "), _buff);
-		Serial.print(_buff);
-		Serial.println(tmpvar);
-		_epc.id = tmpvar;
-	} else if (strncmp_P(line, PSTR("ME"), 2) == 0) { // Measurement params
-		if (line[8] == 'T') {  // MEASURE_TIME
-			_config->measure_time = atoi(param);					
-			get_from_flash_P(PSTR("Measuring Time: "), _buff);
-			Serial.print(_buff);
-			Serial.println(_config->measure_time, DEC);
-			_measure->set_measure_time(_config->measure_time);
-			_epc.measure_time = _config->measure_time;
-		}	
-	} else if (strncmp_P(line, PSTR("SA"), 2) == 0) { // Sampling rate
-		_config->sampling_rate = atoi(param);
-		get_from_flash_P(PSTR("Sampling Rate: "), _buff);
-		Serial.print(_buff);
-		Serial.println(_config->sampling_rate, DEC);
-		_epc.sampling_rate = _config->sampling_rate;
-	} else if (strncmp_P(line, PSTR("HT"), 2) == 0) { // HTTP params
-		if (line[5] == 'U' && line[6] == 'R') { // HTTP_URL
-			param = fforward(param);
-			if (param != NULL) {
-				get_from_flash_P(PSTR("HTTP URL: "), _buff);
-				Serial.print(_buff);
-				Serial.println(param);
-				*(_epc.HTTP_URL) = '\0'; 
-				strcat(_epc.HTTP_URL, param);
+	DLConfigImage img;
+	_parser.begin();
+	for(int i = 0; i < len && line[i]; i++)
+		config_line(&img, _parser.feed(line[i]));
+	config_line(&img, _parser.finish());
+	config_apply(img.get());
+	return 0;
+}
+
+void DLConfig::config_line(DLConfigImage *img, uint8_t key) {
+	if (key == CFG_KEY_NONE)
+		return;
+	if (key == CFG_KEY_BAD || !img->set(key, _parser.index(), _parser.value())) {
+		Serial.print("Config line ");
+		Serial.print(_parser.line(), DEC);
+		Serial.println("?");
+	}
+}
+
+// Sets what img has. The labels go through msg, _buff may hold the file.
+void DLConfig::config_apply(ConfigImage_t *img) {
+	char msg[20];
+	uint8_t i, mode;
+	for(i = 0; i < NUM_IO; i++) {
+		if (img->mode_set & (1 << i)) {
+			if (img->mode[i] == 'A') // Analog
+				mode = IO_ANALOG;
+			else if (img->mode[i] == 'C') // Counter
+				mode = IO_COUNTER;
+			else if (img->mode[i] == 'D') // Digital
+				mode = IO_DIGITAL;
+			else if (img->mode[i] == 'E') // Event
+				mode = IO_EVENT;
+			else if (img->mode[i] == 'F') // Frequency
+				mode = IO_FREQUENCY;
+			else
+				mode = IO_OFF;
+			if (mode != IO_OFF) {
+				Serial.print("Port ");
+				Serial.print(i);
+				Serial.print(": ");
+				Serial.println(img->mode[i]);
 			}
-		} else if (line[5] == 'S') { // HTTP_STATUS_TIME
-			_config->http_status_time = atol(param)*60;
-			get_from_flash_P(PSTR("HST: "), _buff);
-			Serial.print(_buff);
-			Serial.println(_config->http_status_time, DEC);
-		} else if (line[5] == 'U' && line[6] == 'P') { // HTTP_UPLOAD_TIME
-			_config->http_upload_time = atol(param)*60;
-			get_from_flash_P(PSTR("HUT: "), _buff);
-			Serial.print(_buff);
-			Serial.println(_config->http_upload_time, DEC);
+			_epc.AOD[i] = mode;
+			_measure->set_pin(i, mode);
 		}
-	} else if (strncmp_P(line, PSTR("GP"), 2) == 0) { // GPRS params
-		if (line[5] == 'A') { // GPRS_APN
-			param = fforward(param);
-			if (param != NULL) {
-				*(_epc.APN) = '\0';
-				strcat(_epc.APN, param);
-			}
-		} else if (line[5] == 'U') { // GPRS_USER
-		} else if (line[5] == 'P') { // GPRS_PASS
+		if (img->rate_set & (1 << i)) { // PORT_RATE_n in ms
+			_epc.port_rate[i] = img->port_rate[i];
+			_measure->set_port_rate(i, _epc.port_rate[i]);
+		}
+		if (img->window_set & (1 << i)) { // PORT_WINDOW_n in seconds
+			_epc.port_window[i] = img->port_window[i];
+			_measure->set_port_window(i, _epc.port_window[i]);
 		}
 	}
-        return 0;
+	if (CFG_HAS(img, CFG_ID)) {
+		_config->id = img->id;
+		get_from_flash_P(PSTR("Device ID: "), msg);
+		Serial.print(msg);
+		Serial.println(_config->id);
+		_epc.id = _config->id;
+	}
+	if (CFG_HAS(img, CFG_MEASURE_TIME)) {
+		_config->measure_time = img->measure_time;
+		get_from_flash_P(PSTR("Measuring Time: "), msg);
+		Serial.print(msg);
+		Serial.println(_config->measure_time, DEC);
+		_measure->set_measure_time(_config->measure_time);
+		_epc.measure_time = _config->measure_time;
+	}
+	if (CFG_HAS(img, CFG_SAMPLING_RATE)) {
+		_config->sampling_rate = img->sampling_rate;
+		get_from_flash_P(PSTR("Sampling Rate: "), msg);
+		Serial.print(msg);
+		Serial.println(_config->sampling_rate, DEC);
+		_epc.sampling_rate = _config->sampling_rate;
+	}
+	if (CFG_HAS(img, CFG_HTTP_URL)) {
+		get_from_flash_P(PSTR("HTTP URL: "), msg);
+		Serial.print(msg);
+		Serial.println(img->HTTP_URL);
+		strcpy(_epc.HTTP_URL, img->HTTP_URL);
+	}
+	if (CFG_HAS(img, CFG_HTTP_STATUS_TIME)) {
+		_config->http_status_time = img->http_status_time;
+		get_from_flash_P(PSTR("HST: "), msg);
+		Serial.print(msg);
+		Serial.println(_config->http_status_time, DEC);
+	}
+	if (CFG_HAS(img, CFG_HTTP_UPLOAD_TIME)) {
+		_config->http_upload_time = img->http_upload_time;
+		get_from_flash_P(PSTR("HUT: "), msg);
+		Serial.print(msg);
+		Serial.println(_config->http_upload_time, DEC);
+	}
+	if (CFG_HAS(img, CFG_LOG_LATENCY)) {
+		_config->log_latency = img->log_latency;
+		get_from_flash_P(PSTR("Log latency: "), msg);
+		Serial.print(msg);
+		Serial.println(_config->log_latency, DEC);
+	}
+	if (CFG_HAS(img, CFG_LOG_FORMAT)) {
+		_config->log_format = img->log_format ? LOG_BINARY : LOG_TEXT;
+		get_from_flash_P(PSTR("Log format: "), msg);
+		Serial.print(msg);
+		Serial.println(_config->log_format, DEC);
+	}
+	if (CFG_HAS(img, CFG_GPRS_APN))
+		strcpy(_epc.APN, img->APN);
 }
 
 uint8_t DLConfig::load() {
-	int32_t filesize = 0;
 	int i;
+	DLConfigImage img;
 	// Load configuration from the EEPROM
-	load_config_EEPROM(&_epc);
-	print_config_EEPROM(&_epc);
+	if (!load_config_EEPROM(&_epc)) { // Fresh or older firmware
+		memset(_epc.port_rate, 0, sizeof(_epc.port_rate));
+		memset(_epc.port_window, 0, sizeof(_epc.port_window));
+	}
+	load_counters();
 
 	// Set ports up from EEPROM first
 	for(i=0;i<NUM_IO;i++) {
-		Serial.print("Port ");
-		Serial.print(i, DEC);
-		Serial.print(": ");
-		Serial.println(_epc.AOD[i], DEC);
+		if (_epc.port_rate[i] == _UINT16_MAX_) // Fresh EEPROM
+			_epc.port_rate[i] = 0;
+		if (_epc.port_window[i] == _UINT16_MAX_)
+			_epc.port_window[i] = 0;
 		_measure->set_pin(i, _epc.AOD[i]);
+		_measure->set_port_rate(i, _epc.port_rate[i]);
+		_measure->set_port_window(i, _epc.port_window[i]);
 	}
 
 	load_files_count(0);
@@ -160,39 +184,18 @@ uint8_t DLConfig::load() {
 		_sd->init();
 	}
 
-	// Load config file from the sd card
+	// Load config from the sd card, CONFIG.BIN when it is good
 	if (_sd->is_available() > 0) {
 	        _sd->seek_forward_files_count();
 
-		filesize = _sd->open(CONFIG, O_READ);
-		if (filesize == -1 || filesize == 0) { // An Ooops event... Our config file is fucked for some reason
-			_sd->close(CONFIG);
-			Serial.println("No config!");
-			if (_sd->exists("CONFIG.BAK")) {
-				Serial.println("Using the backup file");		
-				if (_sd->copy("CONFIG.BAK", "CONFIG.DAT")) {
-					Serial.println("Restored config");
-				} else {
-					Serial.println("Failed to restore config");
-				}
-			} else {
-				Serial.println("No backup either.");
-				return 0;
-			}
+		i = _sd->read_file(CFG_IMAGE_NAME, _buff, _buff_size + 1);
+		if (i > 0 && img.load((uint8_t *)_buff, i)) {
+			Serial.println(CFG_IMAGE_NAME);
+		} else if (!load_text(&img)) {
+			return 0;
 		}
-		_sd->rewind(CONFIG);
-		for(i=0;i<NUM_IO;i++) {
-			_measure->set_pin(i, IO_OFF);
-			_epc.AOD[i] = IO_OFF;
-		}
-		int rv = 0;
-		do {
-			rv = _sd->read(CONFIG, _buff, _buff_size, '\n');
-			if (_buff[0] != '#' && _buff[0] != 0 && _buff[0] != '\n') {
-				config_process_callback(_buff, _buff_size);
-			}
-		} while (rv >= 0);
-		_sd->close(CONFIG);
+		config_apply(img.get());
+		load_delta(&img);
 
 		// Reset counters if 0xff = freshly programmed eeprom
 		if (_epc.wdt_events == _UINT16_MAX_)
@@ -206,23 +209,136 @@ uint8_t DLConfig::load() {
 				_epc.saved_count[i] = 0;
 		}
 
-		//sync_config_EEPROM(&_epc);
-		save_config_EEPROM(&_epc);
+		sync_config_EEPROM(&_epc);
 		return 1;
 	} 
+	print_config_EEPROM(&_epc);
+	return 0;
+}
+
+// CONFIG.DAT, or CONFIG.BAK restored, into img with every port off
+// that it does not set
+uint8_t DLConfig::load_text(DLConfigImage *img) {
+	int32_t filesize = 0;
+	int i, rv = 0;
+	print_config_EEPROM(&_epc);
+	filesize = _sd->open(CONFIG, O_READ);
+	if (filesize == -1 || filesize == 0) { // An Ooops event... Our config file is fucked for some reason
+		_sd->close(CONFIG);
+		Serial.println("No config!");
+		if (_sd->exists("CONFIG.BAK")) {
+			Serial.println("Using the backup file");		
+			if (_sd->copy("CONFIG.BAK", "CONFIG.DAT")) {
+				Serial.println("Restored config");
+			} else {
+				Serial.println("Failed to restore config");
+			}
+		} else {
+			Serial.println("No backup either.");
+			return 0;
+		}
+	}
+	_sd->rewind(CONFIG);
+	img->begin((1 << NUM_IO) - 1);
+	// Whole blocks of the file through the tokenizer
+	_parser.begin();
+	do {
+		rv = _sd->read(CONFIG, _buff, _buff_size + 1);
+		for(i = 0; i < rv; i++)
+			config_line(img, _parser.feed(_buff[i]));
+	} while (rv > 0);
+	config_line(img, _parser.finish());
+	_sd->close(CONFIG);
+	return 1;
+}
+
+// CONFIG.OTA over the card config, its version counts while it is good
+void DLConfig::load_delta(DLConfigImage *img) {
+	int n;
+	_version = 0;
+	n = _sd->read_file(CFG_DELTA_NAME, _buff, _buff_size + 1);
+	if (n <= 0 || !img->load((uint8_t *)_buff, n))
+		return;
+	Serial.println(CFG_DELTA_NAME);
+	config_apply(img->get());
+	if (_ctr.known(CTR_CFG_VERSION))
+		_version = _ctr.get(CTR_CFG_VERSION);
+}
+
+// Collects the lines of a config.php reply for version
+void DLConfig::delta_begin(uint16_t version) {
+	_delta.begin(0);
+	_delta_version = version;
+	_delta_state = DELTA_OPEN;
+}
+
+// A CF KEY=value or CE version line, as the GSM callback passes it
+int DLConfig::delta_line(char *line, int len) {
+	uint8_t key = CFG_KEY_NONE;
+	int i;
+	if (_delta_state != DELTA_OPEN || len < 3 || line[0] != 'C' || line[2] != ' ')
+		return 0;
+	if (line[1] != 'F' && line[1] != 'E') // Not one of them
+		return 0;
+	if (line[1] == 'E') {
+		_delta_state = (uint16_t)atol(line + 3) == _delta_version ? DELTA_READY : DELTA_BAD;
+		return 0;
+	}
+	_parser.begin();
+	for(i = 3; i < len && line[i] && key == CFG_KEY_NONE; i++)
+		key = _parser.feed(line[i]);
+	if (key == CFG_KEY_NONE)
+		key = _parser.finish();
+	if (key == CFG_KEY_BAD || (key != CFG_KEY_NONE && !_delta.set(key, _parser.index(), _parser.value())))
+		_delta_state = DELTA_BAD;
 	return 0;
 }
 
+bool DLConfig::delta_ready() {
+	return _delta_state == DELTA_READY;
+}
+
+/* The fetched delta onto the running config, then into CONFIG.OTA and
+   its version into the ring. Uses _buff, call it where that is free.
+   A delta that does not reach the card is fetched again. */
+uint8_t DLConfig::delta_apply() {
+	DLConfigImage saved;
+	int n;
+	if (_delta_state != DELTA_READY)
+		return 0;
+	_delta_state = DELTA_NONE;
+	config_apply(_delta.get());
+	n = _sd->read_file(CFG_DELTA_NAME, _buff, _buff_size + 1);
+	if (n <= 0 || !saved.load((uint8_t *)_buff, n))
+		saved.begin(0);
+	saved.merge(_delta.get());
+	saved.seal();
+	if (_sd->write_file(CFG_DELTA_NAME, (char *)saved.get(), sizeof(ConfigImage_t))) {
+		_version = _delta_version;
+		_ctr.set(CTR_CFG_VERSION, _version);
+	} else {
+		Serial.println("No " CFG_DELTA_NAME);
+	}
+	sync_config_EEPROM(&_epc);
+	return 1;
+}
+
+uint16_t DLConfig::get_config_version() {
+	return _version;
+}
+
 uint8_t DLConfig::load_config_EEPROM(EEPROM_config_t *epc) {
 	unsigned long checksum = 0L;
 	load_EEPROM(0, (char *)epc, sizeof(EEPROM_config_t));
 	checksum = crc_struct((char *)epc, sizeof(EEPROM_config_t)-sizeof(unsigned long));
 
 	if (checksum == epc->checksum) {
+		return 1;
 	} else {
 		Serial.println("Checksum failed!");
 		epc->eeprom_events++;
 	}
+	return 0;
 }
 
 uint8_t DLConfig::save_config_EEPROM(EEPROM_config_t *epc) {
@@ -363,11 +479,26 @@ uint8_t DLConfig::save_files_count(uint8_t saved) {
 			v = _sd->get_saved_count(i);
 			_epc.saved_count[i] = v;
 		}
+		_ctr.set((saved ? CTR_SAVED : CTR_FILES) + i, v);
 		Serial.print(saved, DEC);
 		Serial.print(" SFC: ");
 		Serial.println(v);
 	}
-	sync_config_EEPROM(&_epc);
+}
+
+// Newer counters from the ring over those of the struct
+void DLConfig::load_counters() {
+	uint8_t i;
+	Serial.print("Counters: ");
+	Serial.println(_ctr.begin(CTR_RING_START, CTR_RING_SIZE, CTR_NUM), DEC);
+	for(i = 0; i < NUM_FILES; i++) {
+		if (_ctr.known(CTR_FILES + i))
+			_epc.files_count[i] = _ctr.get(CTR_FILES + i);
+		if (_ctr.known(CTR_SAVED + i))
+			_epc.saved_count[i] = _ctr.get(CTR_SAVED + i);
+	}
+	if (_ctr.known(CTR_WDT))
+		_epc.wdt_events = _ctr.get(CTR_WDT);
 }
 
 Config* DLConfig::get_config() {
@@ -386,5 +517,5 @@ uint8_t DLConfig::load_URL(char *dst, int len) {
 
 void DLConfig::wdt_event() {
 	_epc.wdt_events++;
-	sync_config_EEPROM(&_epc);
+	_ctr.set(CTR_WDT, _epc.wdt_events);
 }
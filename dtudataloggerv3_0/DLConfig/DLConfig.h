@@ -10,6 +10,35 @@
 #include <DLCommon.h>
 #include <DLSD.h>
 #include <DLMeasure.h>
+#include "DLCounters.h"
+#include "DLConfigImage.h"
+
+/* Counters in the EEPROM ring past the config struct, which keeps a
+   copy of them written at load() */
+#define CTR_RING_START 1024
+#define CTR_RING_SIZE 3072
+#define CTR_FILES 0 // + file
+#define CTR_SAVED NUM_FILES // + file
+#define CTR_WDT (2 * NUM_FILES)
+#define CTR_CFG_VERSION (2 * NUM_FILES + 1)
+#define CTR_NUM (2 * NUM_FILES + 2)
+
+/* Config deltas from the server: a status reply with CV <version> other
+   than the one applied has the logger fetch config.php, which answers
+   with CF KEY=value lines and CE <version>. The lines go into a pending
+   image, applied whole between measurement windows by delta_apply() once
+   CE matches and none was refused. The deltas merged are kept in
+   CONFIG.OTA on the card over CONFIG.BIN/CONFIG.DAT, remove it to go back
+   to the card config alone. */
+#define CFG_DELTA_NAME "CONFIG.OTA"
+#define DELTA_NONE 0
+#define DELTA_OPEN 1
+#define DELTA_READY 2
+#define DELTA_BAD 3
+
+/* LOG_FORMAT */
+#define LOG_TEXT 0
+#define LOG_BINARY 1
 
 typedef struct {
 	uint16_t id;
@@ -24,6 +53,9 @@ typedef struct {
 	uint8_t AOD[NUM_IO];
 	char APN[20];
 	char HTTP_URL[50];
+	// After the fields of older firmware, whose image fails the checksum
+	uint16_t port_rate[NUM_IO];
+	uint16_t port_window[NUM_IO];
 	unsigned long checksum;
 } EEPROM_config_t;
 
@@ -35,6 +67,8 @@ typedef struct {
 	uint32_t sampling_rate;
 	uint32_t num_samples;
 	uint16_t sampling_delay;
+	uint8_t log_format;
+	uint16_t log_latency; // s a log line may wait in the SD buffer, 0 syncs every line
 	char *APN;
 	char *HTTP_URL;
 	uint16_t *wdt_events;
@@ -47,7 +81,16 @@ class DLConfig
 		DLConfig();
 		void init(DLSD *sd, DLMeasure *measure, char *buff, int len);
 		int config_process_callback(char *line, int len);
+		void config_line(DLConfigImage *img, uint8_t key);
+		void config_apply(ConfigImage_t *img);
 		uint8_t load();
+		uint8_t load_text(DLConfigImage *img);
+		void load_delta(DLConfigImage *img);
+		void delta_begin(uint16_t version);
+		int delta_line(char *line, int len);
+		bool delta_ready();
+		uint8_t delta_apply();
+		uint16_t get_config_version();
 		uint8_t load_config_EEPROM(EEPROM_config_t *epc); 
 		uint8_t save_config_EEPROM(EEPROM_config_t *epc);
 		uint8_t sync_config_EEPROM(EEPROM_config_t *epc);
@@ -58,6 +101,7 @@ class DLConfig
 		uint8_t sync_EEPROM(uint16_t addr, char *data, int len);		
 		uint8_t save_files_count(uint8_t saved);
 		uint8_t load_files_count(uint8_t saved);
+		void load_counters();
 		uint8_t load_APN(char *dst, int len);
 		uint8_t load_URL(char *dst, int len);
 		Config* get_config();
@@ -66,6 +110,12 @@ class DLConfig
 		uint32_t get_eeprom_events();
 	private:
 		EEPROM_config_t _epc;
+		DLCounters _ctr;
+		DLConfigParser _parser;
+		DLConfigImage _delta; // Fetched, not applied yet
+		uint8_t _delta_state;
+		uint16_t _delta_version;
+		uint16_t _version; // Of the deltas in CONFIG.OTA, 0 none
 		Config *_config;
 		DLSD *_sd;
 		DLMeasure *_measure;
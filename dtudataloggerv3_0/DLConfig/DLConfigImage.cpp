@@ -0,0 +1,138 @@
+#include "DLConfigImage.h"
+
+// DLCommon's CRC32, host builds bring their own
+unsigned long crc_update(unsigned long crc, uint8_t data);
+
+DLConfigImage::DLConfigImage()
+{
+	begin(0);
+}
+
+// Empty image, the ports of the mask off unless set
+void DLConfigImage::begin(uint16_t ports) {
+	memset(&_img, 0, sizeof(_img));
+	_img.mode_set = ports;
+	_img.rate_set = ports;
+	_img.window_set = ports;
+}
+
+// Value of a line of the key, false when it is refused
+bool DLConfigImage::set(uint8_t key, uint8_t n, const char *val) {
+	switch (key) {
+	case CFG_PORT_MODE:
+		if (n >= CFG_IMAGE_PORTS)
+			return false;
+		_img.mode[n] = val[0];
+		_img.mode_set |= 1 << n;
+		break;
+	case CFG_PORT_RATE: // ms
+		if (n >= CFG_IMAGE_PORTS)
+			return false;
+		_img.port_rate[n] = atol(val);
+		_img.rate_set |= 1 << n;
+		break;
+	case CFG_PORT_WINDOW: // s
+		if (n >= CFG_IMAGE_PORTS)
+			return false;
+		_img.port_window[n] = atol(val);
+		_img.window_set |= 1 << n;
+		break;
+	case CFG_ID:
+		_img.id = atol(val);
+		break;
+	case CFG_MEASURE_TIME:
+		_img.measure_time = atol(val);
+		break;
+	case CFG_SAMPLING_RATE:
+		_img.sampling_rate = atol(val);
+		break;
+	case CFG_HTTP_URL:
+		if (!val[0] || strlen(val) >= sizeof(_img.HTTP_URL))
+			return false;
+		strncpy(_img.HTTP_URL, val, sizeof(_img.HTTP_URL));
+		break;
+	case CFG_HTTP_STATUS_TIME: // min in the file
+		_img.http_status_time = atol(val) * 60;
+		break;
+	case CFG_HTTP_UPLOAD_TIME:
+		_img.http_upload_time = atol(val) * 60;
+		break;
+	case CFG_LOG_LATENCY:
+		_img.log_latency = atol(val);
+		break;
+	case CFG_LOG_FORMAT: // LOG_BINARY or LOG_TEXT
+		if (!val[0])
+			return false;
+		_img.log_format = val[0] == 'B';
+		break;
+	case CFG_GPRS_APN:
+		if (!val[0] || strlen(val) >= sizeof(_img.APN))
+			return false;
+		strncpy(_img.APN, val, sizeof(_img.APN));
+		break;
+	}
+	_img.keys |= 1UL << key;
+	return true;
+}
+
+// What d sets over what this image has
+void DLConfigImage::merge(const ConfigImage_t *d) {
+	for(uint8_t i = 0; i < CFG_IMAGE_PORTS; i++) {
+		if ((d->mode_set >> i) & 1)
+			_img.mode[i] = d->mode[i];
+		if ((d->rate_set >> i) & 1)
+			_img.port_rate[i] = d->port_rate[i];
+		if ((d->window_set >> i) & 1)
+			_img.port_window[i] = d->port_window[i];
+	}
+	_img.mode_set |= d->mode_set;
+	_img.rate_set |= d->rate_set;
+	_img.window_set |= d->window_set;
+	if (CFG_HAS(d, CFG_ID))
+		_img.id = d->id;
+	if (CFG_HAS(d, CFG_MEASURE_TIME))
+		_img.measure_time = d->measure_time;
+	if (CFG_HAS(d, CFG_SAMPLING_RATE))
+		_img.sampling_rate = d->sampling_rate;
+	if (CFG_HAS(d, CFG_HTTP_URL))
+		strncpy(_img.HTTP_URL, d->HTTP_URL, sizeof(_img.HTTP_URL));
+	if (CFG_HAS(d, CFG_HTTP_STATUS_TIME))
+		_img.http_status_time = d->http_status_time;
+	if (CFG_HAS(d, CFG_HTTP_UPLOAD_TIME))
+		_img.http_upload_time = d->http_upload_time;
+	if (CFG_HAS(d, CFG_LOG_LATENCY))
+		_img.log_latency = d->log_latency;
+	if (CFG_HAS(d, CFG_LOG_FORMAT))
+		_img.log_format = d->log_format;
+	if (CFG_HAS(d, CFG_GPRS_APN))
+		strncpy(_img.APN, d->APN, sizeof(_img.APN));
+	_img.keys |= d->keys;
+}
+
+uint32_t DLConfigImage::crc() {
+	const uint8_t *p = (const uint8_t *)&_img;
+	uint32_t crc = 0xFFFFFFFFUL;
+	for(uint16_t i = 0; i < sizeof(_img) - sizeof(_img.crc); i++)
+		crc = crc_update(crc, p[i]);
+	return ~crc;
+}
+
+void DLConfigImage::seal() {
+	_img.magic = CFG_IMAGE_MAGIC;
+	_img.version = CFG_IMAGE_VERSION;
+	_img.size = sizeof(_img);
+	_img.crc = crc();
+}
+
+// An image from len bytes read, false unless it is whole and of this version
+bool DLConfigImage::load(const uint8_t *buf, uint16_t len) {
+	if (len < sizeof(_img))
+		return false;
+	memcpy(&_img, buf, sizeof(_img));
+	return _img.magic == CFG_IMAGE_MAGIC && _img.version == CFG_IMAGE_VERSION && _img.size == sizeof(_img) &&
+	       _img.crc == crc();
+}
+
+ConfigImage_t *DLConfigImage::get() {
+	return &_img;
+}
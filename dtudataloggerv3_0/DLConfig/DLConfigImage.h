@@ -0,0 +1,64 @@
+#ifndef DLConfigImage_h
+#define DLConfigImage_h
+
+#include <stdint.h>
+#include "DLConfigParser.h"
+
+/* What CONFIG.DAT sets as one record of a fixed layout, little endian
+   and without padding on the AVR and the host alike. Tools/DLConfigc
+   compiles the text into CONFIG.BIN, load() reads that with one block
+   read and only parses CONFIG.DAT when there is no CONFIG.BIN of this
+   version and size with a good CRC. keys has bit 1 << CFG_ key for
+   every key set, the _set masks a bit per port. Ports keep the letter
+   of their PORT_MODE value. A change of the layout needs a new
+   CFG_IMAGE_VERSION. */
+#define CFG_IMAGE_NAME "CONFIG.BIN"
+#define CFG_IMAGE_MAGIC 0x46434C44UL // "DLCF"
+#define CFG_IMAGE_VERSION 1
+#define CFG_IMAGE_SIZE 184
+#define CFG_IMAGE_PORTS 14
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size;
+	uint32_t keys;
+	uint32_t http_status_time; // s
+	uint32_t http_upload_time; // s
+	uint32_t measure_time;
+	uint32_t sampling_rate;
+	uint16_t id;
+	uint16_t log_latency;
+	uint16_t port_rate[CFG_IMAGE_PORTS];
+	uint16_t port_window[CFG_IMAGE_PORTS];
+	uint16_t mode_set;
+	uint16_t rate_set;
+	uint16_t window_set;
+	char mode[CFG_IMAGE_PORTS]; // A, C, D, E, F, others and 0 off
+	uint8_t log_format;
+	uint8_t reserved;
+	char APN[20];
+	char HTTP_URL[50];
+	uint32_t crc; // Of all bytes before it
+} ConfigImage_t;
+
+typedef char cfg_image_size_check[sizeof(ConfigImage_t) == CFG_IMAGE_SIZE ? 1 : -1];
+
+#define CFG_HAS(img, key) (((img)->keys >> (key)) & 1)
+
+class DLConfigImage
+{
+	public:
+		DLConfigImage();
+		void begin(uint16_t ports);
+		bool set(uint8_t key, uint8_t n, const char *val);
+		void merge(const ConfigImage_t *d);
+		void seal();
+		bool load(const uint8_t *buf, uint16_t len);
+		ConfigImage_t *get();
+	private:
+		ConfigImage_t _img;
+		uint32_t crc();
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include "DLConfigParser.h"
+
+#define CFG_S_START 0 // Blanks before the key
+#define CFG_S_KEY 1
+#define CFG_S_EQ 2 // Blanks after the key
+#define CFG_S_VAL 3
+#define CFG_S_SKIP 4 // Comment or bad line, to its end
+
+// Sorted by name for the binary search
+static const CfgKeyword_t cfg_keywords[] PROGMEM = {
+	{ "GPRS_APN", CFG_GPRS_APN },
+	{ "GPRS_PASS", CFG_GPRS_PASS },
+	{ "GPRS_USER", CFG_GPRS_USER },
+	{ "HTTP_STATUS_TIME", CFG_HTTP_STATUS_TIME },
+	{ "HTTP_STATUS_URL", CFG_HTTP_STATUS_URL },
+	{ "HTTP_UPLOAD_TIME", CFG_HTTP_UPLOAD_TIME },
+	{ "HTTP_UPLOAD_URL", CFG_HTTP_UPLOAD_URL },
+	{ "HTTP_URL", CFG_HTTP_URL },
+	{ "ID", CFG_ID },
+	{ "LOG_FORMAT", CFG_LOG_FORMAT },
+	{ "LOG_LATENCY", CFG_LOG_LATENCY },
+	{ "MEASURE_TIME", CFG_MEASURE_TIME },
+	{ "PORT_FUNCT", CFG_PORT_FUNCT | CFG_INDEXED },
+	{ "PORT_MODE", CFG_PORT_MODE | CFG_INDEXED },
+	{ "PORT_NAME", CFG_PORT_NAME | CFG_INDEXED },
+	{ "PORT_RATE", CFG_PORT_RATE | CFG_INDEXED },
+	{ "PORT_WINDOW", CFG_PORT_WINDOW | CFG_INDEXED },
+	{ "SAMPLING_RATE", CFG_SAMPLING_RATE },
+	{ "SECRET", CFG_SECRET }
+};
+#define CFG_KEYWORDS (sizeof(cfg_keywords) / sizeof(CfgKeyword_t))
+
+static bool blank(char c) {
+	return c == ' ' || c == '\t';
+}
+
+static bool ident(char c) {
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+DLConfigParser::DLConfigParser()
+{
+	begin();
+}
+
+void DLConfigParser::begin() {
+	_state = CFG_S_START;
+	_bad = false;
+	_klen = 0;
+	_vlen = 0;
+	_index = 0;
+	_line = 0;
+	_key[0] = 0;
+	_val[0] = 0;
+}
+
+uint8_t DLConfigParser::feed(char c) {
+	if (c == '\n')
+		return end();
+	if (c == '\r')
+		return CFG_KEY_NONE;
+	switch (_state) {
+	case CFG_S_START:
+		if (blank(c))
+			break;
+		if (c == '#') {
+			_state = CFG_S_SKIP;
+			break;
+		}
+		_state = CFG_S_KEY;
+		// Fall through
+	case CFG_S_KEY:
+		if (c == '=')
+			_state = CFG_S_VAL;
+		else if (blank(c))
+			_state = CFG_S_EQ;
+		else if (ident(c) && _klen < CFG_KEY_MAX)
+			_key[_klen++] = c;
+		else
+			_bad = true;
+		break;
+	case CFG_S_EQ:
+		if (c == '=')
+			_state = CFG_S_VAL;
+		else if (!blank(c))
+			_bad = true;
+		break;
+	case CFG_S_VAL:
+		if (_vlen == 0 && blank(c))
+			break;
+		if (c && _vlen < CFG_VAL_MAX)
+			_val[_vlen++] = c;
+		else
+			_bad = true;
+		break;
+	}
+	if (_bad)
+		_state = CFG_S_SKIP;
+	return CFG_KEY_NONE;
+}
+
+// The key of a line the file ends in without a newline
+uint8_t DLConfigParser::finish() {
+	if (_state == CFG_S_START || (_state == CFG_S_SKIP && !_bad))
+		return CFG_KEY_NONE;
+	return end();
+}
+
+uint8_t DLConfigParser::end() {
+	uint8_t key = CFG_KEY_BAD;
+	if (_state == CFG_S_VAL) {
+		while (_vlen && blank(_val[_vlen-1]))
+			_vlen--;
+		_key[_klen] = 0;
+		_val[_vlen] = 0;
+		key = lookup();
+	} else if ((_state == CFG_S_START || _state == CFG_S_SKIP) && !_bad) {
+		key = CFG_KEY_NONE;
+	}
+	_state = CFG_S_START;
+	_bad = false;
+	_klen = 0;
+	_vlen = 0;
+	_line++;
+	return key;
+}
+
+uint8_t DLConfigParser::lookup() {
+	uint8_t lo = 0, hi = CFG_KEYWORDS, m, key, d = _klen;
+	int cmp;
+	bool indexed = false;
+	// A trailing _n is the index
+	while (d && _key[d-1] >= '0' && _key[d-1] <= '9')
+		d--;
+	_index = 0;
+	if (d < _klen && d > 1 && _key[d-1] == '_' && _klen - d <= 3) {
+		if (atoi(_key + d) > 255)
+			return CFG_KEY_BAD;
+		_index = atoi(_key + d);
+		_key[d-1] = 0;
+		indexed = true;
+	}
+	while (lo < hi) {
+		m = (lo + hi) / 2;
+		cmp = strcmp_P(_key, cfg_keywords[m].name);
+		if (cmp == 0) {
+			key = pgm_read_byte(&cfg_keywords[m].key);
+			if (indexed)
+				_key[d-1] = '_';
+			if (((key & CFG_INDEXED) != 0) != indexed)
+				return CFG_KEY_BAD;
+			return key & ~CFG_INDEXED;
+		}
+		if (cmp < 0)
+			hi = m;
+		else
+			lo = m + 1;
+	}
+	if (indexed)
+		_key[d-1] = '_';
+	return CFG_KEY_BAD;
+}
+
+uint8_t DLConfigParser::index() {
+	return _index;
+}
+
+char *DLConfigParser::value() {
+	return _val;
+}
+
+// Number of the line feed() or finish() returned the key of
+uint16_t DLConfigParser::line() {
+	return _line;
+}
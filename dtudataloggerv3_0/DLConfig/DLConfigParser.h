@@ -0,0 +1,78 @@
+#ifndef DLConfigParser_h
+#define DLConfigParser_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#elif !defined(PROGMEM)
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define strcmp_P strcmp
+#endif
+
+/* Tokenizer for the KEY = value lines of CONFIG.DAT, fed one byte at a
+   time from whatever blocks the file is read in. feed() returns the key
+   of a line once its newline is in, CFG_KEY_NONE otherwise and for
+   blank and # comment lines, CFG_KEY_BAD for a line without '=', with
+   an unknown key, a key or value too long or a NUL in the value. Keys
+   are looked up by binary search in a sorted PROGMEM table, the PORT_
+   keys take an index as their last _n part, which index() returns.
+   value() is the value without the blanks around it. */
+#define CFG_KEY_MAX 20
+#define CFG_VAL_MAX 63
+
+#define CFG_KEY_NONE 0
+#define CFG_ID 1
+#define CFG_SECRET 2
+#define CFG_GPRS_APN 3
+#define CFG_GPRS_USER 4
+#define CFG_GPRS_PASS 5
+#define CFG_HTTP_URL 6
+#define CFG_HTTP_STATUS_URL 7
+#define CFG_HTTP_UPLOAD_URL 8
+#define CFG_HTTP_STATUS_TIME 9
+#define CFG_HTTP_UPLOAD_TIME 10
+#define CFG_LOG_FORMAT 11
+#define CFG_LOG_LATENCY 12
+#define CFG_MEASURE_TIME 13
+#define CFG_SAMPLING_RATE 14
+#define CFG_PORT_NAME 15
+#define CFG_PORT_FUNCT 16
+#define CFG_PORT_MODE 17
+#define CFG_PORT_RATE 18
+#define CFG_PORT_WINDOW 19
+#define CFG_KEY_BAD 0xFF
+
+#define CFG_INDEXED 0x80 // Key takes a _n index
+
+typedef struct {
+	char name[17];
+	uint8_t key; // And CFG_INDEXED
+} CfgKeyword_t;
+
+class DLConfigParser
+{
+	public:
+		DLConfigParser();
+		void begin();
+		uint8_t feed(char c);
+		uint8_t finish();
+		uint8_t index();
+		char *value();
+		uint16_t line();
+	private:
+		uint8_t _state;
+		bool _bad;
+		uint8_t _klen;
+		uint8_t _vlen;
+		uint8_t _index;
+		uint16_t _line; // Lines done
+		char _key[CFG_KEY_MAX + 1];
+		char _val[CFG_VAL_MAX + 1];
+		uint8_t end();
+		uint8_t lookup();
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include <Arduino.h>
+#include "DLCounters.h"
+
+DLCounters::DLCounters()
+{
+	_entries = 0;
+	_fields = 0;
+	_head = CTR_NONE;
+}
+
+// CRC-8 of an entry's first five bytes, never 0xFF for an erased slot
+uint8_t DLCounters::check(uint8_t *b) {
+	uint8_t crc = 0x5A;
+	for(uint8_t i = 0; i < CTR_ENTRY - 1; i++) {
+		crc ^= b[i];
+		for(uint8_t k = 0; k < 8; k++)
+			crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+bool DLCounters::load(uint16_t slot, CtrEntry_t *e) {
+	uint8_t b[CTR_ENTRY];
+	uint16_t addr = _start + slot * CTR_ENTRY;
+	for(uint8_t i = 0; i < CTR_ENTRY; i++)
+		b[i] = EEPROM.read(addr + i);
+	e->seq = b[0] | (b[1] << 8);
+	e->field = b[2];
+	e->value = b[3] | (b[4] << 8);
+	return b[5] == check(b) && e->field < _fields;
+}
+
+// Writes the bytes of the entry that differ, the check last
+void DLCounters::put(uint16_t slot, uint8_t field, uint16_t value) {
+	uint8_t b[CTR_ENTRY];
+	uint16_t addr = _start + slot * CTR_ENTRY;
+	_seq++;
+	b[0] = _seq;
+	b[1] = _seq >> 8;
+	b[2] = field;
+	b[3] = value;
+	b[4] = value >> 8;
+	b[5] = check(b);
+	if (EEPROM.read(addr + CTR_ENTRY - 1) != (uint8_t)~b[5])
+		EEPROM.write(addr + CTR_ENTRY - 1, ~b[5]); // Invalid until done
+	for(uint8_t i = 0; i < CTR_ENTRY; i++) {
+		if (EEPROM.read(addr + i) != b[i])
+			EEPROM.write(addr + i, b[i]);
+	}
+	_head = slot;
+	_slot[field] = slot;
+	_value[field] = value;
+}
+
+// Field whose newest entry is in slot, _fields for none
+uint8_t DLCounters::owner(uint16_t slot) {
+	uint8_t f;
+	for(f = 0; f < _fields && _slot[f] != slot; f++);
+	return f;
+}
+
+/* Replays the ring of size bytes at EEPROM address start for fields
+   counters. Returns the number of fields that have a value. */
+uint8_t DLCounters::begin(uint16_t start, uint16_t size, uint8_t fields) {
+	CtrEntry_t e, next;
+	bool valid, next_valid;
+	uint16_t i, slot, found = 0;
+	_start = start;
+	_entries = size / CTR_ENTRY;
+	_fields = fields > CTR_FIELDS ? CTR_FIELDS : fields;
+	_head = CTR_NONE;
+	_seq = 0;
+	for(i = 0; i < CTR_FIELDS; i++)
+		_slot[i] = CTR_NONE;
+	if (_entries < _fields + 2)
+		return 0;
+
+	// The head ends the run of sequence numbers
+	next_valid = load(0, &next);
+	for(i = 0; i < _entries; i++) {
+		e = next;
+		valid = next_valid;
+		next_valid = load((i + 1) % _entries, &next);
+		if (valid && (!next_valid || next.seq != (uint16_t)(e.seq + 1))) {
+			_head = i;
+			_seq = e.seq;
+			break;
+		}
+	}
+	if (_head == CTR_NONE)
+		return 0;
+
+	// Newest entry of every field, back along the run
+	slot = _head;
+	for(i = 0; i < _entries - 1 && found < _fields; i++) {
+		if (!load(slot, &e) || e.seq != (uint16_t)(_seq - i))
+			break;
+		if (_slot[e.field] == CTR_NONE) {
+			_slot[e.field] = slot;
+			_value[e.field] = e.value;
+			found++;
+		}
+		slot = slot ? slot - 1 : _entries - 1;
+	}
+	return found;
+}
+
+bool DLCounters::known(uint8_t field) {
+	return field < _fields && _slot[field] != CTR_NONE;
+}
+
+uint16_t DLCounters::get(uint8_t field) {
+	return known(field) ? _value[field] : 0;
+}
+
+void DLCounters::set(uint8_t field, uint16_t value) {
+	uint16_t slot;
+	uint8_t f;
+	if (field >= _fields || _entries < _fields + 2 || (known(field) && _value[field] == value))
+		return;
+	slot = _head == CTR_NONE ? 0 : (_head + 1) % _entries;
+	// Keeps the slot after the new head free of newest entries
+	while ((f = owner((slot + 1) % _entries)) < _fields && f != field) {
+		put(slot, f, _value[f]);
+		slot = (slot + 1) % _entries;
+	}
+	put(slot, field, value);
+}
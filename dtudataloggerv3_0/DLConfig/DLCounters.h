@@ -0,0 +1,48 @@
+#ifndef DLCounters_h
+#define DLCounters_h
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+/* Counters that change often, kept in a log-structured ring of EEPROM
+   rather than at fixed addresses. set() appends an entry with the next
+   sequence number, the field and the value, so the writes walk the
+   whole ring. begin() replays it: the head is the valid entry whose
+   successor does not carry the next sequence number, every field takes
+   the value of its newest entry found walking back from there.
+   The slot after the head never holds the newest entry of a field, an
+   entry found there is appended again first. A write torn by a reset
+   fails the check of its entry and leaves the values before it. */
+#define CTR_ENTRY 6 // Sequence, field, value and check
+#define CTR_FIELDS 16
+#define CTR_NONE 0xFFFF
+
+typedef struct {
+	uint16_t seq;
+	uint8_t field;
+	uint16_t value;
+} CtrEntry_t;
+
+class DLCounters
+{
+	public:
+		DLCounters();
+		uint8_t begin(uint16_t start, uint16_t size, uint8_t fields);
+		bool known(uint8_t field);
+		uint16_t get(uint8_t field);
+		void set(uint8_t field, uint16_t value);
+	private:
+		uint16_t _start; // EEPROM address of slot 0
+		uint16_t _entries;
+		uint8_t _fields;
+		uint16_t _head; // Slot of the newest entry, CTR_NONE empty
+		uint16_t _seq; // Its sequence number
+		uint16_t _slot[CTR_FIELDS]; // Slot of the newest entry of a field
+		uint16_t _value[CTR_FIELDS];
+		uint8_t check(uint8_t *b);
+		bool load(uint16_t slot, CtrEntry_t *e);
+		void put(uint16_t slot, uint8_t field, uint16_t value);
+		uint8_t owner(uint16_t slot);
+};
+
+#endif
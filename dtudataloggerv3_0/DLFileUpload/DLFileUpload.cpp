@@ -0,0 +1,265 @@
+#include <Arduino.h>
+#include "DLFileUpload.h"
+
+static DLFileUpload *streaming; // Whose part PT_POST_stream() pulls
+
+static int upload_fill(char *dst, int len) {
+	return streaming->fill(dst, len);
+}
+
+DLFileUpload::DLFileUpload()
+{
+	_pack_on = false;
+	_ranged = false;
+	_base = 0;
+}
+
+// buff holds the URL. Packing, it holds the file chunk and what it packs
+// to, at least 256 bytes then.
+void DLFileUpload::init(Config *config, DLSD *sd, DLHTTP *http, char *buff, int len) {
+	_config = config;
+	_sd = sd;
+	_http = http;
+	_buff = buff;
+	_buff_size = len;
+}
+
+void DLFileUpload::set_pack(bool on) {
+	_pack_on = on;
+}
+
+// File bytes packed at a time
+uint16_t DLFileUpload::chunk() {
+	return (_buff_size - 2 * 32) / 6;
+}
+
+// Where the chunks are packed to and its size
+uint8_t *DLFileUpload::out(uint16_t *size) {
+	*size = _buff_size - chunk();
+	return (uint8_t *)_buff + chunk();
+}
+
+void DLFileUpload::make_url() {
+	char num[12];
+	strcpy(_buff, _config->HTTP_URL);
+	strcat_P(_buff, PSTR("upload.php?id="));
+	fmtUnsigned(_config->id, num, sizeof(num));
+	strcat(_buff, num);
+	strcat_P(_buff, PSTR("&fi="));
+	fmtUnsigned(_fd, num, sizeof(num));
+	strcat(_buff, num);
+	strcat_P(_buff, PSTR("&fc="));
+	fmtUnsigned(_sd->get_files_count(_fd), num, sizeof(num));
+	strcat(_buff, num);
+	strcat_P(_buff, PSTR("&p="));
+	fmtUnsigned(_part, num, sizeof(num));
+	strcat(_buff, num);
+	strcat_P(_buff, PSTR("&tp="));
+	fmtUnsigned(_parts - 1, num, sizeof(num));
+	strcat(_buff, num);
+	strcat_P(_buff, PSTR("&fs="));
+	fmtUnsigned(_filesize, num, sizeof(num));
+	strcat(_buff, num);
+	if (_ranged) {
+		strcat_P(_buff, PSTR("&o="));
+		fmtUnsigned(_base, num, sizeof(num));
+		strcat(_buff, num);
+	}
+	if (_pack_on)
+		strcat_P(_buff, PSTR("&z=1"));
+}
+
+void DLFileUpload::part_start() {
+	_sd->seek(_fd, _base + (uint32_t)_part * UPLOAD_PART);
+	_done = 0;
+	_out_len = 0;
+	_out_pos = 0;
+	_ended = false;
+	_failed = false;
+	_streamed = false;
+}
+
+// Packs the part on into out(), until it may not take another chunk and
+// there is something to send. Returns the bytes packed, 0 when the part
+// is through or on a read error, which sets _failed.
+uint16_t DLFileUpload::next() {
+	uint16_t in = chunk(), room, len = 0;
+	uint8_t *o = out(&room);
+	int n;
+	if (_ended)
+		return 0;
+	if (_done == 0)
+		len = _pack.begin(o);
+	while (_done < _part_len && (len == 0 || len + PACK_OUT(in) <= room)) {
+		n = _part_len - _done;
+		if (n > in)
+			n = in;
+		if ((n = _sd->read(_fd, _buff, n)) <= 0) {
+			_ended = true;
+			_failed = true;
+			return 0;
+		}
+		len += _pack.put((uint8_t *)_buff, n, o + len);
+		_done += n;
+	}
+	if (_done == _part_len && len + PACK_OUT_END <= room) {
+		len += _pack.end(o + len);
+		_ended = true;
+	}
+	return len;
+}
+
+/* Up to len bytes of the part at dst for DLHTTP::PT_POST_stream(), -1
+   on a read error. File bytes are read up to the end of their card block
+   or in whole blocks, which SdFat reads into dst without its cache. */
+int DLFileUpload::fill(char *dst, int len) {
+	uint16_t off, room;
+	int n;
+	if (_pack_on) {
+		if (_out_pos == _out_len) {
+			_out_len = next();
+			_out_pos = 0;
+			if (_out_len == 0)
+				return -1;
+		}
+		n = _out_len - _out_pos;
+		if (n > len)
+			n = len;
+		memcpy(dst, out(&room) + _out_pos, n);
+		_out_pos += n;
+		return n;
+	}
+	n = _part_len - _done;
+	if (n > len)
+		n = len;
+	off = (_base + (uint32_t)_part * UPLOAD_PART + _done) % HTTP_STREAM_BLOCK;
+	if (off && n > HTTP_STREAM_BLOCK - off)
+		n = HTTP_STREAM_BLOCK - off;
+	else if (!off && n > HTTP_STREAM_BLOCK)
+		n -= n % HTTP_STREAM_BLOCK;
+	if ((n = _sd->read(_fd, dst, n)) <= 0) {
+		_failed = true;
+		return -1;
+	}
+	_done += n;
+	return n;
+}
+
+// Content-Length of the packed part, -1 on a read error
+long DLFileUpload::packed_size() {
+	long size = 0;
+	part_start();
+	while (!_ended)
+		size += next();
+	return _failed ? -1 : size;
+}
+
+/* Uploads file fd with files count count. ret is 1 when every part went
+   through, 2 when the file does not exist, 0 when a part failed
+   UPLOAD_RETRIES times in a row. */
+int DLFileUpload::PT_upload(struct pt *pt, char *ret, uint8_t fd, uint16_t count) {
+	static struct pt parts_pt;
+	PT_BEGIN(pt);
+	_fd = fd;
+	_ranged = false;
+	_base = 0;
+	_sd->set_files_count(fd, count);
+	_filesize = _sd->open(fd, O_READ);
+	if (_filesize == (uint32_t)-1) {
+		*ret = 2;
+		PT_EXIT(pt);
+	}
+	PT_SPAWN(pt, &parts_pt, PT_parts(&parts_pt, ret));
+	_sd->close(fd);
+	PT_END(pt);
+}
+
+/* Uploads the records from t0 to t1 of the files of fd, from files count
+   newest back until one starts at or before t0. A file without a time
+   index ends the search, unless it is the newest. ret is 1 when every
+   window went through, 2 when no file had an index, 0 when a part
+   failed. */
+int DLFileUpload::PT_upload_range(struct pt *pt, char *ret, uint8_t fd, uint16_t newest, uint32_t t0, uint32_t t1) {
+	static struct pt parts_pt;
+	static char found;
+	uint32_t first;
+	long len;
+	PT_BEGIN(pt);
+	_fd = fd;
+	_ranged = true;
+	_count = newest + 1;
+	_next_first = (uint32_t)-1;
+	found = 2;
+	while (_count > 0 && _next_first > t0) {
+		_count--;
+		_sd->set_files_count(fd, _count);
+		if (_sd->open(fd, O_READ) == (uint32_t)-1)
+			continue;
+		len = _sd->read_range(fd, t0, t1, &_base, &first);
+		if (len < 0) {
+			_sd->close(fd);
+			if (_count < newest)
+				break;
+			continue;
+		}
+		found = 1;
+		_next_first = first;
+		if (len > 0) {
+			_filesize = len;
+			PT_SPAWN(pt, &parts_pt, PT_parts(&parts_pt, ret));
+			if (*ret != 1) {
+				_sd->close(fd);
+				_ranged = false;
+				PT_EXIT(pt);
+			}
+		}
+		_sd->close(fd);
+		wdt_reset();
+	}
+	_ranged = false;
+	*ret = found;
+	PT_END(pt);
+}
+
+// The _filesize bytes from _base of the open file _fd in parts, ret as
+// PT_upload()
+int DLFileUpload::PT_parts(struct pt *pt, char *ret) {
+	static struct pt child_pt;
+	static long body;
+	PT_BEGIN(pt);
+	_parts = (_filesize + UPLOAD_PART - 1) / UPLOAD_PART;
+	if (_parts == 0)
+		_parts = 1;
+	_part = 0;
+	_err = 0;
+	while (_part < _parts) {
+		_part_len = _filesize - (uint32_t)_part * UPLOAD_PART;
+		if (_part_len > UPLOAD_PART)
+			_part_len = UPLOAD_PART;
+		body = _pack_on ? packed_size() : _part_len;
+		part_start();
+		*ret = 0;
+		if (body >= 0) {
+			make_url();
+			PT_WAIT_THREAD(pt, _http->PT_POST_start(&child_pt, ret, _buff, body));
+			if (*ret == 1) {
+				// Other threads run while the ring drains and the modem answers
+				streaming = this;
+				PT_WAIT_THREAD(pt, _http->PT_POST_stream(&child_pt, ret, upload_fill, body,
+				               _pack_on ? 0 : (_base + (uint32_t)_part * UPLOAD_PART) % HTTP_STREAM_BLOCK));
+				_streamed = *ret == 1;
+				PT_WAIT_THREAD(pt, _http->PT_POST_end(&child_pt, ret));
+			}
+		}
+		if (body >= 0 && !_failed && _streamed && _http->get_err_code() == 100) {
+			_part++;
+			_err = 0;
+		} else if (++_err > UPLOAD_RETRIES) {
+			*ret = 0;
+			PT_EXIT(pt);
+		}
+		wdt_reset();
+	}
+	*ret = 1;
+	PT_END(pt);
+}
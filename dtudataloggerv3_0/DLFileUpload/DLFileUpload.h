@@ -0,0 +1,66 @@
+#ifndef DLFileUpload_h
+#define DLFileUpload_h
+
+#include <Arduino.h>
+#include <DLCommon.h>
+#include <DLConfig.h>
+#include <DLSD.h>
+#include <DLHTTP.h>
+#include "DLPack.h"
+
+/* Uploads a log file to upload.php in parts of UPLOAD_PART bytes, each
+   its own POST. With set_pack() every part is packed on its own (DLPack)
+   and the URL says so with &z=1. The Content-Length of a packed part is
+   not known before it is packed, so the part is packed once to count and
+   again to send, packing is deterministic. DLHTTP::PT_POST_stream()
+   pulls the body with fill(): file bytes are read from the card straight
+   into the transmit ring, packed ones copied there from the buffer they
+   are packed to. PT_upload_range() sends only the bytes of a time window,
+   found with the time index of DLSD, the URL has the offset they start
+   at in &o=. */
+#define UPLOAD_PART 4000
+#define UPLOAD_RETRIES 5
+
+class DLFileUpload
+{
+	public:
+		DLFileUpload();
+		void init(Config *config, DLSD *sd, DLHTTP *http, char *buff, int len);
+		void set_pack(bool on);
+		int PT_upload(struct pt *pt, char *ret, uint8_t fd, uint16_t count);
+		int PT_upload_range(struct pt *pt, char *ret, uint8_t fd, uint16_t newest, uint32_t t0, uint32_t t1);
+		int fill(char *dst, int len);
+	private:
+		Config *_config;
+		DLSD *_sd;
+		DLHTTP *_http;
+		char *_buff;
+		int _buff_size;
+		bool _pack_on;
+		DLPack _pack;
+		uint8_t _fd;
+		uint8_t _err;
+		uint16_t _part;
+		uint16_t _parts;
+		uint32_t _filesize; // Bytes to send, the file or the window
+		uint32_t _base; // Offset they start at
+		bool _ranged;
+		uint16_t _count; // File of a range upload
+		uint32_t _next_first; // First indexed time of the file after it
+		uint16_t _part_len; // File bytes of the part
+		uint16_t _done; // File bytes of the part sent
+		bool _ended; // Part read and packed through
+		bool _failed; // Read error in the part
+		uint16_t _out_len; // Packed bytes in out()
+		uint16_t _out_pos; // Of them sent
+		bool _streamed; // The body of the part went out
+		uint16_t chunk();
+		uint8_t *out(uint16_t *size);
+		void make_url();
+		void part_start();
+		uint16_t next();
+		long packed_size();
+		int PT_parts(struct pt *pt, char *ret);
+};
+
+#endif
@@ -0,0 +1,364 @@
+#include <string.h>
+#include "DLPack.h"
+
+#define WIN_MASK (PACK_WINDOW - 1)
+
+// Timestamp stage states, the same on both ends
+#define TS_LINE 0 // At the start of a line
+#define TS_FRAME 1 // In a frame header
+#define TS_DIGITS 2 // After a 'T' at the start of a line
+#define TS_MID 3
+#define TS_CODE 4 // After PACK_TS, unpacking only
+
+#define TS_IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+// Takes digit c into *val unless the timestamp is full or would overflow
+static bool ts_digit(uint8_t c, uint8_t digits, uint32_t *val) {
+	uint8_t d = c - '0';
+	if (!TS_IS_DIGIT(c) || (digits == 0 && d == 0) || digits == PACK_TS_DIGITS ||
+	    *val > (0xFFFFFFFFUL - d) / 10)
+		return false;
+	*val = *val * 10 + d;
+	return true;
+}
+
+// Digits of v, returns their count
+static uint8_t ts_text(uint32_t v, char *buf) {
+	char tmp[PACK_TS_DIGITS];
+	uint8_t n = 0, i;
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	for(i = 0; i < n; i++)
+		buf[i] = tmp[n - 1 - i];
+	return n;
+}
+
+DLPack::DLPack()
+{
+	_out = NULL;
+}
+
+// Starts a body, the header goes to out. Returns its length.
+uint16_t DLPack::begin(uint8_t *out) {
+	memset(_win, 0, sizeof(_win));
+	memset(_head, 0, sizeof(_head));
+	_pos = 0;
+	_end = 0;
+	_line = 0;
+	_line_len = 0;
+	_group[0] = 0;
+	_group_len = 1;
+	_group_items = 0;
+	_ts_state = TS_LINE;
+	_ts_have = false;
+#ifdef PACK_STATS
+	stat_in = stat_steps = stat_compares = stat_inserts = stat_matches = 0;
+#endif
+	out[0] = PACK_MAGIC0;
+	out[1] = PACK_MAGIC1;
+	out[2] = PACK_VERSION;
+	return PACK_HEADER;
+}
+
+// Packs len bytes, out needs PACK_OUT(len) bytes. Returns the bytes
+// written, the rest stays in the window until later calls or end().
+uint16_t DLPack::put(const uint8_t *in, uint16_t len, uint8_t *out) {
+	_out = out;
+	_out_len = 0;
+#ifdef PACK_STATS
+	stat_in += len;
+#endif
+	while (len--)
+		stage(*in++);
+	return _out_len;
+}
+
+// Everything still held, out needs PACK_OUT_END bytes
+uint16_t DLPack::end(uint8_t *out) {
+	_out = out;
+	_out_len = 0;
+	stage_flush();
+	while (_pos != _end)
+		step();
+	group_flush();
+	return _out_len;
+}
+
+void DLPack::stage(uint8_t c) {
+	switch (_ts_state) {
+		case TS_LINE:
+			if (c == PACK_LINE_FRAME) {
+				fill(c);
+				_ts_skip = PACK_LINE_FRAME_HDR - 1;
+				_ts_state = TS_FRAME;
+				return;
+			}
+			if (c == 'T') {
+				_ts_digits = 0;
+				_ts_val = 0;
+				_ts_state = TS_DIGITS;
+				return;
+			}
+			if (c == PACK_TS) {
+				fill(PACK_TS);
+				fill(PACK_TS_ESC);
+				_ts_state = TS_MID;
+				return;
+			}
+			break;
+		case TS_FRAME:
+			fill(c);
+			if (--_ts_skip == 0)
+				_ts_state = TS_LINE;
+			return;
+		case TS_DIGITS:
+			if (ts_digit(c, _ts_digits, &_ts_val)) {
+				_ts_digits++;
+				return;
+			}
+			if (_ts_digits && !TS_IS_DIGIT(c)) {
+				if (_ts_have && _ts_val >= _ts_prev && _ts_val - _ts_prev < PACK_TS_ESC) {
+					fill(PACK_TS);
+					fill(_ts_val - _ts_prev);
+					_ts_state = TS_MID;
+				}
+				_ts_prev = _ts_val;
+				_ts_have = true;
+			}
+			stage_flush();
+			break;
+	}
+	fill(c);
+	_ts_state = c == '\n' ? TS_LINE : TS_MID;
+}
+
+// A timestamp held back goes out as it came
+void DLPack::stage_flush() {
+	char buf[PACK_TS_DIGITS];
+	uint8_t n, i;
+	if (_ts_state != TS_DIGITS)
+		return;
+	fill('T');
+	if (_ts_digits) {
+		n = ts_text(_ts_val, buf);
+		for(i = 0; i < n; i++)
+			fill(buf[i]);
+	}
+	_ts_state = TS_MID;
+}
+
+void DLPack::fill(uint8_t c) {
+	while ((uint16_t)(_end - _pos) >= PACK_MAX)
+		step();
+	_win[_end & WIN_MASK] = c;
+	_end++;
+}
+
+uint16_t DLPack::hash(uint16_t p) {
+	uint8_t a = _win[p & WIN_MASK], b = _win[(p + 1) & WIN_MASK], c = _win[(p + 2) & WIN_MASK];
+	return (uint8_t)((a << 4) ^ (a >> 4) ^ (b << 2) ^ c) & (PACK_HASH - 1);
+}
+
+void DLPack::insert(uint16_t p) {
+#ifdef PACK_STATS
+	stat_inserts++;
+#endif
+	_head[hash(p)] = p;
+}
+
+// Bytes at cand that equal those at _pos, up to limit
+uint8_t DLPack::match_len(uint16_t cand, uint8_t limit) {
+	uint8_t n = 0;
+	uint16_t d = _pos - cand;
+	if (d == 0 || (uint16_t)(_end - cand) > PACK_WINDOW)
+		return 0;
+	while (n < limit && _win[(cand + n) & WIN_MASK] == _win[(_pos + n) & WIN_MASK])
+		n++;
+#ifdef PACK_STATS
+	stat_compares += n + 1;
+#endif
+	return n;
+}
+
+// Encodes the item at _pos
+void DLPack::step() {
+	uint16_t avail = _end - _pos, h, cand, off = 0;
+	uint8_t limit = avail < PACK_MAX ? avail : PACK_MAX, best = 1, n, i;
+#ifdef PACK_STATS
+	stat_steps++;
+#endif
+	if (limit >= PACK_MIN) {
+		h = hash(_pos);
+		cand = _head[h];
+		_head[h] = _pos;
+		if ((n = match_len(cand, limit)) > best) {
+			best = n;
+			off = _pos - cand;
+		}
+		if (_line_len && (cand = _pos - _line_len) != _pos - off && (n = match_len(cand, limit)) > best) {
+			best = n;
+			off = _line_len;
+		}
+	}
+	if (best >= PACK_MIN) {
+#ifdef PACK_STATS
+		stat_matches++;
+#endif
+		item(true, off - 1, best);
+	} else {
+		best = 1;
+		item(false, 0, _win[_pos & WIN_MASK]);
+	}
+	for(i = 0; i < best; i++, _pos++) {
+		if (i && (uint16_t)(_end - _pos) >= PACK_MIN)
+			insert(_pos);
+		if (_win[_pos & WIN_MASK] == '\n') {
+			_line_len = _pos + 1 - _line;
+			_line = _pos + 1;
+		}
+	}
+}
+
+// A literal b, or a match at offset a + 1 of length b
+void DLPack::item(bool match, uint16_t a, uint8_t b) {
+	if (match) {
+		_group[0] |= 1 << _group_items;
+		_group[_group_len++] = a & 0xFF;
+		_group[_group_len++] = (a >> 8) | ((b - PACK_MIN) << 2);
+	} else {
+		_group[_group_len++] = b;
+	}
+	if (++_group_items == 8)
+		group_flush();
+}
+
+void DLPack::group_flush() {
+	if (!_group_items)
+		return;
+	memcpy(_out + _out_len, _group, _group_len);
+	_out_len += _group_len;
+	_group[0] = 0;
+	_group_len = 1;
+	_group_items = 0;
+}
+
+DLUnpack::DLUnpack()
+{
+	_sink = NULL;
+}
+
+void DLUnpack::begin(sink_t sink, void *ctx) {
+	_sink = sink;
+	_ctx = ctx;
+	memset(_win, 0, sizeof(_win));
+	_pos = 0;
+	_hdr = 0;
+	_bits = 0;
+	_lo = -1;
+	_ts_state = TS_LINE;
+}
+
+// False when in is not a packed body
+bool DLUnpack::put(const uint8_t *in, uint32_t len) {
+	static const uint8_t magic[PACK_HEADER] = { PACK_MAGIC0, PACK_MAGIC1, PACK_VERSION };
+	for(; len; len--, in++) {
+		if (_hdr < PACK_HEADER) {
+			if (*in != magic[_hdr++])
+				return false;
+			continue;
+		}
+		lz(*in);
+	}
+	return true;
+}
+
+void DLUnpack::lz(uint8_t c) {
+	uint16_t off;
+	uint8_t n, b;
+	if (_bits == 0) {
+		_flags = c;
+		_bits = 8;
+		return;
+	}
+	if (_flags & 1) {
+		if (_lo < 0) {
+			_lo = c;
+			return;
+		}
+		off = (_lo | (c & 0x03) << 8) + 1;
+		for(n = (c >> 2) + PACK_MIN; n; n--) {
+			b = _win[(_pos - off) & WIN_MASK];
+			_win[_pos++ & WIN_MASK] = b;
+			stage(b);
+		}
+		_lo = -1;
+	} else {
+		_win[_pos++ & WIN_MASK] = c;
+		stage(c);
+	}
+	_flags >>= 1;
+	_bits--;
+}
+
+void DLUnpack::stage(uint8_t c) {
+	switch (_ts_state) {
+		case TS_LINE:
+			if (c == PACK_LINE_FRAME) {
+				emit(c);
+				_ts_skip = PACK_LINE_FRAME_HDR - 1;
+				_ts_state = TS_FRAME;
+				return;
+			}
+			if (c == PACK_TS) {
+				_ts_state = TS_CODE;
+				return;
+			}
+			if (c == 'T') {
+				emit(c);
+				_ts_digits = 0;
+				_ts_val = 0;
+				_ts_state = TS_DIGITS;
+				return;
+			}
+			break;
+		case TS_FRAME:
+			emit(c);
+			if (--_ts_skip == 0)
+				_ts_state = TS_LINE;
+			return;
+		case TS_CODE:
+			if (c == PACK_TS_ESC) {
+				emit(PACK_TS);
+			} else {
+				_ts_prev += c;
+				emit_ts(_ts_prev);
+			}
+			_ts_state = TS_MID;
+			return;
+		case TS_DIGITS:
+			if (ts_digit(c, _ts_digits, &_ts_val)) {
+				emit(c);
+				_ts_digits++;
+				return;
+			}
+			if (_ts_digits && !TS_IS_DIGIT(c)) {
+				_ts_prev = _ts_val;
+			}
+			break;
+	}
+	emit(c);
+	_ts_state = c == '\n' ? TS_LINE : TS_MID;
+}
+
+void DLUnpack::emit(uint8_t c) {
+	_sink(_ctx, c);
+}
+
+void DLUnpack::emit_ts(uint32_t v) {
+	uint8_t n = ts_text(v, _ts_buf), i;
+	emit('T');
+	for(i = 0; i < n; i++)
+		emit(_ts_buf[i]);
+}
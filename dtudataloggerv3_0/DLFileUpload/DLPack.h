@@ -0,0 +1,114 @@
+#ifndef DLPack_h
+#define DLPack_h
+
+#include <stdint.h>
+
+/*
+  Streaming compression of log files for the upload, about 1.6 KB of RAM.
+  A packed body starts with PACK_MAGIC and PACK_VERSION, then LZSS: a
+  flag byte for every 8 items, bit set for a match, LSB first. A literal
+  is one byte, a match two:
+
+    byte 0  (offset - 1) & 0xFF
+    byte 1  (offset - 1) >> 8 | (length - PACK_MIN) << 2
+
+  The body ends with the last item, the receiver knows its length from
+  Content-Length. Before LZSS, a timestamp at the start of a line ('T'
+  and up to 10 digits, after a SD_FRAME header when the file is framed)
+  becomes PACK_TS and its delta to the timestamp before, when that is
+  below PACK_TS_ESC. A PACK_TS byte already at a line start is sent as
+  PACK_TS PACK_TS_ESC. Matches are looked for at the last position with
+  the same 3 bytes and at the same column of the line before, where the
+  fields of a log line repeat.
+*/
+#define PACK_MAGIC0 'D'
+#define PACK_MAGIC1 'Z'
+#define PACK_VERSION 1
+#define PACK_HEADER 3
+
+#define PACK_WINDOW 1024 // Power of 2, history and lookahead
+#define PACK_HASH 256 // Power of 2
+#define PACK_MIN 3
+#define PACK_MAX (PACK_MIN + 63)
+#define PACK_TS 0x01
+#define PACK_TS_ESC 0xFF
+#define PACK_TS_DIGITS 10
+#define PACK_LINE_FRAME 0xA5 // SD_FRAME of DLSD.h
+#define PACK_LINE_FRAME_HDR 7 // SD_FRAME_HDR
+
+// Room put() may need in out for len bytes in, and end()
+#define PACK_OUT(len) ((len) * 9 / 4 + 32)
+#define PACK_OUT_END ((PACK_MAX + PACK_TS_DIGITS + 1) * 9 / 8 + 20)
+
+class DLPack
+{
+	public:
+		DLPack();
+		uint16_t begin(uint8_t *out);
+		uint16_t put(const uint8_t *in, uint16_t len, uint8_t *out);
+		uint16_t end(uint8_t *out);
+#ifdef PACK_STATS
+		uint32_t stat_in, stat_steps, stat_compares, stat_inserts, stat_matches;
+#endif
+	private:
+		uint8_t _win[PACK_WINDOW];
+		uint16_t _head[PACK_HASH]; // Newest position of every hash
+		uint16_t _pos; // Next position to encode
+		uint16_t _end; // Next position to fill
+		uint16_t _line; // Position the line being encoded starts at
+		uint16_t _line_len; // Length of the line before
+		uint8_t _group[17]; // Flag byte and up to 8 items
+		uint8_t _group_len;
+		uint8_t _group_items;
+		uint8_t *_out;
+		uint16_t _out_len;
+		// Timestamp stage
+		uint8_t _ts_state;
+		uint8_t _ts_digits;
+		uint8_t _ts_skip; // Frame header bytes still to pass
+		uint32_t _ts_val;
+		uint32_t _ts_prev;
+		bool _ts_have;
+		void stage(uint8_t c);
+		void stage_flush();
+		void fill(uint8_t c);
+		void step();
+		void item(bool match, uint16_t a, uint8_t b);
+		void group_flush();
+		uint16_t hash(uint16_t p);
+		void insert(uint16_t p);
+		uint8_t match_len(uint16_t cand, uint8_t limit);
+};
+
+/* The receiving end, for the host tools. put() writes what len bytes of
+   a packed body give to the sink. */
+class DLUnpack
+{
+	public:
+		typedef void (*sink_t)(void *ctx, uint8_t c);
+		DLUnpack();
+		void begin(sink_t sink, void *ctx);
+		bool put(const uint8_t *in, uint32_t len);
+	private:
+		sink_t _sink;
+		void *_ctx;
+		uint8_t _win[PACK_WINDOW];
+		uint16_t _pos;
+		uint8_t _hdr; // Header bytes seen
+		uint8_t _flags;
+		uint8_t _bits; // Items left under _flags
+		int16_t _lo; // First byte of a match, -1 none
+		// Timestamp stage
+		uint8_t _ts_state;
+		uint8_t _ts_digits;
+		uint8_t _ts_skip;
+		uint32_t _ts_val;
+		uint32_t _ts_prev;
+		char _ts_buf[PACK_TS_DIGITS + 1];
+		void lz(uint8_t c);
+		void stage(uint8_t c);
+		void emit(uint8_t c);
+		void emit_ts(uint32_t v);
+};
+
+#endif
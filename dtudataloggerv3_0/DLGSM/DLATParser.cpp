@@ -0,0 +1,195 @@
+#include "DLATParser.h"
+
+#define URC_MASK (URC_QUEUE - 1)
+
+// Sorted by name (as strcmp) for the walk
+static const ATReply_t at_replies[] PROGMEM = {
+	{ "+CGREG:", AT_CGREG, AT_K_URC },
+	{ "+CIPSEND:", AT_CIPSEND, AT_K_DATA },
+	{ "+CME ERROR:", AT_CME_ERROR, AT_K_FAIL },
+	{ "+CMGL:", AT_CMGL, AT_K_DATA },
+	{ "+CMGR:", AT_CMGR, AT_K_DATA },
+	{ "+CMGS:", AT_CMGS, AT_K_DATA },
+	{ "+CMS ERROR:", AT_CMS_ERROR, AT_K_FAIL },
+	{ "+CMTI:", AT_CMTI, AT_K_URC },
+	{ "+CREG:", AT_CREG, AT_K_URC },
+	{ "+CSQ:", AT_CSQ, AT_K_DATA },
+	{ "+PDP: DEACT", AT_PDP_DEACT, AT_K_URC },
+	{ ">", AT_PROMPT, AT_K_OK },
+	{ "ALREADY CONNECT", AT_ALREADY_CONNECT, AT_K_OK },
+	{ "CLOSE OK", AT_CLOSE_OK, AT_K_OK },
+	{ "CLOSED", AT_CLOSED, AT_K_URC },
+	{ "CONNECT FAIL", AT_CONNECT_FAIL, AT_K_FAIL },
+	{ "CONNECT OK", AT_CONNECT_OK, AT_K_OK },
+	{ "Call Ready", AT_CALL_READY, AT_K_URC },
+	{ "ERROR", AT_ERROR, AT_K_FAIL },
+	{ "NO CARRIER", AT_NO_CARRIER, AT_K_FAIL },
+	{ "NORMAL POWER DOWN", AT_POWER_DOWN, AT_K_URC },
+	{ "OK", AT_OK, AT_K_OK },
+	{ "OVER-VOLTAGE POWER DOWN", AT_POWER_DOWN, AT_K_URC },
+	{ "RING", AT_RING, AT_K_URC },
+	{ "SEND FAIL", AT_SEND_FAIL, AT_K_FAIL },
+	{ "SEND OK", AT_SEND_OK, AT_K_OK },
+	{ "SHUT OK", AT_SHUT_OK, AT_K_OK },
+	{ "STATE:", AT_STATE, AT_K_DATA },
+	{ "UNDER-VOLTAGE POWER DOWN", AT_POWER_DOWN, AT_K_URC }
+};
+// AT_ENTRIES has to be the size of the table
+typedef char at_entries_check[sizeof(at_replies) / sizeof(ATReply_t) == AT_ENTRIES ? 1 : -1];
+
+static uint8_t name_at(uint8_t e, uint8_t pos) {
+	return pgm_read_byte(&at_replies[e].name[pos]);
+}
+
+DLATParser::DLATParser()
+{
+	begin();
+}
+
+void DLATParser::begin() {
+	reset_line();
+	_last = AT_NO_ENTRY;
+	_prompt = false;
+	_arg = 0;
+	memset(_want, 0, sizeof(_want));
+}
+
+// The expected replies of the command stay
+void DLATParser::reset_line() {
+	_pos = 0;
+	_lo = 0;
+	_hi = AT_ENTRIES;
+	_entry = AT_NO_ENTRY;
+	_num = 0;
+}
+
+uint8_t DLATParser::feed(char c) {
+	if (c == '\r')
+		return AT_K_NONE;
+	if (_prompt) {
+		_prompt = false;
+		if (c == ' ')
+			return AT_K_NONE;
+	}
+	if (c == '\n')
+		return _pos ? end() : AT_K_NONE;
+	if (c >= '0' && c <= '9') {
+		_num = _num < 3276 ? _num * 10 + c - '0' : 32767;
+	} else {
+		_num = 0;
+	}
+	narrow(c);
+	if (_pos == 1 && c == '>') { // No newline after it
+		_prompt = true;
+		return end();
+	}
+	return AT_K_NONE;
+}
+
+// Keeps the entries that go on with c, found by binary search as they
+// are sorted. One that ends here sorts first, the line starts with it.
+void DLATParser::narrow(uint8_t c) {
+	uint8_t lo = _lo, hi = _hi, m;
+	if (lo < hi && name_at(lo, _pos) == 0)
+		_entry = lo++;
+	if (c == 0)
+		lo = hi;
+	while (lo < hi) {
+		m = (lo + hi) / 2;
+		if (name_at(m, _pos) < c)
+			lo = m + 1;
+		else
+			hi = m;
+	}
+	_lo = lo;
+	hi = _hi;
+	while (lo < hi) {
+		m = (lo + hi) / 2;
+		if (name_at(m, _pos) > c)
+			hi = m;
+		else
+			lo = m + 1;
+	}
+	_hi = lo;
+	if (_pos < 255)
+		_pos++;
+}
+
+uint8_t DLATParser::end() {
+	if (_lo < _hi && name_at(_lo, _pos) == 0)
+		_entry = _lo;
+	_last = _entry;
+	_arg = _num;
+	reset_line();
+	return kind();
+}
+
+uint8_t DLATParser::reply() {
+	if (_last == AT_NO_ENTRY)
+		return AT_NONE;
+	return pgm_read_byte(&at_replies[_last].reply);
+}
+
+uint8_t DLATParser::kind() {
+	if (_last == AT_NO_ENTRY)
+		return AT_K_LINE;
+	return pgm_read_byte(&at_replies[_last].kind);
+}
+
+int DLATParser::arg() {
+	return _arg;
+}
+
+// Once for a command, not for a line
+void DLATParser::expect(const char *conf) {
+	char name[AT_NAME_MAX + 1];
+	memset(_want, 0, sizeof(_want));
+	if (conf == NULL)
+		return;
+	for(uint8_t e = 0; e < AT_ENTRIES; e++) {
+		strcpy_P(name, at_replies[e].name);
+		if (strstr(name, conf) != NULL)
+			_want[e >> 3] |= 1 << (e & 7);
+	}
+}
+
+bool DLATParser::expected() {
+	return _last != AT_NO_ENTRY && (_want[_last >> 3] & (1 << (_last & 7)));
+}
+
+DLURCQueue::DLURCQueue()
+{
+	_head = _tail = 0;
+	_overflows = 0;
+}
+
+bool DLURCQueue::push(uint8_t reply, int arg) {
+	for(uint8_t i = _tail; i != _head; i++) {
+		if (_ring[i & URC_MASK].reply == reply && _ring[i & URC_MASK].arg == arg)
+			return true;
+	}
+	if ((uint8_t)(_head - _tail) == URC_QUEUE) {
+		_overflows++;
+		return false;
+	}
+	_ring[_head & URC_MASK].reply = reply;
+	_ring[_head & URC_MASK].arg = arg;
+	_head++;
+	return true;
+}
+
+bool DLURCQueue::pop(Urc_t *urc) {
+	if (_head == _tail)
+		return false;
+	*urc = _ring[_tail & URC_MASK];
+	_tail++;
+	return true;
+}
+
+uint8_t DLURCQueue::available() {
+	return _head - _tail;
+}
+
+uint16_t DLURCQueue::get_overflows() {
+	return _overflows;
+}
@@ -0,0 +1,123 @@
+#ifndef DLATParser_h
+#define DLATParser_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#elif !defined(PROGMEM)
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define strcpy_P strcpy
+#endif
+
+/* Classifier of the lines a SIM900 sends, fed one byte at a time as they
+   come off the UART. The replies are a sorted PROGMEM table walked as a
+   trie: each byte narrows the entries that agree with the line so far,
+   so a line costs its bytes plus at most one step per entry. feed()
+   returns the kind of a line once its newline is in, of the > prompt
+   as soon as the > is, AT_K_NONE otherwise and for blank lines. reply()
+   is the entry the line starts with, the longest one, AT_NONE for a
+   line of none (text, echo, an HTTP reply), arg() the number it ends in,
+   the index of +CMTI: "SM",7. reset_line() drops a line cut short by
+   a timeout, the next starts clean. expect() marks the entries with the
+   confirmation string of a command in them, expected() says if the last
+   line was one. */
+#define AT_K_NONE 0
+#define AT_K_LINE 1 // Not a reply of the table
+#define AT_K_OK 2 // Final result and the prompt
+#define AT_K_FAIL 3 // Final result, the command failed
+#define AT_K_DATA 4 // Intermediate result
+#define AT_K_URC 5 // Unsolicited
+
+#define AT_NONE 0
+#define AT_OK 1
+#define AT_PROMPT 2
+#define AT_SEND_OK 3
+#define AT_CONNECT_OK 4
+#define AT_ALREADY_CONNECT 5
+#define AT_CLOSE_OK 6
+#define AT_SHUT_OK 7
+#define AT_ERROR 8
+#define AT_CME_ERROR 9
+#define AT_CMS_ERROR 10
+#define AT_SEND_FAIL 11
+#define AT_CONNECT_FAIL 12
+#define AT_NO_CARRIER 13
+#define AT_CIPSEND 14
+#define AT_STATE 15
+#define AT_CMGL 16
+#define AT_CMGR 17
+#define AT_CMGS 18
+#define AT_CSQ 19
+#define AT_CREG 20
+#define AT_CGREG 21
+#define AT_RING 22
+#define AT_CMTI 23
+#define AT_CLOSED 24
+#define AT_PDP_DEACT 25
+#define AT_POWER_DOWN 26
+#define AT_CALL_READY 27
+
+#define AT_ENTRIES 29 // Of the table
+#define AT_NAME_MAX 24
+#define AT_NO_ENTRY 0xFF
+
+typedef struct {
+	char name[AT_NAME_MAX + 1];
+	uint8_t reply;
+	uint8_t kind;
+} ATReply_t;
+
+class DLATParser
+{
+	public:
+		DLATParser();
+		void begin();
+		uint8_t feed(char c);
+		void reset_line();
+		uint8_t reply();
+		uint8_t kind();
+		int arg();
+		void expect(const char *conf);
+		bool expected();
+	private:
+		uint8_t _pos; // Bytes of the line, up to 255
+		uint8_t _lo, _hi; // Entries agreeing with them
+		uint8_t _entry; // Longest entry the line starts with
+		uint8_t _last; // And of the last line
+		bool _prompt; // Blank after the > to skip
+		int _num;
+		int _arg;
+		uint8_t _want[(AT_ENTRIES + 7) / 8];
+		void narrow(uint8_t c);
+		uint8_t end();
+};
+
+/* URCs an idle thread has to act on, RING and +CMTI, queued as the
+   parser finds them whatever command reads the line. One already queued
+   is not queued again, a RING repeats every few seconds. A full queue
+   drops the new one and counts it. */
+#define URC_QUEUE 8 // Power of two
+
+typedef struct {
+	uint8_t reply;
+	int arg;
+} Urc_t;
+
+class DLURCQueue
+{
+	public:
+		DLURCQueue();
+		bool push(uint8_t reply, int arg);
+		bool pop(Urc_t *urc);
+		uint8_t available();
+		uint16_t get_overflows();
+	private:
+		Urc_t _ring[URC_QUEUE];
+		uint8_t _head, _tail;
+		uint16_t _overflows;
+};
+
+#endif
@@ -96,11 +96,7 @@ PROGMEM const char *gprs_state_table[] = { gprs_state_0, gprs_state_1, gprs_stat
 
 #define DEBUG 1
 
-#ifdef HARDWARE_SERIAL
-#define _gsmserial Serial1
-#else
-SoftwareSerial _gsmserial(GSM_RX, GSM_TX);
-#endif
+#define _gsmserial gsm_uart
 
 SMS_t curr_sms;
 
@@ -163,7 +159,7 @@ DLGSM::DLGSM()
 		_gsm_ci[k] =  0;
 	}
 	_gsm_callback = NULL;
-	_gsm_wline = 0;
+	_pending = AT_NONE;
 	_sendsize = 0;
 	_tout_cnt = 0;
 	_error_cnt = 0;
@@ -171,57 +167,48 @@ DLGSM::DLGSM()
 }
 
 #ifdef USE_PT
+/* A line, whole however its bytes come in, or the > prompt. Blank lines
+   are skipped, a line longer than len is cut. URC lines are processed
+   whatever process says. */
 int DLGSM::PT_recvline(struct pt *pt, char *ret, char *ptr, int len, int tout, char process) {
-	int a = 0, k = 0;
-	char cchar = 0;
+	uint8_t kind = AT_K_NONE;
+	char cchar;
 	static uint32_t ts = 0;
 	PT_BEGIN(pt);
-		ts = millis();
-		gsm_pt_i = 0;
-		*ret = 0;
-		while (gsm_pt_i < len) {
+	ts = millis();
+	gsm_pt_i = 0;
+	*ret = 0;
+	for(;;) {
 		PT_WAIT_UNTIL(pt, _gsmserial.available() > 0 || (millis() - ts) > tout);
+		if (!_gsmserial.available())
+			break;
 		ts = millis();
-		a = _gsmserial.available();
-		if (a > 0) {
-			for(k=0; cchar != '\n' && k<a && gsm_pt_i < len;k++) {
-				cchar = _gsmserial.read();
-				ptr[gsm_pt_i] = cchar;
-				gsm_pt_i++;
-			}
-			if (cchar == '\n') {
-				ptr[gsm_pt_i] = 0;
-				if (gsm_pt_i > 2) {
-					if (_DEBUG) {
-						Serial.print("Line: ");
-						Serial.print(ptr);
-					}
-				
-					if (process)
-						GSM_process_line(NULL);
-					if (_gsm_callback)
-						_gsm_callback(ptr, gsm_pt_i);
-				}
-				*ret = gsm_pt_i;
-				PT_EXIT(pt);
-			}
-			_tout_cnt = 0;
-		} else if (_gsm_wline) {
+		_tout_cnt = 0;
+		while (kind == AT_K_NONE && _gsmserial.available()) {
+			cchar = _gsmserial.read();
+			kind = GSM_feed(cchar);
+			if (gsm_pt_i < len - 1)
+				ptr[gsm_pt_i++] = cchar;
+			if (kind == AT_K_NONE && cchar == '\n')
+				gsm_pt_i = 0; // Blank
+		}
+		if (kind != AT_K_NONE) {
 			ptr[gsm_pt_i] = 0;
 			if (_DEBUG) {
 				Serial.print("Line: ");
 				Serial.print(ptr);
 			}
-
-			if (process)
+			if (process || kind == AT_K_URC)
 				GSM_process_line(NULL);
 			if (_gsm_callback)
 				_gsm_callback(ptr, gsm_pt_i);
 			*ret = gsm_pt_i;
-			_tout_cnt++;
 			PT_EXIT(pt);
 		}
 	}
+	ptr[gsm_pt_i] = 0;
+	_at.reset_line(); // The next reply starts clean
+	_tout_cnt++;
 	PT_END(pt);
 }
 
@@ -233,6 +220,7 @@ int DLGSM::PT_recv(struct pt *pt, char *ret, char *conf, int tout, char process)
 
 	ts = millis();
 	*ret = 0;
+	_at.expect(conf);
 	PT_WAIT_UNTIL(pt, _gsmserial.available() || (millis() - ts) > tout);
 	ts = millis();
 	if (!_gsmserial.available()) {
@@ -240,15 +228,14 @@ int DLGSM::PT_recv(struct pt *pt, char *ret, char *conf, int tout, char process)
 		PT_EXIT(pt);
 	}
 	startts = millis();
-	_gsm_wline = 1;
 	while (_gsmserial.available() || (millis() - startts) < tout) {
 		PT_WAIT_THREAD(pt, PT_recvline(&linerecv_pt, ret, _gsm_buff, _gsm_buffsize, tout, process));
-		if (conf != NULL && strstr(_gsm_buff, conf) != NULL)
+		if (conf != NULL && *ret > 0 && _at.expected()) {
 			*ret = 1;
-		else if (conf != NULL)
+			PT_EXIT(pt);
+		} else if (conf != NULL)
 			*ret = 0;
 	}
-	_gsm_wline = 0;
 	PT_END(pt);
 }
 
@@ -260,8 +247,9 @@ int DLGSM::PT_send_recv(struct pt *pt, char *ret, char *cmd, int tout) {
 
 	*ret = 0;
 	gotsmtg = 0;
-	ts = millis();
 	GSM_send(cmd);
+	PT_WAIT_UNTIL(pt, GSM_send_done());
+	ts = millis();
 	PT_WAIT_UNTIL(pt, _gsmserial.available() || (millis() - ts) > tout);
 	ts = millis();
 
@@ -269,7 +257,6 @@ int DLGSM::PT_send_recv(struct pt *pt, char *ret, char *cmd, int tout) {
 		PT_RESTART(pt);
 	}
 	startts = millis();
-	_gsm_wline = 1;
 	while (_gsmserial.available()  || (millis() - startts) < tout) {
 		PT_WAIT_THREAD(pt, PT_recvline(&linerecv_pt, ret, _gsm_buff, _gsm_buffsize, tout, 1));
 		if (*ret > gotsmtg)
@@ -280,7 +267,6 @@ int DLGSM::PT_send_recv(struct pt *pt, char *ret, char *cmd, int tout) {
 	}
 	if (*ret == 0)
 		*ret = gotsmtg;
-	_gsm_wline = 0;
 	PT_END(pt);
 }
 
@@ -289,8 +275,10 @@ int DLGSM::PT_send_recv_confirm(struct pt *pt, char *ret, char *cmd, char *conf,
 	static struct pt linerecv_pt;
 	PT_BEGIN(pt);
 	*ret = 0;
-	ts = millis();
+	_at.expect(conf);
 	GSM_send(cmd);
+	PT_WAIT_UNTIL(pt, GSM_send_done());
+	ts = millis();
 	PT_WAIT_UNTIL(pt, _gsmserial.available() || (millis() - ts) > tout);
 
 	if (!_gsmserial.available()) {
@@ -299,24 +287,23 @@ int DLGSM::PT_send_recv_confirm(struct pt *pt, char *ret, char *cmd, char *conf,
 	}
 	ts = millis();
 	startts = millis();
-	_gsm_wline = 1;
 	while (_gsmserial.available() || (millis() - startts) < tout) { 
 		PT_WAIT_THREAD(pt, PT_recvline(&linerecv_pt, ret, _gsm_buff, _gsm_buffsize, tout, 1));
 		ts = millis();
 		if (*ret == 0)
 			_tout_cnt++;
-
-		if (conf != NULL && strstr(_gsm_buff, conf) != NULL) {
-			*ret = 1;
-			PT_EXIT(pt);
-		} else if (conf != NULL && (strstr(_gsm_buff, "ERROR") != NULL || strstr(_gsm_buff, "FAIL") != NULL)) {
+		// The parser's class of the line, a URC in between is no answer
+		else if (conf != NULL && _at.kind() == AT_K_FAIL) {
 			*ret = 2;
 			_error_cnt++;
 			PT_EXIT(pt);
-		} else if (conf != NULL)
+		} else if (conf != NULL && _at.expected()) {
+			*ret = 1;
+			PT_EXIT(pt);
+		}
+		if (conf != NULL)
 			*ret = 0;
 	}
-	_gsm_wline = 0;
 	PT_END(pt);
 }
 
@@ -379,39 +366,31 @@ int DLGSM::PT_GPRS_init(struct pt *pt, char *ret) {
 }
 
 int DLGSM::PT_GSM_event_handler(struct pt *pt, char *ret) {
-	char i = 0;
 	static char iret;
 	static struct pt child_pt;
-	static int n = 0;
+	static Urc_t urc;
 	PT_BEGIN(pt);	
 
-	PT_YIELD_UNTIL(pt, _gsmserial.available() > 1);
-
+	*ret = 0;
+	PT_YIELD_UNTIL(pt, _urc.available() || _gsmserial.available() > 1);
 
-// +CMTI: "SM",1	
-	while (_gsmserial.available()) {
+	// The lines in, RING and +CMTI: "SM",1 go to the queue as they come
+	while (_gsmserial.available())
 		PT_WAIT_THREAD(pt, PT_recvline(&child_pt, &iret, _gsm_buff, _gsm_buffsize, 1000, 1));
-		if (iret > 0) {
-			// Call arriving, hang up?
-			if (_gsm_buff[0] == 'R') {
-				sprintf(_gsm_buff, "ATH\r\n");
-				PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, &iret, _gsm_buff, "OK", 5000));
-				*ret = GSM_EVENT_STATUS_REQ;
-				PT_EXIT(pt);
-			} else if (_gsm_buff[0] == '+') {
-				if (_gsm_buff[3] == 'T' && _gsm_buff[4] == 'I') {
-					n = atoi((char *)(_gsm_buff+12));
-					PT_WAIT_THREAD(pt, PT_SMS_read(&child_pt,&iret,n));
-					iret = 0;
-				        PT_WAIT_THREAD(pt, PT_SMS_process(&child_pt, &iret, &curr_sms));
-					PT_WAIT_THREAD(pt, PT_SMS_delete(&child_pt, n));
-					*ret = iret;
-					PT_EXIT(pt);
-				}
-			} else {
-				GSM_process_line(NULL);
-			}
-        	}
+
+	// One at a time, those queued while a command ran as well
+	if (_urc.pop(&urc)) {
+		if (urc.reply == AT_RING) { // Call arriving, hang up
+			sprintf(_gsm_buff, "ATH\r\n");
+			PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, &iret, _gsm_buff, "OK", 5000));
+			*ret = GSM_EVENT_STATUS_REQ;
+		} else if (urc.reply == AT_CMTI) {
+			PT_WAIT_THREAD(pt, PT_SMS_read(&child_pt, &iret, urc.arg));
+			iret = 0;
+			PT_WAIT_THREAD(pt, PT_SMS_process(&child_pt, &iret, &curr_sms));
+			PT_WAIT_THREAD(pt, PT_SMS_delete(&child_pt, urc.arg));
+			*ret = iret;
+		}
 	}
 	PT_END(pt);
 }
@@ -501,7 +480,6 @@ int DLGSM::PT_SMS_send(struct pt *pt, char *ret, char *nr, char *text, int len)
         get_from_flash(&(sms_string_table[1]), _gsm_buff);
 	PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, ret, _gsm_buff, "OK", 3000));
 
-	_gsm_wline = 1;
 	c = 0;
 	while (c != 1) {
                 get_from_flash(&(sms_string_table[2]), _gsm_buff);
@@ -510,7 +488,6 @@ int DLGSM::PT_SMS_send(struct pt *pt, char *ret, char *nr, char *text, int len)
 		PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, ret, _gsm_buff, ">", 3000));
         	c = *ret;
 	}
-	_gsm_wline = 0;
         GSM_send(text, len);
         
 	PT_WAIT_THREAD(pt, PT_SMS_send_end(&child_pt));
@@ -625,6 +602,8 @@ int DLGSM::PT_SMS_process(struct pt *pt, char *ret, SMS_t *sms) {
 		*ret = GSM_EVENT_SYSINFO;
 	} else if (strncmp(sms->message, "UP", 2) == 0) { // Uptime
 		*ret = GSM_EVENT_UPTIME;
+	} else if (strncmp(sms->message, "GR ", 3) == 0) { // Upload a time window
+		*ret = GSM_EVENT_GET_RANGE;
 	}
 	if (_DEBUG) Serial.println(*ret, DEC);
 	PT_END(pt);
@@ -671,12 +650,10 @@ int DLGSM::PT_GPRS_send_start(struct pt *pt, char *ret) {
 	PT_BEGIN(pt);
 
         get_from_flash(&(gsm_string_table[6]), _gsm_buff); // Send AT+CIPSEND? to get 
-        PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, &r, _gsm_buff, "+", 3000));
+        PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, &r, _gsm_buff, "+CIPSEND:", 3000));
                 
 	get_from_flash(&(gsm_string_table[3]), _gsm_buff); // Send AT+CIPSEND
-	_gsm_wline = 1; // Disable new line character expectancy	
-	PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, &r, _gsm_buff, ">", 3000));
-	_gsm_wline = 0; // Enable new line expectancy   
+	PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, &r, _gsm_buff, ">", 3000)); // The prompt comes without a newline
         if (r > 0)        
 		CONN_set_flag(CONN_SENDING, 1);
 	*ret = r; 
@@ -739,7 +716,7 @@ int DLGSM::PT_pwr_on(struct pt *pt) {
 		CONN_set_flag(CONN_PWR, 1);
 	        PT_WAIT_THREAD(pt, PT_recv(&child_pt, &ret, "Call Ready", 15000, 1));
         }
-	_gsmserial.flush();
+	PT_WAIT_UNTIL(pt, GSM_send_done());
 	PT_END(pt);
 }
 
@@ -769,7 +746,7 @@ int DLGSM::PT_pwr_off(struct pt *pt, uint8_t force) {
                 CONN_set_flag(CONN_CONNECTED, 0);
                 PT_WAIT_THREAD(pt, PT_recv(&child_pt, &ret, "DOWN", 15000, 1));
 	}
-	_gsmserial.flush();
+	PT_WAIT_UNTIL(pt, GSM_send_done());
 	PT_END(pt);
 }
 
@@ -781,7 +758,7 @@ int DLGSM::PT_restart(struct pt *pt, char *ret) {
 	PT_BEGIN(pt);
         u = 0;                
 	while (u < 3) {
-		_gsmserial.flush();
+		PT_WAIT_UNTIL(pt, GSM_send_done());
         	PT_WAIT_THREAD(pt, PT_send_recv_confirm(&child_pt, &iret, "AT\r\n", "OK", 1000));
                 if (iret > 0) {
         		PT_WAIT_THREAD(pt, PT_pwr_off(&child_pt, 1));
@@ -948,11 +925,26 @@ uint8_t DLGSM::GSM_init() {
 	return 1;
 }
 
+// Every byte off the modem goes through the reply parser
+uint8_t DLGSM::GSM_feed(char c) {
+	uint8_t kind = _at.feed(c);
+	if (kind != AT_K_NONE) {
+		_pending = _at.reply();
+		if (_pending == AT_RING || _pending == AT_CMTI)
+			_urc.push(_pending, _at.arg());
+	}
+	return kind;
+}
+
+// State kept from the last line the parser found, once for a line
 uint8_t DLGSM::GSM_process_line(char *check) {
 	char i = 0;
-	char l = 0;
 	char *tpos;
-	if (_gsm_buff[0] == '+' && (_gsm_buff[2] == 'G' || _gsm_buff[2] == 'R')) { // +CGREG: 2,1,"ASDA","XCVB"
+	uint8_t reply = _pending;
+	_pending = AT_NONE;
+	switch (reply) {
+	case AT_CREG: // +CGREG: 2,1,"ASDA","XCVB"
+	case AT_CGREG:
 		tpos = strchr(_gsm_buff, ' ');
 		if (tpos == NULL) return 0;
 
@@ -961,7 +953,7 @@ uint8_t DLGSM::GSM_process_line(char *check) {
 		if (tpos && tpos[1] != '"')
 			i = tpos[1] - '0';
 
-		if (_gsm_buff[2] == 'G') {
+		if (reply == AT_CGREG) {
 			if (i == 1)
 				CONN_set_flag(CONN_GPRS_NET, 1);
 			else
@@ -983,32 +975,38 @@ uint8_t DLGSM::GSM_process_line(char *check) {
 			strncpy(_gsm_lac, tpos+1, 4);
 			strncpy(_gsm_ci, tpos+8, 4);
 		}
-
-	} else if (_gsm_buff[0] == '+' && _gsm_buff[4] == 'S') { // +CIPSEND?
-	//} else if (strncmp_P(_gsm_buff, PSTR("+CIPSEND"),8) == 0) { // +CIPSEND?
+		break;
+	case AT_CIPSEND: // +CIPSEND: 1460
 		_sendsize = atoi(_gsm_buff+10);
-	} else if (_gsm_buff[0] == 'C' && _gsm_buff[8] == 'K') { // CLOSE OK
-	//} else if (strncmp_P(_gsm_buff, PSTR("CLOSE OK"),8) == 0) { // CLOSE OK
+		break;
+	case AT_PDP_DEACT:
+		CONN_set_flag(CONN_GPRS_NET, 0);
+		// Fall through
+	case AT_CLOSE_OK:
+	case AT_CLOSED:
 		CONN_set_flag(CONN_CONNECTED, 0);
 		CONN_set_flag(CONN_SENDING, 0);
-	} else if (_gsm_buff[0] == 'C' && _gsm_buff[5] == 'D') { // CLOSED 
-	//} else if (strncmp_P(_gsm_buff, PSTR("CLOSED"),6) == 0) {
-		CONN_set_flag(CONN_CONNECTED, 0);
+		break;
+	case AT_POWER_DOWN:
+		CONN_set_flag(CONN_PWR, 0);
+		CONN_set_flag(CONN_NETWORK, 0);
 		CONN_set_flag(CONN_SENDING, 0);
-	} else if (_gsm_buff[0] == 'S' && _gsm_buff[6] == 'K') { // SEND OK
-	//} else if (strncmp_P(_gsm_buff, PSTR("SEND OK"),7) == 0) {
+		CONN_set_flag(CONN_CONNECTED, 0);
+		break;
+	case AT_SEND_OK:
 		CONN_set_flag(CONN_SENDING, 0);
-	} else if (_gsm_buff[0] == 'C' && _gsm_buff[10] == 'K') { // CONNECT OK
-		//} else if (strncmp_P(_gsm_buff, PSTR("CONNECT OK"),10) == 0) {
-		CONN_set_flag(CONN_CONNECTED, 1);
-	} else if (_gsm_buff[0] == 'A' && _gsm_buff[1] == 'L') { // ALREADY CONNECT
+		break;
+	case AT_CONNECT_OK:
+	case AT_ALREADY_CONNECT:
 		CONN_set_flag(CONN_CONNECTED, 1);
+		break;
 	}
 	if (check != NULL) {
 		if (strstr(_gsm_buff, check) != 0) {
 			return 1;
 		}
 	}
+	return 0;
 }
 
 uint8_t DLGSM::GSM_process(char *check) {
@@ -1083,9 +1081,9 @@ void DLGSM::GSM_send(int v) {
 	PRINTDBG(_DEBUG, v);
 }
 
+// Queued, a protothread waits on GSM_send_done() for it to be sent
 void DLGSM::GSM_send(char *v) {
 	_gsmserial.print(v);
-	_gsmserial.flush();
         PRINTDBG(_DEBUG, v);
 }
 
@@ -1101,11 +1099,21 @@ void DLGSM::GSM_send(float v) {
 
 void DLGSM::GSM_send(char *v, int len) {
         //PRINTDBG(_DEBUG, v);
-	for(uint8_t i = 0; i < len; i++) {
-		_gsmserial.write((uint8_t)v[i]);
-//		if (_DEBUG)
-//			Serial.print((byte)v[i]);
-	}
+	_gsmserial.write((uint8_t *)v, len);
+}
+
+// All sent is out on the line
+bool DLGSM::GSM_send_done() {
+	return _gsmserial.tx_done();
+}
+
+// Received bytes lost since power up: the USART overran or the ring was full
+uint16_t DLGSM::GSM_rx_overruns() {
+	return _gsmserial.rx_overruns();
+}
+
+uint16_t DLGSM::GSM_rx_dropped() {
+	return _gsmserial.rx_dropped();
 }
 
 void DLGSM::GSM_set_timeout(int tout) {
@@ -1128,6 +1136,7 @@ int DLGSM::GSM_recvline_fast(char *ptr, int len) {
 		if (a > 0) {
 			for(k=0; cchar != '\n' && k<a && i < len;k++) {
 				cchar = _gsmserial.read();
+				GSM_feed(cchar);
 				ptr[i] = cchar;
 				i++;
 			}
@@ -1149,10 +1158,12 @@ int DLGSM::GSM_recvline(char *ptr, int len) {
 	int i = 0, a=0, c = 0, tout=0;
 	// Read the first 2 bytes (should be the beginning of a reply)
 	for(i=0;i<2;i++) {
-		if (_gsmserial.available())
+		if (_gsmserial.available()) {
     			curchar[i] = _gsmserial.read();
-		else
+			GSM_feed(curchar[i]);
+		} else {
 			break;
+		}
   	}
   	// Check that we got the top of the reply
   	if (curchar[0] != '\r' && curchar[1] != '\n') {
@@ -1171,6 +1182,7 @@ int DLGSM::GSM_recvline(char *ptr, int len) {
 			tout=100;
 			for(c=0;c<a && curchar[0] != '\n' && i < len;c++){
 				curchar[0] = _gsmserial.read();
+				GSM_feed(curchar[0]);
 				ptr[i] = curchar[0];
 				i++;
 			}
@@ -1183,6 +1195,7 @@ int DLGSM::GSM_recvline(char *ptr, int len) {
 			delay(1);
 		} else {
 			ptr[i] = 0;
+			_at.reset_line();
       			break;
     		}
  	}
@@ -1327,6 +1340,16 @@ void DLGSM::GPRS_send_raw(char *data, int len) {
 	GSM_send(data, len);
 }
 
+/* Transmit ring bytes to fill in place, *len of them, for
+   GPRS_send_commit() to queue. at as DLUart::tx_span(). */
+char *DLGSM::GPRS_send_span(uint16_t *len, uint16_t at) {
+	return (char *)_gsmserial.tx_span(len, at);
+}
+
+void DLGSM::GPRS_send_commit(uint16_t len) {
+	_gsmserial.tx_commit(len);
+}
+
 void DLGSM::GPRS_send(float n) {
 	GSM_send(n);
 }
@@ -1397,22 +1420,26 @@ int8_t DLGSM::GPRS_check_conn_state() {
 }
 
 int8_t DLGSM::GSM_event_handler() {
-	char i = 0;
-	if (!_gsmserial.available()) return 0;
-
-	i = GSM_recvline(_gsm_buff, _gsm_buffsize);
-	if (i > 0) {
+	Urc_t urc;
+	if (_gsmserial.available())
+		GSM_recvline(_gsm_buff, _gsm_buffsize);
+	while (_urc.pop(&urc)) {
 		// Call arriving, hang up?
-		if (_gsm_buff[0] == 'R') {
+		if (urc.reply == AT_RING) {
 			GSM_send("ATH\r\n");			
 			return GSM_EVENT_STATUS_REQ;
 		}
-	} 
+	}
 	return 0;
 }
 
-int8_t DLGSM::available() {
-	return _gsmserial.available();
+// Bytes in, or URCs queued
+int DLGSM::available() {
+	return _gsmserial.available() + _urc.available();
+}
+
+uint16_t DLGSM::GSM_urc_lost() {
+	return _urc.get_overflows();
 }
 
 SMS_t* DLGSM::get_SMS() {
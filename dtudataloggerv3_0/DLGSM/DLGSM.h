@@ -1,17 +1,14 @@
 #ifndef DLGSM_h
 #define DLGSM_h
 
-#define HARDWARE_SERIAL 1
-
 #include <Arduino.h>
 #include <DLCommon.h>
 #include <avr/wdt.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
-#ifndef HARDWARE_SERIAL
-#include <SoftwareSerial.h>
-#endif
+#include "DLUart.h" // The modem is on USART1
 #include <string.h>
+#include "DLATParser.h"
 
 #define WATCHDOG 1
 
@@ -19,8 +16,6 @@
 
 //#define GSM_BAUD 9600
 #define GSM_BAUD 57600
-#define GSM_RX 7
-#define GSM_TX 8
 #undef GSM_SW_FLOW
 
 #define GPRS_CONN_TIMEOUT 10  // Connection timeout for gprs
@@ -54,6 +49,7 @@
 #define GSM_EVENT_UPTIME 7
 #define GSM_EVENT_UPLOAD 8
 #define GSM_EVENT_UPLOAD_FILE 9
+#define GSM_EVENT_GET_RANGE 10
 
 
 typedef struct {
@@ -119,6 +115,9 @@ class DLGSM
 		void GSM_send(unsigned long v);
 		void GSM_send(char *msg);
 		void GSM_send(char *msg, int len);
+		bool GSM_send_done();
+		uint16_t GSM_rx_overruns();
+		uint16_t GSM_rx_dropped();
 		void GSM_set_timeout(int tout);
 		void GSM_Xon();
 		void GSM_Xoff();
@@ -136,6 +135,8 @@ class DLGSM
 		uint8_t GPRS_send_start();
 		void GPRS_send(char *data);
 		void GPRS_send_raw(char *data, int len);
+		char *GPRS_send_span(uint16_t *len, uint16_t at);
+		void GPRS_send_commit(uint16_t len);
 		void GPRS_send(float n);
 		void GPRS_send(unsigned long n);
 		void GPRS_send(int n);
@@ -147,7 +148,8 @@ class DLGSM
 		char* GSM_get_lac();
 		char* GSM_get_ci();
 		int8_t GSM_event_handler();
-		int8_t available();
+		int available();
+		uint16_t GSM_urc_lost();
 		SMS_t* get_SMS();
 	private:
 		FUN_callback _gsm_callback;
@@ -158,13 +160,16 @@ class DLGSM
 		uint8_t _gsm_ret;
 		char _gsm_lac[5];
 		char _gsm_ci[5];
-		char _gsm_wline;
+		DLATParser _at;
+		DLURCQueue _urc;
+		uint8_t _pending; // Reply of a line GSM_process_line() has not seen
 		uint16_t _sendsize;
 		Connection _c;
 		uint8_t _DEBUG;
 		uint32_t _tout_cnt;
 		uint32_t _error_cnt;
 		uint32_t _sms_count;
+		uint8_t GSM_feed(char c);
 };
 
 #endif
@@ -0,0 +1,178 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "DLUart.h"
+
+#define TX_MASK (UART_TX_SIZE - 1)
+#define RX_MASK (UART_RX_SIZE - 1)
+
+static uint8_t tx_buf[UART_TX_SIZE];
+static volatile uint16_t tx_head, tx_tail; // The interrupt moves the tail
+static volatile bool tx_written; // Since begin(), TXC1 means something
+static uint8_t rx_buf[UART_RX_SIZE];
+static volatile uint16_t rx_head, rx_tail; // Free running as well
+static volatile uint16_t rx_overrun, rx_full;
+
+DLUart gsm_uart;
+
+ISR(USART1_RX_vect) {
+	uint16_t h = rx_head;
+	if (UCSR1A & (1 << DOR1))
+		rx_overrun++;
+	uint8_t c = UDR1;
+	if ((uint16_t)(h - rx_tail) < UART_RX_SIZE) {
+		rx_buf[h & RX_MASK] = c;
+		rx_head = h + 1;
+	} else {
+		rx_full++;
+	}
+}
+
+ISR(USART1_UDRE_vect) {
+	uint16_t t = tx_tail;
+	if (t == tx_head) {
+		UCSR1B &= ~(1 << UDRIE1);
+		return;
+	}
+	UDR1 = tx_buf[t & TX_MASK];
+	// TXC1 cleared, it sets again once this byte is out
+	UCSR1A = (UCSR1A & ((1 << U2X1) | (1 << MPCM1))) | (1 << TXC1);
+	tx_tail = t + 1;
+}
+
+// The rate set as the core's begin() sets it, 57600 without U2X
+void DLUart::begin(unsigned long baud) {
+	uint16_t ubrr;
+	if (F_CPU == 16000000UL && baud == 57600) {
+		UCSR1A = 0;
+		ubrr = (F_CPU / 8 / baud - 1) / 2;
+	} else {
+		UCSR1A = 1 << U2X1;
+		ubrr = (F_CPU / 4 / baud - 1) / 2;
+	}
+	UBRR1H = ubrr >> 8;
+	UBRR1L = ubrr;
+	tx_head = tx_tail = 0;
+	tx_written = false;
+	rx_head = rx_tail = 0;
+	UCSR1B = (1 << RXEN1) | (1 << TXEN1) | (1 << RXCIE1);
+}
+
+void DLUart::end() {
+	flush();
+	UCSR1B = 0;
+	rx_tail = rx_head;
+}
+
+int DLUart::available() {
+	uint16_t h;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		h = rx_head;
+	}
+	return h - rx_tail;
+}
+
+int DLUart::peek() {
+	if (!available())
+		return -1;
+	return rx_buf[rx_tail & RX_MASK];
+}
+
+int DLUart::read() {
+	uint8_t c;
+	if (!available())
+		return -1;
+	c = rx_buf[rx_tail & RX_MASK];
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		rx_tail++;
+	}
+	return c;
+}
+
+// Waits until all is sent, the protothreads wait on tx_done() instead
+void DLUart::flush() {
+	while (!tx_done())
+		;
+}
+
+uint16_t DLUart::tx_queued() {
+	uint16_t t;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		t = tx_tail;
+	}
+	return tx_head - t;
+}
+
+uint16_t DLUart::tx_room() {
+	return UART_TX_SIZE - tx_queued();
+}
+
+/* The free bytes after the head up to the end of the ring, *len of them,
+   to fill and tx_commit(). An empty ring starts over at offset at, given
+   the offset of the data in its card block the blocks stay whole in it
+   and the span ends where one does. */
+uint8_t *DLUart::tx_span(uint16_t *len, uint16_t at) {
+	uint16_t room, end;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (tx_head == tx_tail)
+			tx_head = tx_tail = at & TX_MASK;
+		room = UART_TX_SIZE - (tx_head - tx_tail);
+	}
+	end = UART_TX_SIZE - (tx_head & TX_MASK);
+	*len = room < end ? room : end;
+	return tx_buf + (tx_head & TX_MASK);
+}
+
+void DLUart::tx_commit(uint16_t len) {
+	if (len == 0)
+		return;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		tx_head += len;
+	}
+	tx_written = true;
+	UCSR1B |= 1 << UDRIE1;
+}
+
+// The completion flag: nothing queued and the last byte off the line
+bool DLUart::tx_done() {
+	return tx_queued() == 0 && (!tx_written || (UCSR1A & (1 << TXC1)));
+}
+
+uint16_t DLUart::rx_overruns() {
+	uint16_t n;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		n = rx_overrun;
+	}
+	return n;
+}
+
+uint16_t DLUart::rx_dropped() {
+	uint16_t n;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		n = rx_full;
+	}
+	return n;
+}
+
+// Waits for room while the ring is full
+size_t DLUart::write(uint8_t c) {
+	while (tx_room() == 0)
+		;
+	tx_buf[tx_head & TX_MASK] = c;
+	tx_commit(1);
+	return 1;
+}
+
+size_t DLUart::write(const uint8_t *buf, size_t len) {
+	uint16_t n;
+	uint8_t *p;
+	size_t done = 0;
+	while (done < len) {
+		p = tx_span(&n, 0);
+		if (n > len - done)
+			n = len - done;
+		memcpy(p, buf + done, n);
+		tx_commit(n);
+		done += n;
+	}
+	return len;
+}
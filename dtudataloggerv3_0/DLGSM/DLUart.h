@@ -0,0 +1,53 @@
+#ifndef DLUart_h
+#define DLUart_h
+
+#include <Arduino.h>
+#include <Stream.h>
+
+/* USART1 to the modem in place of the core's Serial1, which the Makefile
+   builds without it (NoSerial1.h). The transmit ring takes two card
+   blocks and is filled in place with tx_span() and tx_commit(), DLSD
+   reads straight into it and the UDRE interrupt sends from there. Its
+   indices run free, all UART_TX_SIZE bytes hold data. Nothing here
+   waits but write() on a full ring and flush(): tx_done() says when
+   all is out on the line, for the protothreads to wait on. Received
+   bytes lost are counted, rx_overruns() those the USART had no time to
+   hand over, rx_dropped() those the full ring had no room for. */
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE 1024 // Power of 2, a multiple of 512
+#endif
+#ifndef UART_RX_SIZE
+#define UART_RX_SIZE 256 // Power of 2
+#endif
+
+#if (UART_TX_SIZE & (UART_TX_SIZE - 1)) || UART_TX_SIZE % 512
+#error UART_TX_SIZE is not a power of 2 of whole card blocks
+#endif
+#if UART_RX_SIZE & (UART_RX_SIZE - 1)
+#error UART_RX_SIZE is not a power of 2
+#endif
+
+class DLUart : public Stream
+{
+	public:
+		void begin(unsigned long baud);
+		void end();
+		virtual int available();
+		virtual int peek();
+		virtual int read();
+		virtual void flush();
+		virtual size_t write(uint8_t c);
+		virtual size_t write(const uint8_t *buf, size_t len);
+		using Print::write;
+		uint16_t tx_queued();
+		uint16_t tx_room();
+		uint8_t *tx_span(uint16_t *len, uint16_t at);
+		void tx_commit(uint16_t len);
+		bool tx_done();
+		uint16_t rx_overruns();
+		uint16_t rx_dropped();
+};
+
+extern DLUart gsm_uart;
+
+#endif
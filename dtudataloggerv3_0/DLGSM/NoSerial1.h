@@ -0,0 +1,6 @@
+/* Forced into the core's HardwareSerial.cpp by the Makefile: without
+   these it leaves out Serial1 and the USART1 interrupts DLUart has. */
+#include <avr/io.h>
+#undef USART1_RX_vect
+#undef USART1_UDRE_vect
+#undef UBRR1H
@@ -9,6 +9,12 @@ Pchar header_string_0[] = "Connection: close\r\n";
 PROGMEM const char *header_string_table[] = { header_string_0 };
 
 uint8_t backend_err = 255;
+// Set by HTTP_process_reply(), taken with get_range()/get_config_version()
+static uint32_t range_t0, range_t1; // Time window of a GR reply
+static bool range_pending = false;
+static uint16_t config_version; // Of a CV reply
+static bool config_pending = false;
+static FUN_callback config_cb = NULL; // Gets the CF and CE lines
 
 int HTTP_process_reply(char *line, int len) {
 	long timestamp = 0;
@@ -20,6 +26,17 @@ int HTTP_process_reply(char *line, int len) {
 		}
 	} else if (line[0] == 'E' && line[1] == 'R') { // ERR code
 		backend_err = atoi(line+4);
+	} else if (line[0] == 'G' && line[1] == 'R') { // Upload of a time window
+		char *end;
+		range_t0 = strtoul(line+3, &end, 10);
+		range_t1 = strtoul(end, &end, 10);
+		range_pending = range_t1 >= range_t0 && end > line+3;
+	} else if (line[0] == 'C' && line[1] == 'V') { // Config version on the server
+		config_version = atol(line+3);
+		config_pending = true;
+	} else if (line[0] == 'C' && (line[1] == 'F' || line[1] == 'E')) { // Config delta
+		if (config_cb)
+			config_cb(line, len);
 	}
 }
 
@@ -170,39 +187,67 @@ int DLHTTP::PT_POST_start(struct pt *pt, char *ret, char *url, int cl) {
 	PT_END(pt);
 }
 
-int DLHTTP::PT_POST(struct pt *pt, char *ret, char *data, int len) {
+/* A body of len bytes that src writes straight into the transmit ring:
+   src(p, n) puts up to n bytes at p and returns how many, -1 on an
+   error. at is the offset of the first byte in its card block, src
+   reading a card file gets whole blocks to read without the SdFat
+   cache, or the bytes up to the end of one. Body bytes go out in
+   AT+CIPSEND transfers filled to the window the modem reports, the next
+   starts when one is full. Yields while the ring is too full to take
+   that much, other threads run while it drains. */
+int DLHTTP::PT_POST_stream(struct pt *pt, char *ret, FUN_callback src, uint32_t len, uint16_t at) {
 	static struct pt child_pt;
-	uint32_t sendsize;
+	static uint32_t done;
+	uint16_t n, want;
+	char *p;
+	int k;
 	PT_BEGIN(pt);
 	if (!_gsm->CONN_get_flag(CONN_CONNECTED)) {
 		*ret = 2;
 		PT_EXIT(pt);
 	}
-
-        if (data) {
-			
-                if (_sent == 0) {
-                	PT_WAIT_THREAD(pt, _gsm->PT_GPRS_send_start(&child_pt, ret)); 
+	done = 0;
+	while (done < len) {
+		if (_sent == 0) {
+			PT_WAIT_THREAD(pt, _gsm->PT_GPRS_send_start(&child_pt, ret));
+			_window = _gsm->GPRS_send_get_size();
+			if (*ret != 1 || _window == 0) {
+				*ret = 3;
+				PT_EXIT(pt);
+			}
+		}
+		want = HTTP_STREAM_BLOCK - (at + done) % HTTP_STREAM_BLOCK;
+		if (want > _window - _sent)
+			want = _window - _sent;
+		if (want > len - done)
+			want = len - done;
+		p = _gsm->GPRS_send_span(&n, (at + done) % HTTP_STREAM_BLOCK);
+		if (n < want) {
+			PT_YIELD(pt);
+			continue;
 		}
-                _sent += len;
-		sendsize = _gsm->GPRS_send_get_size();
-		if (sendsize == 0) {
+		if (n > _window - _sent)
+			n = _window - _sent;
+		if (n > len - done)
+			n = len - done;
+		k = src(p, n);
+		if (k <= 0) {
 			*ret = 3;
 			PT_EXIT(pt);
 		}
-
-                if (_sent > sendsize) {
+		_gsm->GPRS_send_commit(k);
+		done += k;
+		_sent += k;
+		if (_sent == _window) {
 			PT_WAIT_THREAD(pt, _gsm->PT_GPRS_send_end(&child_pt, ret));
-                        _sent = len;
-			PT_WAIT_THREAD(pt, _gsm->PT_GPRS_send_start(&child_pt, ret));
-                }
-                Serial.print("Sent: ");
-                Serial.println(_sent, DEC);
-                _gsm->GPRS_send_raw(data, len);
-		*ret = 1;
-        } else {
-		*ret = 0;
+			_sent = 0;
+			if (*ret != 1) {
+				*ret = 3;
+				PT_EXIT(pt);
+			}
+		}
 	}
+	*ret = 1;
 	PT_END(pt);
 }
 
@@ -211,6 +256,7 @@ int DLHTTP::PT_POST_end(struct pt *pt, char *ret) {
 	PT_BEGIN(pt);
 
         PT_WAIT_THREAD(pt, _gsm->PT_GPRS_send_end(&child_pt, ret));
+	_sent = 0;
 
 	_gsm->GSM_set_callback(HTTP_process_reply);
 
@@ -257,6 +303,29 @@ uint8_t DLHTTP::get_err_code() {
 	return (*_backend_err);
 }
 
+// The window of the last GR reply, once
+bool DLHTTP::get_range(uint32_t *t0, uint32_t *t1) {
+	if (!range_pending)
+		return false;
+	range_pending = false;
+	*t0 = range_t0;
+	*t1 = range_t1;
+	return true;
+}
+
+// The version of the last CV reply, once
+bool DLHTTP::get_config_version(uint16_t *v) {
+	if (!config_pending)
+		return false;
+	config_pending = false;
+	*v = config_version;
+	return true;
+}
+
+void DLHTTP::set_config_callback(FUN_callback fun) {
+	config_cb = fun;
+}
+
 void DLHTTP::parse_url(char *url, char **host, char **query_string) {
 	get_from_flash_P(PSTR("http://"), _http_buff);
 	char *httpb = strstr(url, _http_buff);
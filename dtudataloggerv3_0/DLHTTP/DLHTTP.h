@@ -11,6 +11,9 @@
 // This is the delta time that should be different in order to sync with HTTP time
 #define TIME_DELTA 120
 
+// Card block PT_POST_stream() keeps whole in the transmit ring
+#define HTTP_STREAM_BLOCK 512
+
 static struct pt http_child_pt;
 
 class DLHTTP
@@ -25,12 +28,15 @@ class DLHTTP
 		int PT_GET(struct pt *pt, char *ret, char *url);
 		int PT_POST_start(struct pt *pt, char *ret, char *url);
 		int PT_POST_start(struct pt *pt, char *ret, char *url, int cl);
-		int PT_POST(struct pt *pt, char *ret, char *data, int len);
+		int PT_POST_stream(struct pt *pt, char *ret, FUN_callback src, uint32_t len, uint16_t at);
 		int PT_POST_end(struct pt *pt, char *ret);
 #endif		
 		uint8_t backend_start(char *host, uint16_t port);
 		uint8_t backend_end();
 		uint8_t get_err_code();
+		bool get_range(uint32_t *t0, uint32_t *t1);
+		bool get_config_version(uint16_t *v);
+		void set_config_callback(FUN_callback fun);
 		void parse_url(char *url, char **host, char **query_string);
 		uint8_t GET(char *url);
 		uint8_t POST_start(char *url);
@@ -41,7 +47,8 @@ class DLHTTP
 	private:
 		DLGSM *_gsm;
 		char *_http_buff;
-		uint32_t _sent;
+		uint32_t _sent; // Bytes in the open AT+CIPSEND transfer
+		uint16_t _window; // Its size
 		uint8_t _DEBUG;
 		uint8_t *_backend_err;
 };
@@ -0,0 +1,99 @@
+#include "DLADCScan.h"
+
+DLADCScan::DLADCScan()
+{
+	_bank = 0;
+	_mask = 0;
+	_slot = ADC_SCAN_IDLE;
+	_settle = 0;
+	_dropped = 0;
+	clear(_acc[0]);
+	clear(_acc[1]);
+}
+
+void DLADCScan::clear(ADCAcc_t *bank) {
+	for(uint8_t i=0;i<ADC_SCAN_SLOTS;i++) {
+		bank[i].sum = 0;
+		bank[i].sqsum = 0;
+		bank[i].cnt = 0;
+		bank[i].min = 0xffff;
+		bank[i].max = 0;
+	}
+}
+
+// Caller has to make sure the ISR does not run while the mask is updated
+void DLADCScan::set_mask(uint16_t mask) {
+	_mask = mask & ((1 << ADC_SCAN_SLOTS) - 1);
+}
+
+uint16_t DLADCScan::get_mask() {
+	return _mask;
+}
+
+uint8_t DLADCScan::next_slot(uint8_t slot) {
+	for(uint8_t i=0;i<ADC_SCAN_SLOTS;i++) {
+		slot++;
+		if (slot >= ADC_SCAN_SLOTS)
+			slot = 0;
+		if (_mask & (1 << slot))
+			return slot;
+	}
+	return ADC_SCAN_IDLE;
+}
+
+// Returns the first slot to convert, ADC_SCAN_IDLE if nothing is enabled
+uint8_t DLADCScan::start() {
+	_slot = next_slot(ADC_SCAN_SLOTS-1);
+	_settle = ADC_SCAN_BG_SETTLE;
+	return _slot;
+}
+
+// Called from the ISR with the result for the current slot
+uint8_t DLADCScan::convert(uint16_t raw) {
+	ADCAcc_t *a;
+	if (_slot == ADC_SCAN_IDLE)
+		return ADC_SCAN_IDLE;
+
+	if (_slot == ADC_SCAN_BANDGAP && _settle > 0) {
+		_settle--;
+		return _slot;
+	}
+
+	a = &_acc[_bank][_slot];
+	if (a->cnt < ADC_SCAN_MAX_CNT) {
+		a->sum += raw;
+		a->sqsum += (uint32_t)raw * raw;
+		a->cnt++;
+		if (raw < a->min)
+			a->min = raw;
+		if (raw > a->max)
+			a->max = raw;
+	} else {
+		_dropped++;
+	}
+
+	_slot = next_slot(_slot);
+	if (_slot == ADC_SCAN_BANDGAP)
+		_settle = ADC_SCAN_BG_SETTLE;
+	return _slot;
+}
+
+// False once the mask ran empty, start() has to be called again
+bool DLADCScan::running() {
+	return _slot != ADC_SCAN_IDLE;
+}
+
+// Flip banks and return the one the ISR just finished filling.
+// The returned bank stays valid until the next call.
+ADCAcc_t* DLADCScan::harvest() {
+	uint8_t b = _bank;
+	clear(_acc[b ^ 1]); // Consumed by the previous harvest
+	ADC_SCAN_BARRIER();
+	_bank = b ^ 1;
+	ADC_SCAN_BARRIER();
+	return _acc[b];
+}
+
+uint32_t DLADCScan::get_dropped() {
+	return _dropped;
+}
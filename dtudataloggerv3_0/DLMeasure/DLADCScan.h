@@ -0,0 +1,59 @@
+#ifndef DLADCScan_h
+#define DLADCScan_h
+
+#include <stdint.h>
+
+/* Scan slots: the 8 analog inputs followed by the internal bandgap */
+#define ADC_SCAN_CHANNELS 8
+#define ADC_SCAN_BANDGAP ADC_SCAN_CHANNELS
+#define ADC_SCAN_SLOTS (ADC_SCAN_CHANNELS+1)
+#define ADC_SCAN_IDLE 0xff
+
+// Samples a slot may take between two harvests before the squared sum
+// could overflow 32 bits (1023^2 * 4096 < 2^32)
+#define ADC_SCAN_MAX_CNT 4096
+
+// Conversions thrown away after switching to the bandgap so it can settle
+#define ADC_SCAN_BG_SETTLE 1
+
+// Keeps the compiler from moving bank accesses across the bank flip
+#define ADC_SCAN_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+typedef struct {
+	uint32_t sum;
+	uint32_t sqsum;
+	uint16_t cnt;
+	uint16_t min;
+	uint16_t max;
+} ADCAcc_t;
+
+/*
+  Round robin sequencer for the ADC conversion complete interrupt.
+  The ISR hands every result to convert() which accumulates it into the
+  active bank and returns the next slot to start. The measurement thread
+  calls harvest() to flip banks; the ISR never touches the returned bank
+  again until the following harvest(), so no locking is needed.
+*/
+class DLADCScan
+{
+	public:
+		DLADCScan();
+		void set_mask(uint16_t mask);
+		uint16_t get_mask();
+		uint8_t start();
+		uint8_t convert(uint16_t raw);
+		bool running();
+		ADCAcc_t* harvest();
+		uint32_t get_dropped();
+	private:
+		void clear(ADCAcc_t *bank);
+		uint8_t next_slot(uint8_t slot);
+		ADCAcc_t _acc[2][ADC_SCAN_SLOTS];
+		volatile uint8_t _bank;
+		uint16_t _mask;
+		uint8_t _slot;
+		uint8_t _settle;
+		uint32_t _dropped;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "DLEvents.h"
+
+DLEventQueue::DLEventQueue()
+{
+	_head = 0;
+	_tail = 0;
+	_overflows = 0;
+}
+
+// Called from the ISR
+void DLEventQueue::push(uint8_t port, uint8_t level, uint32_t ts) {
+	uint8_t h = _head;
+	uint8_t next = (h + 1) & EVQ_MASK;
+	if (next == _tail) {
+		_overflows++;
+		return;
+	}
+	_ring[h].ts = ts;
+	_ring[h].port = port | (level ? EVQ_LEVEL : 0);
+	EVQ_BARRIER();
+	_head = next;
+}
+
+bool DLEventQueue::pop(Event_t *ev) {
+	uint8_t t = _tail;
+	if (t == _head)
+		return false;
+	*ev = _ring[t];
+	EVQ_BARRIER();
+	_tail = (t + 1) & EVQ_MASK;
+	return true;
+}
+
+uint8_t DLEventQueue::available() {
+	return (_head - _tail) & EVQ_MASK;
+}
+
+// Edges lost to a full queue since boot, read with interrupts off
+uint32_t DLEventQueue::get_overflows() {
+	return _overflows;
+}
+
+/* ms between two edges of a port from the difference of their micros()
+   (us) and of their millis() (ms). micros() wraps every 71.6 min, past
+   that only the millis() difference is right */
+uint32_t event_delta_ms(uint32_t us, uint32_t ms) {
+	if (ms < EVQ_US_SPAN_MS)
+		return us / 1000;
+	return ms;
+}
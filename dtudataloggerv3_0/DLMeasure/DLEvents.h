@@ -0,0 +1,44 @@
+#ifndef DLEvents_h
+#define DLEvents_h
+
+#include <stdint.h>
+
+// Queue entries, power of two
+#define EVQ_SIZE 32
+#define EVQ_MASK (EVQ_SIZE-1)
+#define EVQ_LEVEL 0x80 // Level after the edge, next to the port number
+
+// ms a micros() difference is good for, 2^32 us less millis() jitter
+#define EVQ_US_SPAN_MS 4294000UL
+
+// Keeps the compiler from publishing an index before the entry is written
+#define EVQ_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+typedef struct {
+	uint32_t ts; // micros() of the edge
+	uint8_t port; // Port | EVQ_LEVEL
+} Event_t;
+
+/*
+  Single producer/single consumer ring of IO_EVENT edges.
+  The pin change ISR is the only writer of _head, the event thread the only
+  reader of _tail, both indexes are single bytes so no locking is needed.
+  A full queue drops the new edge and counts it.
+*/
+class DLEventQueue
+{
+	public:
+		DLEventQueue();
+		void push(uint8_t port, uint8_t level, uint32_t ts);
+		bool pop(Event_t *ev);
+		uint8_t available();
+		uint32_t get_overflows();
+	private:
+		Event_t _ring[EVQ_SIZE];
+		volatile uint8_t _head, _tail;
+		volatile uint32_t _overflows;
+};
+
+uint32_t event_delta_ms(uint32_t us, uint32_t ms);
+
+#endif
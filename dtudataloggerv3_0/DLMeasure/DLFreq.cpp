@@ -0,0 +1,79 @@
+#include "DLFreq.h"
+
+DLFreq::DLFreq()
+{
+	_shift = 0;
+	start(0);
+}
+
+void DLFreq::clear() {
+	_acc.pulses = 0;
+	_acc.sum = 0;
+	_acc.sqsum = 0;
+	_acc.cnt = 0;
+	_acc.min = 0xffffffff;
+	_acc.max = 0;
+	_blocks = 0;
+}
+
+// Counter restarted from 0 at timebase t
+void DLFreq::start(uint32_t t) {
+	clear();
+	_start = t;
+	_tcnt = 0;
+	_primed = false;
+}
+
+// Compare match ISR: 2^shift edges since the last one
+void DLFreq::block(uint32_t t) {
+	uint32_t p;
+	_blocks++;
+	if (_primed) {
+		p = ((t - _last) + ((1UL << _shift) >> 1)) >> _shift;
+		_acc.sum += p;
+		_acc.sqsum += (uint64_t)p * p;
+		_acc.cnt++;
+		if (p < _acc.min)
+			_acc.min = p;
+		if (p > _acc.max)
+			_acc.max = p;
+	}
+	_last = t;
+	_primed = true;
+}
+
+/* Called with interrupts off and the counter value tcnt read at timebase t.
+   Returns true when the block size changed, the caller then has to load
+   get_top() into the compare register and zero the counter. */
+bool DLFreq::harvest(FreqAcc_t *out, uint16_t tcnt, uint32_t t) {
+	uint32_t rate, ms;
+	uint8_t shift = _shift;
+
+	*out = _acc;
+	out->pulses = (_blocks << _shift) + tcnt - _tcnt;
+	ms = (t - _start) / (FREQ_T3_HZ / 1000);
+
+	// Edges per second over FREQ_BLOCK_HZ gives the block size
+	if (ms > 0) {
+		rate = ms >= 1000 ? out->pulses / (ms / 1000) : out->pulses * 1000UL / ms;
+		shift = 0;
+		while (shift < FREQ_MAX_SHIFT && (rate >> (shift+1)) >= FREQ_BLOCK_HZ)
+			shift++;
+		// Only go down once the blocks got clearly too slow
+		if (shift < _shift && (rate >> _shift) >= FREQ_BLOCK_HZ / 2)
+			shift = _shift;
+	}
+	if (shift != _shift) {
+		_shift = shift;
+		start(t);
+		return true;
+	}
+	clear();
+	_start = t;
+	_tcnt = tcnt;
+	return false;
+}
+
+uint16_t DLFreq::get_top() {
+	return (1U << _shift) - 1;
+}
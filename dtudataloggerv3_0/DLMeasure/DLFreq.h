@@ -0,0 +1,49 @@
+#ifndef DLFreq_h
+#define DLFreq_h
+
+#include <stdint.h>
+
+// Timebase for the periods, Timer3 at clk/8
+#define FREQ_T3_HZ 2000000UL
+#define FREQ_US (1000000.0 / FREQ_T3_HZ)
+// Compare interrupts per second the divider aims for
+#define FREQ_BLOCK_HZ 8
+#define FREQ_MAX_SHIFT 14
+
+typedef struct {
+	uint32_t pulses; // Edges counted since the last harvest
+	uint32_t sum; // Per pulse periods (in timebase ticks) of the blocks
+	uint64_t sqsum;
+	uint16_t cnt; // Blocks with a period
+	uint32_t min;
+	uint32_t max;
+} FreqAcc_t;
+
+/*
+  Frequency counter on a hardware timer clocked by the input (T1).
+  The timer counts every edge by itself and only interrupts after a block
+  of 2^shift edges, block() then takes the period of the block from the
+  timebase. harvest() adds the partial block from the counter and
+  retunes the block size so the interrupt rate stays near FREQ_BLOCK_HZ
+  whatever the input frequency is.
+*/
+class DLFreq
+{
+	public:
+		DLFreq();
+		void start(uint32_t t);
+		void block(uint32_t t);
+		bool harvest(FreqAcc_t *out, uint16_t tcnt, uint32_t t);
+		uint16_t get_top();
+	private:
+		void clear();
+		FreqAcc_t _acc;
+		uint32_t _blocks;
+		uint32_t _last; // Timebase at the last block
+		uint32_t _start; // Timebase at the last harvest
+		uint16_t _tcnt; // Counter at the last harvest
+		uint8_t _shift;
+		bool _primed;
+};
+
+#endif
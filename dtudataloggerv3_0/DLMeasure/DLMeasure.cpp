@@ -4,18 +4,78 @@
 #define MASK(v,p) (v & (0x1 << p))
 
 volatile char previous_portvals = 0;
-volatile double _vals[NUM_IO] = { 0 };
-volatile double _std_dev[NUM_IO] = { 0 };
-volatile double _mins[NUM_IO] = { 9999.0 };
-volatile double _maxs[NUM_IO] = { 0 };
+AnalogStat _astat[NUM_ANALOG]; // Running sums of the open window
+CounterStat _cstat[NUM_DIGITAL]; // Pulses per read_all()
+Snap_t _res[NUM_IO]; // Results of the last closed window
+uint8_t _digital[NUM_IO] = { 0 };
 volatile uint32_t _cnt_vals[NUM_DIGITAL] = { 0 };
+DLEventQueue events; // Edges of the event ports, filled by the ISR
+uint8_t _ev_vals[NUM_DIGITAL] = { 0 }; // Level after the last logged edge
+uint32_t _ev_last[NUM_DIGITAL] = { 0 }; // micros() of the last logged edge
+uint32_t _ev_last_ms[NUM_DIGITAL] = { 0 }; // And its millis()
 volatile uint8_t _AOD[NUM_IO] = { IO_OFF };
 volatile uint32_t isr_cnt = 0;
-volatile char got_event = 0;
+
+#ifdef ADC_SCAN
+DLADCScan scan;
+uint32_t _bg_sum = 0; // Bandgap conversions from the last harvest
+uint16_t _bg_cnt = 0;
+
+static inline void adc_scan_mux(uint8_t slot) {
+	if (slot == ADC_SCAN_BANDGAP)
+		ADMUX = ADC_SCAN_REF | ADC_BANDGAP_MUX;
+	else
+		ADMUX = ADC_SCAN_REF | (slot & 0x07);
+}
+
+// Conversion complete: hand over the result and chain the next slot
+ISR(ADC_vect) {
+	uint8_t slot = scan.convert(ADC);
+	if (slot != ADC_SCAN_IDLE) {
+		adc_scan_mux(slot);
+		ADCSRA |= _BV(ADSC);
+	}
+}
+#endif
+
+static uint32_t rounded(double v) {
+	if (v <= 0)
+		return 0;
+	return (uint32_t)(v + 0.5);
+}
+
+static uint32_t fixed(double v) {
+	return rounded(v * REC_FIXED);
+}
+
+#ifdef FREQ_TIMER
+DLFreq freq;
+volatile uint16_t _t3_ovf = 0;
+
+// Timer3 extended to 32 bits, interrupts have to be off
+static uint32_t t3_now() {
+	uint16_t lo = TCNT3;
+	uint16_t hi = _t3_ovf;
+	if ((TIFR3 & _BV(TOV3)) && lo < 0x8000) // Overflow not serviced yet
+		hi++;
+	return ((uint32_t)hi << 16) | lo;
+}
+
+ISR(TIMER3_OVF_vect) {
+	_t3_ovf++;
+}
+
+// Timer1 counted a block of edges on T1
+ISR(TIMER1_COMPA_vect) {
+	freq.block(t3_now());
+}
+#endif
 
 ISR(DIGITAL_ISR_VECT) {
 	unsigned char portvals, i;
 	unsigned char changed;
+	uint32_t ts = 0;
+	bool stamped = false;
 	portvals = DIGITAL_PORT;
 	changed = portvals ^ previous_portvals;
 
@@ -23,19 +83,12 @@ ISR(DIGITAL_ISR_VECT) {
 		if (_AOD[DIGITAL_OFFSET+i] == IO_COUNTER && MASK(changed, 7-i) && MASK(portvals, 7-i)) {
                                 _cnt_vals[i]++;
                 }
-		else if (_AOD[DIGITAL_OFFSET+i] == IO_EVENT) { 
-			if (!MASK(previous_portvals, 7-i) && MASK(portvals, 7-i)) { // Rising edge
-				got_event = 1;
-				_vals[DIGITAL_OFFSET+i] = 1;
-				_std_dev[DIGITAL_OFFSET+i] = ((uint32_t)millis() - (uint32_t)_maxs[DIGITAL_OFFSET+i]);
-				_maxs[DIGITAL_OFFSET+i] = (uint32_t)millis();
-			} 
-			else if (MASK(previous_portvals, 7-i) && !MASK(portvals, 7-i)) { // Falling edge
-				got_event = 1;
-				_vals[DIGITAL_OFFSET+i] = 0;
-			 	_std_dev[DIGITAL_OFFSET+i] = ((uint32_t)millis() - (uint32_t)_maxs[DIGITAL_OFFSET+i]);
-				_maxs[DIGITAL_OFFSET+i] = (uint32_t)millis();
+		else if (_AOD[DIGITAL_OFFSET+i] == IO_EVENT && MASK(changed, 7-i)) {
+			if (!stamped) { // One timestamp for all edges of this interrupt
+				ts = micros();
+				stamped = true;
 			}
+			events.push(DIGITAL_OFFSET+i, MASK(portvals, 7-i), ts);
 		}
 	}
 	previous_portvals = portvals;
@@ -48,6 +101,21 @@ DLMeasure::DLMeasure()
 	_measure_time = 60;
 	_int_ptr = NULL;
 	_count_start = 0;
+#ifdef ADC_SCAN
+	_scan_bank = NULL;
+	_scan_ports = 0xffff;
+#endif
+#ifdef FREQ_TIMER
+	_freq_port = -1;
+	_freq_pulses = 0;
+#endif
+	_delay = MEASURE_RATE;
+	_closed = 0;
+	for(uint8_t i=0;i<NUM_IO;i++) {
+		_rate[i] = 0;
+		_window[i] = 0;
+		_wstart[i] = 0;
+	}
 }
 
 void DLMeasure::init() {
@@ -60,12 +128,19 @@ void DLMeasure::init() {
 	// Enable PCINT for digital ports
 	DIGITAL_PCMSK = DIGITAL_PCMSK_VAL; // Only enable the ports in use
 	PCICR |= (1 << DIGITAL_PCIE);
-	_smeasure = 0;
+	reset();
+	scan_update();
 	enable();
 }
 
+// Ports without a window of their own start theirs over when it changes
 void DLMeasure::set_measure_time(uint16_t measure_time) {
+	if (measure_time == _measure_time) return;
 	_measure_time = measure_time;
+	for(uint8_t i=ANALOG_OFFSET;i<NUM_IO;i++) {
+		if (_window[i] == 0)
+			restart_window(i);
+	}
 }
 
 void DLMeasure::enable() {
@@ -91,36 +166,59 @@ uint16_t DLMeasure::read(uint8_t pin){
 		return 0;
 
 	if (_AOD[pin] == IO_ANALOG) {
+#ifdef ADC_SCAN
+		if (_scan_bank == NULL || _scan_bank[pin].cnt == 0)
+			return 0;
+		ADCAcc_t *a = &_scan_bank[pin];
+		ret = a->sum / a->cnt;
+		_astat[pin].merge(a->sum, a->sqsum, a->cnt, a->min, a->max);
+#else
 		ret = analogRead(num2pin_mapping[pin]); //map(analogRead(_inp), 0, 1023, 0, _bandgap);
-		_vals[pin] += (double)ret;
-		_std_dev[pin] += (double)ret * (double)ret;
-		if ((double)ret < _mins[pin])
-			_mins[pin] = (double)ret;
-		if ((double)ret > _maxs[pin])
-			_maxs[pin] = (double)ret;	
+		_astat[pin].add(ret);
+#endif
 	}
 	else if (_AOD[pin] == IO_DIGITAL) {
 		ret = digitalRead(num2pin_mapping[pin]);
-		_vals[pin] = (double)ret;
+		_digital[pin] = ret;
+	}
+#ifdef FREQ_TIMER
+	else if (_AOD[pin] == IO_FREQUENCY) {
+		read_freq(pin);
 	}
+#endif
 	return ret;
 }
 
-uint32_t DLMeasure::read_all(uint8_t itr){
-	uint16_t v = 0;
-	double tmpv = 0.0;
-	if (_smeasure == 0)
-		_smeasure = millis();
+// Latch the pulses counted since the last sample
+void DLMeasure::read_counter(uint8_t pin) {
+	uint32_t c;
+	uint8_t sreg;
+	sreg = SREG;
+	cli();
+	c = _cnt_vals[pin-DIGITAL_OFFSET];
+	_cnt_vals[pin-DIGITAL_OFFSET] = 0;
+	SREG = sreg;
+	_cstat[pin-DIGITAL_OFFSET].add(c);
+}
 
+void DLMeasure::harvest() {
+#ifdef ADC_SCAN
+	_scan_bank = scan.harvest();
+	if (_scan_bank[ADC_SCAN_BANDGAP].cnt > 0) {
+		_bg_sum = _scan_bank[ADC_SCAN_BANDGAP].sum;
+		_bg_cnt = _scan_bank[ADC_SCAN_BANDGAP].cnt;
+	}
+#endif
+}
+
+// Sample every port regardless of its rate
+uint32_t DLMeasure::read_all(uint8_t itr){
+	harvest();
 	for(uint8_t i = ANALOG_OFFSET; i < NUM_IO; i++) {
-		if (_AOD[i] == IO_COUNTER) {
-			tmpv = (double)_cnt_vals[i-DIGITAL_OFFSET];
-			_cnt_vals[i-DIGITAL_OFFSET] = 0;
-			_vals[i] += tmpv;
-			_std_dev[i] += tmpv*tmpv;
-		} else {
+		if (_AOD[i] == IO_COUNTER)
+			read_counter(i);
+		else
 			read(i);
-		}
 	}
 	_sum_cnt++;
 	return _sum_cnt;		 
@@ -130,65 +228,188 @@ uint32_t DLMeasure::read_all() {
 	return read_all(0);
 }
 
+/* One sampling tick: only the ports due on the wheel are read and
+   their windows closed when they run out. Returns the closed ports,
+   which stay pending until time_log_line() */
+uint16_t DLMeasure::read_due() {
+	uint16_t due;
+	harvest();
+	due = _sched.tick();
+	for(uint8_t i = ANALOG_OFFSET; i < NUM_IO; i++) {
+		if (!(due & (1U << i)))
+			continue;
+		if (_AOD[i] == IO_COUNTER)
+			read_counter(i);
+		else
+			read(i);
+		if ((millis() - _wstart[i]) >= window_ms(i))
+			close_window(i);
+	}
+	_sum_cnt++;
+#ifdef ADC_SCAN
+	// Only convert the channels that are read on the next tick
+	_scan_ports = _sched.peek();
+	scan_update();
+#endif
+	return _closed;
+}
+
+uint32_t DLMeasure::window_ms(uint8_t pin) {
+	if (_window[pin] > 0)
+		return _window[pin] * 1000UL;
+	return _measure_time * 1000UL;
+}
+
+// Move the port's statistics into _res and start a new window
+void DLMeasure::close_window(uint8_t pin) {
+	double dtime = (double)(millis() - _wstart[pin]) / 1000.0;
+	if (_AOD[pin] == IO_COUNTER) {
+		CounterStat *c = &_cstat[pin-DIGITAL_OFFSET];
+		_res[pin].val = dtime > 0 ? (double)c->sum() / dtime : 0;
+		_res[pin].std_dev = c->std_dev();
+		_res[pin].min = c->min();
+		_res[pin].max = c->max();
+		c->reset();
+#ifdef FREQ_TIMER
+	} else if (_AOD[pin] == IO_FREQUENCY) {
+		// Pulses in the window and the input period in us
+		_freq_pulses = _cstat[pin-DIGITAL_OFFSET].sum();
+		_res[pin].val = _pstat.mean() * FREQ_US;
+		_res[pin].std_dev = _pstat.std_dev() * FREQ_US;
+		_res[pin].min = _pstat.min() * FREQ_US;
+		_res[pin].max = _pstat.max() * FREQ_US;
+		_cstat[pin-DIGITAL_OFFSET].reset();
+		_pstat.reset();
+#endif
+	} else {
+		if (!snapshot(&_res[pin], pin))
+			memset(&_res[pin], 0, sizeof(Snap_t));
+		if (pin < NUM_ANALOG)
+			_astat[pin].reset();
+	}
+	_wstart[pin] = millis();
+	_closed |= (1U << pin);
+}
+
+/* Start the port's window over, what it sampled so far is dropped. A
+   window of the old mode or length would not fit the statistics, the
+   rate of a counter would come out inflated. */
+void DLMeasure::restart_window(uint8_t pin) {
+	uint8_t sreg;
+	if (pin < NUM_ANALOG)
+		_astat[pin].reset();
+	if (pin >= DIGITAL_OFFSET) {
+		sreg = SREG;
+		cli();
+		_cnt_vals[pin-DIGITAL_OFFSET] = 0;
+		SREG = sreg;
+		_cstat[pin-DIGITAL_OFFSET].reset();
+	}
+#ifdef FREQ_TIMER
+	if (_freq_port == pin)
+		_pstat.reset();
+#endif
+	_wstart[pin] = millis();
+}
+
+// Close the windows of all ports at once
 uint8_t DLMeasure::get_all() {
-	uint8_t rdy = 0;
-	double dtime = ((double)millis() - (double)_smeasure) / 1000.0;
-	
 	for(uint8_t i=ANALOG_OFFSET;i<NUM_IO;i++) {
-			if (_AOD[i] == IO_ANALOG) { // Only process analog
-				_std_dev[i] = (double)(sqrt((_sum_cnt*_std_dev[i]) - (_vals[i]*_vals[i])) / _sum_cnt); // Rolling stddev
-				_vals[i] = (double)(_vals[i] / _sum_cnt); // Mean
-			} else if (_AOD[i] == IO_COUNTER) {
-				Serial.println((_sum_cnt*_std_dev[i]) - (_vals[i]*_vals[i]));
-				Serial.println(sqrt((_sum_cnt*_std_dev[i]) - (_vals[i]*_vals[i])) / _sum_cnt);
-				_std_dev[i] = (double)(sqrt((_sum_cnt*_std_dev[i]) - (_vals[i]*_vals[i])) / _sum_cnt);
-				_vals[i] = (double)(_vals[i] / dtime);
-
-			}		
+		if (_AOD[i] != IO_OFF && _AOD[i] != IO_EVENT)
+			close_window(i);
 	}
-	rdy = 1;
-	_smeasure = 0;	
-	return rdy;
+	return 1;
 }
 
 uint8_t DLMeasure::snapshot(Snap_t *st, int i) {
-	double dtime = ((double)millis() - (double)_smeasure) / 1000.0;
-
 	if (_AOD[i] == IO_OFF) return 0;
 
 	if (_AOD[i] == IO_ANALOG) {
-		st->std_dev = (double)(sqrt((_sum_cnt*_std_dev[i]) - (_vals[i]*_vals[i])) / _sum_cnt);
-		st->val = (double)(_vals[i] / _sum_cnt);
-		st->min = _mins[i];
-		st->max = _maxs[i];
+		AnalogStat *a = &_astat[i];
+		if (a->count() == 0) return 0;
+		st->val = a->mean();
+		st->std_dev = a->std_dev();
+		st->min = a->min();
+		st->max = a->max();
 	} else if (_AOD[i] == IO_COUNTER) {
-		st->std_dev = (double)(sqrt((_sum_cnt*_std_dev[i]) - (_vals[i]*_vals[i])) / _sum_cnt);
-		st->val = (double)(_vals[i] / _sum_cnt);
+		CounterStat *c = &_cstat[i-DIGITAL_OFFSET];
+		if (c->count() == 0) return 0;
+		st->val = c->mean();
+		st->std_dev = c->std_dev();
 		st->min = 0;
 		st->max = 0;
 	} else if (_AOD[i] == IO_DIGITAL) {
-		st->val = (double)(_vals[i]);
+		st->val = _digital[i];
+		st->std_dev = 0;
+		st->min = 0;
+		st->max = 0;
+	} else if (_AOD[i] == IO_EVENT) {
+		st->val = _ev_vals[i-DIGITAL_OFFSET];
 		st->std_dev = 0;
 		st->min = 0;
 		st->max = 0;
 	}
+#ifdef FREQ_TIMER
+	else if (_AOD[i] == IO_FREQUENCY) { // In Hz
+		if (_pstat.count() == 0) return 0;
+		st->val = (double)FREQ_T3_HZ / _pstat.mean();
+		st->std_dev = 0;
+		st->min = (double)FREQ_T3_HZ / _pstat.max();
+		st->max = (double)FREQ_T3_HZ / _pstat.min();
+	}
+#endif
 	return 1;	
 }
 
 void DLMeasure::reset() {
+	for(uint8_t i=ANALOG_OFFSET;i<NUM_ANALOG;i++)
+		_astat[i].reset();
+	for(uint8_t i=0;i<NUM_DIGITAL;i++)
+		_cstat[i].reset();
+	for(uint8_t i=0;i<NUM_IO;i++)
+		_wstart[i] = millis();
+	_sum_cnt = 0;
+}
+
+// Base tick of read_due() in ms, the port rates are rounded to it
+void DLMeasure::set_base_rate(uint16_t delay) {
+	if (delay == 0) return;
+	_delay = delay;
+	schedule();
+}
+
+// Time between samples of a port in ms, 0 samples it every tick
+void DLMeasure::set_port_rate(uint8_t pin, uint16_t rate) {
+	if (pin >= NUM_IO) return;
+	_rate[pin] = rate;
+	schedule();
+}
+
+// Averaging window of a port in seconds, 0 uses the measure time
+void DLMeasure::set_port_window(uint8_t pin, uint16_t window) {
+	if (pin >= NUM_IO || window == _window[pin]) return;
+	_window[pin] = window;
+	restart_window(pin);
+}
+
+// Put the ports on the wheel, events are not sampled
+void DLMeasure::schedule() {
+	uint16_t period;
+	_sched.clear();
 	for(uint8_t i=ANALOG_OFFSET;i<NUM_IO;i++) {
-		if (_AOD[i] == IO_DIGITAL || _AOD[i] == IO_ANALOG) {
-			_vals[i] = 0;
-			_std_dev[i] = 0;
-			_maxs[i] = 0;
-			_mins[i] = 1024;
-		} else if (_AOD[i] == IO_COUNTER) {
-			_std_dev[i] = 0;
-			_vals[i] = 0;
+		period = 0;
+		if (_AOD[i] != IO_OFF && _AOD[i] != IO_EVENT) {
+			period = (_rate[i] + _delay/2) / _delay;
+			if (period == 0)
+				period = 1;
 		}
+		_sched.set(i, period);
 	}
-	_sum_cnt = 0;
-	_smeasure = 0;	
+#ifdef ADC_SCAN
+	// Keep the supply voltage about once a second
+	period = 1000 / _delay;
+	_sched.set(SCHED_BANDGAP, period > 0 ? period : 1);
+#endif
 }
 
 void DLMeasure::set_int_fun(INT_callback fun) {
@@ -196,18 +417,42 @@ void DLMeasure::set_int_fun(INT_callback fun) {
 }
 
 void DLMeasure::set_pin(uint8_t pin, uint8_t doa){
+	uint8_t old = _AOD[pin];
 	if (doa >= MAX_IO_TYPES) return;
+#ifdef FREQ_TIMER
+	if (doa == IO_FREQUENCY) {
+		if (pin < DIGITAL_OFFSET || (_freq_port >= 0 && _freq_port != pin))
+			return; // Only one timer input
+	} else if (_freq_port == pin) {
+		freq_stop();
+		_freq_port = -1;
+	}
+#else
+	if (doa == IO_FREQUENCY)
+		doa = IO_COUNTER;
+#endif
 
 	if (doa != IO_OFF) {
 		digitalWrite(num2pin_mapping[pin], LOW); // Turn off interal pullup
 	}
 	_AOD[pin] = doa;
+	if (doa != old)
+		restart_window(pin);
+#ifdef FREQ_TIMER
+	if (doa == IO_FREQUENCY && _freq_port != pin) {
+		_freq_port = pin;
+		freq_start();
+	}
+#endif
+	schedule();
+	scan_update();
 }
 
 uint8_t DLMeasure::get_pin(uint8_t pin) {
 	return _AOD[pin];
 }
 
+// Emits the windows closed since the last line
 void DLMeasure::time_log_line(char *line) {
 	char tmpbuff[13];
 	uint32_t n = 0;
@@ -223,89 +468,307 @@ void DLMeasure::time_log_line(char *line) {
 	strcat(line, tmpbuff);
 
 	for(uint8_t i=ANALOG_OFFSET;i<NUM_IO;i++) {
-		if (_AOD[i] != IO_OFF)
-			strcat(line, " ");
+		if (!(_closed & (1U << i)))
+			continue;
+		strcat(line, " ");
 
 		if (_AOD[i] == IO_ANALOG) {
 			strcat(line, "a");
 			fmtUnsigned(i, tmpbuff, 10);
 			strcat(line, tmpbuff);
 			strcat(line, ":");
-			fmtDouble((double)_vals[i], 2, tmpbuff, 12);
+			fmtDouble(_res[i].val, 2, tmpbuff, 12);
 			strcat(line, tmpbuff);
 			strcat(line, ":");
-			fmtDouble((double)_std_dev[i], 2, tmpbuff, 12);
+			fmtDouble(_res[i].std_dev, 2, tmpbuff, 12);
 			strcat(line, tmpbuff);
 			strcat(line, ":");
-			fmtDouble((double)_mins[i], 2, tmpbuff, 12);
+			fmtDouble(_res[i].min, 2, tmpbuff, 12);
 			strcat(line, tmpbuff);
 			strcat(line, ":");
-			fmtDouble((double)_maxs[i], 2, tmpbuff, 12);
+			fmtDouble(_res[i].max, 2, tmpbuff, 12);
 			strcat(line, tmpbuff);	
 		} else if (_AOD[i] == IO_DIGITAL) {
 			strcat(line, "d");
 			fmtUnsigned(i, tmpbuff, 10);
 			strcat(line, tmpbuff);
 			strcat(line, ":");
-			fmtUnsigned(_vals[i], tmpbuff, 12);
+			fmtUnsigned(_digital[i], tmpbuff, 12);
 			strcat(line, tmpbuff);
 		} else if (_AOD[i] == IO_COUNTER) {
 			strcat(line, "c");
 			fmtUnsigned(i, tmpbuff, 10);
 			strcat(line, tmpbuff);
 			strcat(line, ":");
-			fmtDouble((double)_vals[i], 2, tmpbuff, 12);
+			fmtDouble(_res[i].val, 2, tmpbuff, 12);
+			strcat(line, tmpbuff);
+			strcat(line, ":");
+			fmtDouble(_res[i].std_dev, 2, tmpbuff, 12);
+			strcat(line, tmpbuff);
+		}
+#ifdef FREQ_TIMER
+		else if (_AOD[i] == IO_FREQUENCY) { // Pulses, period mean/std dev/min/max in us
+			strcat(line, "f");
+			fmtUnsigned(i, tmpbuff, 10);
+			strcat(line, tmpbuff);
+			strcat(line, ":");
+			fmtUnsigned(_freq_pulses, tmpbuff, 12);
+			strcat(line, tmpbuff);
+			strcat(line, ":");
+			fmtUnsigned(rounded(_res[i].val), tmpbuff, 12);
+			strcat(line, tmpbuff);
+			strcat(line, ":");
+			fmtUnsigned(rounded(_res[i].std_dev), tmpbuff, 12);
+			strcat(line, tmpbuff);
+			strcat(line, ":");
+			fmtUnsigned(rounded(_res[i].min), tmpbuff, 12);
 			strcat(line, tmpbuff);
 			strcat(line, ":");
-			fmtDouble((double)_std_dev[i], 2, tmpbuff, 12);
+			fmtUnsigned(rounded(_res[i].max), tmpbuff, 12);
 			strcat(line, tmpbuff);
 		}
+#endif
 	}
 	strcat(line, "\r\n");
+	_closed = 0;
+	_sum_cnt = 0;
+}
+
+/* Takes the oldest edge off the queue. Returns its port and fills in the
+   time in seconds, the ms since the edge before on the same port and the
+   micros() timestamp, or returns -1 when the queue is empty */
+int8_t DLMeasure::next_event(uint32_t *t, uint32_t *delta, uint32_t *ts) {
+	Event_t ev;
+	uint8_t p;
+	uint32_t ago, ms;
+	if (!events.pop(&ev))
+		return -1;
+	p = (ev.port & ~EVQ_LEVEL) - DIGITAL_OFFSET;
+	ago = micros() - ev.ts; // Queued for ms at most, no wrap
+	ms = millis() - ago / 1000;
+	*t = now() - ago / 1000000UL;
+	*delta = event_delta_ms(ev.ts - _ev_last[p], ms - _ev_last_ms[p]);
+	*ts = ev.ts;
+	_ev_last[p] = ev.ts;
+	_ev_last_ms[p] = ms;
+	_ev_vals[p] = (ev.port & EVQ_LEVEL) ? 1 : 0;
+	return p + DIGITAL_OFFSET;
 }
 
-void DLMeasure::event_log_line(char *line) {
-	uint8_t i=0;
+// One line per edge: time, port:level:ms since the last edge:micros()
+uint8_t DLMeasure::event_log_line(char *line) {
+	uint32_t t, delta, ts;
+	int8_t i;
 	char tmpbuff[13];
 	*line = '\0';
+	i = next_event(&t, &delta, &ts);
+	if (i < 0)
+		return 0;
 	strcat(line, "E");
-	fmtUnsigned(now(), tmpbuff, 12);
-	//ltoa(now(), tmpbuff, 16);
+	fmtUnsigned(t, tmpbuff, 12);
 	strcat(line, tmpbuff);
-	strcat(line, " ");
-	for(i=DIGITAL_OFFSET;i<NUM_IO;i++) {
-		if (_AOD[i] == IO_EVENT) {
-			if (i != 0)
-				strcat(line, " ");
-			fmtUnsigned(i, tmpbuff, 10);
-			//itoa(i, tmpbuff, 10);
-			strcat(line, tmpbuff);
-			strcat(line, ":");
-			fmtUnsigned(_vals[i], tmpbuff, 12);
-			//itoa(_vals[i], tmpbuff, 10);
-			strcat(line, tmpbuff);
-			strcat(line, ":");
-			//ltoa((unsigned long)_std_dev[i], tmpbuff,10);
-			fmtUnsigned(_std_dev[i], tmpbuff, 12);
-			strcat(line, tmpbuff);
+	strcat(line, "  ");
+	fmtUnsigned(i, tmpbuff, 10);
+	strcat(line, tmpbuff);
+	strcat(line, ":");
+	fmtUnsigned(_ev_vals[i-DIGITAL_OFFSET], tmpbuff, 12);
+	strcat(line, tmpbuff);
+	strcat(line, ":");
+	fmtUnsigned(delta, tmpbuff, 12);
+	strcat(line, tmpbuff);
+	strcat(line, ":");
+	fmtUnsigned(ts, tmpbuff, 12);
+	strcat(line, tmpbuff);
+	strcat(line, "\r\n");
+	return 1;
+}
+
+/* Binary form of time_log_line(): voltage, N, closed ports, counter and
+   frequency ports among them (from port 8), then per port in order
+   analog: mean (delta), std dev, mean-min, max-mean
+   counter: rate (delta), std dev
+   frequency: pulses, period mean (delta), std dev, mean-min, max-mean in us
+   digital: level
+   Means, rates and std devs are REC_FIXED fixed point, min and max are
+   raw conversions relative to the integer part of the mean */
+uint16_t DLMeasure::time_log_record(uint8_t *buf) {
+	uint16_t counters = 0, freqs = 0;
+	uint32_t m, v;
+	_rec.begin(buf, 0, now());
+	_rec.put(get_supply_voltage());
+	_rec.put(_sum_cnt);
+	_rec.put(_closed);
+	for(uint8_t i=DIGITAL_OFFSET;i<NUM_IO;i++) {
+		if ((_closed & (1U << i)) && _AOD[i] == IO_COUNTER)
+			counters |= (1 << (i-DIGITAL_OFFSET));
+		if ((_closed & (1U << i)) && _AOD[i] == IO_FREQUENCY)
+			freqs |= (1 << (i-DIGITAL_OFFSET));
+	}
+	_rec.put(counters);
+	_rec.put(freqs);
+
+	for(uint8_t i=ANALOG_OFFSET;i<NUM_IO;i++) {
+		if (!(_closed & (1U << i)))
+			continue;
+		if (_AOD[i] == IO_ANALOG) {
+			m = fixed(_res[i].val);
+			_rec.put_delta(i, m);
+			_rec.put(fixed(_res[i].std_dev));
+			m /= REC_FIXED;
+			v = (uint32_t)_res[i].min;
+			_rec.put(m > v ? m - v : 0);
+			v = (uint32_t)_res[i].max;
+			_rec.put(v > m ? v - m : 0);
+		} else if (_AOD[i] == IO_COUNTER) {
+			_rec.put_delta(i, fixed(_res[i].val));
+			_rec.put(fixed(_res[i].std_dev));
+#ifdef FREQ_TIMER
+		} else if (_AOD[i] == IO_FREQUENCY) {
+			_rec.put(_freq_pulses);
+			m = rounded(_res[i].val);
+			_rec.put_delta(i, m);
+			_rec.put(rounded(_res[i].std_dev));
+			v = rounded(_res[i].min);
+			_rec.put(m > v ? m - v : 0);
+			v = rounded(_res[i].max);
+			_rec.put(v > m ? v - m : 0);
+#endif
+		} else {
+			_rec.put(_digital[i]);
 		}
 	}
-	strcat(line, "\r\n");
+	_closed = 0;
+	_sum_cnt = 0;
+	return _rec.end();
+}
+
+/* Binary form of event_log_line(): port mask, level, ms since the last
+   edge and the micros() timestamp (delta). Returns 0 when the queue is empty */
+uint16_t DLMeasure::event_log_record(uint8_t *buf) {
+	uint32_t t, delta, ts;
+	int8_t i = next_event(&t, &delta, &ts);
+	if (i < 0)
+		return 0;
+	_rec.begin(buf, REC_EVENT, t);
+	_rec.put(1U << i);
+	_rec.put(_ev_vals[i-DIGITAL_OFFSET]);
+	_rec.put(delta);
+	_rec.put_delta(i, ts);
+	return _rec.end();
+}
+
+// Next record starts a new file, write the absolute time
+void DLMeasure::record_sync() {
+	_rec.sync();
 }
 
 float DLMeasure::get_voltage(uint8_t pin) {
-	float r = (_vals[pin] / 1023.0) * VREF;
+	float r = (_res[pin].val / 1023.0) * VREF;
 	return r;
 }
 
+#ifdef FREQ_TIMER
+// Pulses since the last sample and the block periods
+void DLMeasure::read_freq(uint8_t pin) {
+	FreqAcc_t a;
+	uint8_t sreg;
+	sreg = SREG;
+	cli();
+	if (freq.harvest(&a, TCNT1, t3_now())) { // New block size
+		OCR1A = freq.get_top();
+		TCNT1 = 0;
+	}
+	SREG = sreg;
+	_cstat[pin-DIGITAL_OFFSET].add(a.pulses);
+	_pstat.merge(a.sum, a.sqsum, a.cnt, a.min, a.max);
+}
+
+// Takes Timer1 and Timer3 over from the core's PWM setup
+void DLMeasure::freq_start() {
+	uint8_t sreg;
+	pinMode(FREQ_PIN, INPUT);
+	// The input is not counted by the PCINT ISR as well
+	DIGITAL_PCMSK &= ~(1 << (7-(_freq_port-DIGITAL_OFFSET)));
+	_cstat[_freq_port-DIGITAL_OFFSET].reset();
+	_pstat.reset();
+	sreg = SREG;
+	cli();
+	TCCR3A = 0;
+	TCCR3B = _BV(CS31); // clk/8
+	TCNT3 = 0;
+	_t3_ovf = 0;
+	TIFR3 = _BV(TOV3);
+	TIMSK3 = _BV(TOIE3);
+	freq.start(0);
+	TCCR1A = 0;
+	TCNT1 = 0;
+	OCR1A = freq.get_top();
+	TIFR1 = _BV(OCF1A);
+	TIMSK1 = _BV(OCIE1A);
+	TCCR1B = _BV(WGM12) | _BV(CS12) | _BV(CS11) | _BV(CS10); // CTC, clocked by rising edges on T1
+	SREG = sreg;
+}
+
+void DLMeasure::freq_stop() {
+	TCCR1B = 0;
+	TIMSK1 = 0;
+	TCCR3B = 0;
+	TIMSK3 = 0;
+	DIGITAL_PCMSK |= (1 << (7-(_freq_port-DIGITAL_OFFSET))) & DIGITAL_PCMSK_VAL;
+}
+#endif
+
+// (Re)program the scan list from the port modes and the ports due next
+void DLMeasure::scan_update() {
+#ifdef ADC_SCAN
+	uint16_t mask = 0;
+	uint8_t slot, sreg;
+	if (_scan_ports & (1U << SCHED_BANDGAP))
+		mask |= (1 << ADC_SCAN_BANDGAP);
+	for(uint8_t i=ANALOG_OFFSET;i<NUM_ANALOG;i++) {
+		if (_AOD[i] == IO_ANALOG && (_scan_ports & (1U << i)))
+			mask |= (1 << i);
+	}
+	sreg = SREG;
+	cli();
+	scan.set_mask(mask);
+	if (!scan.running()) { // Stopped when the mask ran empty
+		slot = scan.start();
+		if (slot != ADC_SCAN_IDLE) {
+			ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); // 125kHz ADC clock
+			adc_scan_mux(slot);
+			ADCSRA |= _BV(ADSC);
+		}
+	}
+	SREG = sreg;
+#endif
+}
+
+// Supply voltage from the bandgap, without blocking when the scanner owns the ADC
+int DLMeasure::get_bandgap() {
+#ifdef ADC_SCAN
+	if (_bg_cnt == 0)
+		return 0;
+	return bandgap_scale(_bg_sum, _bg_cnt);
+#else
+	return ::get_bandgap();
+#endif
+}
+
 void DLMeasure::debug(uint8_t v) {
 	_DEBUG = v;
 }
 
 char DLMeasure::check_event() {
-	return got_event;
+	return events.available() > 0;
 }
 
-void DLMeasure::reset_event() {
-	got_event = 0;
+// Edges dropped because the event thread fell behind
+uint32_t DLMeasure::event_overflows() {
+	uint32_t n;
+	uint8_t sreg = SREG;
+	cli();
+	n = events.get_overflows();
+	SREG = sreg;
+	return n;
 }
@@ -4,6 +4,12 @@
 #include <Arduino.h>
 #include <DLCommon.h>
 #include <Time.h>
+#include <DLADCScan.h>
+#include <DLStats.h>
+#include <DLSchedule.h>
+#include <DLRecord.h>
+#include <DLFreq.h>
+#include <DLEvents.h>
 
 /* IO defines */
 #define NUM_ANALOG 8  // Number of analog ports
@@ -20,19 +26,35 @@
 #define DIGITAL_PCMSK_VAL 0xF8  // pins 23-18
 #define DIGITAL_ISR_VECT PCINT2_vect
 
+/* Interrupt driven ADC scanning instead of blocking analogRead() */
+#define ADC_SCAN 1
+#define ADC_SCAN_REF (1 << REFS0) // AVcc, same as analogRead() DEFAULT
+#define ADC_BANDGAP_MUX 0x1E // 1.1V (VBG)
+
+/* Frequency ports: the input is wired to T1 and counted by Timer1 without
+   interrupts per edge, Timer3 is the timebase for the periods.
+   Without it Frequency ports fall back to PCINT counters */
+#define FREQ_TIMER 1
+#define FREQ_PIN 1 // T1 (PB1)
+
 /* Voltage reference */
 #define VREF 5.0
 #define EXT_PWR_PIN 15 
 
-#define MAX_IO_TYPES 5
+#define MAX_IO_TYPES 6
 /* IO port types */
 #define IO_OFF 0
 #define IO_ANALOG 1
 #define IO_DIGITAL 2
 #define IO_EVENT 3
 #define IO_COUNTER 4
+#define IO_FREQUENCY 5
 
 #define MEASURE_RATE 500
+// Room left in the log buffer before another event line or record is added
+#define EVENT_LINE_MAX 48
+// Wheel entry of the bandgap, after the IO ports
+#define SCHED_BANDGAP (SCHED_PORTS-1)
 #define MEASURE_MULTIPLIER 1
 
 typedef void (*INT_callback)();
@@ -72,9 +94,13 @@ class DLMeasure
 		void pwr_on();
 		void pwr_off();
 		void set_measure_time(uint16_t measure_time);
+		void set_base_rate(uint16_t delay);
+		void set_port_rate(uint8_t pin, uint16_t rate);
+		void set_port_window(uint8_t pin, uint16_t window);
 		uint16_t read(uint8_t pin);
 		uint32_t read_all(uint8_t intr);
 		uint32_t read_all();
+		uint16_t read_due();
 		uint8_t snapshot(Snap_t *st, int i);
 		void reset();
 		uint8_t get_all();
@@ -82,20 +108,50 @@ class DLMeasure
 		void set_pin(uint8_t pin, uint8_t doa);
 		uint8_t get_pin(uint8_t pin);
 		float get_voltage(uint8_t pin);
+		int get_bandgap();
+		void scan_update();
 		void time_log_line(char *line);
-		void event_log_line(char *line);
+		uint8_t event_log_line(char *line);
+		uint16_t time_log_record(uint8_t *buf);
+		uint16_t event_log_record(uint8_t *buf);
+		void record_sync();
 		char check_event();
-		void reset_event();
+		uint32_t event_overflows();
 	private:
 		uint8_t _en, _inp;
 		bool _pullup;
 		uint32_t _sum_cnt; // Number of measurements
 		uint16_t _measure_time; // Measurement length
-		time_t _smeasure; // Measurement start time
+		uint16_t _delay; // Sampling tick in ms
+		uint16_t _rate[NUM_IO]; // Per port sampling interval in ms
+		uint16_t _window[NUM_IO]; // Per port window in seconds
+		uint32_t _wstart[NUM_IO]; // Window start in millis()
+		uint16_t _closed; // Windows waiting for time_log_line()
+		DLSchedule _sched;
+		DLRecord _rec;
 		volatile uint16_t _dvals;
 		uint32_t _count_start;
 		uint8_t _DEBUG;
 		INT_callback _int_ptr;
+		void harvest();
+		void read_counter(uint8_t pin);
+		void schedule();
+		uint32_t window_ms(uint8_t pin);
+		void close_window(uint8_t pin);
+		void restart_window(uint8_t pin);
+		int8_t next_event(uint32_t *t, uint32_t *delta, uint32_t *ts);
+#ifdef ADC_SCAN
+		ADCAcc_t *_scan_bank; // Last harvested bank
+		uint16_t _scan_ports; // Wheel ports converted by the scanner
+#endif
+#ifdef FREQ_TIMER
+		int8_t _freq_port; // Port on the timer input, -1 if none
+		uint32_t _freq_pulses; // Pulses of the last closed window
+		PeriodStat _pstat;
+		void read_freq(uint8_t pin);
+		void freq_start();
+		void freq_stop();
+#endif
 };
 
 #endif
@@ -0,0 +1,148 @@
+#include "DLRecord.h"
+
+DLRecord::DLRecord()
+{
+	_buf = 0;
+	_p = 0;
+	sync();
+}
+
+// The next record carries the absolute time
+void DLRecord::sync() {
+	_last = 0;
+	_abs = true;
+	for(uint8_t i=0;i<REC_PORTS;i++)
+		_prev[i] = 0;
+}
+
+void DLRecord::begin(uint8_t *buf, uint8_t flags, uint32_t ts) {
+	_buf = buf;
+	_p = buf;
+	if (_abs) {
+		for(uint8_t i=0;i<REC_PORTS;i++)
+			_prev[i] = 0;
+		*_p++ = REC_TAG(flags | REC_ABS);
+		put(ts);
+		_abs = false;
+	} else {
+		*_p++ = REC_TAG(flags & ~REC_ABS);
+		put_signed((int32_t)(ts - _last));
+	}
+	_last = ts;
+}
+
+void DLRecord::put(uint32_t v) {
+	while (v >= 0x80) {
+		*_p++ = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	*_p++ = (uint8_t)v;
+}
+
+// Zigzag, small magnitudes of either sign stay short
+void DLRecord::put_signed(int32_t v) {
+	put(((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+// Slow moving values of a port cost a byte or two
+void DLRecord::put_delta(uint8_t port, uint32_t v) {
+	put_signed((int32_t)(v - _prev[port]));
+	_prev[port] = v;
+}
+
+// Length of the record
+uint16_t DLRecord::end() {
+	return _p - _buf;
+}
+
+DLRecordReader::DLRecordReader()
+{
+	_buf = 0;
+	_p = 0;
+	_end = 0;
+	_flags = 0;
+	_version = 0;
+	sync();
+}
+
+void DLRecordReader::sync() {
+	_last = 0;
+	for(uint8_t i=0;i<REC_PORTS;i++)
+		_prev[i] = 0;
+}
+
+/* Starts decoding the record at buf. Returns 1 when the header was read,
+   0 when buf does not hold a complete header and -1 when it is not a
+   record of a known version. Older versions are still read */
+int8_t DLRecordReader::begin(const uint8_t *buf, uint16_t len) {
+	int32_t d;
+	uint32_t ts;
+	_buf = buf;
+	_p = buf;
+	_end = buf + len;
+	if (len == 0)
+		return 0;
+	if (!REC_IS_TAG(*_p) || REC_TAG_VERSION(*_p) == 0 || REC_TAG_VERSION(*_p) > REC_VERSION)
+		return -1;
+	_version = REC_TAG_VERSION(*_p);
+	_flags = *_p++ & 0x03;
+	if (_flags & REC_ABS) {
+		if (!get(&ts))
+			return 0;
+		sync();
+		_last = ts;
+	} else {
+		if (!get_signed(&d))
+			return 0;
+		_last += d;
+	}
+	return 1;
+}
+
+bool DLRecordReader::get(uint32_t *v) {
+	uint32_t r = 0;
+	uint8_t shift = 0;
+	while (_p < _end && shift < 35) {
+		r |= (uint32_t)(*_p & 0x7f) << shift;
+		if (!(*_p++ & 0x80)) {
+			*v = r;
+			return true;
+		}
+		shift += 7;
+	}
+	return false;
+}
+
+bool DLRecordReader::get_signed(int32_t *v) {
+	uint32_t u;
+	if (!get(&u))
+		return false;
+	*v = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+	return true;
+}
+
+bool DLRecordReader::get_delta(uint8_t port, uint32_t *v) {
+	int32_t d;
+	if (!get_signed(&d))
+		return false;
+	_prev[port] += d;
+	*v = _prev[port];
+	return true;
+}
+
+uint8_t DLRecordReader::flags() {
+	return _flags;
+}
+
+uint8_t DLRecordReader::version() {
+	return _version;
+}
+
+uint32_t DLRecordReader::time() {
+	return _last;
+}
+
+// Bytes consumed so far
+uint16_t DLRecordReader::used() {
+	return _p - _buf;
+}
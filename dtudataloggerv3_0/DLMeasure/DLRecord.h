@@ -0,0 +1,77 @@
+#ifndef DLRecord_h
+#define DLRecord_h
+
+#include <stdint.h>
+
+/*
+  Binary log records, an alternative to the text lines of time_log_line()
+  and event_log_line(). Every record starts with a tag byte followed by
+  LEB128 varints:
+
+    tag   0xB0 | version << 2 | REC_ABS | REC_EVENT
+    time  seconds, zigzag delta to the previous record or absolute
+          when REC_ABS is set (first record after boot or file change)
+
+  The fields after the time are written by DLMeasure, see
+  time_log_record() and event_log_record(). put_delta() values are
+  zigzag deltas to the last value of the same port since the last
+  REC_ABS record. Text lines never start with a byte >= 0x80 so both
+  formats can share a file.
+*/
+#define REC_MAGIC 0xB0
+#define REC_MAGIC_MASK 0xF0
+#define REC_VERSION 2 // 2: frequency ports
+#define REC_ABS 0x02
+#define REC_EVENT 0x01
+
+#define REC_TAG(flags) (REC_MAGIC | (REC_VERSION << 2) | (flags))
+#define REC_IS_TAG(c) (((c) & REC_MAGIC_MASK) == REC_MAGIC)
+#define REC_TAG_VERSION(c) (((c) >> 2) & 0x03)
+
+// tag + time + voltage + N + 3 masks + 8 analog * 4 + 6 counters * 2 fields
+#define REC_MAX_LEN 192
+
+// Fixed point scale of the mean/std dev/min/max fields
+#define REC_FIXED 100
+
+#define REC_PORTS 16
+
+class DLRecord
+{
+	public:
+		DLRecord();
+		void sync();
+		void begin(uint8_t *buf, uint8_t flags, uint32_t ts);
+		void put(uint32_t v);
+		void put_signed(int32_t v);
+		void put_delta(uint8_t port, uint32_t v);
+		uint16_t end();
+	private:
+		uint8_t *_buf, *_p;
+		uint32_t _last;
+		uint32_t _prev[REC_PORTS];
+		bool _abs;
+};
+
+class DLRecordReader
+{
+	public:
+		DLRecordReader();
+		void sync();
+		int8_t begin(const uint8_t *buf, uint16_t len);
+		bool get(uint32_t *v);
+		bool get_signed(int32_t *v);
+		bool get_delta(uint8_t port, uint32_t *v);
+		uint8_t flags();
+		uint8_t version();
+		uint32_t time();
+		uint16_t used();
+	private:
+		const uint8_t *_buf, *_p, *_end;
+		uint8_t _flags;
+		uint8_t _version;
+		uint32_t _last;
+		uint32_t _prev[REC_PORTS];
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "DLSchedule.h"
+
+DLSchedule::DLSchedule()
+{
+	clear();
+}
+
+void DLSchedule::clear() {
+	_pos = 0;
+	for(uint8_t i=0;i<SCHED_SLOTS;i++)
+		_wheel[i] = 0;
+	for(uint8_t i=0;i<SCHED_PORTS;i++) {
+		_period[i] = 0;
+		_rounds[i] = 0;
+	}
+}
+
+void DLSchedule::insert(uint8_t port, uint16_t delay) {
+	_wheel[(_pos + delay) & (SCHED_SLOTS-1)] |= (1U << port);
+	_rounds[port] = (delay - 1) / SCHED_SLOTS;
+}
+
+// First due one period from now
+void DLSchedule::set(uint8_t port, uint16_t period) {
+	if (port >= SCHED_PORTS) return;
+	for(uint8_t i=0;i<SCHED_SLOTS;i++)
+		_wheel[i] &= ~(1U << port);
+	_period[port] = period;
+	if (period > 0)
+		insert(port, period);
+}
+
+uint16_t DLSchedule::get(uint8_t port) {
+	return _period[port];
+}
+
+// Advance one tick, returns the ports that are due
+uint16_t DLSchedule::tick() {
+	uint16_t slot, due = 0;
+	_pos = (_pos + 1) & (SCHED_SLOTS-1);
+	slot = _wheel[_pos];
+	for(uint8_t i=0;slot;i++, slot >>= 1) {
+		if (!(slot & 1))
+			continue;
+		if (_rounds[i] > 0) {
+			_rounds[i]--;
+			continue;
+		}
+		due |= (1U << i);
+		_wheel[_pos] &= ~(1U << i);
+		insert(i, _period[i]);
+	}
+	return due;
+}
+
+// Ports due on the next tick
+uint16_t DLSchedule::peek() {
+	uint16_t slot, due = 0;
+	slot = _wheel[(_pos + 1) & (SCHED_SLOTS-1)];
+	for(uint8_t i=0;slot;i++, slot >>= 1) {
+		if ((slot & 1) && _rounds[i] == 0)
+			due |= (1U << i);
+	}
+	return due;
+}
@@ -0,0 +1,33 @@
+#ifndef DLSchedule_h
+#define DLSchedule_h
+
+#include <stdint.h>
+
+// Wheel size in ticks, power of two
+#define SCHED_SLOTS 16
+#define SCHED_PORTS 16
+
+/*
+  Hashed timer wheel for the per port sampling rates.
+  Every port sits in the slot of its next due tick together with the number
+  of full wheel turns left, so a tick only looks at one slot instead of
+  every port. Periods are in sampling ticks, 0 takes the port off the wheel.
+*/
+class DLSchedule
+{
+	public:
+		DLSchedule();
+		void clear();
+		void set(uint8_t port, uint16_t period);
+		uint16_t get(uint8_t port);
+		uint16_t tick();
+		uint16_t peek();
+	private:
+		void insert(uint8_t port, uint16_t delay);
+		uint16_t _wheel[SCHED_SLOTS];
+		uint16_t _period[SCHED_PORTS];
+		uint16_t _rounds[SCHED_PORTS];
+		uint8_t _pos;
+};
+
+#endif
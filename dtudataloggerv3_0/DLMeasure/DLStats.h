@@ -0,0 +1,113 @@
+#ifndef DLStats_h
+#define DLStats_h
+
+#include <stdint.h>
+#include <math.h>
+
+/*
+  Streaming mean/variance on integer samples.
+  Samples are accumulated relative to the first value of the window
+  (shifted data, the integer form of Welford's centering), so the sums stay
+  small and exact. M2 = n*sum(d^2) - sum(d)^2 is only formed when a result
+  is requested, which is the one place floating point is used.
+
+  X: sample type, S: signed sum of deviations, Q: sum of squared deviations
+*/
+template <typename X, typename S, typename Q>
+class DLStat
+{
+	public:
+		DLStat() {
+			reset();
+		}
+
+		void reset() {
+			_n = 0;
+			_k = 0;
+			_sum = 0;
+			_sqsum = 0;
+			_min = (X)~(X)0;
+			_max = 0;
+		}
+
+		void add(X x) {
+			S d;
+			if (_n == 0)
+				_k = x;
+			d = (S)x - (S)_k;
+			_sum += d;
+			_sqsum += (Q)(d * d);
+			_n++;
+			if (x < _min)
+				_min = x;
+			if (x > _max)
+				_max = x;
+		}
+
+		// Merge raw sums of cnt samples (e.g. an ADC scan bank)
+		void merge(uint64_t sum, uint64_t sqsum, uint16_t cnt, X mn, X mx) {
+			int64_t ks;
+			if (cnt == 0)
+				return;
+			if (_n == 0)
+				_k = (X)(sum / cnt);
+			ks = (int64_t)_k * cnt;
+			_sum += (S)((int64_t)sum - ks);
+			_sqsum += (Q)((int64_t)sqsum - 2 * (int64_t)_k * sum + ks * _k);
+			_n += cnt;
+			if (mn < _min)
+				_min = mn;
+			if (mx > _max)
+				_max = mx;
+		}
+
+		uint32_t count() {
+			return _n;
+		}
+
+		int64_t sum() {
+			return (int64_t)_sum + (int64_t)_n * _k;
+		}
+
+		double mean() {
+			if (_n == 0)
+				return 0;
+			return (double)_k + (double)_sum / _n;
+		}
+
+		double std_dev() {
+			Q m2n, a;
+			if (_n == 0)
+				return 0;
+			if (_sqsum > (Q)~(Q)0 / _n) // Very wide spread, give up exactness
+				return sqrt((double)_sqsum / _n - ((double)_sum / _n) * ((double)_sum / _n));
+			a = _sum < 0 ? -(Q)_sum : (Q)_sum; // sum^2 <= n*sqsum fits Q, not always int64
+			m2n = (Q)_n * _sqsum - a * a;
+			return sqrt((double)m2n) / _n;
+		}
+
+		X min() {
+			return _n ? _min : 0;
+		}
+
+		X max() {
+			return _max;
+		}
+
+	private:
+		uint32_t _n;
+		X _k;
+		S _sum;
+		Q _sqsum;
+		X _min, _max;
+};
+
+// 10 bit conversions. 64 bit sums: a scan channel at 9.6k/s passes the
+// 2^21 samples of a 32 bit sum of 1023 steps within a 4 min window
+typedef DLStat<uint16_t, int64_t, uint64_t> AnalogStat;
+// Pulses per sampling tick
+typedef DLStat<uint32_t, int64_t, uint64_t> CounterStat;
+// Timebase ticks per input period
+typedef DLStat<uint32_t, int64_t, uint64_t> PeriodStat;
+
+#endif
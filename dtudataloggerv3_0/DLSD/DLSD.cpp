@@ -20,14 +20,37 @@ PROGMEM const char *sd_filename_table[] = {
 					  };
 
 prog_char sd_filename_ext[] PROGMEM = ".DAT";
+prog_char sd_index_name[] PROGMEM = "FILES.IDX";
+prog_char sd_tidx_ext[] PROGMEM = ".IDX";
 
 DLSD::DLSD(char fullspeed, uint8_t CS)
 {
 	_CS = CS;
 	_inited = 0;
 	_fullspeed = fullspeed;
-	for(uint8_t i = 0; i < NUM_FILES; i++)
+	_DEBUG = 0;
+	_latency = 0;
+	_frames = 0;
+	for(uint8_t i = 0; i < NUM_FILES; i++) {
 		_files_count[i] = 0;
+		_files_open[i] = false;
+	}
+	for(uint8_t i = 0; i < SD_WB_STREAMS; i++) {
+		_wb_len[i] = 0;
+		_wb_room[i] = SD_BLOCK;
+		_wb_error[i] = false;
+		_wb_sent[i] = 0;
+		_ext_size[i] = 0;
+		_ext_first[i] = 0;
+		_tidx_every[i] = 0;
+		_tidx_recs[i] = 0;
+		_tidx_file[i] = 0;
+#ifdef SD_INDEX
+		_idx.count[i] = 0;
+		_idx.entry[i] = SD_ENTRY_NONE;
+#endif
+	}
+	_stream = SD_WB_STREAMS;
 }
 
 int8_t DLSD::init() {
@@ -46,6 +69,15 @@ int8_t DLSD::init() {
 		return -2;
 	}
 */
+	_stream = SD_WB_STREAMS;
+	// Handles of a previous init are stale
+	for(i = 0; i < NUM_FILES; i++) {
+		if (_files_open[i])
+			_files[i].close();
+		_files_open[i] = false;
+	}
+	for(i = 0; i < SD_WB_STREAMS; i++)
+		_dirs[i].close();
 	if (!_card.begin(_CS, _fullspeed)) {
 		_inited = -1;
 		return -1;
@@ -91,13 +123,15 @@ uint16_t DLSD::get_files_count(uint8_t fid) {
 }
 
 uint8_t DLSD::set_files_count(uint8_t fid, uint16_t count) {
+	if (count != _files_count[fid])
+		release(fid);
 	_files_count[fid] = count;
 	return 1;
 }
 
 void DLSD::reset_files_count() {
 	for(uint8_t i = 0; i < NUM_FILES; i++)
-		_files_count[i] = 0;
+		set_files_count(i, 0);
 }
 
 uint16_t DLSD::get_saved_count(uint8_t fid) {
@@ -114,32 +148,29 @@ void DLSD::reset_saved_count() {
 		_saved_count[i] = 0;
 }
 
+// Moves every stream forward to the newest file on the card
 void DLSD::seek_forward_files_count() {
-	int n, cnt, scnt;
-	char path[50];
-	bool exists = true;
-	for(n=FILES_CNT_START;n<=FILES_CNT_END;n++) {
-		exists = false;
-		cnt = _files_count[n];
-		scnt = cnt;
-		do {
-			*(path) = '\0';
-                	get_from_flash(&(sd_dir_table[n]), _filename);
-               		strcat(path, _filename);
-                	strcat(path, "/");
-                	get_from_flash(&(sd_filename_table[n]), _filename);
-                	if (n != 0)
-                        	pad_filename(_filename, _files_count[n]);
-                	strcat_P(_filename, sd_filename_ext);
-                	strcat(path, _filename);
- 	
-			exists = _card.exists(_filename);
-			cnt++;
-		} while (exists);
-		if (cnt > 1)
-			cnt = cnt - 2;
-
-		if (cnt > scnt) {
+	uint8_t n;
+	int32_t cnt;
+	uint16_t entry;
+#ifdef SD_INDEX
+	bool idx = index_load();
+	bool dirty = !idx;
+#endif
+	for(n = SD_WB_FIRST; n < SD_WB_FIRST + SD_WB_STREAMS; n++) {
+#ifdef SD_INDEX
+		if (idx && index_valid(n)) {
+			cnt = _idx.count[n-SD_WB_FIRST];
+		} else {
+			cnt = newest(n, &entry);
+			_idx.count[n-SD_WB_FIRST] = cnt < 0 ? 0 : cnt;
+			_idx.entry[n-SD_WB_FIRST] = cnt < 0 ? SD_ENTRY_NONE : entry;
+			dirty = true;
+		}
+#else
+		cnt = newest(n, &entry);
+#endif
+		if (cnt > _files_count[n]) {
 			Serial.print("Setting #");
 			Serial.print(n, DEC);
 			Serial.print(" to ");
@@ -147,8 +178,116 @@ void DLSD::seek_forward_files_count() {
 			set_files_count(n, cnt);
 		}
 	}
+	if (_files_count[DATALOG] > _files_count[DATALOG_READONLY])
+		set_files_count(DATALOG_READONLY, _files_count[DATALOG]);
+#ifdef SD_INDEX
+	if (dirty)
+		index_save();
+#endif
+}
+
+bool DLSD::open_dir(uint8_t n) {
+	char name[8];
+	uint8_t b = n - SD_WB_FIRST;
+	if (_dirs[b].isOpen())
+		return true;
+	get_from_flash(&(sd_dir_table[n]), name);
+	return _dirs[b].open(SdBaseFile::cwd(), name, O_READ);
+}
+
+// Highest sequence number in the directory of stream n and the index of
+// its entry, -1 if there is none. One pass over the directory.
+int32_t DLSD::newest(uint8_t n, uint16_t *entry) {
+	uint8_t b = n - SD_WB_FIRST, i;
+	int32_t best = -1, v;
+	dir_t d;
+	stop();
+	if (!open_dir(n))
+		return -1;
+	get_from_flash(&(sd_filename_table[n]), _filename);
+	_dirs[b].rewind();
+	while (_dirs[b].readDir(&d) > 0) {
+		if (memcmp(d.name, _filename, 3) || strncmp_P((char *)d.name + 8, sd_filename_ext + 1, 3))
+			continue;
+		v = 0;
+		for(i = 3; i < 8 && d.name[i] >= '0' && d.name[i] <= '9'; i++)
+			v = v * 10 + d.name[i] - '0';
+		if (i < 8 || v <= best)
+			continue;
+		best = v;
+		*entry = _dirs[b].curPosition() / 32 - 1;
+	}
+	return best;
+}
+
+#ifdef SD_INDEX
+uint16_t DLSD::index_check() {
+	uint16_t *p = (uint16_t *)&_idx, c = 0;
+	for(uint8_t i = 0; i < sizeof(SdIndex_t) / 2 - 1; i++)
+		c = (c << 1 | c >> 15) ^ p[i];
+	return ~c;
+}
+
+bool DLSD::index_load() {
+	SdBaseFile f;
+	char name[12];
+	bool ok;
+	strcpy_P(name, sd_index_name);
+	if (!f.open(SdBaseFile::cwd(), name, O_READ))
+		return false;
+	ok = f.read(&_idx, sizeof(SdIndex_t)) == sizeof(SdIndex_t);
+	f.close();
+	return ok && _idx.magic == SD_INDEX_MAGIC && _idx.check == index_check();
+}
+
+void DLSD::index_save() {
+	SdBaseFile f;
+	char name[12];
+	stop();
+	strcpy_P(name, sd_index_name);
+	_idx.magic = SD_INDEX_MAGIC;
+	_idx.check = index_check();
+	if (!f.open(SdBaseFile::cwd(), name, O_RDWR | O_CREAT))
+		return;
+	f.write(&_idx, sizeof(SdIndex_t));
+	f.close();
 }
 
+// The entry the index points at still holds the file it names
+bool DLSD::index_valid(uint8_t n) {
+	uint8_t b = n - SD_WB_FIRST;
+	SdBaseFile f;
+	char name[13];
+	bool ok;
+	if (_idx.entry[b] == SD_ENTRY_NONE || !open_dir(n))
+		return false;
+	if (!f.open(&_dirs[b], _idx.entry[b], O_READ))
+		return false;
+	ok = f.getFilename(name);
+	f.close();
+	file_name(n, _idx.count[b]);
+	return ok && strcmp(name, _filename) == 0;
+}
+
+// After the file of stream n was opened, if it is the newest one. New
+// files are created in the entry that ended the directory search, or the
+// first one of a cluster added to the directory.
+void DLSD::index_update(uint8_t n) {
+	uint8_t b = n - SD_WB_FIRST;
+	if (_files_count[n] < _idx.count[b] ||
+	    (_files_count[n] == _idx.count[b] && _idx.entry[b] != SD_ENTRY_NONE))
+		return;
+	_idx.count[b] = _files_count[n];
+	_idx.entry[b] = _dirs[b].curPosition() / 32 - 1;
+	if (!index_valid(n)) {
+		_idx.entry[b]++;
+		if (!index_valid(n))
+			_idx.entry[b] = SD_ENTRY_NONE;
+	}
+	index_save();
+}
+#endif
+
 int8_t DLSD::is_available() {
 	return _inited;
 }
@@ -164,8 +303,21 @@ void DLSD::pad_filename(char *filename, uint16_t c) {
 }
 
 bool DLSD::increment_file(uint8_t n) {
-	close(n);
+	// Trim the extent to what was written
+	if (n >= SD_WB_FIRST && n < SD_WB_FIRST + SD_WB_STREAMS && _ext_first[n-SD_WB_FIRST]) {
+		if (open(n, O_RDWR) != (unsigned long)-1)
+			ext_end(n);
+	}
+	release(n);
 	_files_count[n] = _files_count[n] + 1;
+#ifdef SD_INDEX
+	// Not known until the file is created
+	if (n >= SD_WB_FIRST && n < SD_WB_FIRST + SD_WB_STREAMS) {
+		_idx.count[n-SD_WB_FIRST] = _files_count[n];
+		_idx.entry[n-SD_WB_FIRST] = SD_ENTRY_NONE;
+		index_save();
+	}
+#endif
 	return true;
 }
 
@@ -173,46 +325,343 @@ void DLSD::debug(int v){
 	_DEBUG = v;
 }
 
+// Name of file c of n in _filename
+void DLSD::file_name(uint8_t n, uint16_t c) {
+	get_from_flash(&(sd_filename_table[n]), _filename);
+	if (n != 0)
+		pad_filename(_filename, c);
+	strcat_P(_filename, sd_filename_ext);		
+}
+
+/* Streams resolve their directory once and keep the file handle across
+   close() until the file is rotated, set_files_count() or init(). A
+   kept handle is always opened for appending so it serves every caller,
+   its size comes from memory. */
 unsigned long DLSD::open(uint8_t n, uint8_t flags) {
 	uint8_t ret;
 	unsigned long fsize = 0;
 	char path[50];
+	uint8_t b = n - SD_WB_FIRST;
+	bool stream = n >= SD_WB_FIRST && n < SD_WB_FIRST + SD_WB_STREAMS;
+	bool ext = stream && _ext_size[b] > 0;
 	digitalWrite(_CS, LOW);
 	if (_files_open[n] == false) {
-		*(path) = '\0';
-		get_from_flash(&(sd_dir_table[n]), _filename);
-		strcat(path, _filename);
-		strcat(path, "/");
-		get_from_flash(&(sd_filename_table[n]), _filename);
-		if (n != 0)
-			pad_filename(_filename, _files_count[n]);
-		strcat_P(_filename, sd_filename_ext);		
-		strcat(path, _filename);
-		if (_DEBUG) {
-			Serial.print("Opening ");
-			Serial.println(path);
+		stop();
+		if (stream) {
+			flags |= O_RDWR | O_APPEND;
+			if (!open_dir(n))
+				return -1;
+			file_name(n, _files_count[n]);
+			if (_DEBUG) {
+				Serial.print("Opening ");
+				Serial.println(_filename);
+			}
+			ret = _files[n].open(&_dirs[b], _filename, flags & ~O_CREAT);
+			if (!ret && (flags & O_CREAT))
+				ret = (ext && ext_create(n, &_dirs[b])) || _files[n].open(&_dirs[b], _filename, flags);
+		} else {
+			*(path) = '\0';
+			get_from_flash(&(sd_dir_table[n]), path);
+			strcat(path, "/");
+			file_name(n, _files_count[n]);
+			strcat(path, _filename);
+			if (_DEBUG) {
+				Serial.print("Opening ");
+				Serial.println(path);
+			}
+			ret = _files[n].open(path, flags);
 		}
-		ret = _files[n].open(path, flags);
 		if (!ret || !_files[n].isOpen())
 			return -1;
+#ifdef SD_INDEX
+		if (stream)
+			index_update(n);
+#endif
 		_files_open[n] = true;
-		fsize = _files[n].fileSize();
+		fsize = ext ? ext_attach(n, flags) : _files[n].fileSize();
+		if (buffered(n) && !_ext_first[n-SD_WB_FIRST])
+			_wb_room[n-SD_WB_FIRST] = SD_BLOCK - (fsize % SD_BLOCK);
+	} else if (ext && _ext_first[n-SD_WB_FIRST]) {
+		fsize = _ext_base[n-SD_WB_FIRST] + _wb_len[n-SD_WB_FIRST];
 	} else {
 		fsize = _files[n].fileSize();
+		if (buffered(n))
+			fsize += _wb_len[n-SD_WB_FIRST];
 	}
 	return fsize;
 }
 
 bool DLSD::close(uint8_t n) {
-	_files[n].sync();
+	if (n >= SD_WB_FIRST && n < SD_WB_FIRST + SD_WB_STREAMS && _files_open[n]) {
+		// Kept open, see open(). Buffered data keeps its latency.
+		digitalWrite(_CS, HIGH);
+		return true;
+	}
+	return release(n);
+}
+
+// Closes the handle, the next open() resolves the file again
+bool DLSD::release(uint8_t n) {
+	if (!_files_open[n])
+		return true;
+	flush(n);
+	stop();
+	_files_open[n] = false;
 	if (!_files[n].close())
 		return false;
-	_files_open[n] = false;
 	digitalWrite(_CS, HIGH);
 	return true;
 }
 
+// Size of the current file of n, from memory while the handle is kept
+unsigned long DLSD::size(uint8_t n) {
+	unsigned long fsize = open(n, O_READ);
+	close(n);
+	return fsize;
+}
+
+bool DLSD::buffered(uint8_t n) {
+	if (n < SD_WB_FIRST || n >= SD_WB_FIRST + SD_WB_STREAMS)
+		return false;
+	return _latency > 0 || _ext_first[n-SD_WB_FIRST] != 0;
+}
+
+// 0 turns write-behind off, pending data is written out first
+void DLSD::set_latency(uint16_t ms) {
+	if (ms == 0)
+		flush();
+	_latency = ms;
+}
+
+// Size of the extent allocated for each new file of stream n, 0 turns it off
+void DLSD::set_extent(uint8_t n, uint32_t size) {
+	if (n >= SD_WB_FIRST && n < SD_WB_FIRST + SD_WB_STREAMS)
+		_ext_size[n-SD_WB_FIRST] = (size + SD_BLOCK - 1) & ~(uint32_t)(SD_BLOCK - 1);
+}
+
+// Ends the multi-block write, every other card access has to come after it
+void DLSD::stop() {
+	if (_stream == SD_WB_STREAMS)
+		return;
+	if (!_card.card()->writeStop())
+		_wb_error[_stream] = true;
+	_stream = SD_WB_STREAMS;
+}
+
+// New file as one contiguous extent, erased so the written length can be found
+bool DLSD::ext_create(uint8_t n, SdBaseFile *dir) {
+	uint8_t b = n - SD_WB_FIRST;
+	uint32_t first, last, i;
+	Sd2Card *c = _card.card();
+	_ext_first[b] = 0;
+	if (!_files[n].createContiguous(dir, _filename, _ext_size[b]))
+		return false;
+	if (!_files[n].contiguousRange(&first, &last))
+		goto plain;
+	last = first + (_ext_size[b] >> 9) - 1;
+	memset(_wb[b], SD_PAD, SD_BLOCK);
+	if (!c->erase(first, last)) {
+		// No single block erase, pad it by hand
+		if (!c->writeStart(first, last - first + 1))
+			goto plain;
+		for(i = first; i <= last; i++)
+			if (!c->writeData(_wb[b]))
+				goto plain;
+		if (!c->writeStop())
+			goto plain;
+	}
+	_ext_first[b] = first;
+	_ext_base[b] = 0;
+	_ext_file[b] = _files_count[n];
+	_wb_len[b] = 0;
+	_wb_sent[b] = 0;
+	return true;
+plain:
+	_files[n].truncate(0);
+	return true;
+}
+
+// Length of an opened file. An extent of this session is picked up again,
+// one left over from before a reboot is trimmed to its written length.
+uint32_t DLSD::ext_attach(uint8_t n, uint8_t flags) {
+	uint8_t b = n - SD_WB_FIRST;
+	uint32_t first, last, len;
+	if (_files[n].fileSize() != _ext_size[b] || !_files[n].contiguousRange(&first, &last)) {
+		_ext_first[b] = 0;
+		return _files[n].fileSize();
+	}
+	if (_ext_first[b] == first && _ext_file[b] == _files_count[n])
+		return _ext_base[b] + _wb_len[b];
+	_ext_first[b] = 0;
+	_wb_len[b] = 0;
+	_wb_sent[b] = 0;
+	len = ext_scan(b, first);
+	if (flags & O_WRITE)
+		_files[n].truncate(len);
+	return len;
+}
+
+static bool erased(uint8_t *p) {
+	for(uint16_t i = 1; i < SD_BLOCK; i++)
+		if (p[i] != p[0])
+			return false;
+	return p[0] == 0 || p[0] == 0xFF;
+}
+
+// Blocks are written in order, so the written ones are a prefix of the
+// extent. The last one is padded with SD_PAD, which neither the text lines
+// nor the last byte of a binary record can be.
+uint32_t DLSD::ext_scan(uint8_t b, uint32_t first) {
+	Sd2Card *c = _card.card();
+	uint32_t lo = 0, hi = _ext_size[b] >> 9, mid;
+	uint16_t len;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (!c->readBlock(first + mid, _wb[b]))
+			return 0;
+		if (erased(_wb[b]))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (lo == 0)
+		return 0;
+	if (!c->readBlock(first + lo - 1, _wb[b]))
+		return 0;
+	for(len = SD_BLOCK; len > 0 && _wb[b][len-1] == SD_PAD; len--)
+		;
+	return ((lo - 1) << 9) + len;
+}
+
+// The block in _wb to its place in the extent. Consecutive full blocks
+// share one multi-block write, pre-erase covers the rest of the extent.
+bool DLSD::ext_write(uint8_t b) {
+	Sd2Card *c = _card.card();
+	uint32_t block = _ext_first[b] + (_ext_base[b] >> 9);
+	if (_wb_len[b] < SD_BLOCK) {
+		stop();
+		return c->writeBlock(block, _wb[b]);
+	}
+	if (_stream != b || _stream_block != block) {
+		stop();
+		if (!c->writeStart(block, (_ext_size[b] - _ext_base[b]) >> 9))
+			return false;
+		_stream = b;
+	}
+	_stream_block = block + 1;
+	if (!c->writeData(_wb[b])) {
+		_stream = SD_WB_STREAMS;
+		return false;
+	}
+	return true;
+}
+
+// Pending data out and the card left to SdFat before a formatted write,
+// an extent is ended so SdFat appends after the data
+void DLSD::settle(uint8_t n) {
+	ext_end(n);
+	flush(n);
+	stop();
+}
+
+// Back to FAT appends: the file is cut to the written length
+void DLSD::ext_end(uint8_t n) {
+	uint8_t b = n - SD_WB_FIRST;
+	uint32_t len;
+	if (n < SD_WB_FIRST || n >= SD_WB_FIRST + SD_WB_STREAMS || !_ext_first[b])
+		return;
+	flush(n);
+	stop();
+	len = _ext_base[b] + _wb_len[b];
+	if (!_files[n].truncate(len) || !_files[n].seekEnd())
+		_wb_error[b] = true;
+	_ext_first[b] = 0;
+	_wb_len[b] = 0;
+	_wb_sent[b] = 0;
+	_wb_room[b] = SD_BLOCK - (len % SD_BLOCK);
+}
+
+// Appends to the block buffer, a full block goes out with one write and
+// sync. more holds back the sync of latency 0 for the rest of a record.
+bool DLSD::put(uint8_t n, const uint8_t *buf, uint16_t len, bool more) {
+	uint8_t b = n - SD_WB_FIRST;
+	uint16_t c, room;
+	bool err;
+	if (!_files_open[n])
+		return true;
+	while (len > 0) {
+		if (_ext_first[b] && _ext_base[b] >= _ext_size[b])
+			ext_end(n); // Extent full
+		room = _ext_first[b] ? SD_BLOCK : _wb_room[b];
+		c = room - _wb_len[b];
+		if (c > len)
+			c = len;
+		if (_wb_len[b] == _wb_sent[b])
+			_wb_time[b] = millis();
+		memcpy(_wb[b] + _wb_len[b], buf, c);
+		_wb_len[b] += c;
+		buf += c;
+		len -= c;
+		if (_wb_len[b] == room)
+			flush(n);
+	}
+	if (_latency == 0 && !more)
+		flush(n);
+	err = _wb_error[b];
+	_wb_error[b] = false;
+	return err;
+}
+
+bool DLSD::flush(uint8_t n) {
+	uint8_t b = n - SD_WB_FIRST;
+	if (n < SD_WB_FIRST || n >= SD_WB_FIRST + SD_WB_STREAMS || _wb_len[b] == _wb_sent[b])
+		return true;
+	if (_ext_first[b]) {
+		if (!ext_write(b))
+			_wb_error[b] = true;
+		_wb_sent[b] = _wb_len[b];
+		if (_wb_len[b] == SD_BLOCK) { // On to the next block
+			_ext_base[b] += SD_BLOCK;
+			_wb_len[b] = 0;
+			_wb_sent[b] = 0;
+			memset(_wb[b], SD_PAD, SD_BLOCK);
+		}
+		return !_wb_error[b];
+	}
+	stop();
+	_files[n].clearWriteError();
+	_files[n].write(_wb[b], _wb_len[b]);
+	_files[n].sync();
+	if (_files[n].writeError)
+		_wb_error[b] = true;
+	_wb_len[b] = 0;
+	_wb_room[b] = SD_BLOCK - (_files[n].fileSize() % SD_BLOCK);
+	return !_wb_error[b];
+}
+
+// Everything buffered, e.g. on a brownout or before a reboot
+bool DLSD::flush() {
+	bool ret = true;
+	for(uint8_t n = SD_WB_FIRST; n < SD_WB_FIRST + SD_WB_STREAMS; n++)
+		if (!flush(n))
+			ret = false;
+	return ret;
+}
+
+// Writes out buffers that waited longer than the latency
+void DLSD::poll() {
+	for(uint8_t b = 0; b < SD_WB_STREAMS; b++) {
+		if (_wb_len[b] > _wb_sent[b] && millis() - _wb_time[b] >= _latency)
+			flush(b + SD_WB_FIRST);
+	}
+}
+
 bool DLSD::write(uint8_t n, char *ptr) {
+	if (_frames & (1 << n))
+		return frame(n, (const uint8_t *)ptr, strlen(ptr));
+	if (buffered(n))
+		return put(n, (const uint8_t *)ptr, strlen(ptr));
+	stop();
 	_files[n].clearWriteError();
 	_files[n].print(ptr);
 	_files[n].sync();
@@ -220,6 +669,7 @@ bool DLSD::write(uint8_t n, char *ptr) {
 }
 		
 bool DLSD::write(uint8_t n, float a) {
+	settle(n);
 	_files[n].clearWriteError();
 	_files[n].print(a);
 	_files[n].sync();
@@ -227,6 +677,7 @@ bool DLSD::write(uint8_t n, float a) {
 }
 
 bool DLSD::write(uint8_t n, unsigned short a) {
+	settle(n);
         _files[n].clearWriteError();
 	_files[n].print(a);
 	_files[n].sync();
@@ -234,6 +685,7 @@ bool DLSD::write(uint8_t n, unsigned short a) {
 }
 
 bool DLSD::write(uint8_t n, int a) {
+	settle(n);
         _files[n].clearWriteError();
 	_files[n].print(a);
 	_files[n].sync();
@@ -241,18 +693,255 @@ bool DLSD::write(uint8_t n, int a) {
 }
 
 bool DLSD::write(uint8_t n, unsigned long a) {
+	settle(n);
         _files[n].clearWriteError();	
 	_files[n].print(a);
 	_files[n].sync();
 	return _files[n].writeError;
 }
 
+// Raw bytes, used for the binary log records
+bool DLSD::write(uint8_t n, uint8_t *buf, uint16_t len) {
+	if (_frames & (1 << n))
+		return frame(n, buf, len);
+	if (buffered(n))
+		return put(n, buf, len);
+	stop();
+	_files[n].clearWriteError();
+	_files[n].write(buf, len);
+	_files[n].sync();
+	return _files[n].writeError;
+}
+
+// Writes of n as framed records, formatted writes stay plain
+void DLSD::set_frames(uint8_t n, bool on) {
+	if (on)
+		_frames |= 1 << n;
+	else
+		_frames &= ~(1 << n);
+}
+
+// Header and record go out with one sync
+bool DLSD::frame(uint8_t n, const uint8_t *buf, uint16_t len) {
+	uint8_t h[SD_FRAME_HDR];
+	uint32_t crc = 0xFFFFFFFFUL;
+	if (len > SD_FRAME_MAX)
+		return true;
+	h[0] = SD_FRAME;
+	h[1] = len;
+	h[2] = len >> 8;
+	crc = crc_update(crc, h[1]);
+	crc = crc_update(crc, h[2]);
+	for(uint16_t i = 0; i < len; i++)
+		crc = crc_update(crc, buf[i]);
+	crc = ~crc;
+	for(uint8_t i = 0; i < 4; i++)
+		h[3+i] = crc >> (8 * i);
+	if (buffered(n))
+		return put(n, h, SD_FRAME_HDR, true) | put(n, buf, len);
+	stop();
+	_files[n].clearWriteError();
+	_files[n].write(h, SD_FRAME_HDR);
+	_files[n].write(buf, len);
+	_files[n].sync();
+	return _files[n].writeError;
+}
+
+// Whether a whole record with a good CRC starts at pos
+bool DLSD::frame_at(uint8_t n, uint32_t pos, uint32_t size, uint16_t *len) {
+	uint8_t h[SD_FRAME_HDR];
+	uint32_t crc = 0xFFFFFFFFUL;
+	int c;
+	if (pos + SD_FRAME_HDR > size || !_files[n].seekSet(pos) ||
+	    _files[n].read(h, SD_FRAME_HDR) != SD_FRAME_HDR || h[0] != SD_FRAME)
+		return false;
+	*len = h[1] | (h[2] << 8);
+	if (*len > SD_FRAME_MAX || pos + SD_FRAME_HDR + *len > size)
+		return false;
+	crc = crc_update(crc, h[1]);
+	crc = crc_update(crc, h[2]);
+	for(uint16_t i = 0; i < *len; i++) {
+		if ((c = _files[n].read()) < 0)
+			return false;
+		crc = crc_update(crc, c);
+	}
+	crc = ~crc;
+	return h[3] == (uint8_t)crc && h[4] == (uint8_t)(crc >> 8) &&
+	       h[5] == (uint8_t)(crc >> 16) && h[6] == (uint8_t)(crc >> 24);
+}
+
+/* Boot repair of the current file of stream n: the last cluster, at
+   least two records long, is read block by block, records are followed
+   from the first good one and the file is cut after the last one. Returns the bytes cut, -1 on a card
+   error. A file without a good record in that cluster is left alone. */
+long DLSD::repair(uint8_t n) {
+	uint8_t b = n - SD_WB_FIRST;
+	uint32_t size, start, end = 0, next, blk, pos, window;
+	uint16_t len;
+	int r;
+	if (!(_frames & (1 << n)) || n < SD_WB_FIRST || n >= SD_WB_FIRST + SD_WB_STREAMS)
+		return 0;
+	size = open(n, O_RDWR);
+	if (size == (uint32_t)-1)
+		return 0;
+	settle(n);
+	size = _files[n].fileSize();
+	window = (uint32_t)_card.vol()->blocksPerCluster() * SD_BLOCK;
+	if (window < 2 * (SD_FRAME_HDR + SD_FRAME_MAX))
+		window = 2 * (SD_FRAME_HDR + SD_FRAME_MAX);
+	start = size > window ? (size - window) & ~(uint32_t)(SD_BLOCK - 1) : 0;
+	next = start;
+	for(blk = start; blk < size; blk += r) {
+		if (!_files[n].seekSet(blk))
+			return -1;
+		r = _files[n].read(_wb[b], size - blk < SD_BLOCK ? size - blk : SD_BLOCK);
+		if (r <= 0)
+			return -1;
+		for(uint16_t i = 0; i < r; i++) {
+			pos = blk + i;
+			if (pos < next || _wb[b][i] != SD_FRAME || !frame_at(n, pos, size, &len))
+				continue;
+			next = pos + SD_FRAME_HDR + len;
+			end = next;
+		}
+	}
+	_wb_len[b] = 0;
+	_wb_sent[b] = 0;
+	if (end == 0 || end == size) {
+		_files[n].seekEnd();
+		return 0;
+	}
+	if (!_files[n].truncate(end))
+		return -1;
+	_files[n].seekEnd();
+	_wb_room[b] = SD_BLOCK - (end % SD_BLOCK);
+	return size - end;
+}
+
+// Every records of n get a time index entry, 0 for none
+void DLSD::set_time_index(uint8_t n, uint8_t every) {
+	if (n >= SD_WB_FIRST && n < SD_WB_FIRST + SD_WB_STREAMS)
+		_tidx_every[n-SD_WB_FIRST] = every;
+}
+
+// Side index of the current file of n
+bool DLSD::tidx_open(uint8_t n, SdBaseFile *f, uint8_t flags) {
+	char path[24];
+	get_from_flash(&(sd_dir_table[n]), path);
+	strcat(path, "/");
+	file_name(n, _files_count[n]);
+	strcpy_P(_filename + 8, sd_tidx_ext);
+	strcat(path, _filename);
+	stop();
+	return f->open(path, flags);
+}
+
+bool DLSD::tidx_entry(SdBaseFile *f, uint32_t i, SdTimeEntry_t *e) {
+	return f->seekSet(i * sizeof(SdTimeEntry_t)) && f->read(e, sizeof(SdTimeEntry_t)) == sizeof(SdTimeEntry_t);
+}
+
+// First of cnt entries later than t, cnt if there is none
+uint32_t DLSD::tidx_find(SdBaseFile *f, uint32_t cnt, uint32_t t) {
+	uint32_t lo = 0, hi = cnt, mid;
+	SdTimeEntry_t e;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (!tidx_entry(f, mid, &e))
+			return cnt;
+		if (e.t > t)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+/* Called with the time of a record before it is written to stream n.
+   Every _tidx_every-th record of a file, counted from its first or from
+   a boot, goes into the side index with the offset it starts at. */
+void DLSD::stamp(uint8_t n, uint32_t t) {
+	uint8_t b = n - SD_WB_FIRST;
+	SdBaseFile f;
+	SdTimeEntry_t e;
+	if (n < SD_WB_FIRST || n >= SD_WB_FIRST + SD_WB_STREAMS || !_tidx_every[b])
+		return;
+	if (_tidx_file[b] != _files_count[n]) {
+		_tidx_file[b] = _files_count[n];
+		_tidx_recs[b] = 0;
+	}
+	if (_tidx_recs[b]++ > 0) {
+		if (_tidx_recs[b] >= _tidx_every[b])
+			_tidx_recs[b] = 0;
+		return;
+	}
+	e.t = t;
+	e.pos = size(n);
+	if (e.pos == (uint32_t)-1 || !tidx_open(n, &f, O_WRITE | O_CREAT | O_APPEND))
+		return;
+	f.write(&e, sizeof(e));
+	f.close();
+}
+
+// Bytes of the open file of n on the card. DATALOG_READONLY on the file
+// DATALOG writes gets what DATALOG wrote, flushed, not its extent.
+uint32_t DLSD::written(uint8_t n) {
+	if (n == DATALOG_READONLY && _files_open[DATALOG] && _files_count[n] == _files_count[DATALOG]) {
+		flush(DATALOG);
+		return size(DATALOG);
+	}
+	return _files[n].fileSize();
+}
+
+/* Finds records from t0 to t1 in the open file of n with its side index
+   and seeks there. Returns the bytes from there to the end of the window,
+   0 when the file starts after t1, -1 without an index. *from is where
+   the window starts, *first the time of the first entry: older files may
+   only hold part of the window when it is later than t0. The window runs
+   from the last entry not later than t0, or the start of the file, to
+   the first entry later than t1, or the end of the file. */
+long DLSD::read_range(uint8_t n, uint32_t t0, uint32_t t1, uint32_t *from, uint32_t *first) {
+	SdBaseFile f;
+	SdTimeEntry_t e;
+	uint32_t cnt, i, start = 0, end;
+	if (!_files_open[n])
+		return -1;
+	end = written(n);
+	if (!tidx_open(n, &f, O_READ))
+		return -1;
+	cnt = f.fileSize() / sizeof(e);
+	if (cnt == 0 || !tidx_entry(&f, 0, &e)) {
+		f.close();
+		return -1;
+	}
+	*first = e.t;
+	if (e.t > t1) {
+		f.close();
+		*from = 0;
+		return 0;
+	}
+	i = tidx_find(&f, cnt, t0);
+	if (i > 0 && tidx_entry(&f, i - 1, &e))
+		start = e.pos;
+	i = tidx_find(&f, cnt, t1);
+	if (i < cnt && tidx_entry(&f, i, &e) && e.pos < end)
+		end = e.pos;
+	f.close();
+	if (start > end)
+		start = end;
+	*from = start;
+	if (!_files[n].seekSet(start))
+		return -1;
+	return end - start;
+}
+
 int DLSD::read(uint8_t n, char *ptr, int len) {
+	stop();
 	return _files[n].read(ptr, len);
 }
 
 int DLSD::read(uint8_t n, char *ptr, int len, char t) {
 	int c = 0;
+	stop();
 	while (c < len) {
 		ptr[c] = _files[n].read();
 		if (ptr[c] < 0 || ptr[c] == t) {
@@ -272,18 +961,25 @@ int DLSD::read(uint8_t n, char *ptr, int len, char t) {
 }
 
 void DLSD::rewind(uint8_t n) {
+	flush(n);
+	stop();
 	_files[n].rewind();
 }
 
 bool DLSD::seek(uint8_t n, uint32_t pos) {
-	_files[n].seekSet(pos);
+	flush(n);
+	stop();
+	return _files[n].seekSet(pos);
 }
                 
 bool DLSD::seekend(uint8_t n) {
-	_files[n].seekEnd();
+	flush(n);
+	stop();
+	return _files[n].seekEnd();
 }
 
 bool DLSD::exists(char *fname) {
+	stop();
 	return _card.exists(fname);	
 }
 
@@ -296,6 +992,7 @@ uint8_t DLSD::copy(char *src, char *dst) {
   char buf[512];
   SdFile file1, file2;
   
+  stop();
   if (!file1.open(src, O_READ)) {
     error();
   }
@@ -319,3 +1016,33 @@ uint8_t DLSD::copy(char *src, char *dst) {
   file2.close();
   return 1;
 }
+
+// Up to len bytes from the start of a file of the root, -1 if there is
+// none
+int DLSD::read_file(const char *name, char *buf, int len) {
+	SdBaseFile f;
+	int n;
+	if (_inited != 1)
+		return -1;
+	stop();
+	if (!f.open(SdBaseFile::cwd(), name, O_READ))
+		return -1;
+	n = f.read(buf, len);
+	f.close();
+	return n;
+}
+
+// A file of the root holding len bytes of buf and nothing else
+bool DLSD::write_file(const char *name, const char *buf, int len) {
+	SdBaseFile f;
+	if (_inited != 1)
+		return false;
+	stop();
+	if (!f.open(SdBaseFile::cwd(), name, O_WRITE | O_CREAT | O_TRUNC))
+		return false;
+	if (f.write(buf, len) != len) {
+		f.close();
+		return false;
+	}
+	return f.close();
+}
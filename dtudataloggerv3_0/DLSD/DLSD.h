@@ -18,6 +18,58 @@
 #define FILES_CNT_START 1
 #define FILES_CNT_END 4
 
+/* Write-behind: DATALOG, SYSLOG and SERIALLOG collect writes in a block
+   buffer that goes to the card when it fills up to the next block
+   boundary of the file, when the oldest byte is older than the latency
+   set with set_latency() (checked by poll()), or on flush()/close() */
+#define SD_BLOCK 512
+#define SD_WB_FIRST DATALOG
+#define SD_WB_STREAMS 3
+
+/* Extents: with set_extent() every new file of a stream is created as one
+   contiguous, pre-erased run of blocks. Blocks go straight to the card,
+   full ones through a multi-block write that stays open until some other
+   card access, partial ones padded with SD_PAD. The directory entry keeps
+   the extent size until the file is rotated, or until the next boot finds
+   the written length, and the file is truncated to it */
+#define SD_PAD 0xFF
+
+/* Index of the newest file of every stream in the root directory, written
+   on rotation. At boot a count is taken from it when the directory entry
+   it points at still holds that file, otherwise the directory is scanned
+   once. Comment out to always scan. */
+#define SD_INDEX
+#define SD_INDEX_MAGIC 0x4958
+#define SD_ENTRY_NONE 0xFFFF
+
+/* Frames: with set_frames() every write() of a stream is one record after
+   SD_FRAME, its length and the CRC32 of length and record. repair() cuts
+   a record torn by a reset off the end of the current file, looking at
+   its last cluster only. */
+#define SD_FRAME 0xA5
+#define SD_FRAME_HDR 7
+#define SD_FRAME_MAX 1024
+
+/* Time index: with set_time_index() the time of every SD_TIDX_EVERY-th
+   record a stream is stamped with goes into a side file next to the log
+   file, DAT00012.IDX for DAT00012.DAT, with the offset the record starts
+   at. read_range() finds a time window of a file in it by binary search,
+   widened to the entries around it. Times are taken as rising within a
+   file. */
+#define SD_TIDX_EVERY 16
+
+typedef struct {
+	uint32_t t;
+	uint32_t pos;
+} SdTimeEntry_t;
+
+typedef struct {
+	uint16_t magic;
+	uint16_t count[SD_WB_STREAMS];
+	uint16_t entry[SD_WB_STREAMS]; // Directory index of that file
+	uint16_t check;
+} SdIndex_t;
+
 class DLSD
 {
 	public:
@@ -39,11 +91,23 @@ class DLSD
 		bool increment_file(uint8_t n);
 		unsigned long open(uint8_t n, uint8_t flags);
 		bool close(uint8_t n);
+		unsigned long size(uint8_t n);
 		bool write(uint8_t n, char *ptr);
 		bool write(uint8_t n, float a);
 		bool write(uint8_t n, unsigned short a);
 		bool write(uint8_t n, int a);
 		bool write(uint8_t n, unsigned long a);
+		bool write(uint8_t n, uint8_t *buf, uint16_t len);
+		void set_latency(uint16_t ms);
+		void set_extent(uint8_t n, uint32_t size);
+		void set_frames(uint8_t n, bool on);
+		long repair(uint8_t n);
+		void set_time_index(uint8_t n, uint8_t every);
+		void stamp(uint8_t n, uint32_t t);
+		long read_range(uint8_t n, uint32_t t0, uint32_t t1, uint32_t *from, uint32_t *first);
+		bool flush(uint8_t n);
+		bool flush();
+		void poll();
 		int read(uint8_t n, char *ptr, int len);
 		int read(uint8_t n, char *ptr, int len, char t);
 		void rewind(uint8_t n);
@@ -52,6 +116,8 @@ class DLSD
 		bool setRate(uint8_t rate);
 		bool exists(char *fname);
 		uint8_t copy(char *src, char *dst);
+		int read_file(const char *name, char *buf, int len);
+		bool write_file(const char *name, const char *buf, int len);
 	private:
 		char _fullspeed;
 		uint8_t _CS;
@@ -62,7 +128,52 @@ class DLSD
 		boolean _files_open[NUM_FILES];
 		uint16_t _files_count[NUM_FILES];
 		uint16_t _saved_count[NUM_FILES];
-		char _filename[12];
+		char _filename[13]; // 8.3 and the terminator
+		uint8_t _wb[SD_WB_STREAMS][SD_BLOCK];
+		uint16_t _wb_len[SD_WB_STREAMS]; // Bytes waiting
+		uint16_t _wb_room[SD_WB_STREAMS]; // Bytes to the next block boundary
+		uint32_t _wb_time[SD_WB_STREAMS]; // millis() of the oldest byte
+		bool _wb_error[SD_WB_STREAMS]; // Failed flush, reported by the next write
+		uint16_t _latency; // ms, 0 syncs every write
+		uint8_t _frames; // Bit per file writing framed records
+		uint16_t _wb_sent[SD_WB_STREAMS]; // Bytes of an extent block already on the card
+		uint32_t _ext_size[SD_WB_STREAMS]; // Bytes pre-allocated per file, 0 FAT appends
+		uint32_t _ext_first[SD_WB_STREAMS]; // First block of the open extent, 0 none
+		uint32_t _ext_base[SD_WB_STREAMS]; // File offset of the block in _wb
+		uint16_t _ext_file[SD_WB_STREAMS]; // Files count the extent belongs to
+		uint8_t _stream; // Stream of the open multi-block write, SD_WB_STREAMS none
+		uint32_t _stream_block; // Next block of that write
+		SdBaseFile _dirs[SD_WB_STREAMS]; // Stream directories, resolved once
+		uint8_t _tidx_every[SD_WB_STREAMS]; // Records per time index entry, 0 none
+		uint8_t _tidx_recs[SD_WB_STREAMS]; // Records since the last entry
+		uint16_t _tidx_file[SD_WB_STREAMS]; // Files count they belong to
+		void file_name(uint8_t n, uint16_t c);
+		bool open_dir(uint8_t n);
+		int32_t newest(uint8_t n, uint16_t *entry);
+#ifdef SD_INDEX
+		SdIndex_t _idx;
+		uint16_t index_check();
+		bool index_load();
+		void index_save();
+		bool index_valid(uint8_t n);
+		void index_update(uint8_t n);
+#endif
+		bool release(uint8_t n);
+		bool buffered(uint8_t n);
+		bool put(uint8_t n, const uint8_t *buf, uint16_t len, bool more = false);
+		bool frame(uint8_t n, const uint8_t *buf, uint16_t len);
+		bool frame_at(uint8_t n, uint32_t pos, uint32_t size, uint16_t *len);
+		bool tidx_open(uint8_t n, SdBaseFile *f, uint8_t flags);
+		bool tidx_entry(SdBaseFile *f, uint32_t i, SdTimeEntry_t *e);
+		uint32_t tidx_find(SdBaseFile *f, uint32_t cnt, uint32_t t);
+		uint32_t written(uint8_t n);
+		void stop();
+		void settle(uint8_t n);
+		bool ext_create(uint8_t n, SdBaseFile *dir);
+		uint32_t ext_attach(uint8_t n, uint8_t flags);
+		uint32_t ext_scan(uint8_t b, uint32_t first);
+		bool ext_write(uint8_t b);
+		void ext_end(uint8_t n);
 };
 
 #endif
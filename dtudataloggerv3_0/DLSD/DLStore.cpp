@@ -0,0 +1,208 @@
+#include <Arduino.h>
+#include "DLStore.h"
+
+DLStore::DLStore()
+{
+	_sd = NULL;
+	_head = 0;
+	_tail = 0;
+	_end = 0;
+	_rotated = 0;
+	_gen = 0;
+	_lost = 0;
+	_dropped = 0;
+	_failures = 0;
+	for(uint8_t i = 0; i < SD_WB_STREAMS; i++) {
+		_max[i] = 0;
+		_size[i] = 0;
+		_queued[i] = 0;
+		_rot[i] = 0;
+		_lat[i] = 0;
+	}
+}
+
+void DLStore::begin(DLSD *sd) {
+	_sd = sd;
+}
+
+bool DLStore::stream(uint8_t n) {
+	return n >= SD_WB_FIRST && n < SD_WB_FIRST + SD_WB_STREAMS;
+}
+
+// Files of n are rotated once they are past size bytes, 0 never
+void DLStore::set_rotate(uint8_t n, uint32_t size) {
+	if (stream(n))
+		_max[n-SD_WB_FIRST] = size;
+}
+
+// Whether the next put() to n starts a new file. The size is known from
+// the first batch of n on.
+bool DLStore::rotating(uint8_t n) {
+	uint8_t b = n - SD_WB_FIRST;
+	return stream(n) && _max[b] && _size[b] > _max[b];
+}
+
+// Whether a batch of n was lost since the last call. The records put
+// next must not lean on those before.
+bool DLStore::lost(uint8_t n) {
+	uint8_t bit = 1 << (n - SD_WB_FIRST);
+	bool l = stream(n) && (_lost & bit);
+	_lost &= ~bit;
+	return l;
+}
+
+// Room for need bytes in one piece, NULL when the queue is too full
+uint8_t *DLStore::reserve(uint16_t need) {
+	uint8_t *p;
+	if (_tail >= _head) {
+		if (STORE_QUEUE - _tail >= need) {
+			p = _q + _tail;
+			_tail += need;
+			return p;
+		}
+		if (need < _head) { // Wrap, _tail never catches up with _head
+			_end = _tail;
+			_tail = need;
+			return _q;
+		}
+	} else if (_head - _tail > need) {
+		p = _q + _tail;
+		_tail += need;
+		return p;
+	}
+	return NULL;
+}
+
+// Queues len bytes for n, false when they do not fit
+bool DLStore::put(uint8_t n, const uint8_t *buf, uint16_t len, uint32_t t) {
+	uint8_t b = n - SD_WB_FIRST;
+	StoreReq_t r;
+	uint8_t *p;
+	if (!stream(n) || len == 0 || len > SD_FRAME_MAX)
+		return false;
+	if ((p = reserve(STORE_HDR + len)) == NULL) {
+		_dropped++;
+		return false;
+	}
+	r.flags = n | ((_gen >> b) & 1 ? STORE_GEN : 0);
+	if (rotating(n)) {
+		r.flags |= STORE_ROTATE;
+		_rot[b]++;
+		_size[b] = 0;
+	}
+	r.len = len;
+	r.t = t;
+	r.ms = millis();
+	memcpy(p, &r, STORE_HDR);
+	memcpy(p + STORE_HDR, buf, len);
+	_queued[b] += len;
+	_size[b] += len;
+	return true;
+}
+
+bool DLStore::put(uint8_t n, const char *str, uint32_t t) {
+	return put(n, (const uint8_t *)str, strlen(str), t);
+}
+
+bool DLStore::pending() {
+	return _head != _tail;
+}
+
+// Writes the batch at the head of the queue, false when it is empty
+bool DLStore::run() {
+	StoreReq_t r, next;
+	uint8_t n, b, *p, reqs = 1;
+	uint16_t len, at, end, lat;
+	unsigned long fsize;
+	bool err = true, stale;
+	if (_head == _tail)
+		return false;
+	memcpy(&r, _q + _head, STORE_HDR);
+	n = r.flags & STORE_STREAM;
+	b = n - SD_WB_FIRST;
+	stale = (r.flags & STORE_GEN ? 1 : 0) != ((_gen >> b) & 1);
+	p = _q + _head + STORE_HDR;
+	len = r.len;
+	at = _head + STORE_HDR + len;
+	end = _tail > _head ? _tail : _end;
+	// Followers of the same file move up behind it, over the headers
+	while (at < end) {
+		memcpy(&next, _q + at, STORE_HDR);
+		if (next.flags != (r.flags & ~STORE_ROTATE) || len + next.len > SD_FRAME_MAX)
+			break;
+		memmove(p + len, _q + at + STORE_HDR, next.len);
+		len += next.len;
+		at += STORE_HDR + next.len;
+		reqs++;
+	}
+
+	if (_sd->is_available() < 0)
+		_sd->init();
+	if (r.flags & STORE_ROTATE) {
+		_sd->close(n);
+		_sd->increment_file(n);
+		_rot[b]--;
+		_rotated |= 1 << n;
+	}
+	if (stale) { // Queued behind a lost batch
+		_dropped += reqs;
+		err = false;
+	} else if ((fsize = _sd->open(n, O_RDWR | O_CREAT | O_APPEND)) != (unsigned long)-1) {
+		if (!_rot[b])
+			_size[b] = fsize + _queued[b];
+		_sd->stamp(n, r.t);
+		err = _sd->write(n, p, len);
+		_sd->close(n);
+	}
+	_queued[b] -= len;
+	if (!err) {
+		if (!stale)
+			_failures = 0;
+	} else {
+		if (_failures < 255)
+			_failures++;
+		_gen ^= 1 << b;
+		_lost |= 1 << b;
+	}
+	lat = (uint16_t)millis() - r.ms;
+	if (lat > _lat[b])
+		_lat[b] = lat;
+
+	_head = at;
+	if (_head == _tail)
+		_head = _tail = 0;
+	else if (_tail < _head && _head == _end)
+		_head = 0;
+	return true;
+}
+
+// Bytes in the current file of n with those queued for it, without
+// going to the card
+uint32_t DLStore::size(uint8_t n) {
+	return stream(n) ? _size[n-SD_WB_FIRST] : 0;
+}
+
+// Bit 1 << n for every file n rotated since the last call
+uint8_t DLStore::rotated() {
+	uint8_t r = _rotated;
+	_rotated = 0;
+	return r;
+}
+
+// Longest ms a request of n waited since the last call
+uint16_t DLStore::latency(uint8_t n) {
+	uint16_t l;
+	if (!stream(n))
+		return 0;
+	l = _lat[n-SD_WB_FIRST];
+	_lat[n-SD_WB_FIRST] = 0;
+	return l;
+}
+
+uint16_t DLStore::dropped() {
+	return _dropped;
+}
+
+uint8_t DLStore::failures() {
+	return _failures;
+}
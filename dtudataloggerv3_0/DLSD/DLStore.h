@@ -0,0 +1,72 @@
+#ifndef DLStore_h
+#define DLStore_h
+
+#include <Arduino.h>
+#include <DLCommon.h>
+#include "DLSD.h"
+
+/* One owner of the log streams on the card. Producers hand put() a
+   stream and bytes, which are copied into a bounded queue, and go on.
+   run() does the card work from its own thread, one batch per call: the
+   requests of one stream that follow each other from the head of the
+   queue, moved together over their headers and written with one DLSD
+   write. Framed streams get one frame per batch, the time index one
+   stamp, with the time of its first request. A stream past its
+   set_rotate() size is rotated in front of the request put() marks,
+   rotating() tells a producer beforehand. Requests that do not fit the
+   queue are dropped and counted. A batch the card did not take drops
+   those of its stream still queued too, they may be deltas to it, and
+   lost() tells the producer to start over from absolute values. */
+#ifndef STORE_QUEUE
+#define STORE_QUEUE 1024
+#endif
+#define STORE_ROTATE 0x80
+#define STORE_GEN 0x40 // Requests queued before a lost batch differ in it
+#define STORE_STREAM 0x0F
+#define STORE_HDR sizeof(StoreReq_t)
+
+typedef struct {
+	uint8_t flags; // Stream, STORE_ROTATE and STORE_GEN
+	uint16_t len;
+	uint32_t t; // Time of the request
+	uint16_t ms; // millis() it was queued at
+} StoreReq_t;
+
+class DLStore
+{
+	public:
+		DLStore();
+		void begin(DLSD *sd);
+		void set_rotate(uint8_t n, uint32_t size);
+		bool rotating(uint8_t n);
+		bool lost(uint8_t n);
+		bool put(uint8_t n, const uint8_t *buf, uint16_t len, uint32_t t);
+		bool put(uint8_t n, const char *str, uint32_t t);
+		bool pending();
+		bool run();
+		uint32_t size(uint8_t n);
+		uint8_t rotated();
+		uint16_t latency(uint8_t n);
+		uint16_t dropped();
+		uint8_t failures();
+	private:
+		DLSD *_sd;
+		uint8_t _q[STORE_QUEUE];
+		uint16_t _head;
+		uint16_t _tail;
+		uint16_t _end; // End of the requests before _tail wrapped to 0
+		uint32_t _max[SD_WB_STREAMS]; // Rotation size, 0 none
+		uint32_t _size[SD_WB_STREAMS]; // File size with the bytes queued
+		uint16_t _queued[SD_WB_STREAMS];
+		uint8_t _rot[SD_WB_STREAMS]; // Rotations queued
+		uint16_t _lat[SD_WB_STREAMS]; // Longest ms from put() to the card
+		uint8_t _rotated; // Bit per file rotated since rotated()
+		uint8_t _gen; // Bit per stream, toggled by a lost batch
+		uint8_t _lost; // Bit per stream with a batch lost since lost()
+		uint16_t _dropped;
+		uint8_t _failures; // Failed batches in a row
+		bool stream(uint8_t n);
+		uint8_t *reserve(uint16_t need);
+};
+
+#endif
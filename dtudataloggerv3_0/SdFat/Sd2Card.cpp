@@ -19,6 +19,12 @@
  */
 #include <avr/pgmspace.h>
 #include <Sd2Card.h>
+// USE_SD_CRC 3 and 4 need the hardware SPI loops
+#if USE_SD_CRC > 2 && !defined(SOFTWARE_SPI)
+#define SD_CRC_IN_LOOP 1
+#else  // USE_SD_CRC
+#define SD_CRC_IN_LOOP 0
+#endif  // USE_SD_CRC
 //==============================================================================
 // SPI functions
 #ifndef SOFTWARE_SPI
@@ -61,6 +67,41 @@ static uint8_t spiRec() {
   return SPDR;
 }
 //------------------------------------------------------------------------------
+/** SPI take the byte in and start the next one */
+static inline __attribute__((always_inline))
+  uint8_t spiReadNext() {
+  while (!(SPSR & (1 << SPIF)));
+  uint8_t b = SPDR;
+  SPDR = 0XFF;
+  return b;
+}
+//------------------------------------------------------------------------------
+/** SPI start sending b once the bus is free */
+static inline __attribute__((always_inline))
+  void spiSendNext(uint8_t b) {
+  while (!(SPSR & (1 << SPIF)));
+  SPDR = b;
+}
+//------------------------------------------------------------------------------
+#if SD_SPI_UNROLL
+/** SPI read data, four bytes a pass, each stored while the next one is on
+ * the bus - only one call so force inline */
+static inline __attribute__((always_inline))
+  void spiRead(uint8_t* buf, uint16_t nbyte) {
+  if (nbyte-- == 0) return;
+  uint8_t* end = buf + nbyte;
+  SPDR = 0XFF;
+  while (end - buf >= 4) {
+    *buf++ = spiReadNext();
+    *buf++ = spiReadNext();
+    *buf++ = spiReadNext();
+    *buf++ = spiReadNext();
+  }
+  while (buf < end) *buf++ = spiReadNext();
+  while (!(SPSR & (1 << SPIF)));
+  *buf = SPDR;
+}
+#else  // SD_SPI_UNROLL
 /** SPI read data - only one call so force inline */
 static inline __attribute__((always_inline))
   void spiRead(uint8_t* buf, uint16_t nbyte) {
@@ -74,6 +115,7 @@ static inline __attribute__((always_inline))
   while (!(SPSR & (1 << SPIF)));
   buf[nbyte] = SPDR;
 }
+#endif  // SD_SPI_UNROLL
 //------------------------------------------------------------------------------
 /** SPI send a byte */
 static void spiSend(uint8_t b) {
@@ -81,6 +123,22 @@ static void spiSend(uint8_t b) {
   while (!(SPSR & (1 << SPIF)));
 }
 //------------------------------------------------------------------------------
+#if SD_SPI_UNROLL
+/** SPI send block, four bytes a pass, each loaded while the one before is
+ * on the bus - only one call so force inline */
+static inline __attribute__((always_inline))
+  void spiSendBlock(uint8_t token, const uint8_t* buf) {
+  const uint8_t* end = buf + 512;
+  SPDR = token;
+  while (buf < end) {
+    spiSendNext(*buf++);
+    spiSendNext(*buf++);
+    spiSendNext(*buf++);
+    spiSendNext(*buf++);
+  }
+  while (!(SPSR & (1 << SPIF)));
+}
+#else  // SD_SPI_UNROLL
 /** SPI send block - only one call so force inline */
 static inline __attribute__((always_inline))
   void spiSendBlock(uint8_t token, const uint8_t* buf) {
@@ -93,6 +151,7 @@ static inline __attribute__((always_inline))
   }
   while (!(SPSR & (1 << SPIF)));
 }
+#endif  // SD_SPI_UNROLL
 //------------------------------------------------------------------------------
 #else  // SOFTWARE_SPI
 #include <SoftSPI.h>
@@ -147,18 +206,16 @@ static uint8_t CRC7(const uint8_t* data, uint8_t n) {
   return (crc << 1) | 1;
 }
 //------------------------------------------------------------------------------
-#if USE_SD_CRC == 1
+#if USE_SD_CRC == 1 || USE_SD_CRC == 3
 // slower CRC-CCITT
 // uses the x^16,x^12,x^5,x^1 polynomial.
-static uint16_t CRC_CCITT(const uint8_t *data, uint16_t n) {
-  uint16_t crc = 0;
-  for (uint16_t i = 0; i < n; i++) {
-    crc = (uint8_t)(crc >> 8) | (crc << 8);
-    crc ^= data[i];
-    crc ^= (uint8_t)(crc & 0xff) >> 4;
-    crc ^= crc << 12;
-    crc ^= (crc & 0xff) << 5;
-  }
+static inline __attribute__((always_inline))
+  uint16_t crcStep(uint16_t crc, uint8_t b) {
+  crc = (uint8_t)(crc >> 8) | (crc << 8);
+  crc ^= b;
+  crc ^= (uint8_t)(crc & 0xff) >> 4;
+  crc ^= crc << 12;
+  crc ^= (crc & 0xff) << 5;
   return crc;
 }
 #else  // CRC_CCITT
@@ -199,14 +256,77 @@ static uint16_t crctab[] PROGMEM = {
   0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
   0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
 };
+static inline __attribute__((always_inline))
+  uint16_t crcStep(uint16_t crc, uint8_t b) {
+  return pgm_read_word(&crctab[(crc >> 8 ^ b) & 0XFF]) ^ (crc << 8);
+}
+#endif  //  CRC_CCITT
+//------------------------------------------------------------------------------
+#if !SD_CRC_IN_LOOP
 static uint16_t CRC_CCITT(const uint8_t* data, uint16_t n) {
   uint16_t crc = 0;
-  for (uint16_t i = 0; i < n; i++) {
-    crc = pgm_read_word(&crctab[(crc >> 8 ^ data[i]) & 0XFF]) ^ (crc << 8);
+  for (uint16_t i = 0; i < n; i++) crc = crcStep(crc, data[i]);
+  return crc;
+}
+#else  // SD_CRC_IN_LOOP
+//------------------------------------------------------------------------------
+/** SPI take a byte of a block in and add it to crc */
+static inline __attribute__((always_inline))
+  uint16_t spiReadCrcNext(uint8_t* p, uint16_t crc) {
+  uint8_t b = spiReadNext();
+  *p = b;
+  return crcStep(crc, b);
+}
+//------------------------------------------------------------------------------
+/** SPI add b to crc, then send it once the bus is free */
+static inline __attribute__((always_inline))
+  uint16_t spiSendCrcNext(uint8_t b, uint16_t crc) {
+  crc = crcStep(crc, b);
+  spiSendNext(b);
+  return crc;
+}
+//------------------------------------------------------------------------------
+/** SPI read data and return its CRC-CCITT. The CRC of a byte is done while
+ * the next one is on the bus. */
+static inline __attribute__((always_inline))
+  uint16_t spiReadCrc(uint8_t* buf, uint16_t nbyte) {
+  uint16_t crc = 0;
+  if (nbyte-- == 0) return crc;
+  uint8_t* end = buf + nbyte;
+  SPDR = 0XFF;
+#if SD_SPI_UNROLL
+  while (end - buf >= 4) {
+    crc = spiReadCrcNext(buf++, crc);
+    crc = spiReadCrcNext(buf++, crc);
+    crc = spiReadCrcNext(buf++, crc);
+    crc = spiReadCrcNext(buf++, crc);
+  }
+#endif  // SD_SPI_UNROLL
+  while (buf < end) crc = spiReadCrcNext(buf++, crc);
+  while (!(SPSR & (1 << SPIF)));
+  *buf = SPDR;
+  return crcStep(crc, *buf);
+}
+//------------------------------------------------------------------------------
+/** SPI send block and return its CRC-CCITT. The CRC of a byte is done
+ * while the one before is on the bus. */
+static inline __attribute__((always_inline))
+  uint16_t spiSendBlockCrc(uint8_t token, const uint8_t* buf) {
+  const uint8_t* end = buf + 512;
+  uint16_t crc = 0;
+  SPDR = token;
+  while (buf < end) {
+#if SD_SPI_UNROLL
+    crc = spiSendCrcNext(*buf++, crc);
+    crc = spiSendCrcNext(*buf++, crc);
+    crc = spiSendCrcNext(*buf++, crc);
+#endif  // SD_SPI_UNROLL
+    crc = spiSendCrcNext(*buf++, crc);
   }
+  while (!(SPSR & (1 << SPIF)));
   return crc;
 }
-#endif  //  CRC_CCITT
+#endif  // SD_CRC_IN_LOOP
 //==============================================================================
 // Sd2Card member functions
 //------------------------------------------------------------------------------
@@ -470,6 +590,9 @@ bool Sd2Card::readData(uint8_t *dst) {
 //------------------------------------------------------------------------------
 bool Sd2Card::readData(uint8_t* dst, uint16_t count) {
   uint16_t crc;
+#if USE_SD_CRC
+  uint16_t crcData;
+#endif  // USE_SD_CRC
   // wait for start block token
   uint16_t t0 = millis();
   while ((status_ = spiRec()) == 0XFF) {
@@ -483,11 +606,19 @@ bool Sd2Card::readData(uint8_t* dst, uint16_t count) {
     goto fail;
   }
   // transfer data
+#if SD_CRC_IN_LOOP
+  crcData = spiReadCrc(dst, count);
+#else  // SD_CRC_IN_LOOP
   spiRead(dst, count);
-  // get crc
-  crc = (spiRec() << 8) | spiRec();
+#endif  // SD_CRC_IN_LOOP
+  // get crc, high byte first
+  crc = spiRec() << 8;
+  crc |= spiRec();
 #if USE_SD_CRC
-  if (crc != CRC_CCITT(dst, count)) {
+#if !SD_CRC_IN_LOOP
+  crcData = CRC_CCITT(dst, count);
+#endif  // SD_CRC_IN_LOOP
+  if (crc != crcData) {
     error(SD_CARD_ERROR_READ_CRC);
     goto fail;
   }
@@ -647,6 +778,9 @@ bool Sd2Card::writeData(const uint8_t* src) {
 //------------------------------------------------------------------------------
 // send one block of data for write block or write multiple blocks
 bool Sd2Card::writeData(uint8_t token, const uint8_t* src) {
+#if SD_CRC_IN_LOOP
+  uint16_t crc = spiSendBlockCrc(token, src);
+#else  // SD_CRC_IN_LOOP
 #if USE_SD_CRC
   uint16_t crc = CRC_CCITT(src, 512);
 #else  // USE_SD_CRC
@@ -654,6 +788,7 @@ bool Sd2Card::writeData(uint8_t token, const uint8_t* src) {
 #endif  // USE_SD_CRC
 
   spiSendBlock(token, src);
+#endif  // SD_CRC_IN_LOOP
   spiSend(crc >> 8);
   spiSend(crc & 0XFF);
 
@@ -31,8 +31,30 @@
  * Set USE_SD_CRC to 1 to use a smaller slower CRC-CCITT function.
  *
  * Set USE_SD_CRC to 2 to used a larger faster table driven CRC-CCITT function.
+ *
+ * Set USE_SD_CRC to 3 or 4 to compute the data CRC in the SPI byte loops while
+ * the next byte is on the bus, 3 with the function of 1, 4 with the table of
+ * 2. Software SPI falls back to 1 or 2.
+ *
+ * Estimated AVR cycles for the data of a 512 byte block at SPI_FULL_SPEED,
+ * Tests/Host/SdCrcBench:
+ *
+ * USE_SD_CRC          0      1      2      3      4
+ * SD_SPI_UNROLL 0  12300  27600  24100  17900  14300
+ * SD_SPI_UNROLL 1  11300  26600  23000  16400  12800
+ */
+#ifndef USE_SD_CRC
+#define USE_SD_CRC 4
+#endif  // USE_SD_CRC
+//------------------------------------------------------------------------------
+/**
+ * Set SD_SPI_UNROLL nonzero to move data blocks over hardware SPI in loops
+ * unrolled four times that store or load a byte while the one next to it is
+ * on the bus. Set it to zero for the byte at a time loops.
  */
-#define USE_SD_CRC 1
+#ifndef SD_SPI_UNROLL
+#define SD_SPI_UNROLL 1
+#endif  // SD_SPI_UNROLL
 //------------------------------------------------------------------------------
 /**
  * To use multiple SD cards set USE_MULTIPLE_CARDS nonzero.
@@ -0,0 +1,149 @@
+/*
+  Host simulation of the DLADCScan sequencer against the old blocking
+  analogRead() loop. Feeds synthetic conversions through convert() the way
+  ADC_vect would, harvests them on the measurement tick and reports
+  harvest cost, CPU time blocked per tick and sample timing jitter.
+
+  Build: g++ -O2 -I../../../DLMeasure ADCScanSim.cpp ../../../DLMeasure/DLADCScan.cpp -o adcscansim
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "DLADCScan.h"
+
+#define SIM_SECONDS 60
+#define TICK_US 200000.0 // sampling_rate 5Hz
+#define CONV_US 104.0 // 13 ADC clocks at 125kHz
+#define ANALOGREAD_US 112.0 // Conversion + analogRead() overhead
+#define ISR_US 5.0 // ~80 cycles of ADC_vect
+#define NUM_PORTS 8
+
+typedef struct {
+	double last, sum, sqsum;
+	long n;
+} Jitter_t;
+
+static double frand() {
+	return rand() / (double)RAND_MAX;
+}
+
+// Latency before the measurement protothread gets the CPU
+static double thread_latency_us() {
+	double r = frand();
+	if (r < 0.02)
+		return 20000.0 + 20000.0 * frand(); // SD sync / FAT update
+	if (r < 0.10)
+		return 2000.0 + 3000.0 * frand(); // GSM line processing
+	return 1000.0 * frand();
+}
+
+static uint16_t synth(uint8_t slot, double t) {
+	if (slot == ADC_SCAN_BANDGAP)
+		return 225 + (rand() % 3) - 1;
+	double v = 100.0 * (slot + 1) + 20.0 * sin(t / 1e6 * (slot + 1)) + (rand() % 7) - 3;
+	return (uint16_t)v;
+}
+
+static void jitter_add(Jitter_t *j, double t, double nominal) {
+	if (j->n > 0) {
+		double d = (t - j->last) - nominal;
+		j->sum += d;
+		j->sqsum += d * d;
+	}
+	j->last = t;
+	j->n++;
+}
+
+static double jitter_us(Jitter_t *j) {
+	long n = j->n - 1;
+	if (n < 2) return 0;
+	double m = j->sum / n;
+	return sqrt(j->sqsum / n - m * m);
+}
+
+static void run_blocking() {
+	Jitter_t jit[NUM_PORTS] = {};
+	double t = 0, blocked = 0, worst = 0;
+	long ticks = 0;
+	for(double tick = 0; tick < SIM_SECONDS * 1e6; tick += TICK_US) {
+		t = tick + thread_latency_us();
+		for(int k = 0; k < NUM_PORTS; k++) {
+			synth(k, t);
+			jitter_add(&jit[k], t, TICK_US);
+			t += ANALOGREAD_US;
+		}
+		blocked += NUM_PORTS * ANALOGREAD_US;
+		ticks++;
+	}
+	for(int k = 0; k < NUM_PORTS; k++)
+		if (jitter_us(&jit[k]) > worst) worst = jitter_us(&jit[k]);
+	printf("analogRead : blocked/tick %7.1f us  samples/ch/tick %6.1f  worst jitter %8.1f us\n",
+	       blocked / ticks, 1.0, worst);
+}
+
+static void run_scan() {
+	DLADCScan scan;
+	Jitter_t jit[ADC_SCAN_SLOTS] = {};
+	double sum[ADC_SCAN_SLOTS] = {}, expect[ADC_SCAN_SLOTS] = {};
+	long cnt[ADC_SCAN_SLOTS] = {}, ecnt[ADC_SCAN_SLOTS] = {};
+	double t = 0, tick = 0, next_tick = TICK_US + thread_latency_us(), worst = 0, nominal;
+	double harvest_ns = 0, isr_us = 0, samples = 0;
+	long ticks = 0;
+	int bg_run = 0;
+	uint8_t slot, cur;
+	uint16_t raw;
+
+	scan.set_mask((1 << ADC_SCAN_SLOTS) - 1);
+	slot = scan.start();
+	nominal = (ADC_SCAN_SLOTS + ADC_SCAN_BG_SETTLE) * (CONV_US + ISR_US);
+	while (t < SIM_SECONDS * 1e6) {
+		// A conversion completes, the ISR may be held off by cli() sections
+		t += CONV_US + ISR_US + (frand() < 0.05 ? 40.0 * frand() : 0);
+		cur = slot;
+		raw = synth(cur, t);
+		slot = scan.convert(raw);
+		isr_us += ISR_US;
+		bg_run = (cur == ADC_SCAN_BANDGAP) ? bg_run + 1 : 0;
+		if (cur != ADC_SCAN_BANDGAP || bg_run > ADC_SCAN_BG_SETTLE) {
+			jitter_add(&jit[cur], t, nominal);
+			expect[cur] += raw;
+			ecnt[cur]++;
+		}
+		if (t >= next_tick) { // protothread_measure gets the CPU
+			std::chrono::steady_clock::time_point s = std::chrono::steady_clock::now();
+			ADCAcc_t *b = scan.harvest();
+			for(int k = 0; k < ADC_SCAN_SLOTS; k++) {
+				sum[k] += b[k].sum;
+				cnt[k] += b[k].cnt;
+			}
+			harvest_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - s).count();
+			ticks++;
+			tick += TICK_US;
+			next_tick = tick + TICK_US + thread_latency_us();
+		}
+	}
+	ADCAcc_t *b = scan.harvest();
+	for(int k = 0; k < ADC_SCAN_SLOTS; k++) {
+		sum[k] += b[k].sum;
+		cnt[k] += b[k].cnt;
+		samples += cnt[k];
+		if (jitter_us(&jit[k]) > worst) worst = jitter_us(&jit[k]);
+		if (cnt[k] != ecnt[k] || sum[k] != expect[k]) {
+			printf("FAIL slot %d: %ld/%ld samples, sum %.0f/%.0f\n", k, cnt[k], ecnt[k], sum[k], expect[k]);
+			exit(1);
+		}
+	}
+	printf("ADC scan   : blocked/tick %7.3f us  samples/ch/tick %6.1f  worst jitter %8.1f us\n",
+	       harvest_ns / ticks / 1000.0, samples / ADC_SCAN_SLOTS / ticks, worst);
+	printf("             harvest %.0f ns/tick (host), ISR load %.1f%%, dropped %lu\n",
+	       harvest_ns / ticks, 100.0 * isr_us / t, (unsigned long)scan.get_dropped());
+}
+
+int main() {
+	srand(1);
+	printf("%d s at %.0f Hz, %d analog ports + bandgap\n", SIM_SECONDS, 1e6 / TICK_US, NUM_PORTS);
+	run_blocking();
+	run_scan();
+	return 0;
+}
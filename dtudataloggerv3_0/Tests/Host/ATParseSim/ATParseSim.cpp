@@ -0,0 +1,454 @@
+/*
+  SIM900 replies of DATALOG upload sessions read the way DLGSM read them
+  before and read them now. A session is PARTS POSTs (connect, the state,
+  WINDOWS transfers, the HTTP reply up to CLOSED and the state again),
+  RING, +CMTI and +CREG lines come in between the replies at random. A
+  command reads the lines of its answer and whatever the one before left.
+
+  Before: PT_recvline() handed over a line at its newline, or what it had
+  once the command's timeout ran out, the > prompt that way. The
+  confirmation was strstr() of the line, RING and +CMTI were only looked
+  at by the idle handler, one read while a command ran was gone (an SMS
+  is found again by the AT+CMGL every 10 s of the idle state, a call is
+  not), and a CLOSED line cleared the connection flags only if read with
+  process set, DLHTTP waits for it with process 0.
+  Now: DLATParser fed every byte, the confirmation is the parser's class
+  and expect() of the string, URCs are processed whatever reads them and
+  RING and +CMTI go to the DLURCQueue the idle handler empties after the
+  session.
+
+  Counted are commands confirmed by another line than their answer,
+  lines handed over at the timeout, URCs lost and CLOSED lines the flags
+  saw, then the cost per byte of each way of looking at the lines:
+  character compares of strstr() as avr-libc does it against reads of
+  the parser's table, which is built in here to count them, and the host
+  time of both. The replies of the table are checked first, with a
+  reply after a line a timeout cut short.
+
+  Build: g++ -O2 -I../../../DLGSM ATParseSim.cpp -o atparsesim
+*/
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+static long table_reads, compares;
+#define PROGMEM
+#define pgm_read_byte(p) (table_reads++, *(const uint8_t *)(p))
+#define strcpy_P strcpy
+#include "DLATParser.cpp"
+
+#define PARTS 12
+#define WINDOWS 3
+#define SESSIONS 2000
+#define URCS 6 // Up to, in a session
+#define STRESS_URCS 20
+#define TOUT_S 3 // Of a command
+#define BENCH_BYTES (8L << 20)
+
+#define ROLE_REPLY 0
+#define ROLE_RING 1
+#define ROLE_CMTI 2
+#define ROLE_CREG 3
+
+typedef struct {
+	long end; // In the stream
+	int role;
+} Line_t;
+
+typedef struct {
+	const char *conf_old, *conf_new;
+	char process;
+	bool recv; // PT_recv(), no command sent
+	long end; // Of its answer in the stream
+	int answer; // Line that confirms it
+} Cmd_t;
+
+typedef struct {
+	std::string bytes;
+	std::vector<Line_t> lines;
+	std::vector<Cmd_t> cmds;
+	std::vector<int> urcs; // Lines of the RING and +CMTI
+	int closes;
+} Session_t;
+
+typedef struct {
+	long cmds, misread, missed, waits, urcs, lost, overflows, closes, seen;
+} Count_t;
+
+static unsigned long long rnd_state = 12345;
+
+static unsigned long rnd() {
+	rnd_state = rnd_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (rnd_state >> 33) & 0x7FFFFFFF;
+}
+
+static void line(Session_t *s, const char *text, int role) {
+	Line_t l;
+	s->bytes += "\r\n";
+	s->bytes += text;
+	if (text[0] == '>')
+		s->bytes += " "; // The prompt, no newline
+	else
+		s->bytes += "\r\n";
+	l.end = s->bytes.size();
+	l.role = role;
+	s->lines.push_back(l);
+}
+
+// Reply lines of a command, the one at answer confirms it, URCs at the
+// slots picked for them
+static void command(Session_t *s, const char *conf_old, const char *conf_new, char process, bool recv,
+                    const char **replies, int n, int answer, std::vector<int> *slots, int *slot, int *sms) {
+	Cmd_t c;
+	char buf[40];
+	c.conf_old = conf_old;
+	c.conf_new = conf_new;
+	c.process = process;
+	c.recv = recv;
+	for(int i = 0; i < n; i++) {
+		while (!slots->empty() && slots->back() == *slot) {
+			slots->pop_back();
+			switch (rnd() % 4) {
+			case 0:
+				s->urcs.push_back(s->lines.size());
+				line(s, "RING", ROLE_RING);
+				break;
+			case 1:
+				line(s, "+CREG: 1,\"00C3\",\"1E7B\"", ROLE_CREG);
+				break;
+			default:
+				snprintf(buf, sizeof(buf), "+CMTI: \"SM\",%d", ++*sms);
+				s->urcs.push_back(s->lines.size());
+				line(s, buf, ROLE_CMTI);
+			}
+		}
+		(*slot)++;
+		if (i == answer)
+			c.answer = s->lines.size();
+		if (strcmp(replies[i], "CLOSED") == 0)
+			s->closes++;
+		if (replies[i][0])
+			line(s, replies[i], ROLE_REPLY);
+		else
+			s->bytes += "\r\n";
+	}
+	c.end = s->bytes.size();
+	s->cmds.push_back(c);
+}
+
+static void session(Session_t *s, int urcs) {
+	static const char *start[] = { "OK", "CONNECT OK" };
+	static const char *state[] = { "OK", "STATE: CONNECT OK" };
+	static const char *size[] = { "+CIPSEND: 1460", "OK" };
+	static const char *prompt[] = { ">" };
+	static const char *sent[] = { "SEND OK" };
+	static const char *reply[] = { "HTTP/1.1 200 OK", "Content-Type: text/plain", "", "TS 1350000000", "CLOSED" };
+	static const char *closed[] = { "OK", "STATE: TCP CLOSED" };
+	std::vector<int> slots;
+	int slot = 0, sms = 0, n = PARTS * (2 + 2 + WINDOWS * 4 + 5 + 2);
+	s->bytes.clear();
+	s->lines.clear();
+	s->cmds.clear();
+	s->urcs.clear();
+	s->closes = 0;
+	for(int i = 0; i < urcs; i++)
+		slots.push_back(rnd() % n);
+	std::sort(slots.rbegin(), slots.rend());
+	for(int p = 0; p < PARTS; p++) {
+		command(s, "CONNECT", "CONNECT", 1, false, start, 2, 1, &slots, &slot, &sms);
+		command(s, "STATE:", "STATE:", 1, false, state, 2, 1, &slots, &slot, &sms);
+		for(int w = 0; w < WINDOWS; w++) {
+			command(s, "+", "+CIPSEND:", 1, false, size, 2, 0, &slots, &slot, &sms);
+			command(s, ">", ">", 1, false, prompt, 1, 0, &slots, &slot, &sms);
+			command(s, "OK", "OK", 1, false, sent, 1, 0, &slots, &slot, &sms);
+		}
+		command(s, "CLOSED", "CLOSED", 0, true, reply, 5, 4, &slots, &slot, &sms);
+		command(s, "STATE:", "STATE:", 1, false, closed, 2, 1, &slots, &slot, &sms);
+	}
+}
+
+static int line_of(Session_t *s, long at) {
+	int lo = 0, hi = s->lines.size();
+	while (lo < hi) {
+		int m = (lo + hi) / 2;
+		if (s->lines[m].end <= at)
+			lo = m + 1;
+		else
+			hi = m;
+	}
+	return lo;
+}
+
+// PT_recvline() and PT_send_recv_confirm() or PT_recv() before
+static void run_old(Session_t *s, Count_t *c) {
+	long pos = 0;
+	for(size_t i = 0; i < s->cmds.size(); i++) {
+		Cmd_t *cmd = &s->cmds[i];
+		bool done = false, seen = false;
+		while (!done && pos < cmd->end) {
+			std::string l;
+			while (pos < cmd->end) {
+				l += s->bytes[pos++];
+				if (l[l.size()-1] == '\n')
+					break;
+			}
+			if (l[l.size()-1] != '\n')
+				c->waits++; // Nothing more came in
+			if (cmd->process && l.size() > 5 && l[0] == 'C' && l[5] == 'D') // GSM_process_line()
+				c->seen++;
+			if (strstr(l.c_str(), cmd->conf_old)) {
+				if (line_of(s, pos - 1) != cmd->answer)
+					c->misread++;
+				seen = true;
+				done = !cmd->recv; // PT_recv() reads on
+			} else if (strstr(l.c_str(), "ERROR") || strstr(l.c_str(), "FAIL")) {
+				c->misread++;
+				done = true;
+			}
+		}
+		if (!seen)
+			c->missed++;
+	}
+	c->urcs += s->urcs.size();
+	c->lost += s->urcs.size();
+}
+
+// PT_recvline() and GSM_feed() now
+static void run_new(Session_t *s, Count_t *c) {
+	DLATParser at;
+	DLURCQueue urc;
+	Urc_t u;
+	std::vector<bool> queued(s->lines.size(), false);
+	long pos = 0;
+	for(size_t i = 0; i < s->cmds.size(); i++) {
+		Cmd_t *cmd = &s->cmds[i];
+		bool done = false, seen = false;
+		at.expect(cmd->conf_new);
+		while (!done && pos < cmd->end) {
+			uint8_t kind = at.feed(s->bytes[pos++]);
+			if (kind == AT_K_NONE) {
+				if (pos == cmd->end)
+					c->waits++;
+				continue;
+			}
+			int l = line_of(s, pos - 1);
+			if (at.reply() == AT_RING || at.reply() == AT_CMTI)
+				queued[l] = urc.push(at.reply(), at.arg());
+			if (at.reply() == AT_CLOSED)
+				c->seen++;
+			if (kind == AT_K_FAIL) {
+				c->misread++;
+				done = true;
+			} else if (at.expected()) {
+				if (l != cmd->answer)
+					c->misread++;
+				seen = done = true;
+			}
+		}
+		if (!seen)
+			c->missed++;
+	}
+	// The idle handler after the session
+	while (urc.pop(&u))
+		;
+	c->overflows += urc.get_overflows();
+	for(size_t i = 0; i < s->urcs.size(); i++) {
+		c->urcs++;
+		if (!queued[s->urcs[i]])
+			c->lost++;
+	}
+}
+
+static bool check_table() {
+	static const struct {
+		const char *line;
+		uint8_t reply, kind;
+		int arg;
+	} cases[] = {
+		{ "OK", AT_OK, AT_K_OK, 0 }, { "SEND OK", AT_SEND_OK, AT_K_OK, 0 },
+		{ "CONNECT OK", AT_CONNECT_OK, AT_K_OK, 0 }, { "ALREADY CONNECT", AT_ALREADY_CONNECT, AT_K_OK, 0 },
+		{ "CLOSE OK", AT_CLOSE_OK, AT_K_OK, 0 }, { "SHUT OK", AT_SHUT_OK, AT_K_OK, 0 },
+		{ "ERROR", AT_ERROR, AT_K_FAIL, 0 }, { "+CME ERROR: 100", AT_CME_ERROR, AT_K_FAIL, 100 },
+		{ "+CMS ERROR: 321", AT_CMS_ERROR, AT_K_FAIL, 321 }, { "SEND FAIL", AT_SEND_FAIL, AT_K_FAIL, 0 },
+		{ "CONNECT FAIL", AT_CONNECT_FAIL, AT_K_FAIL, 0 }, { "NO CARRIER", AT_NO_CARRIER, AT_K_FAIL, 0 },
+		{ "+CIPSEND: 1460", AT_CIPSEND, AT_K_DATA, 1460 }, { "STATE: IP INITIAL", AT_STATE, AT_K_DATA, 0 },
+		{ "+CMGL: 1,\"REC UNREAD\",\"+4512345678\",\"\",\"12/08/10,09:47:40-08\"", AT_CMGL, AT_K_DATA, 0 },
+		{ "+CMGR: \"REC UNREAD\",\"+299583252\",\"\",\"12/08/10,09:47:40-08\"", AT_CMGR, AT_K_DATA, 0 },
+		{ "+CMGS: 12", AT_CMGS, AT_K_DATA, 12 }, { "+CSQ: 17,0", AT_CSQ, AT_K_DATA, 0 },
+		{ "+CREG: 2,1,\"00C3\",\"1E7B\"", AT_CREG, AT_K_URC, 0 }, { "+CGREG: 1", AT_CGREG, AT_K_URC, 1 },
+		{ "RING", AT_RING, AT_K_URC, 0 }, { "+CMTI: \"SM\",17", AT_CMTI, AT_K_URC, 17 },
+		{ "CLOSED", AT_CLOSED, AT_K_URC, 0 }, { "+PDP: DEACT", AT_PDP_DEACT, AT_K_URC, 0 },
+		{ "NORMAL POWER DOWN", AT_POWER_DOWN, AT_K_URC, 0 }, { "UNDER-VOLTAGE POWER DOWN", AT_POWER_DOWN, AT_K_URC, 0 },
+		{ "OVER-VOLTAGE POWER DOWN", AT_POWER_DOWN, AT_K_URC, 0 }, { "Call Ready", AT_CALL_READY, AT_K_URC, 0 },
+		// Not replies
+		{ "CONNECT", AT_NONE, AT_K_LINE, 0 }, { "CLOSE", AT_NONE, AT_K_LINE, 0 }, { "Connection: close", AT_NONE, AT_K_LINE, 0 },
+		{ "HTTP/1.1 200 OK", AT_NONE, AT_K_LINE, 0 }, { "TS 1350000000", AT_NONE, AT_K_LINE, 32767 },
+		{ "10.72.44.3", AT_NONE, AT_K_LINE, 3 }, { "ST", AT_NONE, AT_K_LINE, 0 }, { "+C", AT_NONE, AT_K_LINE, 0 },
+		{ "\x80\xff" "OK", AT_NONE, AT_K_LINE, 0 }, { "O", AT_NONE, AT_K_LINE, 0 }
+	};
+	static const char *oks[] = { "OK", "SEND OK", "CLOSE OK", "SHUT OK", "+CMTI: \"SM\",3", "CLOSED", "HTTP/1.1 200 OK" };
+	DLATParser at;
+	bool ok = true;
+	for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		std::string l = std::string("\r\n") + cases[i].line + "\r\n";
+		uint8_t kind = AT_K_NONE;
+		int got = 0;
+		for(size_t j = 0; j < l.size(); j++) {
+			uint8_t k = at.feed(l[j]);
+			if (k != AT_K_NONE) {
+				kind = k;
+				got++;
+			}
+		}
+		if (got != 1 || kind != cases[i].kind || at.reply() != cases[i].reply || at.arg() != cases[i].arg) {
+			printf("FAIL: \"%s\" reply %d kind %d arg %d, %d lines\n", cases[i].line, at.reply(), kind, at.arg(), got);
+			ok = false;
+		}
+	}
+	// The prompt is there at the >, the blank after it is no line
+	const char *p = "\r\n> ";
+	int at_gt = -1;
+	for(int j = 0; p[j]; j++)
+		if (at.feed(p[j]) != AT_K_NONE)
+			at_gt = j;
+	if (at_gt != 2 || at.reply() != AT_PROMPT) {
+		printf("FAIL: prompt at %d\n", at_gt);
+		ok = false;
+	}
+	if (at.feed('\r') != AT_K_NONE || at.feed('\n') != AT_K_NONE) {
+		printf("FAIL: a line after the prompt\n");
+		ok = false;
+	}
+	// "OK" as DLGSM confirms with it
+	at.expect("OK");
+	for(int i = 0; i < 7; i++) {
+		std::string l = std::string(oks[i]) + "\r\n";
+		for(size_t j = 0; j < l.size(); j++)
+			at.feed(l[j]);
+		if (at.expected() != (i < 4)) {
+			printf("FAIL: \"%s\" expected %d for OK\n", oks[i], at.expected());
+			ok = false;
+		}
+	}
+	// A line cut short by a timeout, as PT_recvline() leaves it, then OK
+	static const char *cut[] = { "SEND O", "+CSQ: 1", "\x80\x13" "C" };
+	static const char *next[] = { "OK", "Call Ready" };
+	for(int i = 0; i < 3; i++)
+		for(int n = 0; n < 2; n++) {
+			for(const char *c = cut[i]; *c; c++)
+				at.feed(*c);
+			at.reset_line();
+			std::string l = std::string(next[n]) + "\r\n";
+			for(size_t j = 0; j < l.size(); j++)
+				at.feed(l[j]);
+			if (at.reply() != (n ? AT_CALL_READY : AT_OK) || at.expected() != !n) {
+				printf("FAIL: \"%s\" after \"%s\" and a timeout, reply %d\n", next[n], cut[i], at.reply());
+				ok = false;
+			}
+		}
+	return ok;
+}
+
+// strstr() a byte at a time as avr-libc does it, not the host's
+static const char *avr_strstr(const char *s, const char *find) {
+	for(; *s; s++) {
+		const char *a = s, *b = find;
+		while (*b && (compares++, *a == *b)) {
+			a++;
+			b++;
+		}
+		if (!*b)
+			return s;
+	}
+	return NULL;
+}
+
+// Host time per byte of looking at a line: strstr() of the confirmation,
+// ERROR and FAIL and the character checks of GSM_process_line() against
+// the parser fed each byte
+static void bench(Session_t *s) {
+	std::vector<std::string> lines;
+	std::string l;
+	DLATParser at;
+	long n, n_old, hits = 0;
+	for(size_t i = 0; i < s->bytes.size(); i++) {
+		l += s->bytes[i];
+		if (s->bytes[i] == '\n') {
+			lines.push_back(l);
+			l.clear();
+		}
+	}
+	compares = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for(n = 0; n < BENCH_BYTES;) {
+		for(size_t i = 0; i < lines.size(); i++) {
+			const char *b = lines[i].c_str();
+			hits += avr_strstr(b, "STATE:") != NULL;
+			hits += avr_strstr(b, "ERROR") != NULL || avr_strstr(b, "FAIL") != NULL;
+			hits += (b[0] == '+' && (b[2] == 'G' || b[2] == 'R')) + (b[0] == 'C' && b[5] == 'D');
+			n += lines[i].size();
+		}
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	n_old = n;
+	at.expect("STATE:");
+	table_reads = 0;
+	for(n = 0; n < BENCH_BYTES;) {
+		for(size_t i = 0; i < s->bytes.size(); i++) {
+			if (at.feed(s->bytes[i]) != AT_K_NONE)
+				hits += at.expected() + (at.kind() == AT_K_FAIL) + at.reply();
+		}
+		n += s->bytes.size();
+	}
+	auto t2 = std::chrono::steady_clock::now();
+	printf("strstr of lines: %4.2f compares/B %5.2f ns/B   parser: %4.2f table reads/B %5.2f ns/B  (%ld)\n",
+	       (double)compares / n_old, std::chrono::duration<double, std::nano>(t1 - t0).count() / n_old,
+	       (double)table_reads / n, std::chrono::duration<double, std::nano>(t2 - t1).count() / n, hits & 1);
+}
+
+static void report(const char *name, Count_t *c) {
+	printf("%-26s %5ld misread %5ld missed of %6ld commands  %5ld lines at the timeout (%4.0f s/session)  %4ld of %4ld URCs lost (%ld overflows)  %5ld of %5ld CLOSED seen\n",
+	       name, c->misread, c->missed, c->cmds, c->waits, (double)c->waits * TOUT_S / SESSIONS, c->lost, c->urcs, c->overflows,
+	       c->seen, c->closes);
+}
+
+int main() {
+	Session_t s;
+	Count_t old_c, new_c, stress;
+	bool ok = check_table();
+	memset(&old_c, 0, sizeof(old_c));
+	memset(&new_c, 0, sizeof(new_c));
+	memset(&stress, 0, sizeof(stress));
+	printf("%d sessions of %d parts, %d transfers each, up to %d URCs in one\n", SESSIONS, PARTS, WINDOWS, URCS);
+	for(int i = 0; i < SESSIONS; i++) {
+		session(&s, rnd() % (URCS + 1));
+		old_c.cmds += s.cmds.size();
+		new_c.cmds += s.cmds.size();
+		old_c.closes += s.closes;
+		new_c.closes += s.closes;
+		run_old(&s, &old_c);
+		run_new(&s, &new_c);
+	}
+	report("strstr of lines, before", &old_c);
+	report("DLATParser and the queue", &new_c);
+	if (new_c.misread || new_c.missed || new_c.waits || new_c.lost || new_c.seen != new_c.closes) {
+		printf("FAIL: the parser lost or misread a line\n");
+		ok = false;
+	}
+	for(int i = 0; i < SESSIONS / 10; i++) {
+		session(&s, STRESS_URCS);
+		stress.cmds += s.cmds.size();
+		stress.closes += s.closes;
+		run_new(&s, &stress);
+	}
+	report("parser, 20 URCs a session", &stress);
+	if (stress.lost != stress.overflows || stress.misread || stress.missed) {
+		printf("FAIL: URCs lost without a count\n");
+		ok = false;
+	}
+	session(&s, URCS);
+	bench(&s);
+	return ok ? 0 : 1;
+}
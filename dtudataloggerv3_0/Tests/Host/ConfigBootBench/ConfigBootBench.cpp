@@ -0,0 +1,354 @@
+/*
+  Boot time of DLConfig::load() by step for Config/CONFIG.TXT as
+  CONFIG.DAT: the text path as it was (port and EEPROM dumps, the file
+  read a byte at a time, dispatch, the whole struct written back), the
+  text path now (block reads through DLConfigParser into a
+  DLConfigImage, changed bytes written back) and the CONFIG.BIN path
+  (one read of the image compiled as Tools/DLConfigc does, its CRC).
+
+  Card time comes from DLSD on the SdHost card model, the counter replay
+  from DLCounters on an EEPROM model with a year of sets behind it. The
+  console costs CHAR_US a character at the skel's 19200 baud, counted
+  from what each path prints. CPU per byte is estimated in AVR cycles:
+  GETC_CYCLES for a byte through DLSD::read() up to a newline,
+  PARSE_CYCLES through DLConfigParser::feed(), CRC_CYCLES for the image
+  CRC. An EEPROM byte reads in EE_READ_US and writes in EE_WRITE_US.
+
+  The image read back from the card has to equal the compiled one and
+  the image the text path builds from the card blocks, and an image with
+  a flipped bit, another version or cut short has to be refused. The
+  CONFIG.BIN path has to be the fastest.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt -I../../../EEPROM -I../../../DLConfig ConfigBootBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../DLConfig/DLConfigParser.cpp ../../../DLConfig/DLConfigImage.cpp ../../../DLConfig/DLCounters.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o configbootbench
+*/
+#include <string>
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "DLSD.h"
+#include "DLConfigImage.h"
+#include "DLCounters.h"
+#include "SdHost.h"
+
+#define CONFIG_TXT "../../../Config/CONFIG.TXT"
+#define CARD_BLOCKS (64UL * 2048)
+#define CLUSTER_BLOCKS 8
+#define LOG_BUFF_SIZE 512
+#define CHAR_US (10 * 1e6 / 19200)
+#define F_CPU_MHZ 16.0
+#define GETC_CYCLES 120
+#define PARSE_CYCLES 40
+#define CRC_CYCLES 100
+#define EE_READ_US 0.75
+#define EE_WRITE_US 3400.0
+#define CHECK_US 15.0
+
+// As in DLConfig.h and DLSD.h
+#define NUM_IO 14
+#define CFG_SIZE 186 // sizeof(EEPROM_config_t) on the AVR
+#define CTR_RING_START 1024
+#define CTR_RING_SIZE 3072
+#define CTR_NUM (2 * NUM_FILES + 2)
+
+static uint8_t ee[4096];
+static unsigned long ee_reads;
+
+EEPROMClass EEPROM;
+
+uint8_t EEPROMClass::read(int addr) {
+	ee_reads++;
+	return ee[addr];
+}
+
+void EEPROMClass::write(int addr, uint8_t v) {
+	ee[addr] = v;
+}
+
+typedef struct {
+	double eeprom, counters, console, card, cpu, save;
+	long chars, reads, writes;
+} Boot_t;
+
+static double card_mark;
+
+// Card time since the last call
+static double card() {
+	double us = sdhost_stats.us - card_mark;
+	card_mark = sdhost_stats.us;
+	return us;
+}
+
+static long line_chars(const char *label, const std::string &val) {
+	return strlen(label) + val.size() + 2;
+}
+
+static std::string num(unsigned long v) {
+	return std::to_string(v);
+}
+
+// print_config_EEPROM() of a struct holding CONFIG.TXT
+static long print_config_chars() {
+	long n = line_chars("ID: ", "1") + line_chars("WDT Ev: ", "3") + line_chars("EPR Ev: ", "0");
+	for(int i = 0; i < NUM_FILES; i++)
+		n += line_chars("File cnt: ", "120") + line_chars("Saved cnt: ", "119");
+	return n + line_chars("APN: ", "internet") + line_chars("HTTP URL: ", "http://dl2.zsuatt.com/") +
+	       line_chars("Checksum: ", "4A527AD7");
+}
+
+// What both paths print around the config: files counts, counters
+static long common_chars() {
+	return 2 * NUM_FILES * line_chars("0 LFC: ", "120") + line_chars("Counters: ", "11");
+}
+
+// The lines config_process_callback() printed per key before
+static long old_key_chars(uint8_t key, uint8_t n, const char *val) {
+	switch (key) {
+	case CFG_PORT_MODE: return line_chars("Port : ", num(n) + " " + val);
+	case CFG_ID: return line_chars("Device ID: ", val);
+	case CFG_MEASURE_TIME: return line_chars("Measuring Time: ", val);
+	case CFG_SAMPLING_RATE: return line_chars("Sampling Rate: ", val);
+	case CFG_HTTP_URL: return line_chars("HTTP URL: ", val);
+	case CFG_HTTP_STATUS_TIME: case CFG_HTTP_STATUS_URL: return line_chars("HST: ", num(atol(val) * 60));
+	case CFG_HTTP_UPLOAD_TIME: case CFG_HTTP_UPLOAD_URL: return line_chars("HUT: ", num(atol(val) * 60));
+	case CFG_LOG_LATENCY: return line_chars("Log latency: ", val);
+	case CFG_LOG_FORMAT: return line_chars("Log format: ", "0");
+	}
+	return 0;
+}
+
+// The lines config_apply() prints
+static long apply_chars(ConfigImage_t *img) {
+	long n = 0;
+	for(int i = 0; i < NUM_IO; i++)
+		if ((img->mode_set >> i) & 1 && img->mode[i] && strchr("ACDEF", img->mode[i]))
+			n += line_chars("Port : ", num(i) + img->mode[i]);
+	if (CFG_HAS(img, CFG_ID))
+		n += line_chars("Device ID: ", num(img->id));
+	if (CFG_HAS(img, CFG_MEASURE_TIME))
+		n += line_chars("Measuring Time: ", num(img->measure_time));
+	if (CFG_HAS(img, CFG_SAMPLING_RATE))
+		n += line_chars("Sampling Rate: ", num(img->sampling_rate));
+	if (CFG_HAS(img, CFG_HTTP_URL))
+		n += line_chars("HTTP URL: ", img->HTTP_URL);
+	if (CFG_HAS(img, CFG_HTTP_STATUS_TIME))
+		n += line_chars("HST: ", num(img->http_status_time));
+	if (CFG_HAS(img, CFG_HTTP_UPLOAD_TIME))
+		n += line_chars("HUT: ", num(img->http_upload_time));
+	if (CFG_HAS(img, CFG_LOG_LATENCY))
+		n += line_chars("Log latency: ", num(img->log_latency));
+	if (CFG_HAS(img, CFG_LOG_FORMAT))
+		n += line_chars("Log format: ", "0");
+	return n;
+}
+
+// EEPROM struct and counter replay, the same for all paths
+static void eeprom_load(Boot_t *b) {
+	DLCounters ctr;
+	unsigned long reads = ee_reads;
+	for(int i = 0; i < CFG_SIZE; i++)
+		EEPROM.read(i);
+	b->eeprom = (ee_reads - reads) * EE_READ_US;
+	reads = ee_reads;
+	ctr.begin(CTR_RING_START, CTR_RING_SIZE, CTR_NUM);
+	b->counters = (ee_reads - reads) * (EE_READ_US + CHECK_US / CTR_ENTRY);
+	b->chars = common_chars();
+}
+
+static void boot_before(DLSD *sd, Boot_t *b) {
+	char line[LOG_BUFF_SIZE];
+	int rv;
+	DLConfigParser p;
+	uint8_t key;
+	eeprom_load(b);
+	b->chars += print_config_chars();
+	for(int i = 0; i < NUM_IO; i++)
+		b->chars += line_chars("Port : ", num(i) + "0");
+	card();
+	sd->open(CONFIG, O_READ);
+	sd->rewind(CONFIG);
+	do {
+		rv = sd->read(CONFIG, line, LOG_BUFF_SIZE - 1, '\n');
+		b->reads += strlen(line) + 1;
+		if (line[0] != '#' && line[0] != 0 && line[0] != '\n') {
+			// The key the line is for, for what got printed
+			for(char *c = line; *c; c++)
+				p.feed(*c);
+			if ((key = p.finish()) != CFG_KEY_NONE && key != CFG_KEY_BAD)
+				b->chars += old_key_chars(key, p.index(), p.value());
+		}
+	} while (rv >= 0);
+	sd->close(CONFIG);
+	b->card = card();
+	b->cpu = b->reads * GETC_CYCLES / F_CPU_MHZ;
+	b->writes = CFG_SIZE;
+	b->save = CFG_SIZE * EE_WRITE_US;
+}
+
+static bool boot_text(DLSD *sd, Boot_t *b, DLConfigImage *img) {
+	char buf[LOG_BUFF_SIZE];
+	int rv;
+	uint8_t key;
+	DLConfigParser p;
+	eeprom_load(b);
+	b->chars += print_config_chars();
+	card();
+	if (sd->read_file(CFG_IMAGE_NAME, buf, sizeof(buf)) >= 0)
+		return false;
+	sd->open(CONFIG, O_READ);
+	sd->rewind(CONFIG);
+	img->begin((1 << NUM_IO) - 1);
+	do {
+		rv = sd->read(CONFIG, buf, sizeof(buf));
+		for(int i = 0; i < rv; i++)
+			if ((key = p.feed(buf[i])) != CFG_KEY_NONE && (key == CFG_KEY_BAD || !img->set(key, p.index(), p.value())))
+				return false;
+		if (rv > 0)
+			b->reads += rv;
+	} while (rv > 0);
+	key = p.finish();
+	if (key != CFG_KEY_NONE && (key == CFG_KEY_BAD || !img->set(key, p.index(), p.value())))
+		return false;
+	sd->close(CONFIG);
+	b->card = card();
+	b->cpu = b->reads * PARSE_CYCLES / F_CPU_MHZ;
+	b->chars += apply_chars(img->get());
+	b->save = 2 * CFG_SIZE * EE_READ_US; // sync_config_EEPROM(), nothing changed
+	return true;
+}
+
+static bool boot_bin(DLSD *sd, Boot_t *b, DLConfigImage *img) {
+	char buf[LOG_BUFF_SIZE];
+	int rv;
+	eeprom_load(b);
+	card();
+	rv = sd->read_file(CFG_IMAGE_NAME, buf, sizeof(buf));
+	b->card = card();
+	if (rv <= 0 || !img->load((uint8_t *)buf, rv))
+		return false;
+	b->reads = rv;
+	b->cpu = sizeof(ConfigImage_t) * CRC_CYCLES / F_CPU_MHZ;
+	b->chars += line_chars(CFG_IMAGE_NAME, "") + apply_chars(img->get());
+	b->save = 2 * CFG_SIZE * EE_READ_US;
+	return true;
+}
+
+static double total(Boot_t *b) {
+	return b->eeprom + b->counters + b->chars * CHAR_US + b->card + b->cpu + b->save;
+}
+
+static void report(const char *name, Boot_t *b) {
+	printf("%-14s eeprom %5.1f  counters %5.1f  console %6.1f (%4ld chars)  card %5.1f  cpu %5.1f (%5ld bytes)  "
+	       "eeprom save %6.1f (%3ld writes)  total %7.1f ms\n", name, b->eeprom / 1000, b->counters / 1000,
+	       b->chars * CHAR_US / 1000, b->chars, b->card / 1000, b->cpu / 1000, b->reads, b->save / 1000, b->writes,
+	       total(b) / 1000);
+}
+
+// CONFIG.TXT compiled as Tools/DLConfigc does
+static bool compile(const std::string &text, DLConfigImage *img) {
+	DLConfigParser p;
+	uint8_t key;
+	img->begin((1 << NUM_IO) - 1);
+	for(size_t i = 0; i <= text.size(); i++) {
+		key = i < text.size() ? p.feed(text[i]) : p.finish();
+		if (key != CFG_KEY_NONE && (key == CFG_KEY_BAD || !img->set(key, p.index(), p.value())))
+			return false;
+	}
+	img->seal();
+	return true;
+}
+
+static bool put_file(DLSD *sd, uint8_t n, const void *buf, uint16_t len) {
+	sd->open(n, O_RDWR | O_CREAT | O_TRUNC);
+	sd->write(n, (uint8_t *)buf, len);
+	sd->close(n);
+	return sd->flush();
+}
+
+static bool refused(DLConfigImage *img, const char *what, int at, uint8_t x, uint16_t len) {
+	uint8_t buf[sizeof(ConfigImage_t)];
+	DLConfigImage r;
+	memcpy(buf, img->get(), sizeof(buf));
+	buf[at] ^= x;
+	if (r.load(buf, len)) {
+		printf("FAIL: image with %s loaded\n", what);
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	FILE *f = fopen(CONFIG_TXT, "rb");
+	std::string text;
+	char buf[512];
+	size_t n;
+	Boot_t before, text_now, bin;
+	DLConfigImage compiled, from_text, from_card;
+	DLCounters ctr;
+	if (f == NULL) {
+		printf("FAIL: no %s\n", CONFIG_TXT);
+		return 1;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		text.append(buf, n);
+	fclose(f);
+	if (!compile(text, &compiled)) {
+		printf("FAIL: CONFIG.TXT does not compile\n");
+		return 1;
+	}
+
+	// A year of counter sets in the ring
+	memset(ee, 0xFF, sizeof(ee));
+	ctr.begin(CTR_RING_START, CTR_RING_SIZE, CTR_NUM);
+	for(long i = 0; i < 60000; i++)
+		ctr.set(i % 7 ? 6 : 1, i);
+
+	DLSD sd(0, SS);
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sd.init();
+	put_file(&sd, CONFIG, text.data(), text.size());
+
+	memset(&before, 0, sizeof(before));
+	memset(&text_now, 0, sizeof(text_now));
+	memset(&bin, 0, sizeof(bin));
+	card_mark = sdhost_stats.us;
+	boot_before(&sd, &before);
+	if (!boot_text(&sd, &text_now, &from_text)) {
+		printf("FAIL: text path\n");
+		return 1;
+	}
+	from_text.seal();
+
+	// CONFIG.BIN next to it
+	{
+		SdFile bf;
+		if (!bf.open(CFG_IMAGE_NAME, O_RDWR | O_CREAT | O_TRUNC) ||
+		    bf.write(compiled.get(), sizeof(ConfigImage_t)) != sizeof(ConfigImage_t) || !bf.close()) {
+			printf("FAIL: writing %s\n", CFG_IMAGE_NAME);
+			return 1;
+		}
+	}
+	if (!boot_bin(&sd, &bin, &from_card)) {
+		printf("FAIL: %s path\n", CFG_IMAGE_NAME);
+		return 1;
+	}
+	if (memcmp(from_card.get(), compiled.get(), sizeof(ConfigImage_t)) ||
+	    memcmp(from_text.get(), compiled.get(), sizeof(ConfigImage_t))) {
+		printf("FAIL: images differ\n");
+		return 1;
+	}
+	if (!refused(&compiled, "a flipped bit", 60, 0x10, sizeof(ConfigImage_t)) ||
+	    !refused(&compiled, "another version", 4, 0x02, sizeof(ConfigImage_t)) ||
+	    !refused(&compiled, "a bad CRC", sizeof(ConfigImage_t) - 1, 0x80, sizeof(ConfigImage_t)) ||
+	    !refused(&compiled, "its end cut", 0, 0, sizeof(ConfigImage_t) - 1))
+		return 1;
+
+	printf("%s: %zu bytes, %s: %zu bytes\n", CONFIG_TXT, text.size(), CFG_IMAGE_NAME, sizeof(ConfigImage_t));
+	report("text before", &before);
+	report("text now", &text_now);
+	report(CFG_IMAGE_NAME, &bin);
+	if (total(&bin) >= total(&text_now) || total(&text_now) >= total(&before)) {
+		printf("FAIL: %s is not the fastest path\n", CFG_IMAGE_NAME);
+		return 1;
+	}
+	return 0;
+}
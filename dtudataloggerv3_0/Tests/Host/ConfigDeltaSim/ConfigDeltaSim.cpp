@@ -0,0 +1,276 @@
+/*
+  Config deltas over the card config as DLConfig keeps them: ROUNDS
+  random runs of up to DELTAS deltas of random KEY=value lines over
+  Config/CONFIG.TXT. Each delta is parsed into an image of its own,
+  merged into the CONFIG.OTA image as read back from its last write and
+  written again. The card config with CONFIG.OTA over it has to set what
+  the card text with all the delta lines appended sets, compiled in one
+  go. A CONFIG.OTA cut short or with a flipped byte has to be refused.
+  Prints the bytes of the config.php replies against the whole text.
+  Then deltas of port modes, windows and the measure time go in at random
+  ticks, mid-window, over a model of the counter windows of DLMeasure on
+  the digital ports, each counting a steady rate. Every window closed has
+  to give that rate, as DLMeasure::restart_window() sees to. Run again with
+  set_pin() only moving the window start, as it did, to show it catches
+  the rates that come out inflated then.
+
+  Build: g++ -O2 -I../../../DLConfig ConfigDeltaSim.cpp ../../../DLConfig/DLConfigParser.cpp ../../../DLConfig/DLConfigImage.cpp -o configdeltasim
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "DLConfigImage.h"
+
+#define CONFIG_TXT "../../../Config/CONFIG.TXT"
+#define ROUNDS 2000
+#define DELTAS 8
+#define LINES 6
+#define TICK 100 // ms, read_due() of every port
+#define TICKS 2000000L
+#define DIGITAL 8 // First digital port
+
+static const char *urls[] = { "http://dl2.zsuatt.com/", "http://dl.example.org/logger/", "http://10.0.0.2/" };
+static const char *apns[] = { "internet", "websp", "m2m.example" };
+static const char modes[] = "ACDEFX";
+
+// DLCommon's crc_update() for DLConfigImage, bit at a time
+unsigned long crc_update(unsigned long crc, uint8_t data) {
+	crc ^= data;
+	for(int i = 0; i < 8; i++)
+		crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320UL : 0);
+	return crc & 0xFFFFFFFFUL;
+}
+
+static std::string delta_line() {
+	char buf[80];
+	int n = rand() % CFG_IMAGE_PORTS;
+	switch (rand() % 10) {
+	case 0: snprintf(buf, sizeof(buf), "MEASURE_TIME = %d", rand() % 600 + 1); break;
+	case 1: snprintf(buf, sizeof(buf), "SAMPLING_RATE = %d", rand() % 20 + 1); break;
+	case 2: snprintf(buf, sizeof(buf), "PORT_MODE_%d = %c", n, modes[rand() % 6]); break;
+	case 3: snprintf(buf, sizeof(buf), "PORT_RATE_%d = %d", n, rand() % 5000); break;
+	case 4: snprintf(buf, sizeof(buf), "PORT_WINDOW_%d = %d", n, rand() % 3600); break;
+	case 5: snprintf(buf, sizeof(buf), "HTTP_STATUS_TIME = %d", rand() % 60 + 1); break;
+	case 6: snprintf(buf, sizeof(buf), "HTTP_UPLOAD_TIME = %d", rand() % 120 + 1); break;
+	case 7: snprintf(buf, sizeof(buf), "LOG_LATENCY = %d", rand() % 300); break;
+	case 8: snprintf(buf, sizeof(buf), "HTTP_URL = %s", urls[rand() % 3]); break;
+	default: snprintf(buf, sizeof(buf), "GPRS_APN = %s", apns[rand() % 3]); break;
+	}
+	return buf;
+}
+
+// The text into img as DLConfig::load_text() and delta_line() do
+static bool compile(const std::string &text, DLConfigImage *img, uint16_t ports) {
+	DLConfigParser p;
+	uint8_t key;
+	img->begin(ports);
+	for(size_t i = 0; i <= text.size(); i++) {
+		key = i < text.size() ? p.feed(text[i]) : p.finish();
+		if (key != CFG_KEY_NONE && (key == CFG_KEY_BAD || !img->set(key, p.index(), p.value())))
+			return false;
+	}
+	img->seal();
+	return true;
+}
+
+// Delta lines of what a counter window depends on, short windows
+static std::string window_line() {
+	char buf[40];
+	int n = DIGITAL + rand() % (CFG_IMAGE_PORTS - DIGITAL);
+	switch (rand() % 5) {
+	case 0: snprintf(buf, sizeof(buf), "MEASURE_TIME = %d", rand() % 20 + 1); break;
+	case 1: case 2: snprintf(buf, sizeof(buf), "PORT_MODE_%d = %c", n, "CCDX"[rand() % 4]); break;
+	default: snprintf(buf, sizeof(buf), "PORT_WINDOW_%d = %d", n, rand() % 20); break;
+	}
+	return buf;
+}
+
+// DLMeasure's counter windows, pulses in _cnt_vals until read_counter()
+struct Port {
+	char mode;
+	uint16_t window;
+	uint32_t wstart, cnt, sum;
+};
+
+struct Windows {
+	Port p[CFG_IMAGE_PORTS];
+	uint16_t measure_time;
+	uint32_t now;
+	bool fixed; // restart_window(), else set_pin() moves the start only
+	long closed, inflated;
+
+	void begin(bool f) {
+		memset(this, 0, sizeof(*this));
+		measure_time = 10;
+		fixed = f;
+	}
+	void restart_window(int i) {
+		p[i].cnt = 0;
+		p[i].sum = 0;
+		p[i].wstart = now;
+	}
+	uint32_t window_ms(int i) {
+		return (p[i].window > 0 ? p[i].window : measure_time) * 1000UL;
+	}
+	void set_pin(int i, char mode) {
+		char old = p[i].mode;
+		p[i].mode = mode;
+		if (!fixed)
+			p[i].wstart = now;
+		else if (mode != old)
+			restart_window(i);
+	}
+	void set_port_window(int i, uint16_t w) {
+		if (w == p[i].window)
+			return;
+		p[i].window = w;
+		if (fixed)
+			restart_window(i);
+	}
+	void set_measure_time(uint16_t t) {
+		if (t == measure_time)
+			return;
+		measure_time = t;
+		for(int i = DIGITAL; fixed && i < CFG_IMAGE_PORTS; i++)
+			if (p[i].window == 0)
+				restart_window(i);
+	}
+	// config_apply() of a delta, counters or off
+	void apply(const ConfigImage_t *img) {
+		for(int i = DIGITAL; i < CFG_IMAGE_PORTS; i++) {
+			if ((img->mode_set >> i) & 1)
+				set_pin(i, img->mode[i] == 'C' ? 'C' : 0);
+			if ((img->window_set >> i) & 1)
+				set_port_window(i, img->port_window[i]);
+		}
+		if (CFG_HAS(img, CFG_MEASURE_TIME))
+			set_measure_time(img->measure_time);
+	}
+	// Port i counts i-DIGITAL+1 pulses a tick, read_due() of the counters
+	void tick() {
+		now += TICK;
+		for(int i = DIGITAL; i < CFG_IMAGE_PORTS; i++) {
+			p[i].cnt += i - DIGITAL + 1;
+			if (p[i].mode != 'C')
+				continue;
+			p[i].sum += p[i].cnt;
+			p[i].cnt = 0;
+			if (now - p[i].wstart >= window_ms(i)) {
+				closed++;
+				if ((uint64_t)p[i].sum * 1000 * TICK != (uint64_t)(i - DIGITAL + 1) * 1000 * (now - p[i].wstart))
+					inflated++;
+				restart_window(i);
+			}
+		}
+	}
+};
+
+// Counter windows with deltas at random ticks, the deltas applied
+static long run(Windows *w, bool fixed) {
+	DLConfigImage delta;
+	long deltas = 0;
+	std::string lines;
+	srand(2);
+	w->begin(fixed);
+	for(int i = DIGITAL; i < CFG_IMAGE_PORTS; i++)
+		w->set_pin(i, 'C');
+	for(long t = 0; t < TICKS; t++) {
+		w->tick();
+		if (rand() % 50)
+			continue;
+		lines.clear();
+		for(int k = rand() % 3 + 1; k > 0; k--)
+			lines += window_line() + "\n";
+		if (!compile(lines, &delta, 0))
+			return -1;
+		w->apply(delta.get());
+		deltas++;
+	}
+	return deltas;
+}
+
+int main() {
+	FILE *f = fopen(CONFIG_TXT, "rb");
+	std::string text, all;
+	char buf[512];
+	size_t n;
+	long reply_bytes = 0, replies = 0;
+	DLConfigImage base, delta, ota, want, got;
+	uint8_t file[sizeof(ConfigImage_t)];
+	if (f == NULL) {
+		printf("FAIL: no %s\n", CONFIG_TXT);
+		return 1;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		text.append(buf, n);
+	fclose(f);
+	if (!compile(text, &base, (1 << CFG_IMAGE_PORTS) - 1)) {
+		printf("FAIL: CONFIG.TXT does not compile\n");
+		return 1;
+	}
+
+	srand(1);
+	for(int r = 0; r < ROUNDS; r++) {
+		bool have = false;
+		all = text;
+		for(int d = rand() % DELTAS + 1; d > 0; d--) {
+			std::string lines;
+			for(int k = rand() % LINES + 1; k > 0; k--) {
+				std::string l = delta_line();
+				lines += l + "\n";
+				reply_bytes += 3 + l.size() + 2; // CF ... \r\n
+			}
+			reply_bytes += 10; // CE <version>\r\n
+			replies++;
+			all += lines;
+			if (!compile(lines, &delta, 0)) {
+				printf("FAIL: delta does not compile:\n%s", lines.c_str());
+				return 1;
+			}
+			// delta_apply(): CONFIG.OTA read back, merged, written
+			if (!have || !ota.load(file, sizeof(file)))
+				ota.begin(0);
+			ota.merge(delta.get());
+			ota.seal();
+			memcpy(file, ota.get(), sizeof(file));
+			have = true;
+		}
+
+		// load(): the card config, then CONFIG.OTA over it
+		got = base;
+		if (!ota.load(file, sizeof(file))) {
+			printf("FAIL: CONFIG.OTA refused\n");
+			return 1;
+		}
+		got.merge(ota.get());
+		got.seal();
+		compile(all, &want, (1 << CFG_IMAGE_PORTS) - 1);
+		if (memcmp(got.get(), want.get(), sizeof(ConfigImage_t))) {
+			printf("FAIL: round %d, deltas over the card config differ from the text\n", r);
+			return 1;
+		}
+
+		memcpy(buf, file, sizeof(file));
+		buf[rand() % sizeof(file)] ^= 1 << (rand() % 8);
+		if (ota.load((uint8_t *)buf, sizeof(file)) || ota.load(file, rand() % sizeof(file))) {
+			printf("FAIL: round %d, torn CONFIG.OTA loaded\n", r);
+			return 1;
+		}
+	}
+	printf("%d rounds, %ld deltas: %.0f bytes a config.php reply, %zu of CONFIG.TXT, %zu of CONFIG.OTA\n", ROUNDS,
+	       replies, (double)reply_bytes / replies, text.size(), sizeof(ConfigImage_t));
+
+	static Windows fixed, moved;
+	long deltas = run(&fixed, true);
+	if (deltas < 0 || run(&moved, false) < 0) {
+		printf("FAIL: window delta does not compile\n");
+		return 1;
+	}
+	printf("%ld deltas mid-window: %ld counter windows, %ld off the rate; %ld of %ld with set_pin() moving the start only\n",
+	       deltas, fixed.closed, fixed.inflated, moved.inflated, moved.closed);
+	if (fixed.inflated || !moved.inflated) {
+		printf("FAIL: counter rates off across deltas\n");
+		return 1;
+	}
+	return 0;
+}
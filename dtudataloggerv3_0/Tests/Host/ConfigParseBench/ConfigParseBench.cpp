@@ -0,0 +1,460 @@
+/*
+  DLConfigParser against a reference parser of the same CONFIG.DAT rules
+  written the slow way with std::string. Every keyword has to be found
+  with and without its index as the table says, Config/CONFIG.TXT has to
+  parse without a bad line, and a fuzzed corpus of LINES lines (valid
+  lines with random blanks, CRLF, comments, near-miss keys, overlong
+  keys and values and mutated or random bytes) has to give the reference
+  results line by line, fed in 512 byte blocks and in random pieces.
+
+  The corpus is then written as CONFIG.DAT to the SdHost card and read
+  back the way load() does now and did before, reading bytes up to each
+  newline and dispatching lines as config_process_callback() did.
+  Reported are the host time per byte and the card time of both, the
+  DLSD read calls, and the lines of the corpus the old dispatch acts on
+  as another key or despite an unknown key or a bad line.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt -I../../../DLConfig ConfigParseBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../DLConfig/DLConfigParser.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o configparsebench
+*/
+#include <chrono>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include "DLConfigParser.h"
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define LINES 200000
+#define BLOCK 512
+#define CONFIG_TXT "../../../Config/CONFIG.TXT"
+#define CARD_BLOCKS (64UL * 2048)
+#define CLUSTER_BLOCKS 8
+
+typedef struct {
+	const char *name;
+	uint8_t key;
+	bool indexed;
+} Keyword_t;
+
+static const Keyword_t keywords[] = {
+	{ "ID", CFG_ID, false }, { "SECRET", CFG_SECRET, false },
+	{ "GPRS_APN", CFG_GPRS_APN, false }, { "GPRS_USER", CFG_GPRS_USER, false },
+	{ "GPRS_PASS", CFG_GPRS_PASS, false }, { "HTTP_URL", CFG_HTTP_URL, false },
+	{ "HTTP_STATUS_URL", CFG_HTTP_STATUS_URL, false }, { "HTTP_UPLOAD_URL", CFG_HTTP_UPLOAD_URL, false },
+	{ "HTTP_STATUS_TIME", CFG_HTTP_STATUS_TIME, false }, { "HTTP_UPLOAD_TIME", CFG_HTTP_UPLOAD_TIME, false },
+	{ "LOG_FORMAT", CFG_LOG_FORMAT, false }, { "LOG_LATENCY", CFG_LOG_LATENCY, false },
+	{ "MEASURE_TIME", CFG_MEASURE_TIME, false }, { "SAMPLING_RATE", CFG_SAMPLING_RATE, false },
+	{ "PORT_NAME", CFG_PORT_NAME, true }, { "PORT_FUNCT", CFG_PORT_FUNCT, true },
+	{ "PORT_MODE", CFG_PORT_MODE, true }, { "PORT_RATE", CFG_PORT_RATE, true },
+	{ "PORT_WINDOW", CFG_PORT_WINDOW, true }
+};
+#define KEYWORDS (sizeof(keywords) / sizeof(Keyword_t))
+
+typedef struct {
+	uint8_t key;
+	uint8_t index;
+	std::string val;
+	uint16_t line;
+} Result_t;
+
+static bool operator==(const Result_t &a, const Result_t &b) {
+	return a.key == b.key && a.line == b.line &&
+	       (a.key == CFG_KEY_BAD || (a.index == b.index && a.val == b.val));
+}
+
+static bool blank(char c) {
+	return c == ' ' || c == '\t';
+}
+
+// The rules of DLConfigParser.h, one line without its newline
+static Result_t reference(std::string s, uint16_t line) {
+	Result_t r = { CFG_KEY_BAD, 0, "", line };
+	size_t i = 0, k;
+	std::string key, name;
+	bool indexed = false;
+	for(size_t p; (p = s.find('\r')) != std::string::npos; )
+		s.erase(p, 1);
+	while (i < s.size() && blank(s[i]))
+		i++;
+	if (i == s.size() || s[i] == '#') {
+		r.key = CFG_KEY_NONE;
+		return r;
+	}
+	for(k = i; k < s.size() && s[k] != '=' && !blank(s[k]); k++)
+		if (!isalnum((unsigned char)s[k]) && s[k] != '_')
+			return r;
+	key = s.substr(i, k - i);
+	if (key.size() > CFG_KEY_MAX)
+		return r;
+	while (k < s.size() && blank(s[k]))
+		k++;
+	if (k == s.size() || s[k] != '=')
+		return r;
+	k++;
+	while (k < s.size() && blank(s[k]))
+		k++;
+	r.val = s.substr(k);
+	if (r.val.size() > CFG_VAL_MAX || r.val.find('\0') != std::string::npos)
+		return r;
+	while (r.val.size() && blank(r.val[r.val.size() - 1]))
+		r.val.erase(r.val.size() - 1);
+	name = key;
+	size_t d = key.find_last_not_of("0123456789") + 1;
+	if (d < key.size() && d > 1 && key[d - 1] == '_' && key.size() - d <= 3) {
+		if (atoi(key.c_str() + d) > 255)
+			return r;
+		r.index = atoi(key.c_str() + d);
+		name = key.substr(0, d - 1);
+		indexed = true;
+	}
+	for(size_t n = 0; n < KEYWORDS; n++)
+		if (name == keywords[n].name && indexed == keywords[n].indexed)
+			r.key = keywords[n].key;
+	if (r.key == CFG_KEY_BAD)
+		r.val = "";
+	return r;
+}
+
+static std::vector<Result_t> reference_all(const std::string &text) {
+	std::vector<Result_t> out;
+	size_t at = 0, nl;
+	uint16_t line = 0;
+	while (at < text.size()) {
+		nl = text.find('\n', at);
+		if (nl == std::string::npos)
+			nl = text.size();
+		Result_t r = reference(text.substr(at, nl - at), ++line);
+		if (r.key != CFG_KEY_NONE)
+			out.push_back(r);
+		at = nl + 1;
+	}
+	return out;
+}
+
+static void collect(DLConfigParser *p, uint8_t key, std::vector<Result_t> *out) {
+	if (key == CFG_KEY_NONE)
+		return;
+	Result_t r = { key, p->index(), key == CFG_KEY_BAD ? "" : p->value(), p->line() };
+	out->push_back(r);
+}
+
+// piece 0 feeds random pieces up to BLOCK bytes
+static std::vector<Result_t> parse(const std::string &text, int piece) {
+	DLConfigParser p;
+	std::vector<Result_t> out;
+	size_t at = 0, len;
+	char buf[BLOCK];
+	while (at < text.size()) {
+		len = piece ? piece : 1 + rand() % BLOCK;
+		if (len > text.size() - at)
+			len = text.size() - at;
+		memcpy(buf, text.data() + at, len);
+		for(size_t i = 0; i < len; i++)
+			collect(&p, p.feed(buf[i]), &out);
+		at += len;
+	}
+	collect(&p, p.finish(), &out);
+	return out;
+}
+
+// Keys found, the way load() reads the file now
+static long new_parse(DLSD *sd) {
+	DLConfigParser p;
+	char buf[BLOCK];
+	long keys = 0;
+	int rv;
+	uint8_t key;
+	sd->open(CONFIG, O_READ);
+	sd->rewind(CONFIG);
+	do {
+		rv = sd->read(CONFIG, buf, BLOCK);
+		for(int i = 0; i < rv; i++)
+			if ((key = p.feed(buf[i])) != CFG_KEY_NONE && key != CFG_KEY_BAD)
+				keys++;
+	} while (rv > 0);
+	key = p.finish();
+	sd->close(CONFIG);
+	return keys + (key != CFG_KEY_NONE && key != CFG_KEY_BAD);
+}
+
+// The key config_process_callback() acted on before, for a KEY = value line
+static uint8_t old_dispatch(char *line) {
+	char *ptr = strstr(line, "=");
+	if (ptr == NULL)
+		return CFG_KEY_NONE;
+	*ptr = 0;
+	if (strncmp(line, "PORT", 4) == 0) {
+		if (strncmp(line, "PORT_MOD", 8) == 0)
+			return CFG_PORT_MODE;
+		if (strncmp(line, "PORT_RAT", 8) == 0)
+			return CFG_PORT_RATE;
+		if (strncmp(line, "PORT_WIN", 8) == 0)
+			return CFG_PORT_WINDOW;
+	} else if (strncmp(line, "ID", 2) == 0) {
+		return CFG_ID;
+	} else if (strncmp(line, "ME", 2) == 0) {
+		if (line[8] == 'T')
+			return CFG_MEASURE_TIME;
+	} else if (strncmp(line, "SA", 2) == 0) {
+		return CFG_SAMPLING_RATE;
+	} else if (strncmp(line, "HT", 2) == 0) {
+		if (line[5] == 'U' && line[6] == 'R')
+			return CFG_HTTP_URL;
+		else if (line[5] == 'S')
+			return CFG_HTTP_STATUS_TIME;
+		else if (line[5] == 'U' && line[6] == 'P')
+			return CFG_HTTP_UPLOAD_TIME;
+	} else if (strncmp(line, "LOG_L", 5) == 0) {
+		return CFG_LOG_LATENCY;
+	} else if (strncmp(line, "LO", 2) == 0) {
+		return CFG_LOG_FORMAT;
+	} else if (strncmp(line, "GP", 2) == 0) {
+		if (line[5] == 'A')
+			return CFG_GPRS_APN;
+	}
+	return CFG_KEY_NONE;
+}
+
+// Keys the old dispatch did something for
+static bool old_handled(uint8_t key) {
+	return key != CFG_SECRET && key != CFG_GPRS_USER && key != CFG_GPRS_PASS && key != CFG_HTTP_STATUS_URL &&
+	       key != CFG_HTTP_UPLOAD_URL && key != CFG_PORT_NAME && key != CFG_PORT_FUNCT;
+}
+
+// Lines acted on, the way load() read the file before
+static long old_parse(DLSD *sd) {
+	char line[BLOCK];
+	long acted = 0;
+	int rv;
+	sd->open(CONFIG, O_READ);
+	sd->rewind(CONFIG);
+	do {
+		rv = sd->read(CONFIG, line, BLOCK - 1, '\n');
+		if (line[0] != '#' && line[0] != 0 && line[0] != '\n' && old_dispatch(line) != CFG_KEY_NONE)
+			acted++;
+	} while (rv >= 0);
+	sd->close(CONFIG);
+	return acted;
+}
+
+static std::string blanks() {
+	static const char *b[] = { "", "", " ", " ", "  ", "\t", " \t " };
+	return b[rand() % 7];
+}
+
+static std::string value() {
+	static const char *v[] = { "1", "60", "internet", "Counter", "Analog", "Value", "TEXT", "BINARY",
+	                           "http://attila.patup.com/dl/status.php", "R3dT3st", "", "Wind Vane" };
+	return v[rand() % 12];
+}
+
+static std::string valid_line(std::string *key_out) {
+	const Keyword_t *k = &keywords[rand() % KEYWORDS];
+	std::string key = k->name;
+	if (k->indexed)
+		key += "_" + std::to_string(rand() % 16);
+	*key_out = key;
+	return blanks() + key + blanks() + "=" + blanks() + value() + blanks();
+}
+
+static std::string fuzz_line() {
+	std::string key, s;
+	static const char *near[] = { "IDX", "HTTP_STATUS", "PORT_MODE", "PORT_MODE_", "PORT_MODE_1000",
+	                              "PORT_MODE_256", "ID_1", "LOG", "SAMPLES", "MEASURE_TIMES", "GRPS_PASS",
+	                              "HTTP_URLS", "port_mode_1", "MEASURE_DELAY", "PORT_WIN_2", "HTTP_UPLOAD" };
+	int r = rand() % 100;
+	if (r < 55)
+		s = valid_line(&key);
+	else if (r < 62)
+		s = blanks() + "# " + value();
+	else if (r < 67)
+		s = blanks();
+	else if (r < 75)
+		s = blanks() + near[rand() % 16] + blanks() + "=" + blanks() + value();
+	else if (r < 78)
+		s = std::string(CFG_KEY_MAX + rand() % 3, 'K') + " = 1";
+	else if (r < 81)
+		s = "HTTP_URL = http://" + std::string(CFG_VAL_MAX - 10 + rand() % 20, 'u') + blanks();
+	else if (r < 84) {
+		s = valid_line(&key); // No =
+		s.erase(s.find('='), 1);
+	} else if (r < 95) {
+		s = valid_line(&key);
+		int n = 1 + rand() % 3;
+		for(int i = 0; i < n && s.size(); i++) {
+			size_t at = rand() % s.size();
+			switch (rand() % 3) {
+			case 0: s[at] = (char)(rand() % 256); break;
+			case 1: s.erase(at, 1); break;
+			case 2: s.insert(at, 1, (char)(rand() % 256)); break;
+			}
+		}
+	} else {
+		int n = rand() % 80;
+		for(int i = 0; i < n; i++)
+			s += (char)(1 + rand() % 255);
+	}
+	for(size_t p; (p = s.find('\n')) != std::string::npos; )
+		s.erase(p, 1);
+	return s + (rand() % 4 ? "\n" : "\r\n");
+}
+
+static bool check(const char *what, const std::vector<Result_t> &got, const std::vector<Result_t> &want) {
+	size_t n = got.size() < want.size() ? got.size() : want.size();
+	for(size_t i = 0; i < n; i++) {
+		if (!(got[i] == want[i])) {
+			printf("FAIL: %s line %u: key %u index %u '%s', reference line %u key %u index %u '%s'\n", what,
+			       got[i].line, got[i].key, got[i].index, got[i].val.c_str(), want[i].line, want[i].key,
+			       want[i].index, want[i].val.c_str());
+			return false;
+		}
+	}
+	if (got.size() != want.size()) {
+		printf("FAIL: %s %zu results, reference %zu\n", what, got.size(), want.size());
+		return false;
+	}
+	return true;
+}
+
+static bool keyword_test() {
+	char line[64];
+	std::vector<Result_t> got;
+	for(size_t n = 0; n < KEYWORDS; n++) {
+		snprintf(line, sizeof(line), "%s_7 = 3\n", keywords[n].name);
+		got = parse(line, BLOCK);
+		if (got.size() != 1 || got[0].key != (keywords[n].indexed ? keywords[n].key : CFG_KEY_BAD) ||
+		    (keywords[n].indexed && got[0].index != 7)) {
+			printf("FAIL: %s_7\n", keywords[n].name);
+			return false;
+		}
+		snprintf(line, sizeof(line), "%s=3", keywords[n].name);
+		got = parse(line, BLOCK);
+		if (got.size() != 1 || got[0].key != (keywords[n].indexed ? CFG_KEY_BAD : keywords[n].key) ||
+		    (!keywords[n].indexed && got[0].val != "3")) {
+			printf("FAIL: %s\n", keywords[n].name);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool config_txt_test() {
+	FILE *f = fopen(CONFIG_TXT, "rb");
+	std::string text;
+	char buf[BLOCK];
+	size_t n;
+	int found = 0;
+	if (f == NULL) {
+		printf("FAIL: no %s\n", CONFIG_TXT);
+		return false;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		text.append(buf, n);
+	fclose(f);
+	std::vector<Result_t> got = parse(text, BLOCK);
+	if (!check("CONFIG.TXT", got, reference_all(text)))
+		return false;
+	for(size_t i = 0; i < got.size(); i++) {
+		if (got[i].key == CFG_KEY_BAD) {
+			printf("FAIL: CONFIG.TXT line %u is bad\n", got[i].line);
+			return false;
+		}
+		if ((got[i].key == CFG_ID && got[i].val == "1") || (got[i].key == CFG_GPRS_APN && got[i].val == "internet") ||
+		    (got[i].key == CFG_PORT_MODE && got[i].index == 0 && got[i].val == "Counter") ||
+		    (got[i].key == CFG_PORT_NAME && got[i].index == 3 && got[i].val == "External Temperature") ||
+		    (got[i].key == CFG_GPRS_USER && got[i].val == ""))
+			found++;
+	}
+	if (found != 5) {
+		printf("FAIL: CONFIG.TXT values\n");
+		return false;
+	}
+	printf("CONFIG.TXT: %zu keys, no bad lines\n", got.size());
+	return true;
+}
+
+int main() {
+	std::string text, key;
+	std::vector<Result_t> want, got;
+	long keys = 0, acted = 0, wrong = 0, wrong_bad = 0, bad = 0;
+	uint32_t card, card_new, card_old;
+	double t_new, t_old;
+	if (!keyword_test() || !config_txt_test())
+		return 1;
+
+	srand(11);
+	for(long i = 0; i < LINES; i++)
+		text += fuzz_line();
+	text += "ID = 9"; // No newline at the end
+	want = reference_all(text);
+	if (!check("blocks", parse(text, BLOCK), want) || !check("pieces", parse(text, 0), want) ||
+	    !check("bytes", parse(text, 1), want))
+		return 1;
+	for(size_t i = 0; i < want.size(); i++)
+		bad += want[i].key == CFG_KEY_BAD;
+	printf("Corpus: %ld lines, %zu bytes, %zu keys, %ld bad lines, all as the reference\n", LINES + 1L, text.size(),
+	       want.size() - bad, bad);
+
+	// Keys the old dispatch takes for another one
+	for(size_t at = 0, nl; at < text.size(); at = nl + 1) {
+		nl = text.find('\n', at);
+		if (nl == std::string::npos)
+			nl = text.size();
+		std::string l = text.substr(at, nl - at);
+		Result_t r = reference(l, 0);
+		if (r.key == CFG_KEY_NONE || l[0] == ' ' || l[0] == '\t' || l[0] == '#')
+			continue;
+		char buf[BLOCK];
+		snprintf(buf, sizeof(buf), "%s", l.c_str());
+		uint8_t old = old_dispatch(buf);
+		if (old == CFG_KEY_NONE)
+			continue;
+		if (r.key == CFG_KEY_BAD)
+			wrong_bad++;
+		else if (old != r.key || !old_handled(r.key))
+			wrong++;
+	}
+
+	// The corpus as CONFIG.DAT on the card model, without the bytes
+	// DLSD::read() up to a newline took for the end of the file
+	for(size_t i = 0; i < text.size(); i++)
+		if (text[i] & 0x80)
+			text[i] = '?';
+	want = reference_all(text);
+	bad = 0;
+	for(size_t i = 0; i < want.size(); i++)
+		bad += want[i].key == CFG_KEY_BAD;
+	DLSD sd(0, SS);
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sd.init();
+	sd.open(CONFIG, O_RDWR | O_CREAT | O_TRUNC);
+	for(size_t at = 0; at < text.size(); at += BLOCK)
+		sd.write(CONFIG, (uint8_t *)text.data() + at, text.size() - at < BLOCK ? text.size() - at : BLOCK);
+	sd.close(CONFIG);
+	sd.flush();
+
+	card = sdhost_stats.us;
+	auto t0 = std::chrono::steady_clock::now();
+	keys = new_parse(&sd);
+	auto t1 = std::chrono::steady_clock::now();
+	card_new = sdhost_stats.us - card;
+	card = sdhost_stats.us;
+	acted = old_parse(&sd);
+	auto t2 = std::chrono::steady_clock::now();
+	card_old = sdhost_stats.us - card;
+	t_new = std::chrono::duration<double, std::nano>(t1 - t0).count() / text.size();
+	t_old = std::chrono::duration<double, std::nano>(t2 - t1).count() / text.size();
+	if (keys != (long)(want.size() - bad)) {
+		printf("FAIL: %ld keys from the card, %ld\n", keys, (long)(want.size() - bad));
+		return 1;
+	}
+
+	printf("Parse from the card: host %.2f ns/byte in %d byte blocks, %.2f ns/byte by byte before, "
+	       "card %.0f ms, %.0f ms before\n", t_new, BLOCK, t_old, card_new / 1000.0, card_old / 1000.0);
+	printf("DLSD reads: %zu in blocks, %zu by byte before, %ld lines acted on before\n",
+	       (text.size() + BLOCK - 1) / BLOCK + 1, text.size() + 1, acted);
+	printf("Old dispatch: %ld lines with a known key acted on as another key, %ld bad lines acted on\n", wrong,
+	       wrong_bad);
+	return 0;
+}
@@ -0,0 +1,253 @@
+/*
+  EEPROM wear of the file and upload counters over YEARS years, kept in
+  the config struct by sync_config_EEPROM() as before against the
+  DLCounters ring DLConfig keeps them in now. A DATALOG file is rotated
+  every DATALOG_ROTATE_MIN minutes and a SYSLOG file every
+  SYSLOG_ROTATE_MIN (50000 byte files at the skel's line rates), each
+  rotation saving the files counts and then the saved counts. An upload
+  every UPLOAD_MIN minutes saves the saved counts, moving them on either
+  every time or only once per DATALOG file. The device reboots every
+  REBOOT_DAYS days, counting a WDT event and writing the whole struct
+  in load() as it does with both.
+
+  Reported are the writes of the most written cell, where it is and the
+  years to ENDURANCE writes, and the boot replay time of the ring from
+  the EEPROM reads and entry checks it takes at EE_READ_US and CHECK_US.
+  Every reboot the ring has to replay the values set last. Every
+  CUT_EVERY reboots the power goes after a random number of bytes of a
+  set(), the field set has to come back with its old or its new value
+  and all others as they were.
+
+  Build: g++ -O2 -DARDUINO=100 -I../SdHost -I../../../EEPROM -I../../../DLConfig EepromRingSim.cpp ../../../DLConfig/DLCounters.cpp -o eepromringsim
+*/
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "DLCounters.h"
+
+#define YEARS 10
+#define DATALOG_ROTATE_MIN 83
+#define SYSLOG_ROTATE_MIN 690
+#define UPLOAD_MIN 10
+#define REBOOT_DAYS 7
+#define CUT_EVERY 3
+#define ENDURANCE 100000UL
+#define EE_READ_US 0.75
+#define CHECK_US 15.0
+
+// As in DLConfig.h and DLSD.h
+#define NUM_FILES 5
+#define DATALOG 1
+#define SYSLOG 2
+#define CTR_RING_START 1024
+#define CTR_RING_SIZE 3072
+#define CTR_FILES 0
+#define CTR_SAVED NUM_FILES
+#define CTR_WDT (2 * NUM_FILES)
+#define CTR_NUM (2 * NUM_FILES + 1)
+
+#define EE_SIZE 4096
+#define CFG_SIZE 186 // sizeof(EEPROM_config_t) on the AVR
+#define CFG_WDT 2
+#define CFG_FILES 6
+#define CFG_SAVED 16
+#define CFG_CHECKSUM (CFG_SIZE - 4)
+
+static uint8_t ee[EE_SIZE];
+static unsigned long ee_writes[EE_SIZE], ee_reads;
+static long cut = -1; // Writes until the power goes, -1 never
+
+EEPROMClass EEPROM;
+
+uint8_t EEPROMClass::read(int addr) {
+	ee_reads++;
+	return ee[addr];
+}
+
+void EEPROMClass::write(int addr, uint8_t v) {
+	if (cut == 0)
+		return;
+	if (cut > 0)
+		cut--;
+	ee[addr] = v;
+	ee_writes[addr]++;
+}
+
+typedef struct {
+	uint16_t v[CTR_NUM];
+} Counters_t;
+
+// The config struct of the old scheme, written by sync_config_EEPROM()
+static uint8_t cfg[CFG_SIZE];
+static unsigned long cfg_writes[CFG_SIZE];
+
+static uint32_t crc32(const uint8_t *p, int len) {
+	uint32_t crc = 0xFFFFFFFFUL;
+	while (len--) {
+		crc ^= *p++;
+		for(int k = 0; k < 8; k++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320UL : crc >> 1;
+	}
+	return ~crc;
+}
+
+static void cfg_sync(Counters_t *c, bool all) {
+	uint8_t img[CFG_SIZE];
+	uint32_t crc;
+	memcpy(img, cfg, CFG_SIZE);
+	img[CFG_WDT] = c->v[CTR_WDT];
+	img[CFG_WDT + 1] = c->v[CTR_WDT] >> 8;
+	for(int i = 0; i < NUM_FILES; i++) {
+		img[CFG_FILES + 2 * i] = c->v[CTR_FILES + i];
+		img[CFG_FILES + 2 * i + 1] = c->v[CTR_FILES + i] >> 8;
+		img[CFG_SAVED + 2 * i] = c->v[CTR_SAVED + i];
+		img[CFG_SAVED + 2 * i + 1] = c->v[CTR_SAVED + i] >> 8;
+	}
+	crc = crc32(img, CFG_CHECKSUM);
+	memcpy(img + CFG_CHECKSUM, &crc, 4);
+	for(int i = 0; i < CFG_SIZE; i++) {
+		if (all || img[i] != cfg[i])
+			cfg_writes[i]++;
+		cfg[i] = img[i];
+	}
+}
+
+typedef struct {
+	unsigned long max;
+	int cell;
+} Wear_t;
+
+static Wear_t wear(unsigned long *w, int from, int to) {
+	Wear_t r = { 0, from };
+	for(int i = from; i < to; i++) {
+		if (w[i] > r.max) {
+			r.max = w[i];
+			r.cell = i;
+		}
+	}
+	return r;
+}
+
+static double years_to(unsigned long writes) {
+	return writes ? YEARS * (double)ENDURANCE / writes : 1e9;
+}
+
+typedef struct {
+	Counters_t c;
+	DLCounters *ring;
+	double replay_max, replay_sum; // us
+	long boots, cuts, sets;
+	bool ok;
+} Device_t;
+
+static void replay(Device_t *d, int torn, uint16_t old) {
+	unsigned long reads = ee_reads;
+	uint8_t found;
+	double us;
+	delete d->ring;
+	d->ring = new DLCounters();
+	found = d->ring->begin(CTR_RING_START, CTR_RING_SIZE, CTR_NUM);
+	us = (ee_reads - reads) * EE_READ_US + (ee_reads - reads) / CTR_ENTRY * CHECK_US;
+	if (us > d->replay_max)
+		d->replay_max = us;
+	d->replay_sum += us;
+	d->boots++;
+	for(int f = 0; f < CTR_NUM; f++) {
+		uint16_t v = d->ring->known(f) ? d->ring->get(f) : 0;
+		if (f == torn && (v == old || v == d->c.v[f])) {
+			d->c.v[f] = v;
+			continue;
+		}
+		if (v != d->c.v[f]) {
+			printf("FAIL: boot %ld field %d replayed %u, set %u%s\n", d->boots, f, v, d->c.v[f],
+			       f == torn ? " (torn)" : "");
+			d->ok = false;
+		}
+	}
+	if (found != CTR_NUM && d->boots > 1) {
+		printf("FAIL: boot %ld found %u fields\n", d->boots, found);
+		d->ok = false;
+	}
+}
+
+static void set(Device_t *d, int f, uint16_t v) {
+	if (!d->ring->known(f) || d->ring->get(f) != v)
+		d->sets++;
+	d->c.v[f] = v;
+	d->ring->set(f, v);
+}
+
+// save_files_count(saved) of both schemes
+static void save(Device_t *d, bool saved) {
+	for(int i = 0; i < NUM_FILES; i++)
+		set(d, (saved ? CTR_SAVED : CTR_FILES) + i, d->c.v[(saved ? CTR_SAVED : CTR_FILES) + i]);
+	cfg_sync(&d->c, false);
+}
+
+static bool run(bool every_upload) {
+	const long minutes = YEARS * 365L * 24 * 60;
+	Device_t d;
+	Wear_t ring, old_w;
+	int torn;
+	uint16_t old;
+	memset(&d, 0, sizeof(d));
+	d.ok = true;
+	memset(ee, 0xFF, sizeof(ee));
+	memset(ee_writes, 0, sizeof(ee_writes));
+	memset(cfg, 0xFF, sizeof(cfg));
+	memset(cfg_writes, 0, sizeof(cfg_writes));
+	srand(5);
+	replay(&d, -1, 0);
+	for(long m = 1; m <= minutes; m++) {
+		if (m % DATALOG_ROTATE_MIN == 0) {
+			d.c.v[CTR_FILES + DATALOG]++;
+			save(&d, false);
+			save(&d, true);
+		}
+		if (m % SYSLOG_ROTATE_MIN == 0) {
+			d.c.v[CTR_FILES + SYSLOG]++;
+			save(&d, false);
+			save(&d, true);
+		}
+		if (m % UPLOAD_MIN == 0 && (every_upload ||
+		    d.c.v[CTR_SAVED + DATALOG] < d.c.v[CTR_FILES + DATALOG])) {
+			d.c.v[CTR_SAVED + DATALOG]++;
+			save(&d, true);
+		}
+		if (m % (REBOOT_DAYS * 24 * 60) == 0) {
+			torn = -1;
+			old = d.c.v[CTR_WDT];
+			if (d.boots % CUT_EVERY == 0) {
+				torn = CTR_WDT;
+				cut = rand() % (2 * CTR_ENTRY);
+			}
+			set(&d, CTR_WDT, old + 1); // wdt_event() in reboot()
+			if (torn < 0)
+				cfg_sync(&d.c, false);
+			cut = -1;
+			replay(&d, torn, old);
+			cfg_sync(&d.c, true); // save_config_EEPROM() in load()
+			d.cuts += torn >= 0;
+		}
+	}
+	ring = wear(ee_writes, CTR_RING_START, CTR_RING_START + CTR_RING_SIZE);
+	old_w = wear(cfg_writes, 0, CFG_SIZE);
+	printf("%d years, saved counts moved on %s:\n", YEARS, every_upload ? "every upload" : "once per DATALOG file");
+	printf("  struct   %7ld sets  max %7lu writes at %3d  %6.1f years to %lu\n", d.sets, old_w.max, old_w.cell,
+	       years_to(old_w.max), ENDURANCE);
+	printf("  ring     %7ld sets  max %7lu writes at %4d %6.1f years to %lu, struct %ld at boot\n", d.sets,
+	       ring.max, ring.cell, years_to(ring.max), ENDURANCE, d.boots);
+	printf("  replay   %ld boots, %ld power cuts, mean %.2f ms  max %.2f ms\n", d.boots, d.cuts,
+	       d.replay_sum / d.boots / 1000, d.replay_max / 1000);
+	delete d.ring;
+	if (ring.max > ENDURANCE) {
+		printf("FAIL: a cell of the ring wears out within %d years\n", YEARS);
+		return false;
+	}
+	return d.ok;
+}
+
+int main() {
+	if (!run(true) || !run(false))
+		return 1;
+	return 0;
+}
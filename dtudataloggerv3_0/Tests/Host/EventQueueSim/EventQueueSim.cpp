@@ -0,0 +1,156 @@
+/*
+  Bursts of door/switch edges on two event ports, logged the old way
+  (one line per wakeup, nothing within 500 ms of the last line) and
+  through DLEventQueue drained in batches by the event thread.
+  Reports edges logged, edges lost, SD writes and the worst queue depth,
+  and checks that the queue hands back every edge in order. Then the ms
+  between two edges of a quiet port, from micros() alone and with
+  event_delta_ms(), for gaps past the 71.6 min micros() wrap.
+
+  Build: g++ -O2 -I../../../DLMeasure EventQueueSim.cpp ../../../DLMeasure/DLEvents.cpp -o eventqueuesim
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include "DLEvents.h"
+
+#define SIM_SECONDS 3600
+#define BURSTS_PER_HOUR 400
+#define LOG_BUFF_SIZE 512
+#define EVENT_LINE_MAX 48
+#define LINE_LEN 36 // Typical "E.. p:l:ms:us" line
+
+typedef struct {
+	double t; // us
+	uint8_t port, level;
+} Edge_t;
+
+static double frand() {
+	return rand() / (double)RAND_MAX;
+}
+
+// Latency before the event thread gets the CPU, as in ADCScanSim
+static double thread_latency_us() {
+	double r = frand();
+	if (r < 0.02)
+		return 20000.0 + 20000.0 * frand(); // SD sync / FAT update
+	if (r < 0.10)
+		return 2000.0 + 3000.0 * frand(); // GSM line processing
+	return 1000.0 * frand();
+}
+
+// A door opening: contact bounce, then a few open/close cycles
+static void make_edges(std::vector<Edge_t> &e) {
+	uint8_t level[2] = { 0, 0 };
+	for(int b = 0; b < BURSTS_PER_HOUR * SIM_SECONDS / 3600; b++) {
+		double t = frand() * SIM_SECONDS * 1e6;
+		uint8_t port = 12 + (rand() & 1);
+		int n = 2 + rand() % 20;
+		for(int k = 0; k < n; k++) {
+			t += k < 6 ? 200.0 + 3000.0 * frand() : 50000.0 + 400000.0 * frand();
+			level[port - 12] ^= 1;
+			Edge_t x = { t, port, level[port - 12] };
+			e.push_back(x);
+		}
+	}
+	for(size_t i = 1; i < e.size(); i++) // Insertion sort, nearly sorted per burst
+		for(size_t j = i; j > 0 && e[j].t < e[j - 1].t; j--) {
+			Edge_t x = e[j]; e[j] = e[j - 1]; e[j - 1] = x;
+		}
+}
+
+// got_event flag, a wakeup logs the current state once
+static void run_old(const std::vector<Edge_t> &e) {
+	double wake = -1, last = -1e9;
+	long logged = 0, writes = 0;
+	for(size_t i = 0; i < e.size(); i++) {
+		if (wake >= 0 && e[i].t >= wake) {
+			if (wake - last >= 500000.0) {
+				logged++;
+				writes++;
+				last = wake;
+			}
+			wake = -1;
+		}
+		if (wake < 0)
+			wake = e[i].t + thread_latency_us();
+	}
+	if (wake >= 0 && wake - last >= 500000.0) {
+		logged++;
+		writes++;
+	}
+	printf("flag  : %6zu edges  logged %6ld  lost %6ld  SD writes %6ld  ms deltas\n",
+	       e.size(), logged, (long)e.size() - logged, writes);
+}
+
+static void run_queue(const std::vector<Edge_t> &e) {
+	DLEventQueue q;
+	Event_t ev;
+	double wake = -1;
+	long logged = 0, writes = 0, bad = 0;
+	size_t next = 0; // Next edge expected out of the queue
+	uint8_t depth = 0;
+
+	for(size_t i = 0; i <= e.size(); i++) {
+		double t = i < e.size() ? e[i].t : 1e18;
+		// The event thread drains before this edge if it got the CPU by then
+		while (wake >= 0 && wake <= t) {
+			int n = 0;
+			while (n + EVENT_LINE_MAX <= LOG_BUFF_SIZE && q.pop(&ev)) {
+				while (next < e.size() && (uint32_t)e[next].t != ev.ts)
+					next++; // Dropped by a full queue
+				if (next == e.size() || (ev.port & ~EVQ_LEVEL) != e[next].port ||
+				    ((ev.port & EVQ_LEVEL) != 0) != (e[next].level != 0))
+					bad++;
+				next++;
+				n += LINE_LEN;
+				logged++;
+			}
+			writes++;
+			wake = q.available() ? wake + thread_latency_us() : -1;
+		}
+		if (i == e.size())
+			break;
+		q.push(e[i].port, e[i].level, (uint32_t)e[i].t);
+		if (q.available() > depth)
+			depth = q.available();
+		if (wake < 0)
+			wake = e[i].t + thread_latency_us();
+	}
+	printf("queue : %6zu edges  logged %6ld  lost %6lu  SD writes %6ld  us timestamps, max depth %u/%d\n",
+	       e.size(), logged, (unsigned long)q.get_overflows(), writes, depth, EVQ_SIZE - 1);
+	if (bad || logged + (long)q.get_overflows() != (long)e.size()) {
+		printf("FAIL: %ld edges out of order or wrong\n", bad);
+		exit(1);
+	}
+}
+
+// Edges gap_s apart, each read out drain_us after it as next_event()
+static bool quiet_port(double gap_s, double drain_us) {
+	uint64_t t1 = 5000123, t2 = t1 + (uint64_t)(gap_s * 1e6); // us since boot
+	uint64_t now1 = t1 + (uint64_t)drain_us, now2 = t2 + (uint64_t)drain_us;
+	uint32_t ms1 = (uint32_t)(now1 / 1000) - ((uint32_t)now1 - (uint32_t)t1) / 1000;
+	uint32_t ms2 = (uint32_t)(now2 / 1000) - ((uint32_t)now2 - (uint32_t)t2) / 1000;
+	long truth = (long)((t2 - t1) / 1000);
+	long old = (long)(((uint32_t)t2 - (uint32_t)t1) / 1000);
+	long got = (long)event_delta_ms((uint32_t)t2 - (uint32_t)t1, ms2 - ms1);
+	bool ok = labs(got - truth) <= 2;
+	printf("quiet %6.0f s: %10ld ms  micros() only %10ld  event_delta_ms %10ld  %s\n", gap_s, truth, old, got,
+	       ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main() {
+	std::vector<Edge_t> e;
+	srand(1);
+	make_edges(e);
+	printf("%d s, %d door bursts of 2-21 edges on 2 ports\n", SIM_SECONDS, BURSTS_PER_HOUR);
+	run_old(e);
+	run_queue(e);
+	static const double gaps[] = { 1, 3600, 4294, 4296, 72 * 60, 6 * 3600, 30 * 86400 };
+	bool ok = true;
+	for(unsigned i = 0; i < sizeof(gaps) / sizeof(gaps[0]); i++)
+		ok &= quiet_port(gaps[i], 20000);
+	return ok ? 0 : 1;
+}
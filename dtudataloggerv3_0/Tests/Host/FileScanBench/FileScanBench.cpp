@@ -0,0 +1,154 @@
+/*
+  Boot time file discovery with 10000 rotated DATALOG files. Compares
+  the exists() probe per sequence number, started from a lost (0) and an
+  up to date EEPROM count, against DLSD::seek_forward_files_count() with
+  one pass over the directories and with the FILES.IDX index. Times come
+  from the SdHost card model. Also checks that the index follows a
+  rotation, and that an index left stale by a reset or a deleted file
+  falls back to the scan.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt FileScanBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o filescanbench
+*/
+#include <string>
+#include <Arduino.h>
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define DATA_FILES 10000
+#define SYS_FILES 300
+#define CARD_BLOCKS (128UL * 2048)
+#define CLUSTER_BLOCKS 8
+
+static bool populate(const char *dir, const char *prefix, int files) {
+	SdBaseFile d, f;
+	char name[13];
+	if (!d.open(SdBaseFile::cwd(), dir, O_READ))
+		return false;
+	for(int i = 0; i < files; i++) {
+		snprintf(name, sizeof(name), "%s%05d.DAT", prefix, i);
+		if (!f.open(&d, name, O_CREAT | O_WRITE | O_EXCL))
+			return false;
+		f.close();
+	}
+	return true;
+}
+
+// A fresh boot: init and the counts from EEPROM
+static void boot(DLSD *sd, uint16_t eeprom) {
+	sd->init();
+	sd->set_files_count(DATALOG, eeprom);
+	sd->set_files_count(SYSLOG, eeprom ? SYS_FILES - 1 : 0);
+	sdhost_reset_stats();
+}
+
+// The loop seek_forward_files_count() used to be, probing from the count
+static void probe(DLSD *sd, uint8_t n, const char *dir, const char *prefix) {
+	char path[24];
+	uint16_t cnt = sd->get_files_count(n);
+	for(;;) {
+		snprintf(path, sizeof(path), "%s/%s%05u.DAT", dir, prefix, cnt + 1);
+		if (!sd->exists(path))
+			break;
+		cnt++;
+	}
+	sd->set_files_count(n, cnt);
+}
+
+static bool report(const char *name, DLSD *sd, uint16_t data, uint16_t sys) {
+	printf("%-32s: %9.1f ms  %7u blocks read  DAT%05u SYS%05u\n", name, sdhost_stats.us / 1000.0,
+	       sdhost_stats.blocks_read, sd->get_files_count(DATALOG), sd->get_files_count(SYSLOG));
+	if (sd->get_files_count(DATALOG) != data || sd->get_files_count(SYSLOG) != sys) {
+		printf("FAIL: expected DAT%05u SYS%05u\n", data, sys);
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	DLSD *sd;
+	uint16_t last = DATA_FILES - 1;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sd = new DLSD(0, SS);
+	sd->init();
+	if (!populate("DATA", "DAT", DATA_FILES) || !populate("SYSTEM", "SYS", SYS_FILES)) {
+		printf("FAIL: populate\n");
+		return 1;
+	}
+	delete sd;
+	printf("%d DATA files, %d SYSTEM files\n", DATA_FILES, SYS_FILES);
+
+	sd = new DLSD(0, SS);
+	boot(sd, 0);
+	probe(sd, DATALOG, "DATA", "DAT");
+	probe(sd, SYSLOG, "SYSTEM", "SYS");
+	if (!report("exists() probes, EEPROM count 0", sd, last, SYS_FILES - 1))
+		return 1;
+	delete sd;
+
+	sd = new DLSD(0, SS);
+	boot(sd, last);
+	probe(sd, DATALOG, "DATA", "DAT");
+	probe(sd, SYSLOG, "SYSTEM", "SYS");
+	if (!report("exists() probes, EEPROM in sync", sd, last, SYS_FILES - 1))
+		return 1;
+	delete sd;
+
+	// No index yet, as after the update
+	sd = new DLSD(0, SS);
+	boot(sd, 0);
+	sd->seek_forward_files_count();
+	if (!report("directory scan, EEPROM count 0", sd, last, SYS_FILES - 1))
+		return 1;
+	delete sd;
+
+	sd = new DLSD(0, SS);
+	boot(sd, 0);
+	sd->seek_forward_files_count();
+	if (!report("index, EEPROM count 0", sd, last, SYS_FILES - 1))
+		return 1;
+	delete sd;
+
+	// Rotation: the index follows the new file
+	sd = new DLSD(0, SS);
+	boot(sd, last);
+	sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
+	sd->increment_file(DATALOG);
+	sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
+	sd->close(DATALOG);
+	delete sd;
+	sd = new DLSD(0, SS);
+	boot(sd, 0);
+	sd->seek_forward_files_count();
+	if (!report("index after rotation", sd, last + 1, SYS_FILES - 1))
+		return 1;
+	delete sd;
+
+	// Reset between the rotation and the file being created
+	sd = new DLSD(0, SS);
+	boot(sd, last + 1);
+	sd->increment_file(DATALOG);
+	delete sd;
+	sd = new DLSD(0, SS);
+	boot(sd, 0);
+	sd->seek_forward_files_count();
+	if (!report("index stale after reset, scan", sd, last + 1, SYS_FILES - 1))
+		return 1;
+	delete sd;
+
+	// The newest file went away behind the index
+	sd = new DLSD(0, SS);
+	boot(sd, 0);
+	if (!SdBaseFile::remove(SdBaseFile::cwd(), "DATA/DAT10000.DAT")) {
+		printf("FAIL: remove\n");
+		return 1;
+	}
+	delete sd;
+	sd = new DLSD(0, SS);
+	boot(sd, 0);
+	sd->seek_forward_files_count();
+	if (!report("index stale after delete, scan", sd, last, SYS_FILES - 1))
+		return 1;
+	delete sd;
+	return 0;
+}
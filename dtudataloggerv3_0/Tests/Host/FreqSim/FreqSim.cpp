@@ -0,0 +1,101 @@
+/*
+  Interrupt load of the two counter backends over input frequency.
+  PCINT: every edge of the input runs DIGITAL_ISR_VECT.
+  Timer: Timer1 counts the edges on T1, the real DLFreq gets a compare
+  interrupt per block and is harvested on the sampling tick the way
+  DLMeasure::read_freq() does. Timer3 overflows keep the timebase.
+  Checks that every pulse is counted and the period statistics against
+  the simulated input. Loads are after the first second, which the
+  block size needs to settle from 1 edge. Cycle counts per ISR are
+  estimates from the generated code, CPU load is at 16MHz.
+
+  Build: g++ -O2 -I../../../DLMeasure FreqSim.cpp ../../../DLMeasure/DLFreq.cpp -o freqsim
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "DLFreq.h"
+#include "DLStats.h"
+
+#define F_CPU 16000000.0
+#define SIM_SECONDS 60
+#define TICK_US 200000.0 // SAMPLING_RATE = 5
+#define PCINT_CYCLES 190 // Pin change ISR, scan of the port byte
+#define COMPA_CYCLES 600 // DLFreq::block(), 64 bit square included
+#define T3OVF_CYCLES 40
+#define HARVEST_CYCLES 900 // read_freq() with the merge into the stats
+
+static double frand() {
+	return rand() / (double)RAND_MAX;
+}
+
+static int run(double hz) {
+	DLFreq f;
+	FreqAcc_t a;
+	PeriodStat period;
+	uint16_t tcnt = 0, top;
+	double t = 0, next_tick = TICK_US, ref_sum = 0;
+	long edges = 0, blocks = 0, harvests = 0, settled = 0;
+	uint64_t counted = 0;
+
+	f.start(0);
+	top = f.get_top();
+	// Wind speed noise, 5% period jitter
+	for(t = (1e6 / hz) * frand(); t < SIM_SECONDS * 1e6; ) {
+		while (next_tick <= t) {
+			if (f.harvest(&a, tcnt, (uint32_t)(next_tick * FREQ_T3_HZ / 1e6))) {
+				top = f.get_top();
+				tcnt = 0;
+			}
+			period.merge(a.sum, a.sqsum, a.cnt, a.min, a.max);
+			counted += a.pulses;
+			harvests++;
+			next_tick += TICK_US;
+		}
+		edges++;
+		if (t >= 1e6)
+			settled++;
+		if (tcnt++ == top) { // CTC: compare match and back to 0
+			tcnt = 0;
+			f.block((uint32_t)(t * FREQ_T3_HZ / 1e6));
+			if (t >= 1e6)
+				blocks++;
+		}
+		double p = (1e6 / hz) * (1.0 + 0.05 * (2 * frand() - 1));
+		ref_sum += p;
+		t += p;
+	}
+	f.harvest(&a, tcnt, (uint32_t)(next_tick * FREQ_T3_HZ / 1e6));
+	counted += a.pulses;
+	period.merge(a.sum, a.sqsum, a.cnt, a.min, a.max);
+
+	double ref_mean = ref_sum / edges;
+	double mean = period.mean() * FREQ_US;
+	double secs = SIM_SECONDS - 1;
+	double pcint_cpu = 100.0 * 2 * settled * PCINT_CYCLES / (F_CPU * secs);
+	double timer_cpu = 100.0 * (blocks * COMPA_CYCLES + harvests * HARVEST_CYCLES * secs / SIM_SECONDS +
+	                   secs * (FREQ_T3_HZ / 65536.0) * T3OVF_CYCLES) / (F_CPU * secs);
+	printf("%8.0f Hz  PCINT %9.0f irq/s %6.2f%%   timer %6.1f irq/s %6.3f%%  blocks of %5u  period %9.2f us (err %6.3f%%)\n",
+	       hz, 2.0 * settled / secs, pcint_cpu, blocks / secs, timer_cpu,
+	       (unsigned)top + 1, mean, 100.0 * fabs(mean - ref_mean) / ref_mean);
+	if (counted != (uint64_t)edges) {
+		printf("FAIL: %llu of %ld pulses counted\n", (unsigned long long)counted, edges);
+		return 0;
+	}
+	// Periods are only taken from whole blocks, allow for one timebase tick
+	if (period.count() == 0 || fabs(mean - ref_mean) > ref_mean * 0.01 + FREQ_US) {
+		printf("FAIL: period %.2f us, expected %.2f us\n", mean, ref_mean);
+		return 0;
+	}
+	return 1;
+}
+
+int main() {
+	double hz[] = { 1, 3, 10, 35, 100, 500, 2000, 8000, 20000 };
+	srand(1);
+	printf("%d s per frequency, harvest every %.0f ms\n", SIM_SECONDS, TICK_US / 1000);
+	for(unsigned i = 0; i < sizeof(hz) / sizeof(hz[0]); i++)
+		if (!run(hz[i]))
+			return 1;
+	return 0;
+}
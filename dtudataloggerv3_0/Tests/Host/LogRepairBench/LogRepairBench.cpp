@@ -0,0 +1,215 @@
+/*
+  Framed DATALOG records and the boot repair of DLSD. A record is torn at
+  every byte offset of its frame and the next boot has to cut exactly
+  that record. Then the power is cut on the block write carrying a
+  record into a pre-allocated extent, torn at every byte of the block,
+  and the file after the boot has to be the records before it, with or
+  without that one. Finally the repair time is taken for growing files
+  with 4 KB and 32 KB clusters: it reads the last cluster only.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt LogRepairBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o logrepairbench
+*/
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define CARD_BLOCKS (16UL * 2048)
+#define CLUSTER_BLOCKS 8
+#define RECORDS 20
+#define MAX_FILESIZE 50000
+
+static std::vector<uint8_t> snapshot;
+
+static int make_line(char *line, long i) {
+	return snprintf(line, 160, "T%lu V4950 N5 a1:512.25:3.21:498.00:530.00 a2:%ld.50:0.75:300.00:310.00 c8:%ld\r\n",
+	                1350000000UL + i, 300 + i % 10, i * 7 % 1000);
+}
+
+// The frame DLSD writes for a record
+static std::string make_frame(const char *rec) {
+	uint16_t len = strlen(rec);
+	uint32_t crc = 0xFFFFFFFFUL;
+	std::string f;
+	f += (char)SD_FRAME;
+	f += (char)(len & 0xFF);
+	f += (char)(len >> 8);
+	crc = crc_update(crc, len & 0xFF);
+	crc = crc_update(crc, len >> 8);
+	for(uint16_t i = 0; i < len; i++)
+		crc = crc_update(crc, (uint8_t)rec[i]);
+	crc = ~crc;
+	for(int i = 0; i < 4; i++)
+		f += (char)(crc >> (8 * i));
+	return f + rec;
+}
+
+static DLSD *boot(uint16_t latency, bool extents) {
+	DLSD *sd = new DLSD(0, SS);
+	if (sd->init() != 1) {
+		printf("FAIL: init\n");
+		exit(1);
+	}
+	sd->set_latency(latency);
+	if (extents)
+		sd->set_extent(DATALOG, MAX_FILESIZE);
+	sd->set_frames(DATALOG, true);
+	return sd;
+}
+
+static std::string read_file(DLSD *sd) {
+	std::string s;
+	char buf[512];
+	int r;
+	sd->open(DATALOG, O_READ);
+	sd->rewind(DATALOG);
+	while ((r = sd->read(DATALOG, buf, sizeof(buf))) > 0)
+		s.append(buf, r);
+	sd->close(DATALOG);
+	return s;
+}
+
+// RECORDS framed lines, returns what the file holds
+static std::string write_records(DLSD *sd, long from, long count) {
+	std::string good;
+	char line[160];
+	for(long i = from; i < from + count; i++) {
+		make_line(line, i);
+		sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
+		sd->write(DATALOG, line);
+		good += make_frame(line);
+	}
+	return good;
+}
+
+static void save() {
+	snapshot.assign(sdhost_image(), sdhost_image() + sdhost_blocks() * 512UL);
+}
+
+static void restore() {
+	memcpy(sdhost_image(), &snapshot[0], snapshot.size());
+	sdhost_reset_stats();
+}
+
+// The first k bytes of a frame reach the file, at every k
+static bool torn_frame() {
+	DLSD *sd;
+	std::string good, frame, got;
+	char line[160];
+	long cut;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sd = boot(0, false);
+	good = write_records(sd, 0, RECORDS);
+	delete sd;
+	save();
+	make_line(line, RECORDS);
+	frame = make_frame(line);
+	for(size_t k = 1; k <= frame.size(); k++) {
+		restore();
+		sd = boot(0, false);
+		sd->set_frames(DATALOG, false);
+		sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
+		sd->write(DATALOG, (uint8_t *)frame.data(), k);
+		delete sd; // Reset
+		sd = boot(0, false);
+		cut = sd->repair(DATALOG);
+		got = read_file(sd);
+		if (k < frame.size() ? (cut != (long)k || got != good) : (cut != 0 || got != good + frame)) {
+			printf("FAIL: %zu of %zu frame bytes: %ld cut, %zu of %zu bytes left\n", k, frame.size(),
+			       cut, got.size(), good.size());
+			return false;
+		}
+		// Logging carries on after the repair
+		got = write_records(sd, RECORDS + 1, 1);
+		if (read_file(sd) != (k < frame.size() ? good : good + frame) + got) {
+			printf("FAIL: append after repairing %zu bytes\n", k);
+			return false;
+		}
+		delete sd;
+	}
+	printf("torn frame    : cut at each of the %zu byte offsets of a %zu byte frame\n", frame.size() - 1,
+	       frame.size());
+	return true;
+}
+
+// Power cut on the block write of a record into the extent of this
+// session, torn at every byte
+static bool torn_block() {
+	DLSD *sd;
+	std::string good, frame, got;
+	char line[160];
+	int repaired = 0, kept = 0, rec;
+	for(int t = 0; t <= SD_BLOCK; t++) {
+		sdhost_create(CARD_BLOCKS);
+		sdhost_format(CLUSTER_BLOCKS);
+		sd = boot(0, true);
+		// Into the second block, the record under test is a partial block write
+		good = "";
+		for(rec = 0; good.size() <= SD_BLOCK; rec++)
+			good += write_records(sd, rec, 1);
+		make_line(line, rec);
+		frame = make_frame(line);
+		sdhost_fault(0, t);
+		sd->write(DATALOG, line);
+		delete sd;
+		sdhost_fault(SDHOST_NO_FAULT, 0);
+		sd = boot(0, true);
+		if (sd->repair(DATALOG) > 0)
+			repaired++;
+		got = read_file(sd);
+		if (got == good + frame) {
+			kept++;
+		} else if (got != good) {
+			printf("FAIL: block torn at %d: %zu bytes, %zu or %zu expected\n", t, got.size(),
+			       good.size(), good.size() + frame.size());
+			return false;
+		}
+		delete sd;
+	}
+	printf("torn block    : %d cuts, record kept %d times, %d repairs, never a partial record\n",
+	       SD_BLOCK + 1, kept, repaired);
+	return true;
+}
+
+// Repair time with a torn record at the end of files of growing size
+static bool bounded(uint8_t spc) {
+	DLSD *sd;
+	char line[160];
+	long sizes[] = { 8192, 65536, 524288, 4194304 };
+	long i = 0;
+	uint32_t blocks = spc * 4200UL + 2048;
+	sdhost_create(blocks);
+	sdhost_format(spc);
+	sd = boot(60000, false);
+	for(int s = 0; s < 4; s++) {
+		while ((long)sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND) < sizes[s]) {
+			make_line(line, i++);
+			sd->write(DATALOG, line);
+		}
+		sd->flush();
+		sd->set_frames(DATALOG, false);
+		sd->write(DATALOG, (uint8_t *)"\xA5\x40\x00torn", 7); // Header and a few bytes
+		sd->flush();
+		sd->set_frames(DATALOG, true);
+		delete sd;
+		sd = boot(60000, false);
+		sdhost_reset_stats();
+		long cut = sd->repair(DATALOG);
+		printf("%2u KB clusters: %7ld byte file, repair %6.2f ms  %3u blocks read, %ld bytes cut\n",
+		       spc / 2, sizes[s], sdhost_stats.us / 1000.0, sdhost_stats.blocks_read, cut);
+		if (cut != 7) {
+			printf("FAIL: torn record not cut\n");
+			return false;
+		}
+	}
+	delete sd;
+	return true;
+}
+
+int main() {
+	if (!torn_frame() || !torn_block() || !bounded(8) || !bounded(64))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+  DLPack on what the logger uploads, in UPLOAD_PART parts packed on their
+  own as DLFileUpload sends them. There are no DAT files in Config/, so a
+  day of text lines in the time_log_line() format is generated, plain and
+  framed, next to SYSLOG style lines and the two files of Config/. Every
+  part is unpacked with DLUnpack and compared, and packed again in the
+  chunk size of the logger and byte by byte, which has to give the same
+  body: DLFileUpload packs a part twice and sends the Content-Length of
+  the first pass. Then random bytes from the alphabet the timestamp stage
+  reacts to check the round trip and the PACK_OUT bounds.
+
+  AVR cycles per byte are estimated from the operation counts of
+  PACK_STATS with cycle costs per operation read off avr-gcc -Os code for
+  similar loops, they are not measured.
+
+  Build: g++ -O2 -DPACK_STATS -I../../../DLFileUpload PackBench.cpp ../../../DLFileUpload/DLPack.cpp -o packbench
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include "DLPack.h"
+
+#define UPLOAD_PART 4000
+#define CHUNK 51 // DLFileUpload::chunk() with the 200 byte tmp_buff
+#define LINES 1440 // A day, one a minute
+#define FUZZ 2000
+
+// Estimated AVR cycles per operation
+#define CYC_BYTE 45 // stage() and fill()
+#define CYC_STEP 110 // hash, candidates, item()
+#define CYC_COMPARE 18 // One byte of match_len()
+#define CYC_INSERT 40
+#define F_CPU 16000000.0
+
+static std::string unpacked;
+
+static void sink(void *ctx, uint8_t c) {
+	((std::string *)ctx)->push_back(c);
+}
+
+static uint32_t crc_update(uint32_t crc, uint8_t c) {
+	crc ^= c;
+	for(int i = 0; i < 8; i++)
+		crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320UL : 0);
+	return crc;
+}
+
+// DLSD frame around a record
+static std::string frame(const std::string &rec) {
+	uint32_t crc = 0xFFFFFFFFUL;
+	std::string f;
+	f += (char)PACK_LINE_FRAME;
+	f += (char)(rec.size() & 0xFF);
+	f += (char)(rec.size() >> 8);
+	crc = crc_update(crc, rec.size() & 0xFF);
+	crc = crc_update(crc, rec.size() >> 8);
+	for(size_t i = 0; i < rec.size(); i++)
+		crc = crc_update(crc, rec[i]);
+	crc = ~crc;
+	for(int i = 0; i < 4; i++)
+		f += (char)(crc >> (8 * i));
+	return f + rec;
+}
+
+static double walk(double v, double step, double lo, double hi) {
+	v += step * (2.0 * rand() / RAND_MAX - 1.0);
+	return v < lo ? lo : v > hi ? hi : v;
+}
+
+// time_log_line() for a day of the example CONFIG.DAT ports
+static std::string day(bool framed) {
+	std::string s;
+	char line[256], tmp[64];
+	double a[4] = { 512.0, 300.0, 21.5, 880.0 }, c = 4.2;
+	uint32_t ts = 1350000000UL;
+	srand(1);
+	for(int i = 0; i < LINES; i++) {
+		ts += 60 + (rand() % 3 == 0);
+		sprintf(line, "T%u V%u N%u", ts, 4950 + rand() % 20, 300u);
+		for(int k = 0; k < 4; k++) {
+			a[k] = walk(a[k], a[k] / 200, 0, 1023);
+			sprintf(tmp, " a%d:%.2f:%.2f:%.2f:%.2f", k == 3 ? 7 : k, a[k], a[k] / 300 * (rand() % 100) / 50,
+			        a[k] - rand() % 9, a[k] + rand() % 9);
+			strcat(line, tmp);
+		}
+		c = walk(c, 0.5, 0, 30);
+		sprintf(tmp, " c8:%.2f:%.2f f9:%u:%u:%u:%u:%u d10:%u\r\n", c, c / 10, 3000 + rand() % 400,
+		        50 + rand() % 5, rand() % 3, 48 + rand() % 3, 55 + rand() % 3, rand() % 2);
+		strcat(line, tmp);
+		s += framed ? frame(line) : std::string(line);
+	}
+	return s;
+}
+
+static std::string syslog() {
+	std::string s;
+	char line[128];
+	const char *msg[] = { "Booted", "HTTP upload", "Upload successful", "Syncing RTC time",
+	                      "Log repair: 1 files, 37 bytes cut", "GSM power on" };
+	uint32_t ts = 1350000000UL;
+	srand(2);
+	while (s.size() < 40000) {
+		ts += rand() % 3600;
+		sprintf(line, "%u: %s\r\n", ts, msg[rand() % 6]);
+		s += line;
+	}
+	return s;
+}
+
+static bool load(const char *path, std::string *s) {
+	char buf[4096];
+	size_t n;
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return false;
+	s->clear();
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		s->append(buf, n);
+	fclose(f);
+	return true;
+}
+
+// One body, put() in chunks of chunk bytes. False when an output bound
+// does not hold.
+static bool pack(DLPack *p, const std::string &in, size_t chunk, std::string *out) {
+	uint8_t buf[PACK_OUT(UPLOAD_PART) + PACK_OUT_END];
+	uint16_t n;
+	out->assign((char *)buf, p->begin(buf));
+	for(size_t i = 0; i < in.size(); i += chunk) {
+		size_t len = in.size() - i < chunk ? in.size() - i : chunk;
+		n = p->put((const uint8_t *)in.data() + i, len, buf);
+		if (n > PACK_OUT(len))
+			return false;
+		out->append((char *)buf, n);
+	}
+	n = p->end(buf);
+	if (n > PACK_OUT_END)
+		return false;
+	out->append((char *)buf, n);
+	return true;
+}
+
+static bool unpack(const std::string &body, std::string *out) {
+	DLUnpack u;
+	out->clear();
+	u.begin(sink, out);
+	return u.put((const uint8_t *)body.data(), body.size());
+}
+
+static bool run(const char *name, const std::string &data) {
+	DLPack p, q;
+	std::string body, again, back;
+	size_t packed = 0;
+	double cycles = 0, host = 0;
+	for(size_t at = 0; at < data.size(); at += UPLOAD_PART) {
+		std::string part = data.substr(at, UPLOAD_PART);
+		auto t0 = std::chrono::steady_clock::now();
+		if (!pack(&p, part, CHUNK, &body)) {
+			printf("FAIL: %s: PACK_OUT exceeded\n", name);
+			return false;
+		}
+		host += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		cycles += (double)CYC_BYTE * p.stat_in + (double)CYC_STEP * p.stat_steps +
+		          (double)CYC_COMPARE * p.stat_compares + (double)CYC_INSERT * p.stat_inserts;
+		packed += body.size();
+		if (!unpack(body, &back) || back != part) {
+			printf("FAIL: %s: part at %zu does not unpack\n", name, at);
+			return false;
+		}
+		if (!pack(&q, part, 1, &again) || again != body) {
+			printf("FAIL: %s: part at %zu packs differently byte by byte\n", name, at);
+			return false;
+		}
+	}
+	printf("%-20s %7zu -> %6zu bytes  %5.1f %%  ~%3.0f AVR cycles/byte  %4.1f ms/part at 16 MHz  host %5.1f ns/byte\n",
+	       name, data.size(), packed, 100.0 * packed / data.size(), cycles / data.size(),
+	       cycles / data.size() * UPLOAD_PART / F_CPU * 1000, host * 1e9 / data.size());
+	return true;
+}
+
+// Random bytes heavy in what the timestamp stage and the LZ look at
+static bool fuzz() {
+	const char alphabet[] = "T0123456789\n\n\x01\x01\xA5\xFF :.a";
+	DLPack p;
+	std::string in, body, back;
+	srand(3);
+	for(int t = 0; t < FUZZ; t++) {
+		in.clear();
+		size_t len = rand() % 3000;
+		for(size_t i = 0; i < len; i++)
+			in += rand() % 4 ? alphabet[rand() % (sizeof(alphabet) - 1)] : (char)(rand() % 256);
+		if (!pack(&p, in, 1 + rand() % 200, &body)) {
+			printf("FAIL: fuzz %d: PACK_OUT exceeded\n", t);
+			return false;
+		}
+		if (!unpack(body, &back) || back != in) {
+			printf("FAIL: fuzz %d: %zu bytes do not round trip\n", t, len);
+			return false;
+		}
+	}
+	printf("fuzz                 %d random inputs round trip, output within PACK_OUT\n", FUZZ);
+	return true;
+}
+
+int main() {
+	std::string s;
+	if (!run("DATALOG text", day(false)) || !run("DATALOG framed", day(true)) ||
+	    !run("SYSLOG", syslog()))
+		return 1;
+	if (load("../../../Config/CONFIG.TXT", &s) && !run("Config/CONFIG.TXT", s))
+		return 1;
+	if (load("../../../Config/CONFIG.DAT", &s) && !run("Config/CONFIG.DAT", s))
+		return 1;
+	if (!fuzz())
+		return 1;
+	return 0;
+}
@@ -0,0 +1,153 @@
+/*
+  Cost of finding a time window in a DATALOG file with the time index of
+  DLSD. Files of growing size are logged a line a minute with stamp()
+  before every line, then read_range() is asked for random windows from
+  DATALOG_READONLY, as DLFileUpload::PT_upload_range() asks. Every window
+  has to hold all the lines of its times, start on a line and start at
+  most SD_TIDX_EVERY lines early. Reported are the blocks read per seek
+  against the blocks a scan from the start of the file reads; the seek
+  has to stay within a binary search of the index. Last the window of the
+  file DATALOG still writes, which has to end with its last line.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt RangeBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o rangebench
+*/
+#include <string>
+#include <vector>
+#include <math.h>
+#include <Arduino.h>
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define CARD_BLOCKS (64UL * 2048)
+#define CLUSTER_BLOCKS 8
+#define T_START 1350000000UL
+#define T_STEP 60
+#define QUERIES 200
+
+typedef struct {
+	uint32_t t;
+	uint32_t pos;
+} Line_t;
+
+static std::vector<Line_t> lines;
+static std::string data;
+
+static void log(DLSD *sd, long count) {
+	char line[160];
+	Line_t l;
+	lines.clear();
+	data.clear();
+	sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
+	for(long i = 0; i < count; i++) {
+		l.t = T_START + i * T_STEP;
+		l.pos = data.size();
+		snprintf(line, sizeof(line), "T%lu V4950 N5 a1:512.25:3.21:498.00:530.00 a2:%ld.50:0.75:300.00:310.00\r\n",
+		         (unsigned long)l.t, 300 + i % 10);
+		lines.push_back(l);
+		data += line;
+		sd->stamp(DATALOG, l.t);
+		sd->write(DATALOG, line);
+	}
+}
+
+// Checks a window of the open file against the lines written
+static bool check(DLSD *sd, uint8_t n, uint32_t t0, uint32_t t1, long len, uint32_t from) {
+	std::string got(len, '\0');
+	size_t lo = 0, hi = 0, start, end;
+	if (len <= 0) {
+		printf("FAIL: no window for %lu..%lu\n", (unsigned long)t0, (unsigned long)t1);
+		return false;
+	}
+	if (sd->read(n, &got[0], len) != len || data.compare(from, len, got)) {
+		printf("FAIL: window at %lu reads wrong\n", (unsigned long)from);
+		return false;
+	}
+	while (lo < lines.size() && lines[lo].t < t0)
+		lo++;
+	hi = lo;
+	while (hi < lines.size() && lines[hi].t <= t1)
+		hi++;
+	start = lo < lines.size() ? lines[lo].pos : data.size();
+	end = hi < lines.size() ? lines[hi].pos : data.size();
+	if (from > start || from + (size_t)len < end || (from > 0 && data[from - 1] != '\n') ||
+	    start - from > SD_TIDX_EVERY * (data.size() / lines.size() + 1)) {
+		printf("FAIL: window %lu+%ld for lines at %lu..%lu\n", (unsigned long)from, len, (unsigned long)start,
+		       (unsigned long)end);
+		return false;
+	}
+	return true;
+}
+
+static bool run(long count, bool extents) {
+	DLSD sd(0, SS);
+	uint32_t t0, t1, from, first, max = 0;
+	uint32_t entries = (count + SD_TIDX_EVERY - 1) / SD_TIDX_EVERY;
+	uint32_t idx_blocks = (entries * sizeof(SdTimeEntry_t) + 511) / 512;
+	double reads = 0, scan = 0, bound;
+	long len;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sdhost_set_millis(0);
+	sd.init();
+	sd.set_latency(10000);
+	if (extents)
+		sd.set_extent(DATALOG, count * 100);
+	sd.set_time_index(DATALOG, SD_TIDX_EVERY);
+	log(&sd, count);
+	sd.close(DATALOG);
+	sd.increment_file(DATALOG);
+	sd.set_files_count(DATALOG_READONLY, 0);
+	sd.open(DATALOG_READONLY, O_READ);
+	srand(count);
+	for(int q = 0; q < QUERIES; q++) {
+		t0 = T_START + rand() % (count * T_STEP);
+		t1 = t0 + rand() % (3600 * 4);
+		sdhost_reset_stats();
+		len = sd.read_range(DATALOG_READONLY, t0, t1, &from, &first);
+		reads += sdhost_stats.blocks_read;
+		if (sdhost_stats.blocks_read > max)
+			max = sdhost_stats.blocks_read;
+		scan += (lines[(t0 - T_START) / T_STEP].pos + 511) / 512; // To the first line
+		if (first != T_START || !check(&sd, DATALOG_READONLY, t0, t1, len, from))
+			return false;
+	}
+	if (sd.read_range(DATALOG_READONLY, T_START + count * T_STEP * 2, T_START + count * T_STEP * 3, &from,
+	                  &first) <= 0 || sd.read_range(DATALOG_READONLY, 0, T_START - 1, &from, &first) != 0) {
+		printf("FAIL: windows past either end\n");
+		return false;
+	}
+	sd.close(DATALOG_READONLY);
+	// Two binary searches, a probe reads an index block and may read the
+	// FAT block of its chain again, SdFat caches one block. Then the FAT
+	// blocks of the seek in the log file and the directories.
+	bound = 2 * 2 * (log2((double)entries) + 1) + data.size() / (256UL * CLUSTER_BLOCKS * 512) + 8;
+	printf("%6ld lines %8u bytes %s  index %5u entries %3u blocks  blocks read per seek %5.1f (max %2u, bound %4.1f)  scan %7.1f\n",
+	       count, (unsigned)data.size(), extents ? "extent" : "plain ", entries, idx_blocks, reads / QUERIES, max, bound,
+	       scan / QUERIES);
+	if (max > bound) {
+		printf("FAIL: seek reads %u blocks, more than a binary search\n", max);
+		return false;
+	}
+
+	// The file DATALOG is writing
+	log(&sd, count);
+	sd.set_files_count(DATALOG_READONLY, sd.get_files_count(DATALOG));
+	sd.open(DATALOG_READONLY, O_READ);
+	t0 = T_START + (count - 5) * T_STEP;
+	len = sd.read_range(DATALOG_READONLY, t0, t0 + 3600, &from, &first);
+	if (!check(&sd, DATALOG_READONLY, t0, t0 + 3600, len, from) || from + (size_t)len != data.size()) {
+		printf("FAIL: window of the file being written\n");
+		return false;
+	}
+	sd.close(DATALOG_READONLY);
+	sd.close(DATALOG);
+	return true;
+}
+
+int main() {
+	for(long count = 256; count <= 65536; count *= 4) {
+		if (!run(count, false) || !run(count, true))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+  Text log lines against the binary records of LOG_FORMAT = BINARY.
+  Builds a day of windows for the example CONFIG.DAT ports both ways, the
+  text with the same fmtDouble() rounding the logger uses, then runs the
+  binary file through the DLDecode tool and checks it gives the text back.
+  Reports bytes per day and host encode time per record.
+
+  Build: g++ -O2 -DDLDECODE_NO_MAIN -I../../../DLMeasure RecordBench.cpp ../../../Tools/DLDecode/DLDecode.cpp ../../../DLMeasure/DLRecord.cpp -o recordbench
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include "DLRecord.h"
+
+#define NUM_IO 14
+#define DIGITAL_OFFSET 8
+#define RECORDS 1440 // One a minute
+#define EVENT_EVERY 3 // Anemometer edges between time records
+
+long dl_decode(const uint8_t *buf, long len, FILE *out);
+
+typedef struct {
+	char type;
+	double val, std_dev, min, max;
+	uint8_t digital;
+	uint32_t pulses;
+} Port_t;
+
+// DLCommon fmtDouble(), 2 decimals
+static void fmt2(double val, char *buf) {
+	val += 0.005;
+	unsigned long i = (unsigned long)val;
+	sprintf(buf, "%lu.%02lu", i, (unsigned long)((val - i) * 100));
+}
+
+static uint32_t rounded(double v) {
+	if (v <= 0)
+		return 0;
+	return (uint32_t)(v + 0.5);
+}
+
+static uint32_t fixed(double v) {
+	return rounded(v * REC_FIXED);
+}
+
+// Away from the rounding ties so both paths agree on the last digit
+static double val2(double lo, double hi) {
+	long k = (long)((lo + (hi - lo) * rand() / (double)RAND_MAX) * 100);
+	return k / 100.0 + 0.002;
+}
+
+// Slow drift of a one minute mean
+static double walk2(double v, double step, double lo, double hi) {
+	v = val2(v - step, v + step);
+	if (v < lo) v = lo + 0.002;
+	if (v > hi) v = hi + 0.002;
+	return v;
+}
+
+static void text_line(char *line, uint32_t ts, Port_t *p, uint16_t mask) {
+	char tmp[16];
+	sprintf(line, "T%u V%u N%u", ts, 4950u, 300u);
+	for(int i = 0; i < NUM_IO; i++) {
+		if (!(mask & (1U << i)))
+			continue;
+		strcat(line, " ");
+		if (p[i].type == 'a') {
+			sprintf(tmp, "a%d:", i); strcat(line, tmp);
+			fmt2(p[i].val, tmp); strcat(line, tmp); strcat(line, ":");
+			fmt2(p[i].std_dev, tmp); strcat(line, tmp); strcat(line, ":");
+			fmt2(p[i].min, tmp); strcat(line, tmp); strcat(line, ":");
+			fmt2(p[i].max, tmp); strcat(line, tmp);
+		} else if (p[i].type == 'c') {
+			sprintf(tmp, "c%d:", i); strcat(line, tmp);
+			fmt2(p[i].val, tmp); strcat(line, tmp); strcat(line, ":");
+			fmt2(p[i].std_dev, tmp); strcat(line, tmp);
+		} else if (p[i].type == 'f') {
+			sprintf(tmp, "f%d:%u:%u:%u:%u:%u", i, p[i].pulses, rounded(p[i].val),
+			        rounded(p[i].std_dev), rounded(p[i].min), rounded(p[i].max));
+			strcat(line, tmp);
+		} else {
+			sprintf(tmp, "d%d:%u", i, p[i].digital); strcat(line, tmp);
+		}
+	}
+	strcat(line, "\r\n");
+}
+
+// Mirrors DLMeasure::time_log_record()
+static uint16_t time_record(DLRecord *rec, uint8_t *buf, uint32_t ts, Port_t *p, uint16_t mask) {
+	uint16_t counters = 0, freqs = 0;
+	uint32_t m, v;
+	rec->begin(buf, 0, ts);
+	rec->put(4950);
+	rec->put(300);
+	rec->put(mask);
+	for(int i = DIGITAL_OFFSET; i < NUM_IO; i++) {
+		if ((mask & (1U << i)) && p[i].type == 'c')
+			counters |= 1 << (i - DIGITAL_OFFSET);
+		if ((mask & (1U << i)) && p[i].type == 'f')
+			freqs |= 1 << (i - DIGITAL_OFFSET);
+	}
+	rec->put(counters);
+	rec->put(freqs);
+	for(int i = 0; i < NUM_IO; i++) {
+		if (!(mask & (1U << i)))
+			continue;
+		if (p[i].type == 'a') {
+			m = fixed(p[i].val);
+			rec->put_delta(i, m);
+			rec->put(fixed(p[i].std_dev));
+			m /= REC_FIXED;
+			v = (uint32_t)p[i].min;
+			rec->put(m > v ? m - v : 0);
+			v = (uint32_t)p[i].max;
+			rec->put(v > m ? v - m : 0);
+		} else if (p[i].type == 'c') {
+			rec->put_delta(i, fixed(p[i].val));
+			rec->put(fixed(p[i].std_dev));
+		} else if (p[i].type == 'f') {
+			rec->put(p[i].pulses);
+			m = rounded(p[i].val);
+			rec->put_delta(i, m);
+			rec->put(rounded(p[i].std_dev));
+			v = rounded(p[i].min);
+			rec->put(m > v ? m - v : 0);
+			v = rounded(p[i].max);
+			rec->put(v > m ? v - m : 0);
+		} else {
+			rec->put(p[i].digital);
+		}
+	}
+	return rec->end();
+}
+
+int main() {
+	Port_t p[NUM_IO] = {};
+	uint16_t mask = 0;
+	const char types[NUM_IO + 1] = "aaa0000acfd000";
+	std::string text, bin;
+	char line[512];
+	uint8_t buf[REC_MAX_LEN];
+	DLRecord rec;
+	double text_ns = 0, bin_ns = 0;
+	uint32_t ts = 1350000000, us = 0;
+	long events = 0, text_t = 0, bin_t = 0;
+
+	srand(1);
+	for(int i = 0; i < NUM_IO; i++) {
+		p[i].type = types[i];
+		if (types[i] != '0')
+			mask |= 1U << i;
+	}
+
+	for(int r = 0; r < RECORDS; r++) {
+		for(int e = 0; e < EVENT_EVERY; e++) {
+			uint8_t lvl = e & 1;
+			uint32_t d = rand() % 5000;
+			us += d * 1000 + rand() % 1000;
+			ts += 1;
+			sprintf(line, "E%u  12:%u:%u:%u\r\n", ts, lvl, d, us);
+			text += line;
+			rec.begin(buf, REC_EVENT, ts);
+			rec.put(1U << 12);
+			rec.put(lvl);
+			rec.put(d);
+			rec.put_delta(12, us);
+			bin.append((char *)buf, rec.end());
+			events++;
+		}
+		ts += 60;
+		for(int i = 0; i < NUM_IO; i++) {
+			if (p[i].type == 'a') {
+				p[i].val = r ? walk2(p[i].val, 2.0, 0, 1023) : val2(100, 900);
+				p[i].std_dev = val2(0, 20);
+				p[i].min = (int)p[i].val - rand() % 30;
+				p[i].max = (int)p[i].val + 1 + rand() % 30;
+			} else if (p[i].type == 'c') {
+				p[i].val = r ? walk2(p[i].val, 1.0, 0, 50) : val2(0, 50);
+				p[i].std_dev = val2(0, 5);
+			} else if (p[i].type == 'f') { // Anemometer period in us
+				p[i].val = r ? walk2(p[i].val, 2000.0, 20000, 500000) : val2(50000, 200000);
+				p[i].std_dev = val2(0, 5000);
+				p[i].min = p[i].val - rand() % 10000;
+				p[i].max = p[i].val + rand() % 10000;
+				p[i].pulses = (uint32_t)(60e6 / p[i].val);
+			} else {
+				p[i].digital = rand() & 1;
+			}
+		}
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		text_line(line, ts, p, mask);
+		text_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+		text += line;
+		text_t += strlen(line);
+
+		t0 = std::chrono::steady_clock::now();
+		uint16_t n = time_record(&rec, buf, ts, p, mask);
+		bin_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+		bin.append((char *)buf, n);
+		bin_t += n;
+	}
+
+	char *out = NULL;
+	size_t outlen = 0;
+	FILE *f = open_memstream(&out, &outlen);
+	long recs = dl_decode((const uint8_t *)bin.data(), bin.size(), f);
+	fclose(f);
+	if (recs != RECORDS + events || text != std::string(out, outlen)) {
+		printf("FAIL: %ld records, decoded text %s\n", recs, text == std::string(out, outlen) ? "matches" : "differs");
+		return 1;
+	}
+	free(out);
+
+	printf("%d time + %ld event records, decoded text identical\n", RECORDS, events);
+	printf("text  : %7zu bytes/day  T line %6.1f B  encode %6.0f ns/record (host)\n",
+	       text.size(), (double)text_t / RECORDS, text_ns / RECORDS);
+	printf("binary: %7zu bytes/day  T rec  %6.1f B  encode %6.0f ns/record (host)\n",
+	       bin.size(), (double)bin_t / RECORDS, bin_ns / RECORDS);
+	printf("ratio : %.1fx overall, %.1fx on time records\n", (double)text.size() / bin.size(), (double)text_t / bin_t);
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+  Checks the DLSchedule timer wheel and compares one hour of the example
+  CONFIG.DAT port setup sampled on every tick (single SAMPLING_RATE)
+  against per port PORT_RATE_n / PORT_WINDOW_n.
+  Reports ADC busy time, conversions spent on the slow ports, samples
+  taken and log bytes written. The scanner free runs while any channel is
+  requested, so the fast wind vane keeps it busy and the conversions freed
+  from the slow ports go to its oversampling instead.
+
+  Build: g++ -O2 -I../../../DLMeasure ScheduleSim.cpp ../../../DLMeasure/DLSchedule.cpp -o schedulesim
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DLSchedule.h"
+
+#define TICK_MS 200 // SAMPLING_RATE = 5
+#define MEASURE_TIME 60
+#define HOUR_TICKS (3600000L / TICK_MS)
+#define CONV_PER_TICK (TICK_MS * 1000L / 104) // 13 ADC clocks at 125kHz
+#define BANDGAP 15
+
+typedef struct {
+	const char *name;
+	char type; // a(nalog), c(ounter), d(igital)
+	uint16_t rate; // ms, 0 = every tick
+	uint16_t window; // s, 0 = MEASURE_TIME
+} Port_t;
+
+static Port_t ports[] = {
+	{ "Wind Vane", 'a', 0, 0 },
+	{ "Humidity", 'a', 10000, 600 },
+	{ "External Temperature", 'a', 10000, 600 },
+	{ NULL, 0, 0, 0 },
+	{ NULL, 0, 0, 0 },
+	{ NULL, 0, 0, 0 },
+	{ NULL, 0, 0, 0 },
+	{ "Internal Temperature", 'a', 60000, 600 },
+	{ "Arduino Signal", 'c', 0, 0 },
+	{ NULL, 0, 0, 0 },
+	{ "Test button", 'd', 1000, 60 },
+};
+#define NPORTS (int)(sizeof(ports) / sizeof(ports[0]))
+
+static int field_len(char type, int port) {
+	char buf[40];
+	if (type == 'a')
+		return snprintf(buf, sizeof(buf), " a%d:%.2f:%.2f:%.2f:%.2f", port, 512.25, 3.21, 498.0, 530.0);
+	if (type == 'c')
+		return snprintf(buf, sizeof(buf), " c%d:%.2f:%.2f", port, 12.5, 0.75);
+	return snprintf(buf, sizeof(buf), " d%d:%d", port, 1);
+}
+
+static int header_len() {
+	char buf[40];
+	return snprintf(buf, sizeof(buf), "T%u V%u N%u\r\n", 1350000000u, 4950u, 300u);
+}
+
+// Every port comes up exactly once per period
+static int check_wheel() {
+	DLSchedule s;
+	uint16_t periods[SCHED_PORTS] = { 1, 2, 3, 15, 16, 17, 31, 32, 33, 50, 300, 3000, 0, 7, 0, 5 };
+	long last[SCHED_PORTS], hits[SCHED_PORTS];
+	for(int i = 0; i < SCHED_PORTS; i++) {
+		s.set(i, periods[i]);
+		last[i] = 0;
+		hits[i] = 0;
+	}
+	for(long t = 1; t <= 100000; t++) {
+		uint16_t next = s.peek();
+		uint16_t due = s.tick();
+		if (next != due) {
+			printf("FAIL tick %ld: peek %04x tick %04x\n", t, next, due);
+			return 0;
+		}
+		for(int i = 0; i < SCHED_PORTS; i++) {
+			if (!(due & (1U << i)))
+				continue;
+			if (periods[i] == 0 || t - last[i] != periods[i]) {
+				printf("FAIL port %d period %u: due after %ld\n", i, periods[i], t - last[i]);
+				return 0;
+			}
+			last[i] = t;
+			hits[i]++;
+		}
+	}
+	for(int i = 0; i < SCHED_PORTS; i++) {
+		if (periods[i] && hits[i] != 100000 / periods[i]) {
+			printf("FAIL port %d: %ld hits\n", i, hits[i]);
+			return 0;
+		}
+	}
+	printf("wheel: periods 1..3000 due on time over 100000 ticks\n");
+	return 1;
+}
+
+static void run(int multirate) {
+	DLSchedule s;
+	long wstart[NPORTS] = { 0 }, samples = 0, busy = 0, slow = 0, lines = 0, bytes = 0;
+	uint16_t scan = 0xffff, closed;
+	for(int i = 0; i < NPORTS; i++) {
+		uint16_t period = 0;
+		if (ports[i].name) {
+			period = multirate ? (ports[i].rate + TICK_MS / 2) / TICK_MS : 1;
+			if (period == 0)
+				period = 1;
+		}
+		s.set(i, period);
+	}
+	s.set(BANDGAP, multirate ? 1000 / TICK_MS : 1);
+
+	for(long t = 1; t <= HOUR_TICKS; t++) {
+		int nch = 0, nslow = 0;
+		// The scanner converted the channels requested after the last tick
+		for(int i = 0; i < 8; i++) {
+			if (i < NPORTS && ports[i].type == 'a' && (scan & (1U << i))) {
+				nch++;
+				if (ports[i].rate > TICK_MS)
+					nslow++;
+			}
+		}
+		if (scan & (1U << BANDGAP))
+			nch++;
+		if (nch) {
+			busy++;
+			slow += CONV_PER_TICK * nslow / nch;
+		}
+
+		uint16_t due = s.tick();
+		closed = 0;
+		for(int i = 0; i < NPORTS; i++) {
+			if (!(due & (1U << i)))
+				continue;
+			samples++;
+			uint16_t w = (multirate && ports[i].window) ? ports[i].window : MEASURE_TIME;
+			if ((t - wstart[i]) * TICK_MS >= w * 1000L) {
+				closed |= (1U << i);
+				wstart[i] = t;
+			}
+		}
+		if (closed) {
+			lines++;
+			bytes += header_len();
+			for(int i = 0; i < NPORTS; i++)
+				if (closed & (1U << i))
+					bytes += field_len(ports[i].type, i);
+		}
+		scan = multirate ? s.peek() : 0xffff;
+	}
+	printf("%-10s: ADC busy %5.1f%%  slow port conversions/h %8ld  port samples/h %7ld  lines/h %4ld  SD bytes/h %6ld\n",
+	       multirate ? "per port" : "uniform", 100.0 * busy / HOUR_TICKS, slow, samples, lines, bytes);
+}
+
+int main() {
+	if (!check_wheel())
+		return 1;
+	printf("1 h at %d ms ticks, MEASURE_TIME %d s\n", TICK_MS, MEASURE_TIME);
+	run(0);
+	run(1);
+	return 0;
+}
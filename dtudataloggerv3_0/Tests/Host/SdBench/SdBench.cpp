@@ -0,0 +1,122 @@
+/*
+  SdFat/examples/bench on the host: a 5 MB file written and read back in
+  100 byte calls, reported the way the sketch does, for the block loops
+  of Sd2Card.cpp with and without SD_SPI_UNROLL in every USE_SD_CRC
+  mode. Runs on the real SdFat over the SdHost card, times are its
+  modelled card time with the block transfer time of SdSpiCycles.h for
+  the loops, micros() of the sketch is that time. The FAT code's own
+  CPU time is not in it, so the KB/sec are above what the sketch shows
+  on the logger (documentation/datasheets/SD-benchmark.rtf).
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLCommon -I../../../Time -I../../../pt SdBench.cpp ../SdHost/SdHost.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o sdbench
+*/
+#include <Arduino.h>
+#include <SdFat.h>
+#include "SdHost.h"
+#include "SdSpiCycles.h"
+
+#define FILE_SIZE_MB 5
+#define FILE_SIZE (1000000UL*FILE_SIZE_MB)
+#define BUF_SIZE 100
+#define CARD_BLOCKS (16UL * 2048)
+#define CLUSTER_BLOCKS 8
+
+static uint8_t buf[BUF_SIZE];
+
+typedef struct {
+	double kbs;
+	uint32_t max;
+	uint32_t min;
+	uint32_t avg;
+} Result_t;
+
+static void result(const char *what, Result_t *r) {
+	printf("%s %.2f KB/sec\n", what, r->kbs);
+	printf("Maximum latency: %u usec, Minimum Latency: %u usec, Avg Latency: %u usec\n\n", r->max, r->min,
+	       r->avg);
+}
+
+static bool run(int crc, bool unroll, Result_t *w, Result_t *r) {
+	SdFat sd;
+	SdFile file;
+	uint32_t n = FILE_SIZE / sizeof(buf), t, m;
+	double s;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sdhost_set_xfer_us(spi_xfer_us(crc, unroll));
+	if (!sd.begin(SS, SPI_FULL_SPEED) || !file.open("BENCH.DAT", O_CREAT | O_TRUNC | O_RDWR)) {
+		printf("FAIL: open failed\n");
+		return false;
+	}
+	for (uint16_t i = 0; i < (BUF_SIZE-2); i++) {
+		buf[i] = 'A' + (i % 26);
+	}
+	buf[BUF_SIZE-2] = '\r';
+	buf[BUF_SIZE-1] = '\n';
+
+	// write test
+	w->max = w->avg = 0;
+	w->min = 999999;
+	sdhost_reset_stats();
+	for (uint32_t i = 0; i < n; i++) {
+		m = sdhost_stats.us;
+		if (file.write(buf, sizeof(buf)) != sizeof(buf)) {
+			printf("FAIL: write failed\n");
+			return false;
+		}
+		m = sdhost_stats.us - m;
+		if (w->max < m) w->max = m;
+		if (w->min > m) w->min = m;
+		w->avg += m;
+	}
+	file.sync();
+	t = sdhost_stats.us / 1000;
+	s = file.fileSize();
+	w->kbs = s / t;
+	w->avg /= n;
+
+	// read test
+	file.rewind();
+	r->max = r->avg = 0;
+	r->min = 99999;
+	sdhost_reset_stats();
+	for (uint32_t i = 0; i < n; i++) {
+		m = sdhost_stats.us;
+		if (file.read(buf, sizeof(buf)) != sizeof(buf) || buf[0] != 'A' || buf[BUF_SIZE-1] != '\n') {
+			printf("FAIL: read failed\n");
+			return false;
+		}
+		m = sdhost_stats.us - m;
+		if (r->max < m) r->max = m;
+		if (r->min > m) r->min = m;
+		r->avg += m;
+	}
+	t = sdhost_stats.us / 1000;
+	r->kbs = s / t;
+	r->avg /= n;
+	file.close();
+	return true;
+}
+
+int main() {
+	const char *name[] = { "no CRC", "shift CRC after", "table CRC after", "shift CRC in loop", "table CRC in loop" };
+	Result_t w[2], r[2];
+	printf("File size %dMB\n", FILE_SIZE_MB);
+	printf("Buffer size %d bytes\n\n", BUF_SIZE);
+	for (int crc = 0; crc <= 4; crc++) {
+		for (int u = 0; u < 2; u++) {
+			if (!run(crc, u, &w[u], &r[u]))
+				return 1;
+			printf("USE_SD_CRC %d (%s), SD_SPI_UNROLL %d, block transfer %u usec\n", crc, name[crc], u,
+			       spi_xfer_us(crc, u));
+			result("Write", &w[u]);
+			result("Read", &r[u]);
+		}
+		if (w[1].kbs < w[0].kbs || r[1].kbs < r[0].kbs) {
+			printf("FAIL: USE_SD_CRC %d slower unrolled\n", crc);
+			return 1;
+		}
+	}
+	printf("Done\n");
+	return 0;
+}
@@ -0,0 +1,309 @@
+/*
+  The data CRC modes of Sd2Card. SdFat/Sd2Card.cpp itself is built in
+  with SPDR and SPSR over a SPI mode card model that checks command CRC7
+  and, with CMD59, the CRC-CCITT of written blocks against a bitwise
+  reference. Blocks are written and read back, then a bit is flipped on
+  the wire of a read and of a write: with CRC on both have to be caught,
+  with USE_SD_CRC 0 they go through.
+
+  The host cannot time the AVR loops, the AVR cycles per block are the
+  estimates of SdSpiCycles.h, they are not measured.
+
+  Build, once per mode and loop:
+  for u in 0 1; do for m in 0 1 2 3 4; do g++ -O2 -DARDUINO=100 -DUSE_SD_CRC=$m -DSD_SPI_UNROLL=$u -I../../../SdFat -I../SdHost SdCrcBench.cpp -o sdcrcbench && ./sdcrcbench; done; done
+*/
+#include <Arduino.h>
+
+// SPI registers over the card model
+#define SPIF 7
+#define SPI2X 0
+#define SPE 6
+#define MSTR 4
+#define SPR0 0
+#define SPR1 1
+
+class SpiData {
+	public:
+		SpiData &operator=(uint8_t b);
+		operator uint8_t() const { return _miso; }
+	private:
+		uint8_t _miso;
+};
+
+class SpiStatus {
+	public:
+		SpiStatus &operator=(uint8_t) { return *this; }
+		operator uint8_t() const { return 1 << SPIF; } // Transfers are done at once
+};
+
+static SpiData spi_data;
+static SpiStatus spi_status;
+uint8_t SPCR;
+#define SPDR spi_data
+#define SPSR spi_status
+
+#include "../../../SdFat/Sd2Card.cpp"
+#include "SdSpiCycles.h"
+
+#define BLOCKS 256
+#define RUNS 500
+#define NO_FLIP 0xFFFF
+
+#define F_CPU 16000000.0
+
+enum { CARD_CMD, CARD_W_TOKEN, CARD_W_DATA };
+
+typedef struct {
+	bool cs;
+	bool crc_on;
+	bool idle;
+	bool app;
+	uint8_t state;
+	uint8_t cmd[6];
+	uint8_t ncmd;
+	uint8_t out[600]; // MISO bytes queued
+	uint16_t nout;
+	uint16_t pos;
+	uint8_t w[514]; // Block and CRC of a write
+	uint16_t nw;
+	uint32_t waddr;
+	uint16_t flip_read; // Byte of the next read sent with a bit flipped
+	uint16_t flip_write; // Byte of the next write received so
+	long bad_cmd_crc;
+	long bad_write_crc;
+} Card_t;
+
+static Card_t card;
+static uint8_t img[BLOCKS][512];
+static const uint8_t cid[16] = { 0x03, 'S', 'D', 'S', 'U', '0', '4', 'G', 0x80, 0x12, 0x34, 0x56, 0x78, 0x00, 0xC9, 0x01 };
+static unsigned long now_ms;
+
+unsigned long millis() {
+	return now_ms++;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+	if (pin != SS)
+		return;
+	card.cs = val == LOW;
+	if (!card.cs) {
+		card.ncmd = card.nout = card.pos = 0;
+		card.state = CARD_CMD;
+	}
+}
+
+static uint8_t crc7_ref(const uint8_t *d, int n) {
+	uint8_t crc = 0;
+	for(int i = 0; i < n * 8; i++) {
+		uint8_t bit = (d[i / 8] >> (7 - i % 8)) & 1;
+		crc = ((crc << 1) & 0x7F) ^ (((crc >> 6) ^ bit) ? 0x09 : 0);
+	}
+	return (crc << 1) | 1;
+}
+
+static uint16_t crc16_ref(const uint8_t *d, int n) {
+	uint16_t crc = 0;
+	for(int i = 0; i < n; i++) {
+		crc ^= d[i] << 8;
+		for(int k = 0; k < 8; k++)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static void queue(uint8_t b) {
+	card.out[card.nout++] = b;
+}
+
+static void queue_data(const uint8_t *d, int n, uint16_t flip) {
+	uint16_t crc = crc16_ref(d, n);
+	queue(0xFF);
+	queue(DATA_START_BLOCK);
+	for(int i = 0; i < n; i++)
+		queue(i == flip ? d[i] ^ 0x10 : d[i]);
+	queue(crc >> 8);
+	queue(crc & 0xFF);
+}
+
+static void command() {
+	uint8_t cmd = card.cmd[0] & 0x3F;
+	uint32_t arg = (uint32_t)card.cmd[1] << 24 | (uint32_t)card.cmd[2] << 16 | card.cmd[3] << 8 | card.cmd[4];
+	bool app = card.app;
+	uint8_t r1;
+	card.nout = card.pos = 0;
+	card.app = false;
+	queue(0xFF);
+	if ((card.crc_on || cmd == CMD0 || cmd == CMD8) && card.cmd[5] != crc7_ref(card.cmd, 5)) {
+		card.bad_cmd_crc++;
+		queue((card.idle ? R1_IDLE_STATE : 0) | 0x08);
+		return;
+	}
+	if (cmd == CMD0) {
+		card.idle = true;
+		card.crc_on = false;
+	} else if (cmd == CMD59) {
+		card.crc_on = arg & 1;
+	} else if (cmd == ACMD41 && app) {
+		card.idle = false;
+	}
+	r1 = card.idle ? R1_IDLE_STATE : R1_READY_STATE;
+	switch (cmd) {
+		case CMD0:
+		case CMD59:
+		case CMD12:
+			queue(r1);
+			break;
+		case CMD55:
+			card.app = true;
+			queue(r1);
+			break;
+		case CMD8:
+			queue(r1);
+			queue(0);
+			queue(0);
+			queue(1);
+			queue(0xAA);
+			break;
+		case CMD58:
+			queue(r1);
+			queue(0xC0);
+			queue(0xFF);
+			queue(0x80);
+			queue(0);
+			break;
+		case CMD10:
+			queue(r1);
+			queue_data(cid, 16, NO_FLIP);
+			break;
+		case CMD13:
+			queue(r1);
+			queue(0);
+			break;
+		case CMD17:
+			queue(r1);
+			queue_data(img[arg % BLOCKS], 512, card.flip_read);
+			card.flip_read = NO_FLIP;
+			break;
+		case CMD24:
+			queue(r1);
+			card.waddr = arg % BLOCKS;
+			card.state = CARD_W_TOKEN;
+			break;
+		default:
+			if (cmd == ACMD41 && app)
+				queue(r1);
+			else
+				queue(r1 | R1_ILLEGAL_COMMAND);
+	}
+}
+
+static void write_end() {
+	uint16_t crc = card.w[512] << 8 | card.w[513];
+	card.nout = card.pos = 0;
+	card.state = CARD_CMD;
+	if (card.crc_on && crc != crc16_ref(card.w, 512)) {
+		card.bad_write_crc++;
+		queue(0x0B);
+		return;
+	}
+	memcpy(img[card.waddr], card.w, 512);
+	queue(DATA_RES_ACCEPTED | 0x01);
+	for(int i = 0; i < 4; i++)
+		queue(0); // Busy
+}
+
+SpiData &SpiData::operator=(uint8_t b) {
+	_miso = card.cs && card.pos < card.nout ? card.out[card.pos++] : 0xFF;
+	if (!card.cs)
+		return *this;
+	switch (card.state) {
+		case CARD_CMD:
+			if (card.ncmd == 0 && (b & 0xC0) != 0x40)
+				break;
+			card.cmd[card.ncmd++] = b;
+			if (card.ncmd == 6) {
+				card.ncmd = 0;
+				command();
+			}
+			break;
+		case CARD_W_TOKEN:
+			if (b == DATA_START_BLOCK) {
+				card.state = CARD_W_DATA;
+				card.nw = 0;
+			}
+			break;
+		case CARD_W_DATA:
+			card.w[card.nw] = card.nw == card.flip_write ? b ^ 0x10 : b;
+			if (++card.nw == 514) {
+				card.flip_write = NO_FLIP;
+				write_end();
+			}
+			break;
+	}
+	return *this;
+}
+
+static bool fail(const char *what, Sd2Card *sd) {
+	printf("FAIL: USE_SD_CRC %d SD_SPI_UNROLL %d: %s, error 0x%02X\n", USE_SD_CRC, SD_SPI_UNROLL, what,
+	       sd->errorCode());
+	return false;
+}
+
+static bool run() {
+	Sd2Card sd;
+	uint8_t buf[512], back[512], old[512];
+	cid_t id;
+	uint32_t b;
+	bool ok;
+	memset(&card, 0, sizeof(card));
+	card.flip_read = card.flip_write = NO_FLIP;
+	srand(USE_SD_CRC + 1);
+	if (!sd.init(SPI_FULL_SPEED, SS) || sd.type() != SD_CARD_TYPE_SDHC)
+		return fail("init", &sd);
+	if (card.crc_on != (USE_SD_CRC != 0) || card.bad_cmd_crc)
+		return fail("CMD59 or command CRC", &sd);
+	if (!sd.readCID(&id) || memcmp(&id, cid, 16))
+		return fail("readCID()", &sd);
+	for(int i = 0; i < RUNS; i++) {
+		b = rand() % BLOCKS;
+		for(int k = 0; k < 512; k++)
+			buf[k] = rand();
+		if (!sd.writeBlock(b, buf) || card.bad_write_crc)
+			return fail("writeBlock()", &sd);
+		if (!sd.readBlock(b, back) || memcmp(buf, back, 512))
+			return fail("readBlock()", &sd);
+	}
+
+	// A bit flipped on the way in
+	card.flip_read = rand() % 512;
+	ok = sd.readBlock(b, back);
+	if (USE_SD_CRC && (ok || sd.errorCode() != SD_CARD_ERROR_READ_CRC))
+		return fail("flipped read not caught", &sd);
+	if (!USE_SD_CRC && (!ok || !memcmp(buf, back, 512)))
+		return fail("flipped read", &sd);
+
+	// And on the way out
+	memcpy(old, img[b], 512);
+	buf[0] ^= 1;
+	card.flip_write = rand() % 512;
+	ok = sd.writeBlock(b, buf);
+	if (USE_SD_CRC && (ok || sd.errorCode() != SD_CARD_ERROR_WRITE || card.bad_write_crc != 1 ||
+	    memcmp(img[b], old, 512)))
+		return fail("flipped write not caught", &sd);
+	if (!USE_SD_CRC && (!ok || !memcmp(img[b], buf, 512)))
+		return fail("flipped write", &sd);
+	return true;
+}
+
+int main() {
+	const char *name[] = { "no CRC", "shift, after", "table, after", "shift, in the loop", "table, in the loop" };
+	long cyc = spi_block_cycles(USE_SD_CRC, SD_SPI_UNROLL);
+	if (!run())
+		return 1;
+	printf("USE_SD_CRC %d %-19s %s ~%5ld AVR cycles/block  %4.0f us at 16 MHz  %3.0f KB/s  %s\n", USE_SD_CRC,
+	       name[USE_SD_CRC], SD_SPI_UNROLL ? "unrolled" : "bytewise", cyc, cyc / F_CPU * 1e6, 512 / (cyc / F_CPU) / 1024,
+	       USE_SD_CRC ? "flipped bits caught" : "flipped bits go through");
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*
+  Just enough of the Arduino core to run DLSD and SdFat on the host
+  against the RAM card in SdHost.cpp. millis() is the simulated clock.
+  Build with -DARDUINO=100 -DSdStream_h -DArduinoStream_h, the stream
+  classes of SdFat are not needed.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+// SdBaseFile and Time.h have their own, include C++ headers before this one
+#define fpos_t sd_fpos_t
+#define time_t dl_time_t
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include "Print.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define _BV(b) (1 << (b))
+#define SS 4
+#define MOSI 5
+#define MISO 6
+#define SCK 7
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+class HardwareSerial : public Print {
+	public:
+		void begin(unsigned long) {}
+		int available() { return 0; }
+		int read() { return -1; }
+		size_t write(uint8_t c);
+		using Print::write;
+};
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print
+{
+	public:
+		Print() : write_error(0) {}
+		void clearWriteError() { write_error = 0; }
+		int getWriteError() { return write_error; }
+		virtual size_t write(uint8_t) = 0;
+		virtual size_t write(const uint8_t *buf, size_t size);
+		size_t write(const char *s);
+		size_t print(const char *s);
+		size_t print(char c);
+		size_t print(unsigned char n, int base = DEC);
+		size_t print(int n, int base = DEC);
+		size_t print(unsigned int n, int base = DEC);
+		size_t print(long n, int base = DEC);
+		size_t print(unsigned long n, int base = DEC);
+		size_t print(double n, int digits = 2);
+		size_t println(const char *s);
+		size_t println(char c);
+		size_t println(unsigned char n, int base = DEC);
+		size_t println(int n, int base = DEC);
+		size_t println(unsigned int n, int base = DEC);
+		size_t println(long n, int base = DEC);
+		size_t println(unsigned long n, int base = DEC);
+		size_t println(double n, int digits = 2);
+		size_t println();
+	private:
+		int write_error;
+};
+
+#endif
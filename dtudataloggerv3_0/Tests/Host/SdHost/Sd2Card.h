@@ -0,0 +1,65 @@
+/*
+  Host stand-in for SdFat's Sd2Card: same interface, backed by the block
+  image of SdHost.cpp so the real SdVolume/SdBaseFile/DLSD code runs on
+  top of it. Put this directory before SdFat on the include path.
+*/
+#ifndef Sd2Card_h
+#define Sd2Card_h
+
+#include <Arduino.h>
+#include <SdFatConfig.h>
+#include <SdInfo.h>
+// The on-card structures rely on AVR's byte alignment
+#pragma pack(push, 1)
+#include <SdFatStructs.h>
+#pragma pack(pop)
+
+uint8_t const SPI_FULL_SPEED = 0;
+uint8_t const SPI_HALF_SPEED = 1;
+uint8_t const SPI_QUARTER_SPEED = 2;
+uint8_t const SPI_EIGHTH_SPEED = 3;
+uint8_t const SPI_SIXTEENTH_SPEED = 4;
+
+uint8_t const SD_CARD_ERROR_CMD0 = 0X1;
+uint8_t const SD_CARD_ERROR_CMD17 = 0X4;
+uint8_t const SD_CARD_ERROR_CMD24 = 0X6;
+uint8_t const SD_CARD_ERROR_CMD25 = 0X7;
+uint8_t const SD_CARD_ERROR_ERASE = 0XC;
+uint8_t const SD_CARD_ERROR_WRITE = 0X13;
+uint8_t const SD_CARD_ERROR_INIT_NOT_CALLED = 0X19;
+
+uint8_t const SD_CARD_TYPE_SD1 = 1;
+uint8_t const SD_CARD_TYPE_SD2 = 2;
+uint8_t const SD_CARD_TYPE_SDHC = 3;
+
+uint8_t const SD_CHIP_SELECT_PIN = SS;
+
+class Sd2Card {
+	public:
+		Sd2Card() : errorCode_(SD_CARD_ERROR_INIT_NOT_CALLED), type_(0) {}
+		uint32_t cardSize();
+		bool erase(uint32_t firstBlock, uint32_t lastBlock);
+		bool eraseSingleBlockEnable() { return true; }
+		void error(uint8_t code) { errorCode_ = code; }
+		int errorCode() const { return errorCode_; }
+		int errorData() const { return 0; }
+		bool init(uint8_t sckRateID = SPI_FULL_SPEED, uint8_t chipSelectPin = SD_CHIP_SELECT_PIN);
+		bool readBlock(uint32_t block, uint8_t *dst);
+		bool readCID(cid_t *cid) { memset(cid, 0, sizeof(*cid)); return true; }
+		bool readCSD(csd_t *csd) { memset(csd, 0, sizeof(*csd)); return true; }
+		bool readData(uint8_t *dst);
+		bool readStart(uint32_t blockNumber);
+		bool readStop();
+		bool setSckRate(uint8_t sckRateID) { return sckRateID <= 6; }
+		int type() const { return type_; }
+		bool writeBlock(uint32_t blockNumber, const uint8_t *src);
+		bool writeData(const uint8_t *src);
+		bool writeStart(uint32_t blockNumber, uint32_t eraseCount);
+		bool writeStop();
+	private:
+		uint8_t errorCode_;
+		uint8_t type_;
+		uint32_t block_; // Next block of a multi block transfer
+};
+
+#endif
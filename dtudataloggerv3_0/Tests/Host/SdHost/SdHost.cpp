@@ -0,0 +1,380 @@
+/*
+  Host runtime for DLSD and SdFat: the Sd2Card stand-in over a RAM or
+  file mapped image with power cut and read error injection, a FAT16
+  formatter, the Print/Serial bits of the core and the DLCommon
+  helpers DLSD uses.
+*/
+#include <Arduino.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <Sd2Card.h>
+#include <DLCommon.h>
+#include "SdHost.h"
+
+SdHostStats_t sdhost_stats;
+HardwareSerial Serial;
+uint8_t SPCR, SPSR, SREG;
+
+static uint8_t *img = NULL;
+static uint32_t img_blocks = 0;
+static bool img_mapped = false;
+static unsigned long now_ms = 0;
+static uint32_t fault_writes = SDHOST_NO_FAULT; // Block writes left before the cut
+static uint16_t fault_torn = 0; // Bytes of the cut write that land
+static bool dead = false;
+static uint32_t bad_block = SDHOST_NO_FAULT;
+static uint16_t xfer_us = SDHOST_XFER_US;
+static const uint8_t *watch_lo = NULL, *watch_hi = NULL;
+
+static void power_on() {
+	fault_writes = SDHOST_NO_FAULT;
+	dead = false;
+	bad_block = SDHOST_NO_FAULT;
+	sdhost_reset_stats();
+}
+
+bool sdhost_create(uint32_t blocks) {
+	sdhost_free();
+	img = (uint8_t *)calloc(blocks, 512);
+	img_blocks = img ? blocks : 0;
+	power_on();
+	return img != NULL;
+}
+
+// Image in a file, kept as it is when it already has the size
+bool sdhost_open(const char *path, uint32_t blocks) {
+	int fd;
+	void *p;
+	sdhost_free();
+	if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+		return false;
+	if (ftruncate(fd, blocks * 512UL) < 0) {
+		close(fd);
+		return false;
+	}
+	p = mmap(NULL, blocks * 512UL, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	img = (uint8_t *)p;
+	img_blocks = blocks;
+	img_mapped = true;
+	power_on();
+	return true;
+}
+
+void sdhost_free() {
+	if (img_mapped)
+		munmap(img, img_blocks * 512UL);
+	else
+		free(img);
+	img = NULL;
+	img_blocks = 0;
+	img_mapped = false;
+}
+
+void sdhost_fault(uint32_t writes, uint16_t torn) {
+	fault_writes = writes;
+	fault_torn = torn;
+	dead = false;
+}
+
+bool sdhost_dead() {
+	return dead;
+}
+
+void sdhost_read_error(uint32_t block) {
+	bad_block = block;
+}
+
+void sdhost_watch(const void *buf, uint32_t len) {
+	watch_lo = (const uint8_t *)buf;
+	watch_hi = watch_lo + len;
+}
+
+// One block to the image, or the part of it that lands before the cut
+static bool program(uint32_t block, const uint8_t *src) {
+	if (dead)
+		return false;
+	if (fault_writes == 0) {
+		memcpy(img + block * 512UL, src, fault_torn);
+		dead = true;
+		return false;
+	}
+	if (fault_writes != SDHOST_NO_FAULT)
+		fault_writes--;
+	memcpy(img + block * 512UL, src, 512);
+	return true;
+}
+
+uint8_t *sdhost_image() {
+	return img;
+}
+
+uint32_t sdhost_blocks() {
+	return img_blocks;
+}
+
+void sdhost_reset_stats() {
+	memset(&sdhost_stats, 0, sizeof(sdhost_stats));
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+// FAT16 super floppy (boot sector in block 0), 512 root entries
+bool sdhost_format(uint8_t spc) {
+	uint8_t *b = img;
+	uint32_t clusters, fat_blocks = 1, data;
+	if (!img)
+		return false;
+	memset(img, 0, img_blocks * 512UL);
+	// The FAT has to cover the clusters left after it
+	for(;;) {
+		data = img_blocks - 1 - 2 * fat_blocks - 32;
+		clusters = data / spc;
+		if ((clusters + 2) * 2 <= fat_blocks * 512UL)
+			break;
+		fat_blocks++;
+	}
+	if (clusters < 4085 || clusters >= 65525)
+		return false;
+	b[0] = 0xEB; b[1] = 0x3C; b[2] = 0x90;
+	memcpy(b + 3, "SDHOST  ", 8);
+	put16(b + 11, 512);
+	b[13] = spc;
+	put16(b + 14, 1); // Reserved blocks
+	b[16] = 2; // FATs
+	put16(b + 17, 512); // Root entries
+	if (img_blocks < 65536)
+		put16(b + 19, img_blocks);
+	else
+		put32(b + 32, img_blocks);
+	b[21] = 0xF8;
+	put16(b + 22, fat_blocks);
+	put16(b + 24, 32);
+	put16(b + 26, 64);
+	b[36] = 0x80;
+	b[38] = 0x29;
+	memcpy(b + 43, "NO NAME    FAT16   ", 19);
+	b[510] = 0x55;
+	b[511] = 0xAA;
+	for(int f = 0; f < 2; f++) {
+		uint8_t *fat = img + (1 + f * fat_blocks) * 512UL;
+		put16(fat, 0xFFF8);
+		put16(fat + 2, 0xFFFF);
+	}
+	return true;
+}
+
+void sdhost_set_millis(unsigned long ms) {
+	now_ms = ms;
+}
+
+void sdhost_set_xfer_us(uint16_t us) {
+	xfer_us = us;
+}
+
+unsigned long millis() {
+	return now_ms;
+}
+
+unsigned long micros() {
+	return now_ms * 1000UL;
+}
+
+void delay(unsigned long ms) {
+	now_ms += ms;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return 0; }
+
+//------------------------------------------------------------------------------
+bool Sd2Card::init(uint8_t, uint8_t) {
+	errorCode_ = img && !dead ? 0 : SD_CARD_ERROR_CMD0;
+	type_ = SD_CARD_TYPE_SDHC;
+	return errorCode_ == 0;
+}
+
+uint32_t Sd2Card::cardSize() {
+	return img_blocks;
+}
+
+bool Sd2Card::readBlock(uint32_t block, uint8_t *dst) {
+	sdhost_stats.commands++;
+	if (block >= img_blocks || block == bad_block || dead) {
+		error(SD_CARD_ERROR_CMD17);
+		return false;
+	}
+	memcpy(dst, img + block * 512UL, 512);
+	sdhost_stats.blocks_read++;
+	if (dst >= watch_lo && dst < watch_hi)
+		sdhost_stats.blocks_watched++;
+	sdhost_stats.us += SDHOST_CMD_US + SDHOST_READ_US + xfer_us;
+	return true;
+}
+
+bool Sd2Card::readStart(uint32_t block) {
+	sdhost_stats.commands++;
+	sdhost_stats.us += SDHOST_CMD_US;
+	block_ = block;
+	return block < img_blocks;
+}
+
+bool Sd2Card::readData(uint8_t *dst) {
+	if (block_ >= img_blocks || block_ == bad_block || dead)
+		return false;
+	memcpy(dst, img + block_++ * 512UL, 512);
+	sdhost_stats.blocks_read++;
+	if (dst >= watch_lo && dst < watch_hi)
+		sdhost_stats.blocks_watched++;
+	sdhost_stats.us += SDHOST_READ_US + xfer_us;
+	return true;
+}
+
+bool Sd2Card::readStop() {
+	sdhost_stats.commands++;
+	sdhost_stats.us += SDHOST_CMD_US;
+	return true;
+}
+
+bool Sd2Card::writeBlock(uint32_t block, const uint8_t *src) {
+	sdhost_stats.commands++;
+	if (block == 0 || block >= img_blocks) {
+		error(SD_CARD_ERROR_CMD24);
+		return false;
+	}
+	if (!program(block, src)) {
+		error(SD_CARD_ERROR_WRITE);
+		return false;
+	}
+	sdhost_stats.blocks_written++;
+	sdhost_stats.us += SDHOST_CMD_US + xfer_us + SDHOST_WRITE_US;
+	return true;
+}
+
+bool Sd2Card::writeStart(uint32_t block, uint32_t) {
+	sdhost_stats.commands += 2; // ACMD23 pre-erase count, CMD25
+	sdhost_stats.us += 2 * SDHOST_CMD_US;
+	block_ = block;
+	return block > 0 && block < img_blocks;
+}
+
+bool Sd2Card::writeData(const uint8_t *src) {
+	if (block_ >= img_blocks || !program(block_, src)) {
+		error(SD_CARD_ERROR_WRITE);
+		return false;
+	}
+	block_++;
+	sdhost_stats.blocks_written++;
+	sdhost_stats.us += xfer_us + SDHOST_STREAM_US;
+	return true;
+}
+
+bool Sd2Card::writeStop() {
+	sdhost_stats.commands++;
+	sdhost_stats.us += SDHOST_STOP_US;
+	return true;
+}
+
+bool Sd2Card::erase(uint32_t first, uint32_t last) {
+	sdhost_stats.commands += 3;
+	sdhost_stats.us += 3 * SDHOST_CMD_US + SDHOST_ERASE_US;
+	if (last >= img_blocks || first > last || dead) {
+		error(SD_CARD_ERROR_ERASE);
+		return false;
+	}
+	memset(img + first * 512UL, 0, (last - first + 1) * 512UL);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+size_t HardwareSerial::write(uint8_t c) {
+	return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t Print::write(const uint8_t *buf, size_t size) {
+	size_t n = 0;
+	while (size--)
+		n += write(*buf++);
+	return n;
+}
+
+size_t Print::write(const char *s) {
+	return write((const uint8_t *)s, strlen(s));
+}
+
+size_t Print::print(const char *s) { return write(s); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return print((unsigned long)n, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t Print::print(long n, int base) {
+	if (n < 0 && base == DEC)
+		return print('-') + print((unsigned long)-n, base);
+	return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+	char buf[33], *p = buf + 32;
+	*p = '\0';
+	do {
+		uint8_t d = n % base;
+		*--p = d < 10 ? '0' + d : 'A' + d - 10;
+		n /= base;
+	} while (n);
+	return write(p);
+}
+
+size_t Print::print(double n, int digits) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.*f", digits, n);
+	return write(buf);
+}
+
+size_t Print::println() { return write("\r\n"); }
+size_t Print::println(const char *s) { return print(s) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base) { return print(n, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+//------------------------------------------------------------------------------
+void get_from_flash(void *ptr, char *dst) {
+	strcpy(dst, *(const char **)ptr);
+}
+
+void get_from_flash_P(const prog_char *ptr, char *dst) {
+	strcpy(dst, ptr);
+}
+
+unsigned long crc_update(unsigned long crc, byte data) {
+	crc ^= data;
+	for(int i = 0; i < 8; i++)
+		crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320UL : 0);
+	return crc & 0xFFFFFFFFUL;
+}
+
+unsigned fmtUnsigned(unsigned long val, char *buf, unsigned bufLen, byte width) {
+	char tmp[12];
+	int n = snprintf(tmp, sizeof(tmp), "%0*lu", width, val);
+	if ((unsigned)n >= bufLen)
+		n = bufLen - 1;
+	memcpy(buf, tmp, n);
+	buf[n] = '\0';
+	return n;
+}
@@ -0,0 +1,53 @@
+#ifndef SdHost_h
+#define SdHost_h
+
+#include <stdint.h>
+
+/*
+  RAM block image behind the Sd2Card stand-in, with counters of what the
+  SPI bus would have carried and an estimate of the time the AVR spends
+  on it: SPI at 8MHz with SdFat's byte loops, busy times of a class 4
+  card. Single block writes cost a program cycle each, streamed blocks of
+  a pre-erased multi-block write go to the card's buffer.
+  The image can be a file that outlives a run. sdhost_fault() cuts the
+  power on a later block write: it lands torn, then every command fails
+  until the next sdhost_open()/sdhost_create() or sdhost_fault(NO_FAULT).
+  sdhost_set_xfer_us() changes the block transfer time for other SPI loops,
+  SdSpiCycles.h estimates it for those of Sd2Card.cpp. sdhost_watch()
+  counts the blocks read into a buffer of the caller, those SdFat reads
+  there without its cache.
+*/
+#define SDHOST_CMD_US 40
+#define SDHOST_XFER_US 580 // 512 bytes + CRC
+#define SDHOST_READ_US 350 // Access time to the data token
+#define SDHOST_WRITE_US 1800 // Program busy after CMD24
+#define SDHOST_STREAM_US 250 // Busy per block of CMD25
+#define SDHOST_STOP_US 1500 // Stop token, buffer flushed
+#define SDHOST_ERASE_US 8000
+#define SDHOST_NO_FAULT 0xFFFFFFFFUL
+
+typedef struct {
+	uint32_t commands; // CMD17/18/24/25/12 and the erase commands
+	uint32_t blocks_read;
+	uint32_t blocks_watched; // Read into the sdhost_watch() buffer
+	uint32_t blocks_written;
+	uint32_t us; // Modelled time
+} SdHostStats_t;
+
+extern SdHostStats_t sdhost_stats;
+
+bool sdhost_create(uint32_t blocks);
+bool sdhost_open(const char *path, uint32_t blocks);
+void sdhost_free();
+bool sdhost_format(uint8_t blocks_per_cluster);
+uint8_t *sdhost_image();
+uint32_t sdhost_blocks();
+void sdhost_reset_stats();
+void sdhost_set_millis(unsigned long ms);
+void sdhost_set_xfer_us(uint16_t us);
+void sdhost_fault(uint32_t writes, uint16_t torn);
+bool sdhost_dead();
+void sdhost_read_error(uint32_t block);
+void sdhost_watch(const void *buf, uint32_t len);
+
+#endif
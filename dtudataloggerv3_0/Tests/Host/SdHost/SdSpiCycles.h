@@ -0,0 +1,44 @@
+#ifndef SdSpiCycles_h
+#define SdSpiCycles_h
+
+/*
+  Estimated AVR cycles of the block loops of Sd2Card.cpp at
+  SPI_FULL_SPEED, for a USE_SD_CRC mode with or without SD_SPI_UNROLL.
+  The costs per operation are read off avr-gcc -Os code for the loops,
+  they are not measured. A byte is 16 cycles on the bus, the work a loop
+  does after its SPDR write hides under it. The byte at a time loops load
+  or store between SPIF and the next SPDR write, the others after it.
+*/
+#define CYC_BUS 17 // A byte at F_CPU/2 and the SPIF poll that sees it
+#define CYC_CRIT 5 // SPIF seen to the next SPDR write
+#define CYC_MEM 2 // Load or store of a buffer byte
+#define CYC_COUNT 4 // Counter and branch of a pass
+#define CYC_PASS 6 // Load, counter and branch of CRC_CCITT()
+#define CYC_SHIFT 24 // crcStep() of USE_SD_CRC 1 and 3
+#define CYC_TABLE 17 // crcStep() of USE_SD_CRC 2 and 4, two lpm
+#define CYC_BYTE 24 // spiSend() or spiRec() of the token and CRC
+#define SPI_UNROLL 4
+
+// The 512 data bytes
+static inline long spi_block_cycles(int crc, bool unroll) {
+	int step = crc == 1 || crc == 3 ? CYC_SHIFT : CYC_TABLE;
+	int crit = CYC_CRIT, work = unroll ? CYC_COUNT / SPI_UNROLL : CYC_COUNT;
+	long n;
+	if (crc > 2)
+		work += CYC_MEM + step;
+	else if (unroll)
+		work += CYC_MEM;
+	else
+		crit += CYC_MEM;
+	n = 512L * (crit + (work > CYC_BUS ? work : CYC_BUS));
+	if (crc == 1 || crc == 2)
+		n += 512L * (CYC_PASS + step);
+	return n;
+}
+
+// Data token, block and CRC in us at 16 MHz, for sdhost_set_xfer_us()
+static inline uint16_t spi_xfer_us(int crc, bool unroll) {
+	return (spi_block_cycles(crc, unroll) + 3 * CYC_BYTE) / 16;
+}
+
+#endif
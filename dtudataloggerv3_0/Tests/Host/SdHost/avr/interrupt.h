@@ -0,0 +1,8 @@
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+#define cli()
+#define sei()
+#define ISR(v) void v()
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+#include <stdint.h>
+
+extern uint8_t SPCR, SPSR, SREG;
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __PGMSPACE_H_
+#define __PGMSPACE_H_
+
+#include <string.h>
+#include <stdint.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+typedef char prog_char;
+typedef uint8_t prog_uint8_t;
+typedef uint16_t prog_uint16_t;
+typedef uint32_t prog_uint32_t;
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define strcpy_P strcpy
+#define strcat_P strcat
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _AVR_WDT_H_
+#define _AVR_WDT_H_
+
+#define wdt_reset()
+#define wdt_enable(t)
+#define wdt_disable()
+
+#endif
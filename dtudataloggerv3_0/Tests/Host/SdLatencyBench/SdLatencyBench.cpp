@@ -0,0 +1,193 @@
+/*
+  Time the main loop spends in DLSD per call, FAT appends against
+  pre-allocated extents, each with a sync per line and with write-behind.
+  Replays the logger: a DATALOG line a second, a SYSLOG line every 10 s,
+  rotation past MAX_FILESIZE as in protothread_measure, poll() from the
+  loop. Times come from the SdHost card model. Reports the mean per line,
+  the worst call outside rotation and the worst rotation or file
+  creation, checks that the
+  rotated files hold exactly what was written and that a file left open
+  by a reset is found and trimmed to its data on the next boot.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt SdLatencyBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o sdlatencybench
+*/
+#include <string>
+#include <Arduino.h>
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define LINES 3000
+#define CRASH_LINE 1234
+#define CARD_BLOCKS (64UL * 2048)
+#define CLUSTER_BLOCKS 8
+#define MAX_FILESIZE 50000
+#define LOG_BUFF_SIZE 512
+#define SYS_BUFF_SIZE 200
+
+typedef struct {
+	uint32_t total, worst, rotation;
+} Times_t;
+
+static Times_t tm;
+static uint32_t mark;
+
+static void start() {
+	mark = sdhost_stats.us;
+}
+
+static void stop(bool rotation) {
+	uint32_t t = sdhost_stats.us - mark;
+	tm.total += t;
+	if (rotation) {
+		if (t > tm.rotation)
+			tm.rotation = t;
+	} else if (t > tm.worst) {
+		tm.worst = t;
+	}
+}
+
+static void make_line(char *line, int i) {
+	snprintf(line, 160, "T%u V4950 N5 a1:512.25:3.21:498.00:530.00 a2:%d.50:0.75:300.00:310.00 c8:12.50:0.75 d10:%d\r\n",
+	         1350000000u + i, 300 + i % 10, i & 1);
+}
+
+static void make_sys(char *line, int i) {
+	snprintf(line, 160, "%u: 1523Hz Sys 12ms Meas 3ms Comm 41ms Ser 0ms Event 1ms V4950 GSM 3 C%d\r\n",
+	         1350000000u + i, i);
+}
+
+static void setup(DLSD *sd, uint16_t latency, bool extents) {
+	if (sd->init() != 1)
+		printf("FAIL: init\n");
+	sd->set_latency(latency);
+	if (extents) {
+		sd->set_extent(DATALOG, MAX_FILESIZE + LOG_BUFF_SIZE);
+		sd->set_extent(SYSLOG, MAX_FILESIZE + SYS_BUFF_SIZE);
+	}
+}
+
+// protothread_measure / sys_log_message
+static void log(DLSD *sd, uint8_t n, char *line) {
+	bool rotated = false;
+	start();
+	long filesize = sd->open(n, O_RDWR | O_CREAT | O_APPEND);
+	if (filesize == 0) // First file created
+		rotated = true;
+	if (filesize > MAX_FILESIZE) {
+		sd->close(n);
+		sd->increment_file(n);
+		sd->open(n, O_RDWR | O_CREAT | O_APPEND);
+		rotated = true;
+	}
+	sd->write(n, line);
+	stop(rotated);
+}
+
+// Every file of stream n up to and including the current one
+static std::string read_all(DLSD *sd, uint8_t n) {
+	std::string s;
+	char buf[512];
+	int r;
+	uint16_t last = sd->get_files_count(n);
+	for(uint16_t f = 0; f <= last; f++) {
+		sd->set_files_count(n, f);
+		if (sd->open(n, O_READ) == (unsigned long)-1)
+			continue;
+		sd->rewind(n);
+		while ((r = sd->read(n, buf, sizeof(buf))) > 0)
+			s.append(buf, r);
+		sd->close(n);
+	}
+	sd->set_files_count(n, last);
+	return s;
+}
+
+static bool run(const char *name, uint16_t latency, bool extents) {
+	DLSD sd(0, SS);
+	std::string data, sys;
+	char line[160];
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sdhost_set_millis(0);
+	memset(&tm, 0, sizeof(tm));
+	setup(&sd, latency, extents);
+	for(int i = 0; i < LINES; i++) {
+		sdhost_set_millis(i * 1000UL);
+		make_line(line, i);
+		data += line;
+		log(&sd, DATALOG, line);
+		if (i % 10 == 9) {
+			make_sys(line, i);
+			sys += line;
+			log(&sd, SYSLOG, line);
+		}
+		for(int t = 0; t < 10; t++) {
+			sdhost_set_millis(i * 1000UL + t * 100);
+			start();
+			sd.poll();
+			stop(false);
+		}
+	}
+	printf("%-22s: mean %6.2f ms/line  worst %6.2f ms  rotate %6.2f ms  files %u\n", name,
+	       tm.total / 1000.0 / LINES, tm.worst / 1000.0, tm.rotation / 1000.0,
+	       sd.get_files_count(DATALOG) + 1);
+	// Rotate the last files so every one is trimmed
+	sd.close(DATALOG);
+	sd.increment_file(DATALOG);
+	sd.close(SYSLOG);
+	sd.increment_file(SYSLOG);
+	if (read_all(&sd, DATALOG) != data || read_all(&sd, SYSLOG) != sys) {
+		printf("FAIL: rotated files differ from what was written\n");
+		return false;
+	}
+	return true;
+}
+
+// Reset without closing, the next boot finds the written length
+static bool crash(uint16_t latency) {
+	DLSD *sd = new DLSD(0, SS);
+	std::string data;
+	char line[160];
+	unsigned long len;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sdhost_set_millis(0);
+	setup(sd, latency, true);
+	for(int i = 0; i < CRASH_LINE; i++) {
+		sdhost_set_millis(i * 1000UL);
+		make_line(line, i);
+		data += line;
+		log(sd, DATALOG, line);
+		sd->poll();
+	}
+	uint16_t files = sd->get_files_count(DATALOG);
+	delete sd; // Power gone, nothing flushed
+	sd = new DLSD(0, SS);
+	setup(sd, latency, true);
+	sd->set_files_count(DATALOG, files);
+	len = sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
+	sd->close(DATALOG);
+	std::string got = read_all(sd, DATALOG);
+	delete sd;
+	// Write-behind may lose what was younger than the latency
+	if (got.size() > data.size() || data.compare(0, got.size(), got) != 0 ||
+	    data.size() - got.size() > (latency ? 2 * SD_BLOCK : 0)) {
+		printf("FAIL: reset with latency %u: %zu of %zu bytes back\n", latency, got.size(), data.size());
+		return false;
+	}
+	printf("reset, latency %5u ms: file %u trimmed to %lu bytes, %zu bytes lost\n",
+	       latency, files, len, data.size() - got.size());
+	return true;
+}
+
+int main() {
+	printf("%d lines, MAX_FILESIZE %d, %d blocks per cluster\n", LINES, MAX_FILESIZE, CLUSTER_BLOCKS);
+	if (!run("append, sync per line", 0, false) ||
+	    !run("append, write-behind", 10000, false) ||
+	    !run("extent, sync per line", 0, true) ||
+	    !run("extent, write-behind", 10000, true))
+		return 1;
+	if (!crash(0) || !crash(10000))
+		return 1;
+	return 0;
+}
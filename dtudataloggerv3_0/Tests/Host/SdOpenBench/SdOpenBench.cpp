@@ -0,0 +1,100 @@
+/*
+  SD traffic of opening the log streams. Replays the logger: a DATALOG
+  line every second, a SYSLOG line every 10 s and the HTTP status report
+  asking for the DATALOG size every 60 s, once with the streams left open
+  between lines as protothread_measure does and once opened and closed
+  around every line. Reports blocks read, SD commands and modelled card
+  time per 1000 DATALOG lines, with a sync per line and with extents and
+  write-behind, and checks the files against what was written.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt SdOpenBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o sdopenbench
+*/
+#include <string>
+#include <Arduino.h>
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define LINES 1000
+#define CARD_BLOCKS (64UL * 2048)
+#define CLUSTER_BLOCKS 8
+#define MAX_FILESIZE 50000
+
+static std::string read_file(DLSD *sd, uint8_t n) {
+	std::string s;
+	char buf[512];
+	int r;
+	sd->open(n, O_READ);
+	sd->rewind(n);
+	while ((r = sd->read(n, buf, sizeof(buf))) > 0)
+		s.append(buf, r);
+	sd->close(n);
+	return s;
+}
+
+static void log(DLSD *sd, uint8_t n, char *line, bool reopen) {
+	sd->open(n, O_RDWR | O_CREAT | O_APPEND);
+	sd->write(n, line);
+	if (reopen)
+		sd->close(n);
+}
+
+static bool run(const char *name, bool reopen, bool extents) {
+	DLSD sd(0, SS);
+	std::string data, sys;
+	char line[160];
+	unsigned long size = 0;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sdhost_set_millis(0);
+	sd.init();
+	if (extents) {
+		sd.set_latency(10000);
+		sd.set_extent(DATALOG, MAX_FILESIZE);
+		sd.set_extent(SYSLOG, MAX_FILESIZE);
+	}
+	sdhost_reset_stats();
+	for(int i = 0; i < LINES; i++) {
+		sdhost_set_millis(i * 1000UL);
+		snprintf(line, sizeof(line), "T%u V4950 N5 a1:512.25:3.21:498.00:530.00 a2:%d.50:0.75:300.00:310.00 c8:12.50:0.75 d10:%d\r\n",
+		         1350000000u + i, 300 + i % 10, i & 1);
+		data += line;
+		log(&sd, DATALOG, line, reopen);
+		if (i % 10 == 9) {
+			snprintf(line, sizeof(line), "%u: 1523Hz Sys 12ms Meas 3ms Comm 41ms Ser 0ms Event 1ms V4950 GSM 3 C%d\r\n",
+			         1350000000u + i, i);
+			sys += line;
+			log(&sd, SYSLOG, line, reopen);
+		}
+		if (i % 60 == 59) // Status report
+			size = sd.size(DATALOG);
+		for(int t = 0; t < 10; t++) {
+			sdhost_set_millis(i * 1000UL + t * 100);
+			sd.poll();
+		}
+	}
+	SdHostStats_t st = sdhost_stats;
+	printf("%-30s: blocks read %5u  SD commands %5u  card time %6.0f ms  per %d lines\n",
+	       name, st.blocks_read, st.commands, st.us / 1000.0, LINES);
+	if (size < (LINES - 60) * 80UL || size > data.size()) {
+		printf("FAIL: status size %lu of %zu bytes\n", size, data.size());
+		return false;
+	}
+	sd.increment_file(DATALOG);
+	sd.increment_file(SYSLOG);
+	sd.set_files_count(DATALOG, 0);
+	sd.set_files_count(SYSLOG, 0);
+	if (read_file(&sd, DATALOG) != data || read_file(&sd, SYSLOG) != sys) {
+		printf("FAIL: files differ from what was written\n");
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	if (!run("kept open, sync per line", false, false) ||
+	    !run("kept open, extents", false, true) ||
+	    !run("open/close per line, sync", true, false) ||
+	    !run("open/close per line, extents", true, true))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*
+  SD traffic of DLSD with a sync per write against write-behind, on the
+  real SdFat over the RAM card of SdHost. Replays the logger's pattern:
+  a DATALOG line every second (SAMPLING_RATE/MEASURE_TIME 1 s windows),
+  a SYSLOG status line every 10 s, with poll() run from the main loop.
+  Reports blocks written, blocks read and SD commands per 1000 DATALOG
+  lines and checks both runs leave the same files.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt SdWriteBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o sdwritebench
+*/
+#include <string>
+#include <Arduino.h>
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define LINES 1000
+#define CARD_BLOCKS (64UL * 2048) // 64 MB
+#define CLUSTER_BLOCKS 8
+
+static std::string read_file(DLSD *sd, uint8_t n) {
+	std::string s;
+	char buf[128];
+	int r;
+	sd->open(n, O_READ);
+	sd->rewind(n);
+	while ((r = sd->read(n, buf, sizeof(buf))) > 0)
+		s.append(buf, r);
+	sd->close(n);
+	return s;
+}
+
+static void run(const char *name, uint16_t latency, std::string *data, std::string *sys) {
+	DLSD sd(0, SS);
+	char line[160];
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sdhost_set_millis(0);
+	if (sd.init() != 1) {
+		printf("FAIL: init\n");
+		exit(1);
+	}
+	sd.set_latency(latency);
+	sdhost_reset_stats();
+	for(int i = 0; i < LINES; i++) {
+		sdhost_set_millis(i * 1000UL);
+		sd.open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
+		snprintf(line, sizeof(line), "T%u V4950 N5 a1:512.25:3.21:498.00:530.00 a2:%d.50:0.75:300.00:310.00 c8:12.50:0.75 d10:%d\r\n",
+		         1350000000u + i, 300 + i % 10, i & 1);
+		sd.write(DATALOG, line);
+		if (i % 10 == 9) {
+			sd.open(SYSLOG, O_RDWR | O_CREAT | O_APPEND);
+			snprintf(line, sizeof(line), "%u: 1523Hz Sys 12ms Meas 3ms Comm 41ms Ser 0ms Event 1ms V4950 GSM 3 C%d\r\n",
+			         1350000000u + i, i);
+			sd.write(SYSLOG, line);
+		}
+		for(int t = 0; t < 10; t++) { // Main loop iterations within the second
+			sdhost_set_millis(i * 1000UL + t * 100);
+			sd.poll();
+		}
+	}
+	sd.close(DATALOG);
+	sd.close(SYSLOG);
+	SdHostStats_t st = sdhost_stats;
+	printf("%-13s: blocks written %6.0f  blocks read %6.0f  SD commands %6.0f  per %d lines\n",
+	       name, st.blocks_written * 1000.0 / LINES, st.blocks_read * 1000.0 / LINES,
+	       st.commands * 1000.0 / LINES, 1000);
+	*data = read_file(&sd, DATALOG);
+	*sys = read_file(&sd, SYSLOG);
+}
+
+int main() {
+	std::string d0, s0, d1, s1;
+	run("sync per line", 0, &d0, &s0);
+	run("write-behind", 10000, &d1, &s1);
+	if (d0 != d1 || s0 != s1 || d0.size() < LINES * 80) {
+		printf("FAIL: files differ (%zu/%zu, %zu/%zu bytes)\n", d0.size(), d1.size(), s0.size(), s1.size());
+		return 1;
+	}
+	printf("DATALOG %zu bytes, SYSLOG %zu bytes, identical in both modes\n", d0.size(), s0.size());
+	return 0;
+}
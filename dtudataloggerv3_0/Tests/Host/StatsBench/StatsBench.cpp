@@ -0,0 +1,138 @@
+/*
+  Accuracy and cost of DLStat against the old double accumulators.
+  On the AVR double is a 32 bit float, so the old path is run with float
+  (what the logger computed) and with host double for comparison.
+  Reference is a two pass long double mean/std dev over the same samples.
+  Last a long window with a large swing, a scan channel for 7 minutes
+  that starts low and goes to full scale, past a 32 bit sum.
+
+  Build: g++ -O2 -I../../../DLMeasure StatsBench.cpp -o statsbench
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "DLStats.h"
+
+#define WINDOW 1000000L
+
+typedef struct {
+	const char *name;
+	double mean, std;
+} Signal_t;
+
+template <typename F>
+static void old_stats(const std::vector<uint16_t> &x, double *mean, double *std) {
+	F sum = 0, sqsum = 0, n = x.size();
+	for(size_t i = 0; i < x.size(); i++) {
+		sum += (F)x[i];
+		sqsum += (F)x[i] * (F)x[i];
+	}
+	F m2 = n * sqsum - sum * sum;
+	*std = m2 > 0 ? (double)(sqrt(m2) / n) : 0; // Negative M2 gives NaN on the logger
+	*mean = (double)(sum / n);
+}
+
+static void ref_stats(const std::vector<uint16_t> &x, double *mean, double *std) {
+	long double sum = 0, sq = 0;
+	for(size_t i = 0; i < x.size(); i++)
+		sum += x[i];
+	long double m = sum / x.size();
+	for(size_t i = 0; i < x.size(); i++)
+		sq += (x[i] - m) * (x[i] - m);
+	*mean = (double)m;
+	*std = (double)sqrtl(sq / x.size());
+}
+
+static double rel(double v, double ref) {
+	if (ref == 0)
+		return fabs(v);
+	return fabs(v - ref) / ref;
+}
+
+int main() {
+	Signal_t sig[] = {
+		{ "low noise, high offset", 1000.0, 0.5 },
+		{ "mid scale", 512.0, 40.0 },
+		{ "near zero", 3.0, 1.0 },
+	};
+	std::vector<uint16_t> x(WINDOW);
+	srand(1);
+
+	printf("%ld samples per window\n", WINDOW);
+	printf("%-24s %-10s %12s %12s %10s\n", "signal", "method", "mean err", "std err", "ns/sample");
+	for(unsigned s = 0; s < sizeof(sig) / sizeof(sig[0]); s++) {
+		for(long i = 0; i < WINDOW; i++) {
+			// Sum of uniforms ~ gaussian
+			double g = 0;
+			for(int k = 0; k < 12; k++)
+				g += rand() / (double)RAND_MAX;
+			double v = sig[s].mean + (g - 6.0) * sig[s].std;
+			x[i] = v < 0 ? 0 : (v > 1023 ? 1023 : (uint16_t)(v + 0.5));
+		}
+		double rm, rs, m, sd;
+		ref_stats(x, &rm, &rs);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		old_stats<float>(x, &m, &sd);
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / WINDOW;
+		printf("%-24s %-10s %12.3e %12.3e %10.2f\n", sig[s].name, "float", rel(m, rm), rel(sd, rs), ns);
+
+		t0 = std::chrono::steady_clock::now();
+		old_stats<double>(x, &m, &sd);
+		ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / WINDOW;
+		printf("%-24s %-10s %12.3e %12.3e %10.2f\n", "", "double", rel(m, rm), rel(sd, rs), ns);
+
+		AnalogStat a;
+		t0 = std::chrono::steady_clock::now();
+		for(long i = 0; i < WINDOW; i++)
+			a.add(x[i]);
+		m = a.mean();
+		sd = a.std_dev();
+		ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / WINDOW;
+		printf("%-24s %-10s %12.3e %12.3e %10.2f\n", "", "DLStat", rel(m, rm), rel(sd, rs), ns);
+
+		// Same data in scan banks of up to 4096 samples merged per tick
+		AnalogStat b;
+		t0 = std::chrono::steady_clock::now();
+		for(long i = 0; i < WINDOW; ) {
+			uint32_t sum = 0, sq = 0;
+			uint16_t cnt = 0, mn = 0xffff, mx = 0;
+			for(; cnt < 4096 && i < WINDOW; i++, cnt++) {
+				sum += x[i];
+				sq += (uint32_t)x[i] * x[i];
+				if (x[i] < mn) mn = x[i];
+				if (x[i] > mx) mx = x[i];
+			}
+			b.merge(sum, sq, cnt, mn, mx);
+		}
+		m = b.mean();
+		sd = b.std_dev();
+		ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / WINDOW;
+		printf("%-24s %-10s %12.3e %12.3e %10.2f\n", "", "merge", rel(m, rm), rel(sd, rs), ns);
+		if (rel(a.mean(), rm) > 1e-6 || rel(a.std_dev(), rs) > 1e-6 ||
+		    rel(b.mean(), rm) > 1e-6 || rel(b.std_dev(), rs) > 1e-6 ||
+		    a.count() != WINDOW || b.count() != WINDOW) {
+			printf("FAIL\n");
+			return 1;
+		}
+	}
+
+	// 2^22 samples, ~437 s at 9.6k/s, the first at 5 and most near 1020
+	std::vector<uint16_t> y(1L << 22);
+	for(size_t i = 0; i < y.size(); i++)
+		y[i] = i < 1000 ? 5 : 1018 + rand() % 6;
+	double rm, rs;
+	AnalogStat c;
+	ref_stats(y, &rm, &rs);
+	for(size_t i = 0; i < y.size(); i++)
+		c.add(y[i]);
+	printf("%-24s %-10s %12.3e %12.3e  %u samples\n", "long window, swing", "DLStat", rel(c.mean(), rm), rel(c.std_dev(), rs),
+	       c.count());
+	if (rel(c.mean(), rm) > 1e-6 || rel(c.std_dev(), rs) > 1e-6) {
+		printf("FAIL: long window\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,375 @@
+/*
+  Jitter of the measurement thread with the SYSLOG traffic around it,
+  each thread opening, rotating and writing the card itself as the skel
+  did, against putting into the DLStore queue with protothread_store()
+  writing one batch per loop pass. The loop is replayed for SECONDS
+  seconds on the SdHost card model with the skel's setup: framed
+  DATALOG and SYSLOG, extents, write-behind and rotation at MAX_FILESIZE.
+  A pass costs PASS_US of CPU plus the card time of what it does, in the
+  thread order of loop(). A DATALOG line is due every second and an
+  event line every few, SYSLOG lines come at 0 to 20 a second and in a
+  burst of BURST lines every minute, which the store writes coalesced.
+
+  Jitter is the time from a line being due to the measurement thread
+  being done with it. Reported are its mean, deviation and maximum, the
+  longest store pass, requests per batch and the longest queue waits.
+  With the store the maximum may not grow with the SYSLOG rate by more
+  than one store pass. The files are then read back through the frames
+  and have to hold every line in order, files starting on a line.
+
+  Then binary records, deltas to the one before, with the store thread
+  held long enough for the queue to fill and the card failing now and
+  then. The producer starts over from absolute values after a put()
+  that failed and when lost() says so, as protothread_measure() does.
+  Every record read back has to decode to the values it was made with,
+  without the resync some do not.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../DLMeasure -I../../../Time -I../../../pt StoreBench.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../DLSD/DLStore.cpp ../../../DLMeasure/DLRecord.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o storebench
+*/
+#include <string>
+#include <math.h>
+#include <Arduino.h>
+#include "DLSD.h"
+#include "DLStore.h"
+#include "DLRecord.h"
+#include "SdHost.h"
+
+#define CARD_BLOCKS (64UL * 2048)
+#define CLUSTER_BLOCKS 8
+#define MAX_FILESIZE 50000
+#define LOG_BUFF_SIZE 512
+#define SYS_BUFF_SIZE 200
+#define SECONDS 1200
+#define PASS_US 1500.0
+#define T_START 1350000000UL
+#define BURST 8
+#define REC_SECONDS 20000
+#define REC_ROTATE 20000
+#define HOLD_EVERY 600 // s between store thread holds
+#define HOLD 120 // s it is held, the queue fills
+#define FAIL_EVERY 700 // s between card failures
+
+typedef struct {
+	double sum, sum2, max;
+	long n;
+} Stat_t;
+
+typedef struct {
+	Stat_t jitter;
+	double store_max; // Longest store pass, us
+	long requests, batches;
+	uint16_t lat[SD_WB_STREAMS + SD_WB_FIRST];
+} Run_t;
+
+static DLSD *sd;
+static DLStore *store;
+static double now_us;
+static uint32_t card_us; // Card time on the clock so far
+static std::string data, sys;
+
+static void stat(Stat_t *s, double v) {
+	s->sum += v;
+	s->sum2 += v * v;
+	if (v > s->max)
+		s->max = v;
+	s->n++;
+}
+
+// Card time of the work since the last call goes on the clock
+static double card() {
+	double us = sdhost_stats.us - card_us;
+	card_us = sdhost_stats.us;
+	now_us += us;
+	sdhost_set_millis(now_us / 1000);
+	return us;
+}
+
+// The old sys_log_message() and measurement write: open, rotate, write
+static void direct(uint8_t n, const char *line) {
+	long filesize;
+	if (sd->is_available() < 0)
+		sd->init();
+	filesize = sd->open(n, O_RDWR | O_CREAT | O_APPEND);
+	if (filesize != -1) {
+		if (filesize > MAX_FILESIZE) {
+			sd->close(n);
+			sd->increment_file(n);
+			filesize = sd->open(n, O_RDWR | O_CREAT | O_APPEND);
+		}
+		sd->stamp(n, T_START + (uint32_t)(now_us / 1e6));
+		sd->write(n, (char *)line);
+	}
+}
+
+static void log(uint8_t n, const char *line, bool queued) {
+	(n == DATALOG ? data : sys) += line;
+	if (!queued)
+		direct(n, line);
+	else if (!store->put(n, line, T_START + (uint32_t)(now_us / 1e6)))
+		printf("FAIL: queue full\n");
+}
+
+// Payloads of the framed files of n, a file has to start on a line
+static bool read_back(uint8_t n, std::string *out) {
+	uint16_t last = sd->get_files_count(n);
+	uint8_t h[SD_FRAME_HDR];
+	char buf[SD_FRAME_MAX];
+	uint16_t len;
+	for(uint16_t c = 0; c <= last; c++) {
+		sd->set_files_count(n, c);
+		if (sd->open(n, O_READ) == (unsigned long)-1)
+			continue;
+		sd->rewind(n);
+		if (out->size() && (*out)[out->size() - 1] != '\n')
+			return false;
+		while (sd->read(n, (char *)h, SD_FRAME_HDR) == SD_FRAME_HDR && h[0] == SD_FRAME) {
+			len = h[1] | h[2] << 8;
+			if (len > SD_FRAME_MAX || sd->read(n, buf, len) != len)
+				return false;
+			out->append(buf, len);
+		}
+		sd->close(n);
+	}
+	sd->set_files_count(n, last);
+	return true;
+}
+
+static bool run(double sys_rate, bool queued, Run_t *r) {
+	char line[SYS_BUFF_SIZE];
+	double next_meas = 1e6, next_ev = 2.5e6, next_sys = 0, next_burst = 30e6, us;
+	long lines = 0, events = 0, syslines = 0;
+	std::string got;
+	DLSD card_sd(0, SS);
+	DLStore st;
+	sd = &card_sd;
+	store = &st;
+	memset(r, 0, sizeof(*r));
+	data.clear();
+	sys.clear();
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	now_us = 0;
+	card_us = sdhost_stats.us;
+	sdhost_set_millis(0);
+	sd->init();
+	sd->set_latency(10000);
+	sd->set_extent(DATALOG, MAX_FILESIZE + LOG_BUFF_SIZE);
+	sd->set_extent(SYSLOG, MAX_FILESIZE + SYS_BUFF_SIZE);
+	sd->set_time_index(DATALOG, SD_TIDX_EVERY);
+	sd->set_frames(DATALOG, true);
+	sd->set_frames(SYSLOG, true);
+	st.begin(sd);
+	st.set_rotate(DATALOG, MAX_FILESIZE);
+	st.set_rotate(SYSLOG, MAX_FILESIZE);
+	srand(7);
+	card();
+	while (now_us < SECONDS * 1e6) {
+		// protothread_sys
+		if (sys_rate > 0 && now_us >= next_sys) {
+			snprintf(line, sizeof(line), "%lu: 1523Hz Sys 12ms Meas 3ms Ev 1ms Comm 41ms Net: 3 M: %ld V: 4950\r\n",
+			         T_START + (unsigned long)(now_us / 1e6), syslines++);
+			log(SYSLOG, line, queued);
+			next_sys += 1e6 / sys_rate;
+		}
+		if (now_us >= next_burst) {
+			for(int i = 0; i < BURST; i++) {
+				snprintf(line, sizeof(line), "%lu: Thread %d timing %d exceed 0\r\n",
+				         T_START + (unsigned long)(now_us / 1e6), i, i * 7);
+				log(SYSLOG, line, queued);
+				syslines++;
+			}
+			next_burst += 60e6;
+		}
+		card();
+		// protothread_measure
+		if (now_us >= next_meas) {
+			snprintf(line, sizeof(line), "T%lu V4950 N5 a1:512.25:3.21:498.00:530.00 a2:%ld.50:0.75:300.00:310.00\r\n",
+			         T_START + (unsigned long)(now_us / 1e6), 300 + lines++ % 10);
+			log(DATALOG, line, queued);
+			card();
+			stat(&r->jitter, now_us - next_meas);
+			next_meas += 1e6;
+		}
+		// protothread_event
+		if (now_us >= next_ev) {
+			snprintf(line, sizeof(line), "E%lu d10:%ld\r\n", T_START + (unsigned long)(now_us / 1e6), events++ & 1);
+			log(DATALOG, line, queued);
+			card();
+			next_ev += (1 + rand() % 5) * 1e6;
+		}
+		// protothread_store
+		if (queued && st.pending()) {
+			st.run();
+			us = card();
+			r->batches++;
+			if (us > r->store_max)
+				r->store_max = us;
+		}
+		sd->poll();
+		card();
+		now_us += PASS_US;
+		sdhost_set_millis(now_us / 1000);
+	}
+	while (st.run())
+		r->batches++;
+	sd->flush();
+	r->requests = lines + events + syslines;
+	for(uint8_t n = DATALOG; n <= SYSLOG; n++)
+		r->lat[n] = st.latency(n);
+	if (st.dropped()) {
+		printf("FAIL: %u requests dropped\n", st.dropped());
+		return false;
+	}
+	if (!read_back(DATALOG, &got) || got != data) {
+		printf("FAIL: DATALOG differs from what was logged\n");
+		return false;
+	}
+	got.clear();
+	if (!read_back(SYSLOG, &got) || got != sys) {
+		printf("FAIL: SYSLOG differs from what was logged\n");
+		return false;
+	}
+	if (sd->get_files_count(DATALOG) == 0) {
+		printf("FAIL: DATALOG never rotated\n");
+		return false;
+	}
+	return true;
+}
+
+static void report(double rate, const char *name, Run_t *r) {
+	double mean = r->jitter.sum / r->jitter.n;
+	double sd = sqrt(r->jitter.sum2 / r->jitter.n - mean * mean);
+	printf("SYSLOG %4.1f/s %-7s jitter mean %6.2f ms  dev %6.2f ms  max %6.2f ms", rate, name, mean / 1000, sd / 1000,
+	       r->jitter.max / 1000);
+	if (r->batches)
+		printf("  store pass max %5.2f ms  %4.2f requests/batch  waits %u/%u ms", r->store_max / 1000,
+		       (double)r->requests / r->batches, r->lat[DATALOG], r->lat[SYSLOG]);
+	printf("\n");
+}
+
+static uint32_t rec_val(uint32_t t, uint8_t port) {
+	return port ? t * 3 : 1000 + (t * 37) % 500;
+}
+
+// Records of every DATALOG file, decoded each from its start as
+// DLDecode does. Counts those that do not give their values back.
+static void decode_back(long *good, long *bad) {
+	uint16_t last = sd->get_files_count(DATALOG);
+	uint8_t h[SD_FRAME_HDR];
+	std::string f;
+	char buf[SD_FRAME_MAX];
+	uint16_t len, at;
+	uint32_t v0, v1;
+	DLRecordReader rd;
+	for(uint16_t c = 0; c <= last; c++) {
+		sd->set_files_count(DATALOG, c);
+		if (sd->open(DATALOG, O_READ) == (unsigned long)-1)
+			continue;
+		sd->rewind(DATALOG);
+		f.clear();
+		while (sd->read(DATALOG, (char *)h, SD_FRAME_HDR) == SD_FRAME_HDR && h[0] == SD_FRAME) {
+			len = h[1] | h[2] << 8;
+			if (len > SD_FRAME_MAX || sd->read(DATALOG, buf, len) != len)
+				break;
+			f.append(buf, len);
+		}
+		sd->close(DATALOG);
+		rd.sync();
+		for(at = 0; at < f.size() && rd.begin((const uint8_t *)f.data() + at, f.size() - at) == 1; at += rd.used()) {
+			if (rd.get_delta(0, &v0) && rd.get_delta(1, &v1) && v0 == rec_val(rd.time(), 0) &&
+			    v1 == rec_val(rd.time(), 1))
+				(*good)++;
+			else
+				(*bad)++;
+		}
+	}
+	sd->set_files_count(DATALOG, last);
+}
+
+static bool binary_run(bool resync) {
+	uint8_t buf[REC_MAX_LEN];
+	uint16_t len;
+	long made = 0, failed = 0, lost = 0, batches = 0, good = 0, bad = 0;
+	DLSD card_sd(0, SS);
+	DLStore st;
+	DLRecord rec;
+	sd = &card_sd;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(CLUSTER_BLOCKS);
+	sdhost_set_millis(0);
+	sd->init();
+	sd->set_frames(DATALOG, true);
+	sd->set_frames(SYSLOG, true);
+	st.begin(sd);
+	st.set_rotate(DATALOG, REC_ROTATE);
+	st.set_rotate(SYSLOG, REC_ROTATE);
+	for(uint32_t s = 1; s <= REC_SECONDS; s++) {
+		sdhost_set_millis(s * 1000UL);
+		for(int k = 0; k < 4; k++) { // Windows and events
+			uint32_t t = T_START + s * 4 + k;
+			bool l = st.lost(DATALOG);
+			batches += l;
+			if ((resync && l) || st.rotating(DATALOG))
+				rec.sync();
+			rec.begin(buf, 0, t);
+			rec.put_delta(0, rec_val(t, 0));
+			rec.put_delta(1, rec_val(t, 1));
+			len = rec.end();
+			made++;
+			if (!st.put(DATALOG, buf, len, t)) {
+				failed++;
+				if (resync)
+					rec.sync();
+			}
+			if (k == 1) // SYSLOG in between splits the batches
+				st.put(SYSLOG, "Net: 3 M: 12 V: 4950\r\n", t);
+		}
+		if (s % HOLD_EVERY < HOLD)
+			continue;
+		if (s % FAIL_EVERY == 0 || s % (3 * HOLD_EVERY) == HOLD) // Some as a full queue drains
+			sdhost_fault(0, 0);
+		for(int k = 0; k < 4 && st.run(); k++) // One batch a loop pass
+			if (sdhost_dead())
+				break;
+		if (sdhost_dead()) {
+			lost++;
+			sdhost_fault(SDHOST_NO_FAULT, 0);
+			sd->init();
+		}
+	}
+	while (st.run())
+		;
+	sd->flush();
+	decode_back(&good, &bad);
+	printf("binary %-9s %6ld records  %5ld put() failed  %2ld card failures  %2ld lost()  %5u dropped  %6ld read back, %5ld wrong\n",
+	       resync ? "resync" : "no resync", made, failed, lost, batches, st.dropped(), good + bad, bad);
+	if (!failed || !lost) {
+		printf("FAIL: queue never full or card never failed\n");
+		return false;
+	}
+	if (resync && (bad || good == 0)) {
+		printf("FAIL: records decode wrong\n");
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	const double rates[] = { 0, 1, 5, 20 };
+	Run_t direct_run, queued_run;
+	double base = 0;
+	for(int i = 0; i < 4; i++) {
+		if (!run(rates[i], false, &direct_run) || !run(rates[i], true, &queued_run))
+			return 1;
+		report(rates[i], "direct", &direct_run);
+		report(rates[i], "queued", &queued_run);
+		if (i == 0)
+			base = queued_run.jitter.max;
+		else if (queued_run.jitter.max > base + queued_run.store_max) {
+			printf("FAIL: jitter grows with the SYSLOG rate\n");
+			return 1;
+		}
+	}
+	binary_run(false);
+	return binary_run(true) ? 0 : 1;
+}
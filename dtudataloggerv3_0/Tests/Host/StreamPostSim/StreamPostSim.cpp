@@ -0,0 +1,322 @@
+/*
+  Upload of a DATALOG file streamed into the transmit ring as
+  DLFileUpload::fill() and DLHTTP::PT_POST_stream() do it, against the
+  double buffer before it with the core's 63 byte ring. Counted are the
+  RAM writes for each body byte: a card block landing in RAM, a copy
+  from the SdFat cache to a buffer, one from a buffer to the ring. The
+  stream reads into a model of DLUart's ring and tx_span(), the blocks
+  SdFat reads straight into it are seen with sdhost_watch(). The UART
+  drains the ring at GSM_BAUD into a modem model that checks every byte
+  against the file and that no transfer passes the window.
+
+  Modem answer times are the assumptions of UploadPipeSim. Reported are
+  RAM writes per body byte, the body time, UART idle time in it, the
+  throughput with the per POST overhead and the longest other threads
+  wait in a body.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt StreamPostSim.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o streampostsim
+*/
+#include <Arduino.h>
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define CARD_BLOCKS (16UL * 2048)
+#define FILE_SIZE 48000L
+#define UPLOAD_PART 4000
+#define GSM_BAUD 57600
+#define BYTE_US (10000000.0 / GSM_BAUD)
+#define TX_RING 63 // The core's
+#define UART_TX_SIZE 1024 // DLUart's
+#define BLOCK 512 // HTTP_STREAM_BLOCK
+#define WINDOW 1460 // +CIPSEND: reply of a SIM900
+#define OPEN_US 60000.0 // AT+CIPSEND? and AT+CIPSEND to the prompt
+#define SEND_OK_US 150000.0
+#define HEADER 180 // Request line and headers of a POST
+#define POST_US 2500000.0 // Connect, reply and CLOSED of a POST
+#define OTHERS_US 2000.0
+#define HALF 128 // DLFileUpload with the 256 byte tmp_buff
+
+typedef struct {
+	double t; // Now
+	double uart; // Time the UART has sent up to
+	double idle; // UART idle in transfers
+	double sd; // Card time
+	double others; // Last time other threads ran
+	double wait; // Longest they waited in a body
+	double blocks; // Bytes of card blocks landing in RAM
+	double copies; // Bytes copied in RAM
+	bool open; // In a transfer
+	long in_transfer; // Body bytes the modem got in it
+	long got; // Body bytes the modem got
+	bool bad;
+} Sim_t;
+
+static DLSD *sd;
+static uint8_t file[FILE_SIZE];
+static uint8_t ring[UART_TX_SIZE];
+static uint32_t head, tail; // Free running as DLUart's
+
+static void fail(Sim_t *s, const char *what, long at) {
+	if (!s->bad)
+		printf("FAIL: %s at %ld\n", what, at);
+	s->bad = true;
+}
+
+static void modem_byte(Sim_t *s, uint8_t c) {
+	if (!s->open)
+		fail(s, "byte outside a transfer", s->got);
+	if (++s->in_transfer > WINDOW)
+		fail(s, "transfer over the window", s->got);
+	if (s->got >= FILE_SIZE || c != file[s->got])
+		fail(s, "body differs from the file", s->got);
+	s->got++;
+}
+
+// The UDRE interrupt up to now
+static void drain(Sim_t *s) {
+	while (tail != head && s->uart + BYTE_US <= s->t) {
+		modem_byte(s, ring[tail % UART_TX_SIZE]);
+		tail++;
+		s->uart += BYTE_US;
+	}
+	if (tail == head && s->uart < s->t) {
+		if (s->open)
+			s->idle += s->t - s->uart;
+		s->uart = s->t;
+	}
+}
+
+// Until the ring is sent, as flush()
+static void drain_all(Sim_t *s) {
+	s->t += (head - tail) * BYTE_US;
+	drain(s);
+}
+
+static void threads_run(Sim_t *s) {
+	if (s->t - s->others > s->wait)
+		s->wait = s->t - s->others;
+	s->others = s->t;
+}
+
+static void transfer_open(Sim_t *s) {
+	drain_all(s);
+	threads_run(s);
+	s->t += OPEN_US; // They run while the modem answers
+	drain(s);
+	s->others = s->t;
+	s->open = true;
+	s->in_transfer = 0;
+}
+
+static void transfer_close(Sim_t *s) {
+	drain_all(s);
+	threads_run(s);
+	s->open = false;
+	s->t += SEND_OK_US;
+	drain(s);
+	s->others = s->t;
+}
+
+// Until the ring is sent before the Ctrl-Z, others run meanwhile
+static void ring_wait(Sim_t *s) {
+	threads_run(s);
+	drain_all(s);
+	s->others = s->t;
+}
+
+static void post(Sim_t *s) {
+	s->t += POST_US + OPEN_US + HEADER * BYTE_US + SEND_OK_US;
+	drain(s);
+}
+
+// Card time and RAM writes of reading len bytes on into dst
+static long sd_read(Sim_t *s, uint8_t *dst, long len) {
+	uint32_t us = sdhost_stats.us, blocks = sdhost_stats.blocks_read, direct = sdhost_stats.blocks_watched;
+	len = sd->read(DATALOG, (char *)dst, len);
+	s->t += sdhost_stats.us - us;
+	s->sd += sdhost_stats.us - us;
+	s->blocks += (sdhost_stats.blocks_read - blocks) * 512.0;
+	s->copies += len - (sdhost_stats.blocks_watched - direct) * 512.0; // Cache to dst
+	drain(s);
+	return len;
+}
+
+// DLFileUpload with the double buffer and window filled transfers, the bytes of
+// a half copied into the core's ring as there is room
+static double old_path(Sim_t *s) {
+	static uint8_t half[2][HALF];
+	double body = 0, t0;
+	long len[2], pos[2], sent, n, read;
+	int cur;
+	for(long at = 0; at < FILE_SIZE; at += UPLOAD_PART) {
+		long part = FILE_SIZE - at < UPLOAD_PART ? FILE_SIZE - at : UPLOAD_PART;
+		post(s);
+		sd->seek(DATALOG, at);
+		t0 = s->others = s->t;
+		sent = 0;
+		read = len[0] = sd_read(s, half[0], part < HALF ? part : HALF);
+		len[1] = 0;
+		pos[0] = pos[1] = 0;
+		cur = 0;
+		while (len[cur]) {
+			while (pos[cur] < len[cur]) {
+				if (sent == 0)
+					transfer_open(s);
+				drain(s);
+				n = len[cur] - pos[cur];
+				if (n > WINDOW - sent)
+					n = WINDOW - sent;
+				if (n > TX_RING - (long)(head - tail))
+					n = TX_RING - (head - tail);
+				for(long i = 0; i < n; i++)
+					ring[head++ % UART_TX_SIZE] = half[cur][pos[cur] + i];
+				s->copies += n;
+				pos[cur] += n;
+				sent += n;
+				if (sent == WINDOW) {
+					transfer_close(s);
+					sent = 0;
+				} else if (!len[!cur] && read < part) {
+					// The other half while this one drains
+					len[!cur] = sd_read(s, half[!cur], part - read < HALF ? part - read : HALF);
+					pos[!cur] = 0;
+					read += len[!cur];
+				} else if (pos[cur] < len[cur]) {
+					s->t += BYTE_US; // Spins on the ring
+				}
+			}
+			len[cur] = 0;
+			cur = !cur;
+			threads_run(s);
+			s->t += OTHERS_US;
+			s->others = s->t;
+		}
+		if (sent)
+			transfer_close(s);
+		body += s->t - t0;
+	}
+	return body;
+}
+
+// DLUart::tx_span()
+static uint8_t *tx_span(long *len, uint16_t at) {
+	long room, end;
+	if (head == tail)
+		head = tail = at;
+	room = UART_TX_SIZE - (head - tail);
+	end = UART_TX_SIZE - head % UART_TX_SIZE;
+	*len = room < end ? room : end;
+	return ring + head % UART_TX_SIZE;
+}
+
+// DLFileUpload::fill() of the unpacked part from pos
+static long fill(Sim_t *s, uint8_t *dst, long n, long pos) {
+	long off = pos % BLOCK;
+	if (off && n > BLOCK - off)
+		n = BLOCK - off;
+	else if (!off && n > BLOCK)
+		n -= n % BLOCK;
+	return sd_read(s, dst, n);
+}
+
+// DLHTTP::PT_POST_stream() pulling fill()
+static double new_path(Sim_t *s) {
+	double body = 0, t0;
+	long sent, done, want, n, k;
+	uint8_t *p;
+	for(long at = 0; at < FILE_SIZE; at += UPLOAD_PART) {
+		long part = FILE_SIZE - at < UPLOAD_PART ? FILE_SIZE - at : UPLOAD_PART;
+		post(s);
+		sd->seek(DATALOG, at);
+		t0 = s->others = s->t;
+		sent = 0;
+		done = 0;
+		while (done < part) {
+			if (sent == 0)
+				transfer_open(s);
+			want = BLOCK - (at + done) % BLOCK;
+			if (want > WINDOW - sent)
+				want = WINDOW - sent;
+			if (want > part - done)
+				want = part - done;
+			drain(s);
+			p = tx_span(&n, (at + done) % BLOCK);
+			if (n < want) {
+				// PT_YIELD()
+				threads_run(s);
+				s->t += OTHERS_US;
+				s->others = s->t;
+				continue;
+			}
+			if (n > WINDOW - sent)
+				n = WINDOW - sent;
+			if (n > part - done)
+				n = part - done;
+			k = fill(s, p, n, at + done);
+			if (k <= 0) {
+				fail(s, "card read", at + done);
+				return body;
+			}
+			head += k;
+			done += k;
+			sent += k;
+			if (sent == WINDOW || done == part)
+				ring_wait(s);
+			if (sent == WINDOW) {
+				transfer_close(s);
+				sent = 0;
+			}
+		}
+		if (sent)
+			transfer_close(s);
+		body += s->t - t0;
+	}
+	return body;
+}
+
+static void report(const char *name, Sim_t *s, double body) {
+	printf("%-26s %4.2f RAM writes/B (%4.2f card, %4.2f copies)  body %6.0f ms %5.0f B/s  UART idle %4.0f ms  card %4.0f ms  threads wait %4.0f ms  with POSTs %4.0f B/s\n",
+	       name, (s->blocks + s->copies) / FILE_SIZE, s->blocks / FILE_SIZE, s->copies / FILE_SIZE, body / 1000, FILE_SIZE / (body / 1e6), s->idle / 1000, s->sd / 1000, s->wait / 1000,
+	       FILE_SIZE / (s->t / 1e6));
+}
+
+static bool run(const char *name, double (*path)(Sim_t *)) {
+	Sim_t s;
+	double body;
+	memset(&s, 0, sizeof(s));
+	head = tail = 0;
+	sd->open(DATALOG, O_READ);
+	body = path(&s);
+	sd->close(DATALOG);
+	if (s.got != FILE_SIZE)
+		fail(&s, "body cut short", s.got);
+	report(name, &s, body);
+	return !s.bad;
+}
+
+int main() {
+	char line[160];
+	bool ok;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(8);
+	sd = new DLSD(0, SS);
+	sd->init();
+	for(long i = 0; sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND) < (unsigned long)FILE_SIZE; i++) {
+		snprintf(line, sizeof(line), "T%lu V4950 N5 a1:512.25:3.21:498.00:530.00 a2:%ld.50:0.75:300.00:310.00\r\n",
+		         1350000000UL + i * 60, 300 + i % 10);
+		sd->write(DATALOG, line);
+	}
+	sd->close(DATALOG);
+	sd->open(DATALOG, O_READ);
+	sd->seek(DATALOG, 0);
+	for(long at = 0; at < FILE_SIZE; at += 500)
+		sd->read(DATALOG, (char *)file + at, FILE_SIZE - at < 500 ? FILE_SIZE - at : 500);
+	sd->close(DATALOG);
+	sdhost_watch(ring, sizeof(ring));
+	printf("%ld byte file, %d byte parts, %d byte window, UART %d baud (%.0f B/s)\n", FILE_SIZE, UPLOAD_PART,
+	       WINDOW, GSM_BAUD, 1e6 / BYTE_US);
+
+	ok = run("double buffer, 63 B ring", old_path);
+	ok &= run("stream, 1024 B ring", new_path);
+	return ok ? 0 : 1;
+}
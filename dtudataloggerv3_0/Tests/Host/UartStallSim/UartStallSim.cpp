@@ -0,0 +1,168 @@
+/*
+  Main loop stall of a DATALOG upload on the GSM port. The strings
+  DLFileUpload, DLHTTP and DLGSM send for each part of the file go
+  through a model of DLUart's transmit ring draining at GSM_BAUD, the
+  body as DLHTTP::PT_POST_stream() streams it. With the flush after
+  every GSM_send() string the loop busy-waits until the ring is out,
+  without it the protothread waits on GSM_send_done() and the loop
+  goes on. A stall is time the loop spends waiting for the wire, the
+  measure thread waits as long. Modem answer times are assumptions, they
+  only move the session time.
+
+  Then a modem burst of BURST bytes (a +CMGL list, an HTTP reply) comes
+  in while the loop is held for a while by a card write or a stall: the
+  bytes lost to the receive ring of the core and of DLUart.
+
+  Build: g++ -O2 UartStallSim.cpp -o uartstallsim
+*/
+#include <stdio.h>
+#include <string.h>
+
+#define FILE_SIZE 48000L
+#define UPLOAD_PART 4000
+#define GSM_BAUD 57600
+#define BYTE_US (10000000.0 / GSM_BAUD)
+#define UART_TX_SIZE 1024
+#define WINDOW 1460
+#define HOST "attila.patup.com"
+#define ANSWER_US 30000.0 // OK, STATE:, +CIPSEND:, the prompt
+#define CONNECT_US 1500000.0
+#define SEND_OK_US 150000.0
+#define CLOSED_US 1000000.0
+#define BURST 300
+#define CORE_RX 63 // Of 64, one kept empty
+
+typedef struct {
+	bool flush; // GSM_send(char *) flushes
+	double t; // Now
+	double busy; // Time the ring is out
+	double stall; // The loop waiting for the wire
+	double longest;
+	long strings;
+} Sim_t;
+
+static void stall(Sim_t *s, double until) {
+	if (until <= s->t)
+		return;
+	s->stall += until - s->t;
+	if (until - s->t > s->longest)
+		s->longest = until - s->t;
+	s->t = until;
+}
+
+// len bytes queued, write() waits on a full ring
+static void queue(Sim_t *s, long len) {
+	if (s->busy < s->t)
+		s->busy = s->t;
+	s->busy += len * BYTE_US;
+	stall(s, s->busy - UART_TX_SIZE * BYTE_US);
+}
+
+// GSM_send(char *)
+static void send(Sim_t *s, const char *str) {
+	queue(s, strlen(str));
+	s->strings++;
+	if (s->flush)
+		stall(s, s->busy);
+}
+
+// PT_send_recv_confirm(): the command, out on the line, then the answer
+static void command(Sim_t *s, const char *cmd, double answer) {
+	send(s, cmd);
+	if (s->t < s->busy)
+		s->t = s->busy; // PT_WAIT_UNTIL(GSM_send_done()), the loop goes on
+	s->t += answer;
+}
+
+static void transfer_open(Sim_t *s) {
+	command(s, "AT+CIPSEND?\r\n", ANSWER_US);
+	command(s, "AT+CIPSEND\r\n", ANSWER_US);
+}
+
+static void transfer_close(Sim_t *s) {
+	command(s, "\x1a", SEND_OK_US);
+}
+
+static void part(Sim_t *s, int p, int parts, long len) {
+	char buf[120];
+	long sent = 0, n;
+	// PT_POST_start(): connect, the state, the headers in a transfer
+	command(s, "AT+CIPSTART=\"TCP\",\"" HOST "\",\"80\"\r\n", CONNECT_US);
+	command(s, "AT+CIPSTATUS\r\n", ANSWER_US);
+	transfer_open(s);
+	send(s, "POST /");
+	snprintf(buf, sizeof(buf), "dl/upload.php?id=17&fi=0&fc=12&p=%d&tp=%d&fs=%ld", p, parts - 1, FILE_SIZE);
+	send(s, buf);
+	send(s, " HTTP/1.1\r\n");
+	send(s, "Host: ");
+	send(s, HOST);
+	send(s, "\r\n");
+	send(s, "Content-Length: ");
+	snprintf(buf, sizeof(buf), "%ld", len);
+	queue(s, strlen(buf)); // GSM_send(int) never flushed
+	send(s, "\r\n");
+	send(s, "Connection: close\r\n");
+	send(s, "\r\n");
+	transfer_close(s);
+	// PT_POST_stream(), no busy waits: it yields on a full ring
+	while (sent < len) {
+		transfer_open(s);
+		n = len - sent < WINDOW ? len - sent : WINDOW;
+		if (s->busy < s->t)
+			s->busy = s->t;
+		s->busy += n * BYTE_US;
+		s->t = s->busy;
+		sent += n;
+		transfer_close(s);
+	}
+	// PT_POST_end(): CLOSED, the state and again after the close
+	s->t += CLOSED_US;
+	command(s, "AT+CIPSTATUS\r\n", ANSWER_US);
+	command(s, "AT+CIPSTATUS\r\n", ANSWER_US);
+}
+
+static double run(const char *name, bool flush) {
+	Sim_t s;
+	int parts = (FILE_SIZE + UPLOAD_PART - 1) / UPLOAD_PART;
+	memset(&s, 0, sizeof(s));
+	s.flush = flush;
+	for(int p = 0; p < parts; p++)
+		part(&s, p, parts, FILE_SIZE - p * UPLOAD_PART < UPLOAD_PART ? FILE_SIZE - p * UPLOAD_PART : UPLOAD_PART);
+	printf("%-24s %4.1f ms stall/KB  longest %5.1f ms  %3ld strings  session %5.1f s\n", name,
+	       s.stall / 1000 / (FILE_SIZE / 1024.0), s.longest / 1000, s.strings, s.t / 1e6);
+	return s.stall;
+}
+
+// Bytes of a burst lost to a ring of room bytes while the loop reads
+// nothing for held_us, it reads all once it is back
+static long burst_lost(long room, double held_us) {
+	long in = (long)(held_us / BYTE_US);
+	if (in > BURST)
+		in = BURST;
+	return in > room ? in - room : 0;
+}
+
+int main() {
+	static const double held[] = { 2000, 10000, 20000, 40000, 80000 };
+	char name[40];
+	printf("%ld byte file, %d byte parts, %d byte window, UART %d baud, %d byte ring\n", FILE_SIZE, UPLOAD_PART, WINDOW,
+	       GSM_BAUD, UART_TX_SIZE);
+	run("flush after each string", true);
+	if (run("yield on GSM_send_done()", false) > 0) {
+		printf("FAIL: the loop still waits for the wire\n");
+		return 1;
+	}
+
+	snprintf(name, sizeof(name), "%d byte burst, loop held:", BURST);
+	printf("%-31s", name);
+	for(unsigned i = 0; i < sizeof(held) / sizeof(held[0]); i++)
+		printf(" %5.0f ms", held[i] / 1000);
+	printf("\n%-31s", "core, 64 byte ring: lost");
+	for(unsigned i = 0; i < sizeof(held) / sizeof(held[0]); i++)
+		printf(" %8ld", burst_lost(CORE_RX, held[i]));
+	printf("\n%-31s", "DLUart, 256 byte ring: lost");
+	for(unsigned i = 0; i < sizeof(held) / sizeof(held[0]); i++)
+		printf(" %8ld", burst_lost(256, held[i]));
+	printf("\n");
+	return 0;
+}
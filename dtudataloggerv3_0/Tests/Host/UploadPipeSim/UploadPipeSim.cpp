@@ -0,0 +1,229 @@
+/*
+  Upload of a DATALOG file to the modem, the serial path of upload_file()
+  against DLFileUpload with the double buffer and window filled
+  AT+CIPSEND transfers. The card reads are real DLSD reads of a file on
+  the SdHost card model, timed by it. The UART drains the core's 63 byte
+  transmit ring at GSM_BAUD. upload_file() reads 511 bytes, then writes
+  them with write() waiting on the ring, and starts a new transfer when a
+  chunk does not fit the window any more. DLFileUpload reads a 128 byte
+  half while the other drains, other threads run once per half and may
+  keep the ring unfed for OTHERS_US.
+
+  Modem answer times are assumptions, not measurements: the AT+CIPSEND?
+  and AT+CIPSEND round trips, SEND OK after the last byte of a transfer,
+  and the connect and CLOSED of every POST. Reported are the body time
+  of the file, UART idle time in it, and the throughput with the per
+  POST overhead, and the longest other threads wait in a body.
+
+  Build: g++ -O2 -DARDUINO=100 -DSdStream_h -DArduinoStream_h -I../SdHost -I../../../SdFat -I../../../DLSD -I../../../DLCommon -I../../../Time -I../../../pt UploadPipeSim.cpp ../SdHost/SdHost.cpp ../../../DLSD/DLSD.cpp ../../../SdFat/SdBaseFile.cpp ../../../SdFat/SdVolume.cpp ../../../SdFat/SdFat.cpp ../../../SdFat/SdFile.cpp -o uploadpipesim
+*/
+#include <Arduino.h>
+#include "DLSD.h"
+#include "SdHost.h"
+
+#define CARD_BLOCKS (16UL * 2048)
+#define FILE_SIZE 48000L
+#define UPLOAD_PART 4000
+#define GSM_BAUD 57600
+#define BYTE_US (10000000.0 / GSM_BAUD)
+#define TX_RING 63
+#define WINDOW 1460 // +CIPSEND: reply of a SIM900
+#define OPEN_US 60000.0 // AT+CIPSEND? and AT+CIPSEND to the prompt
+#define SEND_OK_US 150000.0
+#define HEADER 180 // Request line and headers of a POST
+#define POST_US 2500000.0 // Connect, reply and CLOSED of a POST
+#define OTHERS_US 2000.0
+#define OLD_CHUNK 511 // LOG_BUFF_SIZE - 1
+#define HALF 128 // DLFileUpload with the 256 byte tmp_buff
+
+typedef struct {
+	double t; // Now
+	double busy; // Time the last queued byte is out
+	double idle; // UART idle in transfers
+	double sd; // Card time
+	double others; // Last time other threads ran
+	double wait; // Longest they waited in a body
+	long bytes;
+} Sim_t;
+
+static DLSD *sd;
+
+// Card time of reading len bytes on from the open file
+static double sd_read(long len) {
+	static char buf[OLD_CHUNK];
+	uint32_t us = sdhost_stats.us;
+	sd->read(DATALOG, buf, len);
+	return sdhost_stats.us - us;
+}
+
+static void sd_seek(long pos) {
+	sd->seek(DATALOG, pos);
+}
+
+// Queues n bytes, returns when write() would, as many as fit the ring
+static void uart_write(Sim_t *s, long n) {
+	if (s->busy < s->t) {
+		s->idle += s->t - s->busy;
+		s->busy = s->t;
+	}
+	s->busy += n * BYTE_US;
+	s->bytes += n;
+	if (s->busy - TX_RING * BYTE_US > s->t)
+		s->t = s->busy - TX_RING * BYTE_US;
+}
+
+static long uart_room(Sim_t *s) {
+	long queued = s->busy > s->t ? (long)((s->busy - s->t) / BYTE_US + 0.999) : 0;
+	return queued < TX_RING ? TX_RING - queued : 0;
+}
+
+static void transfer_open(Sim_t *s) {
+	s->t += OPEN_US;
+	s->busy = s->t;
+}
+
+static void transfer_close(Sim_t *s) {
+	if (s->busy > s->t)
+		s->t = s->busy;
+	s->t += SEND_OK_US;
+}
+
+static void post(Sim_t *s) {
+	s->t += POST_US;
+	transfer_open(s);
+	uart_write(s, HEADER);
+	transfer_close(s);
+}
+
+// upload_file() and the DLHTTP::POST() it calls
+static double old_path(Sim_t *s) {
+	double body = 0, t0;
+	long sent;
+	for(long at = 0; at < FILE_SIZE; at += UPLOAD_PART) {
+		long part = FILE_SIZE - at < UPLOAD_PART ? FILE_SIZE - at : UPLOAD_PART;
+		post(s);
+		sd_seek(at);
+		t0 = s->t;
+		sent = 0;
+		for(long done = 0; done < part; ) {
+			long n = part - done < OLD_CHUNK ? part - done : OLD_CHUNK;
+			double us = sd_read(n);
+			s->t += us;
+			s->sd += us;
+			if (sent == 0) {
+				transfer_open(s);
+			} else if (sent + n > WINDOW) {
+				transfer_close(s);
+				transfer_open(s);
+				sent = 0;
+			}
+			sent += n;
+			uart_write(s, n);
+			done += n;
+		}
+		transfer_close(s);
+		body += s->t - t0;
+		if (s->t - t0 > s->wait)
+			s->wait = s->t - t0; // Nothing else runs in upload_file()
+	}
+	return body;
+}
+
+// DLFileUpload::PT_upload() with the double buffer, window filled transfers
+static double new_path(Sim_t *s) {
+	double body = 0, t0, us;
+	long len[2], pos[2], sent, n, read;
+	int cur;
+	for(long at = 0; at < FILE_SIZE; at += UPLOAD_PART) {
+		long part = FILE_SIZE - at < UPLOAD_PART ? FILE_SIZE - at : UPLOAD_PART;
+		post(s);
+		sd_seek(at);
+		t0 = s->others = s->t;
+		sent = 0;
+		read = n = part < HALF ? part : HALF;
+		us = sd_read(n);
+		s->t += us;
+		s->sd += us;
+		len[0] = n;
+		len[1] = 0;
+		pos[0] = pos[1] = 0;
+		cur = 0;
+		while (len[cur]) {
+			while (pos[cur] < len[cur]) {
+				if (sent == 0) {
+					transfer_open(s);
+					s->others = s->t; // They run while the modem answers
+				}
+				n = len[cur] - pos[cur];
+				if (n > WINDOW - sent)
+					n = WINDOW - sent;
+				if (n > uart_room(s))
+					n = uart_room(s);
+				uart_write(s, n);
+				pos[cur] += n;
+				sent += n;
+				if (sent == WINDOW) {
+					transfer_close(s);
+					s->others = s->t;
+					sent = 0;
+				} else if (!len[!cur] && read < part) {
+					// The other half while this one drains
+					n = part - read < HALF ? part - read : HALF;
+					us = sd_read(n);
+					s->t += us;
+					s->sd += us;
+					len[!cur] = n;
+					pos[!cur] = 0;
+					read += n;
+				} else if (pos[cur] < len[cur]) {
+					s->t += BYTE_US; // Spins on the ring
+				}
+			}
+			len[cur] = 0;
+			cur = !cur;
+			if (s->t - s->others > s->wait)
+				s->wait = s->t - s->others;
+			s->t += OTHERS_US;
+			s->others = s->t;
+		}
+		if (sent)
+			transfer_close(s);
+		body += s->t - t0;
+	}
+	return body;
+}
+
+static void report(const char *name, Sim_t *s, double body) {
+	printf("%-26s body %6.0f ms %5.0f B/s  UART idle %4.0f ms  card %4.0f ms  threads wait %5.0f ms  with POSTs %4.0f B/s\n",
+	       name, body / 1000, FILE_SIZE / (body / 1e6), s->idle / 1000, s->sd / 1000, s->wait / 1000,
+	       FILE_SIZE / (s->t / 1e6));
+}
+
+int main() {
+	char line[160];
+	Sim_t s;
+	double body;
+	sdhost_create(CARD_BLOCKS);
+	sdhost_format(8);
+	sd = new DLSD(0, SS);
+	sd->init();
+	for(long i = 0; sd->open(DATALOG, O_RDWR | O_CREAT | O_APPEND) < (unsigned long)FILE_SIZE; i++) {
+		snprintf(line, sizeof(line), "T%lu V4950 N5 a1:512.25:3.21:498.00:530.00 a2:%ld.50:0.75:300.00:310.00\r\n",
+		         1350000000UL + i * 60, 300 + i % 10);
+		sd->write(DATALOG, line);
+	}
+	sd->close(DATALOG);
+	printf("%ld byte file, %d byte parts, %d byte window, UART %d baud (%.0f B/s)\n", FILE_SIZE, UPLOAD_PART,
+	       WINDOW, GSM_BAUD, 1e6 / BYTE_US);
+
+	memset(&s, 0, sizeof(s));
+	sd->open(DATALOG, O_READ);
+	body = old_path(&s);
+	report("upload_file()", &s, body);
+
+	memset(&s, 0, sizeof(s));
+	body = new_path(&s);
+	report("DLFileUpload double buffer", &s, body);
+	sd->close(DATALOG);
+	return 0;
+}
@@ -0,0 +1,72 @@
+/*
+  Compiles a CONFIG.TXT into the CONFIG.BIN image DLConfig::load() reads
+  instead of parsing the text, with the same tokenizer and the same
+  rules: ports the text does not set are off. A line the logger would
+  report as bad stops the compile. Copy CONFIG.BIN next to CONFIG.DAT
+  on the card and compile it again whenever the text changes, the
+  logger no longer reads the text while the image is good.
+
+  Build: g++ -O2 -I../../DLConfig DLConfigc.cpp ../../DLConfig/DLConfigParser.cpp ../../DLConfig/DLConfigImage.cpp -o dlconfigc
+  Usage: dlconfigc CONFIG.TXT CONFIG.BIN
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "DLConfigImage.h"
+
+static int bad;
+
+// DLCommon's crc_update() for DLConfigImage, bit at a time
+unsigned long crc_update(unsigned long crc, uint8_t data) {
+	crc ^= data;
+	for(int i = 0; i < 8; i++)
+		crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320UL : 0);
+	return crc & 0xFFFFFFFFUL;
+}
+
+static void line(DLConfigParser *p, DLConfigImage *img, uint8_t key, const char *name) {
+	if (key == CFG_KEY_NONE)
+		return;
+	if (key == CFG_KEY_BAD || !img->set(key, p->index(), p->value())) {
+		fprintf(stderr, "%s:%u: bad line\n", name, p->line());
+		bad++;
+	}
+}
+
+int main(int argc, char **argv) {
+	DLConfigParser p;
+	DLConfigImage img;
+	FILE *f;
+	char buf[512];
+	size_t n;
+	int keys = 0;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s CONFIG.TXT CONFIG.BIN\n", argv[0]);
+		return 2;
+	}
+	f = fopen(argv[1], "rb");
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+	img.begin((1 << CFG_IMAGE_PORTS) - 1);
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		for(size_t i = 0; i < n; i++)
+			line(&p, &img, p.feed(buf[i]), argv[1]);
+	line(&p, &img, p.finish(), argv[1]);
+	fclose(f);
+	if (bad)
+		return 1;
+	img.seal();
+
+	f = fopen(argv[2], "wb");
+	if (!f || fwrite(img.get(), sizeof(ConfigImage_t), 1, f) != 1 || fclose(f) != 0) {
+		perror(argv[2]);
+		return 1;
+	}
+	for(uint8_t k = 0; k < 32; k++)
+		keys += CFG_HAS(img.get(), k);
+	printf("%s: version %d, %d bytes, %d keys, crc %08lx\n", argv[2], CFG_IMAGE_VERSION, (int)sizeof(ConfigImage_t),
+	       keys, (unsigned long)img.get()->crc);
+	return 0;
+}
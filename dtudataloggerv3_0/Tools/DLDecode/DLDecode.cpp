@@ -0,0 +1,216 @@
+/*
+  Converts DAT log files with binary records (LOG_FORMAT = BINARY) back
+  into the text lines of DLMeasure::time_log_line()/event_log_line().
+  Text lines in the same file are passed through unchanged. Framed
+  records (DLSD::set_frames()) are unwrapped, torn ones skipped.
+
+  Build: g++ -O2 -I../../DLMeasure DLDecode.cpp ../../DLMeasure/DLRecord.cpp -o dldecode
+  Usage: dldecode DAT00001.DAT [...] > out.txt
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DLRecord.h"
+
+// Port layout of DLMeasure.h
+#define NUM_IO 14
+#define NUM_ANALOG 8
+#define DIGITAL_OFFSET 8
+
+// Frame layout of DLSD.h
+#define SD_FRAME 0xA5
+#define SD_FRAME_HDR 7
+#define SD_FRAME_MAX 1024
+
+static uint32_t crc_update(uint32_t crc, uint8_t c) {
+	crc ^= c;
+	for(int i = 0; i < 8; i++)
+		crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320UL : 0);
+	return crc;
+}
+
+// Record length of a good frame at buf, -1 if there is none
+static long frame_len(const uint8_t *buf, long len) {
+	uint32_t crc = 0xFFFFFFFFUL;
+	long n;
+	if (len < SD_FRAME_HDR || buf[0] != SD_FRAME)
+		return -1;
+	n = buf[1] | (buf[2] << 8);
+	if (n > SD_FRAME_MAX || SD_FRAME_HDR + n > len)
+		return -1;
+	crc = crc_update(crc, buf[1]);
+	crc = crc_update(crc, buf[2]);
+	for(long i = 0; i < n; i++)
+		crc = crc_update(crc, buf[SD_FRAME_HDR + i]);
+	crc = ~crc;
+	if (buf[3] != (uint8_t)crc || buf[4] != (uint8_t)(crc >> 8) ||
+	    buf[5] != (uint8_t)(crc >> 16) || buf[6] != (uint8_t)(crc >> 24))
+		return -1;
+	return n;
+}
+
+static void fixed(char *buf, uint32_t v) {
+	sprintf(buf, "%lu.%02lu", (unsigned long)(v / REC_FIXED), (unsigned long)(v % REC_FIXED));
+}
+
+// One record to a text line, returns the bytes used or 0 when it is broken
+static uint16_t decode_record(DLRecordReader *r, const uint8_t *buf, long len, char *line) {
+	uint32_t volt, n, mask, counters, freqs = 0, m, s, a, b, p, ts;
+	char f[4][16], tmp[96];
+	int8_t ret;
+
+	ret = r->begin(buf, len > 0xffff ? 0xffff : len);
+	if (ret != 1)
+		return 0;
+
+	if (r->flags() & REC_EVENT) {
+		if (!r->get(&mask))
+			return 0;
+		sprintf(line, "E%lu ", (unsigned long)r->time());
+		for(int i = DIGITAL_OFFSET; i < NUM_IO; i++) {
+			if (!(mask & (1U << i)))
+				continue;
+			if (!r->get(&a) || !r->get(&b))
+				return 0;
+			sprintf(tmp, " %d:%lu:%lu", i, (unsigned long)a, (unsigned long)b);
+			strcat(line, tmp);
+			if (r->version() >= 2) { // One edge per record with its micros()
+				if (!r->get_delta(i, &ts))
+					return 0;
+				sprintf(tmp, ":%lu", (unsigned long)ts);
+				strcat(line, tmp);
+			}
+		}
+		strcat(line, "\r\n");
+		return r->used();
+	}
+
+	if (!r->get(&volt) || !r->get(&n) || !r->get(&mask) || !r->get(&counters))
+		return 0;
+	if (r->version() >= 2 && !r->get(&freqs))
+		return 0;
+	sprintf(line, "T%lu V%lu N%lu", (unsigned long)r->time(), (unsigned long)volt, (unsigned long)n);
+	for(int i = 0; i < NUM_IO; i++) {
+		if (!(mask & (1U << i)))
+			continue;
+		if (i < NUM_ANALOG) {
+			if (!r->get_delta(i, &m) || !r->get(&s) || !r->get(&a) || !r->get(&b))
+				return 0;
+			fixed(f[0], m);
+			fixed(f[1], s);
+			fixed(f[2], (m / REC_FIXED - a) * REC_FIXED);
+			fixed(f[3], (m / REC_FIXED + b) * REC_FIXED);
+			sprintf(tmp, " a%d:%s:%s:%s:%s", i, f[0], f[1], f[2], f[3]);
+		} else if (counters & (1U << (i - DIGITAL_OFFSET))) {
+			if (!r->get_delta(i, &m) || !r->get(&s))
+				return 0;
+			fixed(f[0], m);
+			fixed(f[1], s);
+			sprintf(tmp, " c%d:%s:%s", i, f[0], f[1]);
+		} else if (freqs & (1U << (i - DIGITAL_OFFSET))) {
+			if (!r->get(&p) || !r->get_delta(i, &m) || !r->get(&s) || !r->get(&a) || !r->get(&b))
+				return 0;
+			sprintf(tmp, " f%d:%lu:%lu:%lu:%lu:%lu", i, (unsigned long)p, (unsigned long)m,
+			        (unsigned long)s, (unsigned long)(m - a), (unsigned long)(m + b));
+		} else {
+			if (!r->get(&m))
+				return 0;
+			sprintf(tmp, " d%d:%lu", i, (unsigned long)m);
+		}
+		strcat(line, tmp);
+	}
+	strcat(line, "\r\n");
+	return r->used();
+}
+
+/* One binary record or text line of buf, returns the bytes used, 0 when
+   the record is broken. *recs counts the binary records. */
+static long decode_one(DLRecordReader *r, const uint8_t *buf, long len, FILE *out, long *recs) {
+	char line[1024];
+	long e;
+	if (REC_IS_TAG(buf[0])) {
+		e = decode_record(r, buf, len, line);
+		if (e == 0)
+			return 0;
+		fputs(line, out);
+		(*recs)++;
+		return e;
+	}
+	for(e = 0; e < len && buf[e] != '\n'; e++)
+		;
+	if (e < len)
+		e++;
+	fwrite(buf, 1, e, out);
+	return e;
+}
+
+/* Decodes a whole file image, returns the number of binary records or -1
+   if a record is cut short or of an unknown version */
+long dl_decode(const uint8_t *buf, long len, FILE *out) {
+	DLRecordReader r;
+	long pos = 0, recs = 0, e, n, used;
+
+	while (pos < len) {
+		if (buf[pos] == SD_FRAME) {
+			n = frame_len(buf + pos, len - pos);
+			if (n < 0) {
+				// Torn by a reset, on to the next good frame
+				for(e = pos + 1; e < len && (buf[e] != SD_FRAME || frame_len(buf + e, len - e) < 0); e++)
+					;
+				fprintf(stderr, "torn record at offset %ld, %ld bytes skipped\n", pos, e - pos);
+				pos = e;
+				continue;
+			}
+			pos += SD_FRAME_HDR;
+			for(e = pos; e < pos + n; e += used) {
+				used = decode_one(&r, buf + e, pos + n - e, out, &recs);
+				if (used == 0) {
+					fprintf(stderr, "bad record at offset %ld\n", e);
+					return -1;
+				}
+			}
+			pos += n;
+			continue;
+		}
+		used = decode_one(&r, buf + pos, len - pos, out, &recs);
+		if (used == 0) {
+			fprintf(stderr, "bad record at offset %ld\n", pos);
+			return -1;
+		}
+		pos += used;
+	}
+	return recs;
+}
+
+#ifndef DLDECODE_NO_MAIN
+int main(int argc, char **argv) {
+	FILE *f;
+	uint8_t *buf;
+	long len;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s FILE...\n", argv[0]);
+		return 2;
+	}
+	for(int i = 1; i < argc; i++) {
+		f = fopen(argv[i], "rb");
+		if (!f) {
+			perror(argv[i]);
+			return 1;
+		}
+		fseek(f, 0, SEEK_END);
+		len = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		buf = (uint8_t *)malloc(len > 0 ? len : 1);
+		if (fread(buf, 1, len, f) != (size_t)len) {
+			perror(argv[i]);
+			return 1;
+		}
+		fclose(f);
+		if (dl_decode(buf, len, stdout) < 0)
+			return 1;
+		free(buf);
+	}
+	return 0;
+}
+#endif
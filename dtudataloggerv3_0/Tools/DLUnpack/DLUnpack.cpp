@@ -0,0 +1,44 @@
+/*
+  Unpacks the bodies of packed uploads (DLFileUpload with set_pack(),
+  parts with &z=1 in the URL). Every file is the body of one part, the
+  parts are written out in the order given, so a log file is unpacked
+  with its parts in part number order.
+
+  Build: g++ -O2 -I../../DLFileUpload DLUnpack.cpp ../../DLFileUpload/DLPack.cpp -o dlunpack
+  Usage: dlunpack PART0 [PART1 ...] > DAT00001.DAT
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "DLPack.h"
+
+static void sink(void *ctx, uint8_t c) {
+	putc(c, (FILE *)ctx);
+}
+
+int main(int argc, char **argv) {
+	DLUnpack u;
+	FILE *f;
+	uint8_t buf[4096];
+	size_t n;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s PART...\n", argv[0]);
+		return 2;
+	}
+	for(int i = 1; i < argc; i++) {
+		f = fopen(argv[i], "rb");
+		if (!f) {
+			perror(argv[i]);
+			return 1;
+		}
+		u.begin(sink, stdout);
+		while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+			if (!u.put(buf, n)) {
+				fprintf(stderr, "%s: not a packed body\n", argv[i]);
+				return 1;
+			}
+		}
+		fclose(f);
+	}
+	return 0;
+}
@@ -18,6 +18,7 @@
 #include <DLConfig.h>
 #include <DLMeasure.h>
 #include <DLSD.h>
+#include <DLStore.h>
 #include <DLGSM.h>
 #include <DLHTTP.h>
 #include <DLFileUpload.h>
@@ -42,11 +43,17 @@ DHT22 myDHT22(DHT22_PIN);
 // and the current is larger than the threshold, otherwise show average
 // Average gives a better picture on the long run
 #define VOLTAGE_THRESHOLD 10
+// Supply voltage (mV) below which the SD write buffers are flushed
+#define BROWNOUT_VOLTAGE 4500
 
 // Maximum File size for the data logs
 #define MAX_FILESIZE 50000
 // Maximum file size for the serial logs
 #define SERIAL_MAX_FILESIZE 100000000
+// DATALOG and SYSLOG writes framed with length and CRC32, torn ones cut at boot
+#define LOG_FRAMES
+// Log files are packed (DLPack) for the upload, the server unpacks parts with &z=1
+#define UPLOAD_PACKED
 
 // Define a serial port as console (can be remapped to different hardware serial
 // Or software serial
@@ -82,7 +89,7 @@ Config *config = NULL;
 #define SYS_BUFF_SIZE 200
 char sys_buff[SYS_BUFF_SIZE];
 
-#define TMP_BUFF_SIZE 200
+#define TMP_BUFF_SIZE 256
 char tmp_buff[TMP_BUFF_SIZE]; 
 
 
@@ -93,14 +100,18 @@ char smallbuff[20];
 #define GSM_BUFF_SIZE 200
 DLGSM gsm;
 char gsm_buff[GSM_BUFF_SIZE];
-enum gsm_states { gsm_init_poff, gsm_idle, gsm_booted, gsm_send_http_status, gsm_upload_data, gsm_firmware_dl, gsm_sms_sysinfo, gsm_sms_get_all_readings, gsm_sms_get_reading, gsm_sms_reboot, gsm_sms_uptime };
+enum gsm_states { gsm_init_poff, gsm_idle, gsm_booted, gsm_send_http_status, gsm_upload_data, gsm_firmware_dl, gsm_sms_sysinfo, gsm_sms_get_all_readings, gsm_sms_get_reading, gsm_sms_reboot, gsm_sms_uptime, gsm_sms_get_range, gsm_upload_range, gsm_fetch_config };
 static enum gsm_states gsm_curr_state = gsm_init_poff;
 static enum gsm_states requested_state = gsm_idle;
+static uint32_t range_t0, range_t1; // Time window to upload
+static uint16_t config_version; // Of the config on the server
 
 DLHTTP http;
 DLFileUpload fup;
 
 DLSD sd(SPI_FULL_SPEED,4);
+// Every log write goes through its queue, protothread_store() does the card work
+DLStore store;
 
 // IO setup
 DLMeasure measure;
@@ -113,13 +124,14 @@ typedef struct {
 	char exceed;
 } Thread_t;
 
-#define NUM_THREADS 6
+#define NUM_THREADS 7
 #define THREAD_SYS 0
 #define THREAD_MEAS 1
 #define THREAD_COMM 2
 #define THREAD_SER 3
 #define THREAD_EVENT 4
 #define THREAD_WDT 5
+#define THREAD_STORE 6
 Thread_t threads[NUM_THREADS];
 static struct pt comm_child_pt; 
 
@@ -151,6 +163,8 @@ uint32_t measure_cnt = 0;
 
 void reboot() {
 	int i;
+	while (store.run());
+	sd.flush();
 	for(i=0;i<NUM_FILES;i++) {
 		sd.close(i);
 	}
@@ -159,35 +173,9 @@ void reboot() {
 }
 
 void sys_log_message(char *msg) {
-	static int sd_error = 0;
-	long filesize;
-	bool write_error;
 	DEBUG_LOG(msg);
 	//Serial.print(msg);
-	if (sd.is_available() < 0)
-		sd.init();
-        filesize = sd.open(SYSLOG, O_RDWR | O_CREAT | O_APPEND);
-        if (filesize != -1) {
-        	if (filesize > MAX_FILESIZE) {
-                	sd.close(SYSLOG);
-                	sd.increment_file(SYSLOG);
-                	cfg.save_files_count(0);
-                	filesize = sd.open(SYSLOG, O_RDWR | O_CREAT | O_APPEND);
-                }
-                if (filesize != -1) {
-                	write_error = sd.write(SYSLOG, sys_buff);
-                        if (write_error) {
-                        	Serial.print("SD write error fs: ");   
-				Serial.println(filesize, DEC);     
-        			sd.error();
-	        		sd_error++;
-			} else {
-				sd_error = 0;
-			}
-			if (sd_error == 10) // Wow the SD card kinda sucks
-				reboot();
-		}
-	}
+	store.put(SYSLOG, msg, now());
 }
 
 void ext_wdt_reset() {
@@ -196,6 +184,29 @@ void ext_wdt_reset() {
 	digitalWrite(WATCHDOG_PIN, HIGH);
 }
 
+// Lines of a config.php reply
+int config_delta(char *line, int len) {
+	return cfg.delta_line(line, len);
+}
+
+// Defaults and derived timing of the config, at boot and after a delta
+void config_timing() {
+	if (config->http_status_time == 0)
+		config->http_status_time = 1*60; // 1 min
+	if (config->http_upload_time == 0)
+		config->http_upload_time = 10*60; // 10 min
+	if (config->measure_time == 0)
+		config->measure_time = 10;
+	if (config->sampling_rate == 0 || config->sampling_rate > 1000)
+		config->sampling_rate = 5;
+
+	config->num_samples = config->sampling_rate * config->measure_time;
+	config->sampling_delay = 1000 / config->sampling_rate;
+	measure.set_measure_time(config->measure_time);
+	measure.set_base_rate(config->sampling_delay);
+	sd.set_latency(config->log_latency * 1000U);
+}
+
 void setup() {
 	int ret = 0;
 	int cdown = 0;
@@ -260,6 +271,7 @@ void setup() {
 	DEBUG_LOG("HTTP init");
 	// Initialize HTTP
 	http.init(gsm_buff, &gsm);
+	http.set_config_callback(config_delta);
         ext_wdt_reset();
 
 	DEBUG_LOG("SD init");
@@ -299,18 +311,34 @@ void setup() {
 
 	cfg.load();
 	config = cfg.get_config();
-	if (config->http_status_time == 0)
-		config->http_status_time = 1*60; // 1 min
-	if (config->http_upload_time == 0)
-		config->http_upload_time = 10*60; // 10 min
-
-	//config->http_status_time = 99999;
-	//config->http_upload_time = 99999;
-	config->measure_time = 10;
-	config->sampling_rate = 5;
-
-	config->num_samples = config->sampling_rate * config->measure_time;
-	config->sampling_delay = 1000 / config->sampling_rate;
+	config_timing();
+	// Rotated logs as contiguous extents, one record of slack past MAX_FILESIZE
+	sd.set_extent(DATALOG, MAX_FILESIZE + LOG_BUFF_SIZE);
+	sd.set_extent(SYSLOG, MAX_FILESIZE + SYS_BUFF_SIZE);
+	sd.set_time_index(DATALOG, SD_TIDX_EVERY);
+	store.begin(&sd);
+	store.set_rotate(DATALOG, MAX_FILESIZE);
+	store.set_rotate(SYSLOG, MAX_FILESIZE);
+	store.set_rotate(SERIALLOG, SERIAL_MAX_FILESIZE);
+#ifdef LOG_FRAMES
+	sd.set_frames(DATALOG, true);
+	sd.set_frames(SYSLOG, true);
+	{
+		long cut, bytes = 0;
+		uint8_t repaired = 0;
+		for(uint8_t i = DATALOG; i <= SYSLOG; i++) {
+			cut = sd.repair(i);
+			if (cut > 0) {
+				repaired++;
+				bytes += cut;
+			}
+		}
+		if (repaired) {
+			sprintf(sys_buff, "%lu: Log repair: %d files, %ld bytes cut\r\n", now(), repaired, bytes);
+			sys_log_message(sys_buff);
+		}
+	}
+#endif
 
 	// HAX
 	if (strlen(config->HTTP_URL) <= 1) {
@@ -323,6 +351,9 @@ void setup() {
 	DEBUG_LOG("File Upload init");
 	// File upload init, depends on: config, sd, http
 	fup.init(config, &sd, &http, tmp_buff, TMP_BUFF_SIZE); 
+#ifdef UPLOAD_PACKED
+	fup.set_pack(true);
+#endif
 
 #ifdef HAS_EXT_SERIAL
 	// External serial launch
@@ -401,13 +432,18 @@ static int protothread_sys(struct pt *pt, int interval) {
 			} 
 			
 			// Get the supply voltage by using the internal bandgap, do a rolling average of it
-			curr_voltage = get_bandgap();
+			curr_voltage = measure.get_bandgap();
 			tmp_voltage = curr_voltage;
 			total_voltage -= total_voltage / 16;	
 			total_voltage += curr_voltage;
 			curr_voltage = total_voltage / 16;
 
 			set_supply_voltage(((tmp_voltage-VOLTAGE_THRESHOLD) > curr_voltage ? tmp_voltage : curr_voltage));
+			if (tmp_voltage > 0 && tmp_voltage < BROWNOUT_VOLTAGE) {
+				// Don't lose queued and buffered lines if the supply goes
+				while (store.run());
+				sd.flush();
+			}
 	
 			t = gsm.CONN_get_flag(0xff);
 
@@ -428,6 +464,9 @@ static int protothread_sys(struct pt *pt, int interval) {
 			strcat(sys_buff, "ms Comm ");
 			fmtUnsigned(threads[THREAD_COMM].timing, smallbuff, 11);
 			strcat(sys_buff, smallbuff);
+			strcat(sys_buff, "ms St ");
+			fmtUnsigned(threads[THREAD_STORE].timing, smallbuff, 11);
+			strcat(sys_buff, smallbuff);
 			strcat(sys_buff, "ms Net: ");
 			fmtUnsigned(t, smallbuff, 11);
 			strcat(sys_buff, smallbuff);
@@ -443,6 +482,16 @@ static int protothread_sys(struct pt *pt, int interval) {
 			strcat(sys_buff, " V: ");
 			fmtUnsigned(get_supply_voltage(), smallbuff, 10);
 			strcat(sys_buff, smallbuff);
+			// Longest waits in the store queue, ms, and requests dropped
+			strcat(sys_buff, " Q: ");
+			fmtUnsigned(store.latency(DATALOG), smallbuff, 10);
+			strcat(sys_buff, smallbuff);
+			strcat(sys_buff, "/");
+			fmtUnsigned(store.latency(SYSLOG), smallbuff, 10);
+			strcat(sys_buff, smallbuff);
+			strcat(sys_buff, "/");
+			fmtUnsigned(store.dropped(), smallbuff, 10);
+			strcat(sys_buff, smallbuff);
 			strcat(sys_buff, "\r\n");
 	
 			if (sys_cnt == 10) {
@@ -471,18 +520,28 @@ static int protothread_sys(struct pt *pt, int interval) {
 	}
 	PT_END(pt);
 }
+
+// Some port has windows that close
+static bool measuring() {
+	for(uint8_t i = 0; i < NUM_IO; i++)
+		if (measure.get_pin(i) != IO_OFF && measure.get_pin(i) != IO_EVENT)
+			return true;
+	return false;
+}
+
 /* Measurement protothread
    Tasks:
-         - Take all the periodic analog measurements + write to SD
+         - Take all the periodic analog measurements + queue them for the SD
+	 - Apply a fetched config delta between windows
 	 - (Event handling?)
 */
 static int protothread_measure(struct pt *pt, uint16_t interval) {
 	static unsigned long timestamp = 0;
 	static int delta_ts = 0;
-	static time_t last_measure;
 	static uint16_t interval_v;
-	static int32_t filesize = 0;
 	static short val = 0;
+	static uint16_t n;
+	uint16_t due;
 
 	PT_BEGIN(pt);
 	interval_v = interval;
@@ -508,27 +567,30 @@ static int protothread_measure(struct pt *pt, uint16_t interval) {
 		Serial.println(interval_v, DEC);		
 */
 
-		measure_cnt = measure.read_all(1);
-		if ((now() - last_measure) > config->measure_time || measure_cnt >= config->num_samples) {
-			last_measure = now();
-			measure.get_all();
-			measure.time_log_line(log_buff);   
-			measure.reset();
-			if (sd.is_available() < 0)
-				sd.init();
-			filesize = sd.open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
-			if (filesize != -1) {
-				if (filesize > MAX_FILESIZE) {
-					sd.close(DATALOG);
-					sd.increment_file(DATALOG);
-					cfg.save_files_count(0);
-					filesize = sd.open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
-					requested_state = gsm_upload_data;
-				}
-				sd.write(DATALOG, log_buff);
-				//sd.close(DATALOG);
+		measure_cnt++;
+		due = measure.read_due();
+		if (due) { // Some port closed its window
+			// The new file starts absolute, so do records after lost ones
+			if (store.lost(DATALOG) || store.rotating(DATALOG))
+				measure.record_sync();
+			if (config->log_format == LOG_BINARY) {
+				n = measure.time_log_record((uint8_t *)log_buff);
+			} else {
+				measure.time_log_line(log_buff);   
+				Serial.print(log_buff);
+				n = strlen(log_buff);
+			}
+			if (!store.put(DATALOG, (uint8_t *)log_buff, n, now())) {
+				measure.record_sync();
+				LOG("Store queue full");
 			}
-			Serial.print(log_buff);
+		}
+		// A fetched config delta goes in right after windows closed, the
+		// ports it changes start theirs over (DLMeasure::restart_window())
+		if (cfg.delta_ready() && (due || !measuring())) {
+			LOG("Config delta");
+			cfg.delta_apply();
+			config_timing();
 		}
 #ifdef SHOW_MEASURE_LOGS
 		LOG("Measured");
@@ -552,6 +614,7 @@ static int protothread_comm(struct pt *pt, int interval) {
 	static int n;
 	char e=0, v;
 	char ret=0;
+	char *end;
 	static SMS_t *sms;	
 	static Snap_t snap;
 	static double up;
@@ -600,6 +663,8 @@ static int protothread_comm(struct pt *pt, int interval) {
 					gsm_curr_state = gsm_sms_sysinfo;
 				} else if (ret == GSM_EVENT_UPTIME) {
 					gsm_curr_state = gsm_sms_uptime;
+				} else if (ret == GSM_EVENT_GET_RANGE) {
+					gsm_curr_state = gsm_sms_get_range;
 				} 
 				sms = gsm.get_SMS();
 			} else if ((now() - last_status) > config->http_status_time) {
@@ -626,6 +691,8 @@ static int protothread_comm(struct pt *pt, int interval) {
                                         gsm_curr_state = gsm_sms_sysinfo;
                                 } else if (ret == GSM_EVENT_UPTIME) {
 					gsm_curr_state = gsm_sms_uptime;
+				} else if (ret == GSM_EVENT_GET_RANGE) {
+					gsm_curr_state = gsm_sms_get_range;
 				}
 				sms = gsm.get_SMS();
 			}
@@ -658,14 +725,22 @@ static int protothread_comm(struct pt *pt, int interval) {
                         strcat_P(tmp_buff, PSTR("&cl="));
                         fmtUnsigned(u, smallbuff, 12);
                         strcat(tmp_buff, smallbuff);
-			filesize = sd.open(DATALOG, O_READ);
-			sd.close(DATALOG);
+			filesize = store.size(DATALOG);
                         strcat_P(tmp_buff, PSTR("&cls="));
 			fmtUnsigned(filesize, smallbuff, 12);
 			strcat(tmp_buff, smallbuff);
 			strcat_P(tmp_buff, PSTR("&v="));
 			fmtUnsigned(get_supply_voltage(), smallbuff, 12);
 			strcat(tmp_buff, smallbuff);
+			strcat_P(tmp_buff, PSTR("&ro="));
+			fmtUnsigned(gsm.GSM_rx_overruns(), smallbuff, 12);
+			strcat(tmp_buff, smallbuff);
+			strcat_P(tmp_buff, PSTR("&rd="));
+			fmtUnsigned(gsm.GSM_rx_dropped(), smallbuff, 12);
+			strcat(tmp_buff, smallbuff);
+			strcat_P(tmp_buff, PSTR("&ul="));
+			fmtUnsigned(gsm.GSM_urc_lost(), smallbuff, 12);
+			strcat(tmp_buff, smallbuff);
 			
 			PT_WAIT_THREAD(pt, http.PT_GET(&comm_child_pt, &ret, tmp_buff));
                         get_from_flash_P(PSTR("R: "), tmp_buff);
@@ -682,6 +757,10 @@ static int protothread_comm(struct pt *pt, int interval) {
 
 			if (ret) {
 				gsm_curr_state = gsm_idle;
+				if (http.get_range(&range_t0, &range_t1))
+					gsm_curr_state = gsm_upload_range;
+				else if (http.get_config_version(&config_version) && config_version != cfg.get_config_version())
+					gsm_curr_state = gsm_fetch_config;
 			}
                         //PT_WAIT_THREAD(pt, gsm.PT_pwr_off(&comm_inside_pt, 0));
 			//gsm_curr_state = gsm_idle;
@@ -715,6 +794,42 @@ static int protothread_comm(struct pt *pt, int interval) {
 			last_upload = now();
                         //PT_WAIT_THREAD(pt, gsm.PT_pwr_off(&comm_inside_pt, 0));
 			gsm_curr_state = gsm_idle;
+		} else if (gsm_curr_state == gsm_sms_get_range) {
+			// GR <from> <to>, unix times
+			range_t0 = strtoul(sms->message+3, &end, 10);
+			range_t1 = strtoul(end, &end, 10);
+			if (range_t1 >= range_t0) {
+				gsm_curr_state = gsm_upload_range;
+			} else {
+				LOG("Bad GR window");
+				gsm_curr_state = gsm_idle;
+			}
+		} else if (gsm_curr_state == gsm_upload_range) {
+			LOG("HTTP range upload");
+			PT_WAIT_THREAD(pt, fup.PT_upload_range(&comm_inside_pt, &ret, DATALOG_READONLY, sd.get_files_count(DATALOG), range_t0, range_t1));
+			if (ret == 1) {
+				LOG("Range upload successful");
+			} else if (ret == 2) {
+				LOG("No time index");
+			} else {
+				sprintf(tmp_buff, "Range upload failed: %d", ret);
+				LOG(tmp_buff);
+			}
+			gsm_curr_state = gsm_idle;
+		} else if (gsm_curr_state == gsm_fetch_config) {
+			LOG("HTTP config");
+			strcpy(tmp_buff, config->HTTP_URL);
+			strcat_P(tmp_buff, PSTR("config.php?id="));
+			fmtUnsigned(config->id, smallbuff, 10);
+			strcat(tmp_buff, smallbuff);
+			strcat_P(tmp_buff, PSTR("&cv="));
+			fmtUnsigned(cfg.get_config_version(), smallbuff, 10);
+			strcat(tmp_buff, smallbuff);
+			cfg.delta_begin(config_version);
+			PT_WAIT_THREAD(pt, http.PT_GET(&comm_child_pt, &ret, tmp_buff));
+			if (!cfg.delta_ready())
+				LOG("Config delta failed");
+			gsm_curr_state = gsm_idle;
 		} else if (gsm_curr_state == gsm_sms_sysinfo) {	
 			strcpy(tmp_buff, sys_buff);
                         PT_WAIT_THREAD(pt, gsm.PT_SMS_send(&comm_inside_pt, &ret, sms->number, tmp_buff, strlen(tmp_buff)));
@@ -805,7 +920,6 @@ static int protothread_comm(struct pt *pt, int interval) {
 static int protothread_serial(struct pt *pt, int interval) {
 	static struct pt child_pt;
 	static long timestamp;
-	int32_t filesize;
 	char c;
 	PT_BEGIN(pt);
 	while (1) {
@@ -818,20 +932,11 @@ static int protothread_serial(struct pt *pt, int interval) {
 			ext_buff_pos++;
 		}
 		if (ext_buff_pos == (EXT_BUFF_SIZE-1)) { // Write to SD
-                        if (sd.is_available() < 0)
-                                sd.init();
-                        filesize = sd.open(SERIALLOG, O_RDWR | O_CREAT | O_APPEND);
-                 	if (filesize != -1) {
-				if (filesize > SERIAL_MAX_FILESIZE) {
-                        	        sd.close(SERIALLOG);
-                        	        sd.increment_file(SERIALLOG);
-                        	        //cfg.save_files_count(0);
-                        	        filesize = sd.open(SERIALLOG, O_RDWR | O_CREAT | O_APPEND);
-                       		}
-                        	sd.write(SERIALLOG, ext_buff);
-	                        //sd.close(SERIALLOG);
-				LOG("Wrote external serial data");	
-			}
+			if (store.put(SERIALLOG, (uint8_t *)ext_buff, ext_buff_pos, now()))
+				LOG("Queued external serial data");
+			else
+				LOG("Store queue full, serial data dropped");
+			ext_buff_pos = 0;
 		}
 	}
 	PT_END(pt);
@@ -840,43 +945,67 @@ static int protothread_serial(struct pt *pt, int interval) {
 
 static int protothread_event(struct pt *pt, int interval) {
 	static struct pt child_pt;
-	static long timestamp, lastevent;
-	static long filesize;
-	static bool write_error = false;
+	static long timestamp;
+	static uint16_t n, len;
+	static uint32_t overflows = 0;
 	PT_BEGIN(pt);
 	while (1) {
 		PT_WAIT_UNTIL(pt, measure.check_event() == 1 || (millis() - timestamp) > 1000);
 		timestamp = millis();
-		if ((millis() - lastevent) < 500) {
-			measure.reset_event();
-		}
-		else if (measure.check_event()) {
-			lastevent = millis();
-			measure.event_log_line(log_buff);
-			measure.reset_event();
-		        if (sd.is_available() < 0)
-       		         	sd.init();
-			filesize = sd.open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
-			if (filesize != -1) {
-				if (filesize > MAX_FILESIZE) {
-					sd.close(DATALOG);
-					sd.increment_file(DATALOG);
-					cfg.save_files_count(0);
-					filesize = sd.open(DATALOG, O_RDWR | O_CREAT | O_APPEND);
-				}
-				if (filesize != -1) {
-					write_error = sd.write(DATALOG, log_buff);
-					if (write_error) {
-						LOG("Failed to write event");
-					}
-				}
+		if (measure.check_event()) {
+			if (store.lost(DATALOG) || store.rotating(DATALOG))
+				measure.record_sync();
+			// Drain the queued edges into one write
+			n = 0;
+			log_buff[0] = '\0';
+			if (config->log_format == LOG_BINARY) {
+				while (n + EVENT_LINE_MAX <= LOG_BUFF_SIZE && (len = measure.event_log_record((uint8_t *)log_buff + n)) > 0)
+					n += len;
+			} else {
+				while (n + EVENT_LINE_MAX <= LOG_BUFF_SIZE && measure.event_log_line(log_buff + n))
+					n += strlen(log_buff + n);
+			}
+			if (n > 0 && !store.put(DATALOG, (uint8_t *)log_buff, n, now())) {
+				measure.record_sync();
+				LOG("Store queue full");
+			}
+			if (config->log_format != LOG_BINARY)
+				_cons_serial.print(log_buff);
+			if (measure.event_overflows() != overflows) {
+				overflows = measure.event_overflows();
+				LOG("Event queue overflow");
 			}
-			_cons_serial.print(log_buff);
 		}
 	}
 	PT_END(pt);
 }
 
+/* Storage protothread
+   Tasks:
+	 - Writes the queued log requests, one batch per pass
+	 - Saves the files counts once for the rotations of a pass
+*/
+static int protothread_store(struct pt *pt, int interval) {
+	static uint8_t rotated;
+	PT_BEGIN(pt);
+	while (1) {
+		PT_WAIT_UNTIL(pt, store.pending());
+		store.run();
+		if (store.failures() == 10) { // Wow the SD card kinda sucks
+			sd.error();
+			reboot();
+		}
+		rotated = store.rotated();
+		if (rotated) {
+			cfg.save_files_count(0);
+			if (rotated & (1 << DATALOG))
+				requested_state = gsm_upload_data;
+		}
+		PT_YIELD(pt);
+	}
+	PT_END(pt);
+}
+
 static int protothread_wdt(struct pt *pt, int interval) {
 	static struct pt child_pt;
 	static long timestamp;
@@ -919,6 +1048,10 @@ void loop() {
 	ts = millis();
 	protothread_wdt(&threads[THREAD_WDT].pt, 600);
 	SET_IF_MAX(threads[THREAD_WDT].timing, millis()-ts);
+	ts = millis();
+	protothread_store(&threads[THREAD_STORE].pt, 0);
+	SET_IF_MAX(threads[THREAD_STORE].timing, millis()-ts);
+	sd.poll();
 	main_iter_cnt++;
 
 //	set_sleep_mode(SLEEP_MODE_IDLE);